@@ -0,0 +1,30 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stdint.h>
+
+typedef enum { DAC_CHANNEL_1 = 1, DAC_CHANNEL_2 } dac_channel_t;
+
+typedef enum {
+    DAC_CW_SCALE_1,
+    DAC_CW_SCALE_2,
+    DAC_CW_SCALE_4,
+    DAC_CW_SCALE_8
+} dac_cw_scale_t;
+
+typedef enum { DAC_CW_PHASE_0 = 2, DAC_CW_PHASE_180 = 3 } dac_cw_phase_t;
+
+typedef struct {
+    dac_channel_t en_ch;
+    dac_cw_scale_t scale;
+    dac_cw_phase_t phase;
+    uint32_t freq;
+    int8_t offset;
+} dac_cw_config_t;
+
+// Records what the output does, see mockdac.h
+esp_err_t dac_output_enable(dac_channel_t channel);
+esp_err_t dac_output_disable(dac_channel_t channel);
+esp_err_t dac_cw_generator_enable(void);
+esp_err_t dac_cw_generator_disable(void);
+esp_err_t dac_cw_generator_config(dac_cw_config_t* cw);
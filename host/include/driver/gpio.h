@@ -0,0 +1,34 @@
+#pragma once
+
+#include <esp_err.h>
+
+typedef enum {
+    GPIO_NUM_12 = 12,
+    GPIO_NUM_15 = 15,
+    GPIO_NUM_25 = 25
+} gpio_num_t;
+
+typedef enum { GPIO_MODE_INPUT = 1 } gpio_mode_t;
+
+typedef enum {
+    GPIO_INTR_DISABLE,
+    GPIO_INTR_POSEDGE,
+    GPIO_INTR_NEGEDGE,
+    GPIO_INTR_ANYEDGE,
+    GPIO_INTR_LOW_LEVEL,
+    GPIO_INTR_HIGH_LEVEL
+} gpio_int_type_t;
+
+typedef void (*gpio_isr_t)(void* arg);
+
+// Only the ring button is wired up: it follows the presses given to
+// setMockButtonPresses(), see mockdevice.h
+int gpio_get_level(gpio_num_t gpio_num);
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode);
+esp_err_t gpio_install_isr_service(int intr_alloc_flags);
+esp_err_t
+gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void* args);
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num);
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num);
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type);
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio_num);
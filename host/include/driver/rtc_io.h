@@ -0,0 +1,11 @@
+#pragma once
+
+#include <driver/dac.h>
+#include <driver/gpio.h>
+
+typedef enum { RTC_GPIO_MODE_INPUT_ONLY } rtc_gpio_mode_t;
+
+esp_err_t rtc_gpio_init(gpio_num_t gpio_num);
+esp_err_t rtc_gpio_deinit(gpio_num_t gpio_num);
+esp_err_t rtc_gpio_set_direction(gpio_num_t gpio_num, rtc_gpio_mode_t mode);
+esp_err_t rtc_gpio_isolate(gpio_num_t gpio_num);
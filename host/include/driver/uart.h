@@ -0,0 +1,7 @@
+#pragma once
+
+#include <esp_err.h>
+
+typedef int uart_port_t;
+
+esp_err_t uart_wait_tx_idle_polling(uart_port_t uart_num);
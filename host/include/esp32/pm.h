@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdbool.h>
+
+typedef struct {
+    int max_freq_mhz;
+    int min_freq_mhz;
+    bool light_sleep_enable;
+} esp_pm_config_esp32_t;
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Word offsets of the ULP variables count from here
+extern uint32_t mockRtcSlowMem[];
+#define RTC_SLOW_MEM mockRtcSlowMem
+
+// The program is modeled by standbymodel.c, see mockdevice.h
+esp_err_t ulp_load_binary(
+    uint32_t load_addr, const uint8_t* program_binary, size_t program_size);
+esp_err_t ulp_set_wakeup_period(size_t period_index, uint32_t period_us);
+esp_err_t ulp_run(uint32_t entry_point);
@@ -0,0 +1,8 @@
+#pragma once
+
+// Each test is a single process, so memory that survives deep sleep is
+// ordinary memory. It is kept in one section so that resetRtcMemory() can
+// wipe it like a cold boot does.
+#define RTC_DATA_ATTR __attribute__((section("rtc_data")))
+#define RTC_NOINIT_ATTR
+#define IRAM_ATTR
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+#define heap_caps_calloc(count, size, caps) calloc(count, size)
+#define heap_caps_free(pointer) free(pointer)
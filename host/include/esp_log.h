@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#define LOG_FORMAT(letter, format) #letter " (%u) %s: " format "\n"
+
+void esp_log_write(
+    esp_log_level_t level, const char* tag, const char* format, ...)
+    __attribute__((format(printf, 3, 4)));
+// In ms of virtual time since the last boot
+uint32_t esp_log_timestamp(void);
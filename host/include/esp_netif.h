@@ -0,0 +1,63 @@
+#pragma once
+
+#include <esp_err.h>
+#include <esp_event.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ESP_ERR_ESP_NETIF_BASE 0x5000
+#define ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED (ESP_ERR_ESP_NETIF_BASE + 0x04)
+#define ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED (ESP_ERR_ESP_NETIF_BASE + 0x05)
+#define ESP_ERR_ESP_NETIF_DHCP_NOT_STOPPED (ESP_ERR_ESP_NETIF_BASE + 0x06)
+
+typedef struct esp_netif_obj esp_netif_t;
+
+// In network byte order
+typedef struct {
+    uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+typedef struct {
+    union {
+        esp_ip4_addr_t ip4;
+    } u_addr;
+    uint8_t type;
+} esp_ip_addr_t;
+
+typedef struct {
+    esp_ip_addr_t ip;
+} esp_netif_dns_info_t;
+
+typedef enum { ESP_NETIF_DNS_MAIN, ESP_NETIF_DNS_BACKUP } esp_netif_dns_type_t;
+
+typedef enum { IP_EVENT_STA_GOT_IP, IP_EVENT_STA_LOST_IP } ip_event_t;
+
+typedef struct {
+    esp_netif_t* esp_netif;
+    esp_netif_ip_info_t ip_info;
+    bool ip_changed;
+} ip_event_got_ip_t;
+
+extern esp_event_base_t const IP_EVENT;
+
+// The station of the mock WiFi driver, see mockwifi.h
+esp_err_t esp_netif_init(void);
+esp_netif_t* esp_netif_create_default_wifi_sta(void);
+esp_err_t esp_netif_dhcpc_start(esp_netif_t* esp_netif);
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t* esp_netif);
+esp_err_t esp_netif_set_ip_info(
+    esp_netif_t* esp_netif, const esp_netif_ip_info_t* ip_info);
+esp_err_t esp_netif_get_ip_info(
+    esp_netif_t* esp_netif, esp_netif_ip_info_t* ip_info);
+esp_err_t esp_netif_set_dns_info(
+    esp_netif_t* esp_netif, esp_netif_dns_type_t type,
+    esp_netif_dns_info_t* dns);
+esp_err_t esp_netif_get_dns_info(
+    esp_netif_t* esp_netif, esp_netif_dns_type_t type,
+    esp_netif_dns_info_t* dns);
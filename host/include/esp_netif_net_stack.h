@@ -0,0 +1,6 @@
+#pragma once
+
+#include <esp_netif.h>
+
+// The struct netif of lwIP, see lwip/netif.h
+void* esp_netif_get_netif_impl(esp_netif_t* esp_netif);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <esp_err.h>
+
+typedef enum {
+    ESP_PM_CPU_FREQ_MAX,
+    ESP_PM_APB_FREQ_MAX,
+    ESP_PM_NO_LIGHT_SLEEP
+} esp_pm_lock_type_t;
+
+typedef struct VirtualPmLock* esp_pm_lock_handle_t;
+
+// Counts acquisitions, see mockdac.h
+esp_err_t esp_pm_lock_create(
+    esp_pm_lock_type_t lock_type, int arg, const char* name,
+    esp_pm_lock_handle_t* out_handle);
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle);
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle);
+// Takes the config of esp32/pm.h, see mockdevice.h
+esp_err_t esp_pm_configure(const void* config);
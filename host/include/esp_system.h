@@ -0,0 +1,15 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum { ESP_MAC_WIFI_STA } esp_mac_type_t;
+
+// Aborts, as nothing on the host can restart
+void esp_restart(void);
+// Repeats the same sequence in every run
+uint32_t esp_random(void);
+void esp_fill_random(void* buf, size_t len);
+// The same address in every run
+esp_err_t esp_read_mac(uint8_t* mac, esp_mac_type_t type);
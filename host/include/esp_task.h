@@ -0,0 +1,6 @@
+#pragma once
+
+#define ESP_TASK_MAIN_PRIO 1
+#define ESP_TASK_MAIN_STACK 8192
+#define ESP_TASK_EVENT_PRIO 20
+#define ESP_TASK_TIMER_PRIO 22
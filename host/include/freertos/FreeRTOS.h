@@ -0,0 +1,30 @@
+#pragma once
+
+// Like FreeRTOSConfig.h and portmacro.h of ESP-IDF, which sources rely on
+// for assert(), malloc(), bool and the sdkconfig
+#include <assert.h>
+#include <sdkconfig.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define portMAX_DELAY ((TickType_t)0xffffffff)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portNUM_PROCESSORS 2
+#define configMAX_PRIORITIES 25
+#define configMAX_TASK_NAME_LEN 16
+
+// Tests run one task at a time, so critical sections have nothing to guard
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
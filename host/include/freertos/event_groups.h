@@ -0,0 +1,22 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+
+#define BIT0 0x00000001
+#define BIT1 0x00000002
+#define BIT2 0x00000004
+#define BIT3 0x00000008
+
+typedef uint32_t EventBits_t;
+// Like semaphores, waiting lets other tasks run and virtual time pass, see
+// virtualtasks.h
+typedef struct VirtualEventGroup* EventGroupHandle_t;
+
+EventGroupHandle_t xEventGroupCreate(void);
+void vEventGroupDelete(EventGroupHandle_t group);
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits);
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group);
+EventBits_t xEventGroupWaitBits(
+    EventGroupHandle_t group, EventBits_t bits, BaseType_t clearOnExit,
+    BaseType_t waitForAll, TickType_t ticks);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+
+// Waiting lets other tasks run and virtual time pass, see virtualtasks.h
+typedef struct VirtualQueue* QueueHandle_t;
+
+typedef struct {
+    QueueHandle_t handle;
+} StaticQueue_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+QueueHandle_t xQueueCreateStatic(
+    UBaseType_t length, UBaseType_t itemSize, uint8_t* storage,
+    StaticQueue_t* queueBuffer);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks);
+BaseType_t xQueueReset(QueueHandle_t queue);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
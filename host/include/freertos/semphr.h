@@ -0,0 +1,18 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+
+// Waiting lets other tasks run and virtual time pass, see virtualtasks.h
+typedef struct VirtualSemaphore* SemaphoreHandle_t;
+
+// Holds the semaphore itself, as jobs create one each time
+typedef struct {
+    uint64_t storage[2];
+} StaticSemaphore_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t* buffer);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+
+// Each task is a thread, of which only one runs at a time, see
+// virtualtasks.h
+typedef struct VirtualTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* parameter);
+
+// Only holds the handle, as tasks are allocated by the scheduler
+typedef struct {
+    TaskHandle_t handle;
+} StaticTask_t;
+
+// Stack sizes are in bytes, as in ESP-IDF
+BaseType_t xTaskCreate(
+    TaskFunction_t function, const char* name, uint32_t stackDepth,
+    void* parameter, UBaseType_t priority, TaskHandle_t* createdTask);
+BaseType_t xTaskCreatePinnedToCore(
+    TaskFunction_t function, const char* name, uint32_t stackDepth,
+    void* parameter, UBaseType_t priority, TaskHandle_t* createdTask,
+    BaseType_t core);
+TaskHandle_t xTaskCreateStaticPinnedToCore(
+    TaskFunction_t function, const char* name, uint32_t stackDepth,
+    void* parameter, UBaseType_t priority, StackType_t* stack,
+    StaticTask_t* taskBuffer, BaseType_t core);
+// Only for the calling task, with NULL
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+char* pcTaskGetTaskName(TaskHandle_t task);
+// In bytes. Stacks aren't watched on the host, so this is the stack size
+// the task was created with.
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <lwip/netif.h>
+#include <stdint.h>
+
+// The times of the last lease, in seconds
+struct dhcp {
+    uint32_t offered_t0_lease;
+    uint32_t offered_t1_renew;
+    uint32_t offered_t2_rebind;
+};
+
+#define netif_dhcp_data(netif) ((netif)->dhcp)
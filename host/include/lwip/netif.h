@@ -0,0 +1,8 @@
+#pragma once
+
+// Only what the sources read from lwIP, which mockwifi.c fills in
+struct dhcp;
+
+struct netif {
+    struct dhcp* dhcp;
+};
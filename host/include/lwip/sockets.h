@@ -0,0 +1,10 @@
+#pragma once
+
+// lwIP follows the BSD socket API, which the host has, and brings errno
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
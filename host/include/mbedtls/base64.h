@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stddef.h>
+
+#define MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL -0x002A
+
+// Like mbedTLS: the output is terminated, and on a buffer that's too small
+// olen is set to the size needed including the terminator
+int mbedtls_base64_encode(
+    unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src,
+    size_t slen);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Over the sockets of the host, see mock/ssl.c
+
+#define MBEDTLS_ERR_NET_RECV_FAILED -0x004C
+#define MBEDTLS_ERR_NET_SEND_FAILED -0x004E
+#define MBEDTLS_ERR_NET_CONN_RESET -0x0050
+
+typedef struct {
+    int fd;
+} mbedtls_net_context;
+
+void mbedtls_net_init(mbedtls_net_context* ctx);
+int mbedtls_net_send(
+    mbedtls_net_context* ctx, const unsigned char* buf, size_t len);
+// Blocks until data arrives if timeout is 0
+int mbedtls_net_recv_timeout(
+    mbedtls_net_context* ctx, unsigned char* buf, size_t len,
+    uint32_t timeout);
+void mbedtls_net_free(mbedtls_net_context* ctx);
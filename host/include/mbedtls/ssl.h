@@ -0,0 +1,111 @@
+#pragma once
+
+#include <mbedtls/ssl_ciphersuites.h>
+#include <mbedtls/x509_crt.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The part of the mbedTLS 2 API that tls.c uses. mock/ssl.c implements it
+// over OpenSSL for tests of tls.c itself, other tests only need the types.
+// The maximum fragment length extension is left out, as OpenSSL only
+// resumes a session with it if the session carries it.
+
+#define MBEDTLS_SSL_SESSION_TICKETS
+
+#define MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE -0x7080
+#define MBEDTLS_ERR_SSL_BAD_INPUT_DATA -0x7100
+#define MBEDTLS_ERR_SSL_CONN_EOF -0x7280
+#define MBEDTLS_ERR_SSL_FATAL_ALERT_MESSAGE -0x7780
+#define MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY -0x7880
+#define MBEDTLS_ERR_SSL_ALLOC_FAILED -0x7F00
+#define MBEDTLS_ERR_SSL_WANT_READ -0x6900
+#define MBEDTLS_ERR_SSL_WANT_WRITE -0x6880
+#define MBEDTLS_ERR_SSL_TIMEOUT -0x6800
+
+#define MBEDTLS_SSL_IS_CLIENT 0
+#define MBEDTLS_SSL_TRANSPORT_STREAM 0
+#define MBEDTLS_SSL_PRESET_DEFAULT 0
+#define MBEDTLS_SSL_VERIFY_NONE 0
+#define MBEDTLS_SSL_VERIFY_OPTIONAL 1
+#define MBEDTLS_SSL_VERIFY_REQUIRED 2
+#define MBEDTLS_SSL_SESSION_TICKETS_DISABLED 0
+#define MBEDTLS_SSL_SESSION_TICKETS_ENABLED 1
+
+typedef int mbedtls_ssl_send_t(void* ctx, const unsigned char* buf, size_t len);
+typedef int mbedtls_ssl_recv_t(void* ctx, unsigned char* buf, size_t len);
+typedef int mbedtls_ssl_recv_timeout_t(
+    void* ctx, unsigned char* buf, size_t len, uint32_t timeout);
+
+// Plain data but for the pointers, as in mbedTLS, so that it can be copied
+typedef struct {
+    int ciphersuite;
+    size_t id_len;
+    unsigned char id[32];
+    unsigned char master[48];
+    mbedtls_x509_crt* peer_cert;
+    unsigned char* ticket;
+    size_t ticket_len;
+    uint32_t ticket_lifetime;
+} mbedtls_ssl_session;
+
+typedef struct {
+    int endpoint;
+    int authmode;
+    mbedtls_x509_crt* ca_chain;
+    int session_tickets;
+    // Of OpenSSL if null
+    const int* ciphersuite_list;
+    unsigned char* psk;
+    size_t psk_len;
+    unsigned char* psk_identity;
+    size_t psk_identity_len;
+} mbedtls_ssl_config;
+
+typedef struct {
+    const mbedtls_ssl_config* conf;
+    // Of the handshake once it's done
+    mbedtls_ssl_session* session;
+    mbedtls_ssl_send_t* f_send;
+    mbedtls_ssl_recv_t* f_recv;
+    void* p_bio;
+    char* hostname;
+    // Of f_send or f_recv, which OpenSSL only sees as a failure
+    int bio_error;
+    struct ssl_st* openssl;
+} mbedtls_ssl_context;
+
+void mbedtls_ssl_config_init(mbedtls_ssl_config* conf);
+int mbedtls_ssl_config_defaults(
+    mbedtls_ssl_config* conf, int endpoint, int transport, int preset);
+void mbedtls_ssl_config_free(mbedtls_ssl_config* conf);
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config* conf, int authmode);
+void mbedtls_ssl_conf_ca_chain(
+    mbedtls_ssl_config* conf, mbedtls_x509_crt* ca_chain, void* ca_crl);
+// OpenSSL brings its own random numbers
+void mbedtls_ssl_conf_rng(
+    mbedtls_ssl_config* conf,
+    int (*f_rng)(void* context, unsigned char* output, size_t length),
+    void* p_rng);
+void mbedtls_ssl_conf_session_tickets(
+    mbedtls_ssl_config* conf, int use_tickets);
+// Kept by reference, as in mbedTLS
+void mbedtls_ssl_conf_ciphersuites(
+    mbedtls_ssl_config* conf, const int* ciphersuites);
+int mbedtls_ssl_conf_psk(
+    mbedtls_ssl_config* conf, const unsigned char* psk, size_t psk_len,
+    const unsigned char* psk_identity, size_t psk_identity_len);
+
+void mbedtls_ssl_init(mbedtls_ssl_context* ssl);
+int mbedtls_ssl_setup(mbedtls_ssl_context* ssl, const mbedtls_ssl_config* conf);
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context* ssl, const char* hostname);
+void mbedtls_ssl_set_bio(
+    mbedtls_ssl_context* ssl, void* p_bio, mbedtls_ssl_send_t* f_send,
+    mbedtls_ssl_recv_t* f_recv, mbedtls_ssl_recv_timeout_t* f_recv_timeout);
+int mbedtls_ssl_set_session(
+    mbedtls_ssl_context* ssl, const mbedtls_ssl_session* session);
+int mbedtls_ssl_handshake(mbedtls_ssl_context* ssl);
+int mbedtls_ssl_read(mbedtls_ssl_context* ssl, unsigned char* buf, size_t len);
+int mbedtls_ssl_write(
+    mbedtls_ssl_context* ssl, const unsigned char* buf, size_t len);
+int mbedtls_ssl_close_notify(mbedtls_ssl_context* ssl);
+void mbedtls_ssl_free(mbedtls_ssl_context* ssl);
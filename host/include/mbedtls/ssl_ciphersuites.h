@@ -0,0 +1,29 @@
+#pragma once
+
+// The cipher suites of OpenSSL that TLS 1.2 has, see mock/ssl.c
+
+typedef enum {
+    MBEDTLS_KEY_EXCHANGE_NONE = 0,
+    MBEDTLS_KEY_EXCHANGE_RSA,
+    MBEDTLS_KEY_EXCHANGE_DHE_RSA,
+    MBEDTLS_KEY_EXCHANGE_ECDHE_RSA,
+    MBEDTLS_KEY_EXCHANGE_ECDHE_ECDSA,
+    MBEDTLS_KEY_EXCHANGE_PSK,
+    MBEDTLS_KEY_EXCHANGE_DHE_PSK,
+    MBEDTLS_KEY_EXCHANGE_RSA_PSK,
+    MBEDTLS_KEY_EXCHANGE_ECDHE_PSK,
+    MBEDTLS_KEY_EXCHANGE_ECDH_RSA,
+    MBEDTLS_KEY_EXCHANGE_ECDH_ECDSA,
+    MBEDTLS_KEY_EXCHANGE_ECJPAKE,
+} mbedtls_key_exchange_type_t;
+
+// Only the fields that tls.c reads
+typedef struct {
+    int id;
+    const char* name;
+    mbedtls_key_exchange_type_t key_exchange;
+} mbedtls_ssl_ciphersuite_t;
+
+// Terminated by 0
+const int* mbedtls_ssl_list_ciphersuites(void);
+const mbedtls_ssl_ciphersuite_t* mbedtls_ssl_ciphersuite_from_id(int id);
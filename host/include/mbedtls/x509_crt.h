@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stddef.h>
+
+// A single certificate of OpenSSL rather than a chain, see mock/ssl.c
+
+#define MBEDTLS_ERR_X509_INVALID_FORMAT -0x2180
+#define MBEDTLS_ERR_X509_CERT_VERIFY_FAILED -0x2700
+
+typedef struct {
+    struct x509_st* openssl;
+} mbedtls_x509_crt;
+
+void mbedtls_x509_crt_init(mbedtls_x509_crt* crt);
+int mbedtls_x509_crt_parse_der(
+    mbedtls_x509_crt* chain, const unsigned char* buf, size_t buflen);
+void mbedtls_x509_crt_free(mbedtls_x509_crt* crt);
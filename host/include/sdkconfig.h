@@ -0,0 +1,6 @@
+#pragma once
+
+// The options of the sdkconfig that main/ refers to
+#define CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ 240
+#define CONFIG_ESP_CONSOLE_UART_NUM 0
+#define CONFIG_DOORBELL_TLS_PSK 1
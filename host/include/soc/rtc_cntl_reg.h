@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+// Only the register that keeps the ULP timer running, see mockdevice.h
+extern volatile uint32_t mockRtcCntlState0Reg;
+#define RTC_CNTL_STATE0_REG (&mockRtcCntlState0Reg)
+#define RTC_CNTL_ULP_CP_SLP_TIMER_EN (1u << 24)
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
+#define SET_PERI_REG_MASK(reg, mask) (*(reg) |= (mask))
+#define CLEAR_PERI_REG_MASK(reg, mask) (*(reg) &= ~(mask))
+#define REG_GET_BIT(reg, bit) (*(reg) & (bit))
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+// Generated from the globals of ulp/standby.S on the device, and set by the
+// model of the program in mockdevice.c
+extern uint32_t ulp_entry;
+extern uint32_t ulp_debounce_samples;
+extern uint32_t ulp_battery_interval;
+extern uint32_t ulp_button_armed;
+extern uint32_t ulp_button_count;
+extern uint32_t ulp_battery_ticks;
+extern uint32_t ulp_battery_reading;
+extern uint32_t ulp_battery_sample_count;
+extern uint32_t ulp_wake_reason;
@@ -0,0 +1,33 @@
+#include <mbedtls/base64.h>
+
+static const char ALPHABET[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+int mbedtls_base64_encode(
+    unsigned char* dst, size_t dlen, size_t* olen, const unsigned char* src,
+    size_t slen) {
+    const size_t length = (slen + 2) / 3 * 4;
+
+    if (dlen < length + 1) {
+        *olen = length + 1;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+
+    unsigned char* output = dst;
+    for (size_t i = 0; i < slen; i += 3) {
+        const size_t remaining = slen - i;
+        const unsigned long group =
+            (unsigned long)src[i] << 16 |
+            (remaining > 1 ? (unsigned long)src[i + 1] << 8 : 0) |
+            (remaining > 2 ? src[i + 2] : 0);
+
+        *output++ = ALPHABET[(group >> 18) & 0x3f];
+        *output++ = ALPHABET[(group >> 12) & 0x3f];
+        *output++ = remaining > 1 ? ALPHABET[(group >> 6) & 0x3f] : '=';
+        *output++ = remaining > 2 ? ALPHABET[group & 0x3f] : '=';
+    }
+
+    *output = 0;
+    *olen = length;
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include <mbedtls/md.h>
+#include <mbedtls/sha256.h>
+#include <string.h>
+
+// RFC 2104
+#define HMAC_BLOCK_SIZE 64
+#define HMAC_HASH_SIZE 32
+#define MBEDTLS_ERR_MD_BAD_INPUT_DATA -0x5100
+
+struct mbedtls_md_info_t {
+    mbedtls_md_type_t type;
+};
+
+static const mbedtls_md_info_t SHA256_INFO = {.type = MBEDTLS_MD_SHA256};
+
+const mbedtls_md_info_t* mbedtls_md_info_from_type(mbedtls_md_type_t md_type) {
+    return md_type == MBEDTLS_MD_SHA256 ? &SHA256_INFO : NULL;
+}
+
+static void hash(
+    const unsigned char* pad,
+    const unsigned char* input,
+    size_t length,
+    unsigned char* output) {
+    mbedtls_sha256_context context;
+    mbedtls_sha256_init(&context);
+    mbedtls_sha256_starts_ret(&context, 0);
+    mbedtls_sha256_update_ret(&context, pad, HMAC_BLOCK_SIZE);
+    mbedtls_sha256_update_ret(&context, input, length);
+    mbedtls_sha256_finish_ret(&context, output);
+    mbedtls_sha256_free(&context);
+}
+
+int mbedtls_md_hmac(
+    const mbedtls_md_info_t* md_info,
+    const unsigned char* key,
+    size_t keylen,
+    const unsigned char* input,
+    size_t ilen,
+    unsigned char* output) {
+    if (md_info != &SHA256_INFO) {
+        return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    }
+
+    unsigned char blockKey[HMAC_BLOCK_SIZE] = {0};
+    unsigned char innerPad[HMAC_BLOCK_SIZE];
+    unsigned char outerPad[HMAC_BLOCK_SIZE];
+    unsigned char innerHash[HMAC_HASH_SIZE];
+
+    // Longer keys are hashed first
+    if (keylen > HMAC_BLOCK_SIZE) {
+        mbedtls_sha256_context context;
+        mbedtls_sha256_init(&context);
+        mbedtls_sha256_starts_ret(&context, 0);
+        mbedtls_sha256_update_ret(&context, key, keylen);
+        mbedtls_sha256_finish_ret(&context, blockKey);
+        mbedtls_sha256_free(&context);
+    } else {
+        memcpy(blockKey, key, keylen);
+    }
+
+    for (size_t i = 0; i < HMAC_BLOCK_SIZE; ++i) {
+        innerPad[i] = blockKey[i] ^ 0x36;
+        outerPad[i] = blockKey[i] ^ 0x5c;
+    }
+
+    hash(innerPad, input, ilen, innerHash);
+    hash(outerPad, innerHash, sizeof(innerHash), output);
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include "mockadc.h"
+
+#include <driver/adc.h>
+#include <esp_adc_cal.h>
+
+// Full scale at 6 dB attenuation
+#define ADC_FULL_SCALE_IN_MV 2200
+#define ADC_MAX_READING 4095
+
+static const uint16_t* adcTrace = NULL;
+static size_t adcTraceLength = 0;
+static size_t adcReadCount = 0;
+
+void setAdcTrace(const uint16_t* readings, size_t count) {
+    adcTrace = readings;
+    adcTraceLength = count;
+    adcReadCount = 0;
+}
+
+size_t getAdcReadCount(void) { return adcReadCount; }
+
+esp_err_t adc1_config_width(adc_bits_width_t width_bit) { return ESP_OK; }
+
+esp_err_t adc1_config_channel_atten(adc1_channel_t channel, adc_atten_t atten) {
+    return ESP_OK;
+}
+
+int adc1_get_raw(adc1_channel_t channel) {
+    if (adcTraceLength == 0) {
+        return 0;
+    }
+
+    const size_t index =
+        adcReadCount < adcTraceLength ? adcReadCount : adcTraceLength - 1;
+    ++adcReadCount;
+    return adcTrace[index];
+}
+
+void adc_power_acquire(void) {}
+
+void adc_power_release(void) {}
+
+esp_err_t adc1_ulp_enable(void) { return ESP_OK; }
+
+esp_adc_cal_value_t esp_adc_cal_characterize(
+    adc_unit_t adc_num,
+    adc_atten_t atten,
+    adc_bits_width_t bit_width,
+    uint32_t default_vref,
+    esp_adc_cal_characteristics_t* chars) {
+    chars->adc_num = adc_num;
+    chars->atten = atten;
+    chars->bit_width = bit_width;
+    chars->vref = default_vref;
+    return ESP_ADC_CAL_VAL_DEFAULT_VREF;
+}
+
+// Ideal and linear, unlike a real ADC with its eFuse calibration
+uint32_t esp_adc_cal_raw_to_voltage(
+    uint32_t adc_reading, const esp_adc_cal_characteristics_t* chars) {
+    return (adc_reading * ADC_FULL_SCALE_IN_MV + ADC_MAX_READING / 2) /
+           ADC_MAX_READING;
+}
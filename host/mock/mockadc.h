@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Raw readings that adc1_get_raw() returns in turn. The last one repeats
+// once they run out. The caller keeps them valid.
+void setAdcTrace(const uint16_t* readings, size_t count);
+// Readings taken since the trace was set
+size_t getAdcReadCount(void);
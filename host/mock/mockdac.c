@@ -0,0 +1,113 @@
+#include "mockdac.h"
+#include "clock.h"
+
+#include <driver/dac.h>
+#include <esp_pm.h>
+#include <stdio.h>
+
+struct VirtualPmLock {
+    int count;
+};
+
+static bool generatorEnabled = false;
+static bool outputEnabled = false;
+static dac_cw_config_t generatorConfig;
+static DacChange changes[MOCK_DAC_MAX_CHANGE_COUNT];
+static size_t changeCount = 0;
+static struct VirtualPmLock pmLock = {0};
+
+void resetMockDac(void) {
+    outputEnabled = false;
+    changeCount = 0;
+    pmLock.count = 0;
+}
+
+size_t getMockDacChanges(const DacChange** result) {
+    *result = changes;
+    return changeCount;
+}
+
+int getMockPmLockCount(void) { return pmLock.count; }
+
+static void recordChange(void) {
+    DacChange change = {
+        .timeInUs = getClockTimeInUs(),
+        .frequency = outputEnabled ? generatorConfig.freq : 0,
+        .scale = outputEnabled ? generatorConfig.scale : 0};
+
+    if (changeCount > 0) {
+        const DacChange* last = &changes[changeCount - 1];
+        if (last->frequency == change.frequency &&
+            last->scale == change.scale) {
+            return;
+        }
+    }
+
+    if (changeCount == MOCK_DAC_MAX_CHANGE_COUNT) {
+        fprintf(stderr, "Too many DAC changes.\n");
+        abort();
+    }
+
+    changes[changeCount++] = change;
+}
+
+esp_err_t dac_output_enable(dac_channel_t channel) {
+    if (!generatorEnabled) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    outputEnabled = true;
+    recordChange();
+    return ESP_OK;
+}
+
+esp_err_t dac_output_disable(dac_channel_t channel) {
+    outputEnabled = false;
+    recordChange();
+    return ESP_OK;
+}
+
+esp_err_t dac_cw_generator_enable(void) {
+    generatorEnabled = true;
+    return ESP_OK;
+}
+
+esp_err_t dac_cw_generator_disable(void) {
+    generatorEnabled = false;
+    return ESP_OK;
+}
+
+esp_err_t dac_cw_generator_config(dac_cw_config_t* cw) {
+    if (cw->freq < 130 || cw->freq > 55000) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    generatorConfig = *cw;
+
+    if (outputEnabled) {
+        recordChange();
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(
+    esp_pm_lock_type_t lock_type, int arg, const char* name,
+    esp_pm_lock_handle_t* out_handle) {
+    *out_handle = &pmLock;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle) {
+    ++handle->count;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle) {
+    if (handle->count == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    --handle->count;
+    return ESP_OK;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MOCK_DAC_MAX_CHANGE_COUNT 64
+
+// What the DAC puts out from a point in time on. Scale is the attenuation
+// shift of dac_cw_scale_t, and frequency is 0 while the output is off.
+typedef struct {
+    uint64_t timeInUs;
+    uint32_t frequency;
+    int scale;
+} DacChange;
+
+// Forgets the changes so far and turns the output off
+void resetMockDac(void);
+// Only records the changes where the output would sound different
+size_t getMockDacChanges(const DacChange** changes);
+// Locks held to keep the chip out of light sleep
+int getMockPmLockCount(void);
@@ -0,0 +1,449 @@
+#include "mockdevice.h"
+#include "clock.h"
+#include "mocksystem.h"
+#include "pin.h"
+#include "standbymodel.h"
+#include "ulp_main.h"
+#include "virtualclock.h"
+
+#include <driver/gpio.h>
+#include <driver/rtc_io.h>
+#include <driver/uart.h>
+#include <esp32/ulp.h>
+#include <esp_attr.h>
+#include <esp_pm.h>
+#include <esp_timer.h>
+#include <soc/rtc_cntl_reg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define MOCK_ULP_PROGRAM_SIZE 64
+#define MOCK_RTC_SLOW_MEM_WORDS 2048
+
+// Bounds of the sections kept between wakes, from the linker
+extern char __start_rtc_data[] __attribute__((weak));
+extern char __stop_rtc_data[] __attribute__((weak));
+extern char __start_retained[] __attribute__((weak));
+extern char __stop_retained[] __attribute__((weak));
+
+// Of main.c
+void app_main(void);
+
+typedef struct {
+    bool timerEnabled;
+    uint64_t timerDurationInUs;
+    bool ext1Enabled;
+    uint64_t ext1Mask;
+    bool gpioEnabled;
+    bool ulpEnabled;
+    uint32_t ulpPeriodInUs;
+    esp_sleep_wakeup_cause_t cause;
+    uint64_t sleepTimeInUs;
+} SleepState;
+
+// Written by the wake and read back by the test
+typedef struct {
+    bool asleep;
+    char sections[];
+} SharedMemory;
+
+static RTC_DATA_ATTR SleepState sleepState;
+
+RTC_DATA_ATTR uint32_t ulp_entry;
+RTC_DATA_ATTR uint32_t ulp_debounce_samples;
+RTC_DATA_ATTR uint32_t ulp_battery_interval;
+RTC_DATA_ATTR uint32_t ulp_button_armed;
+RTC_DATA_ATTR uint32_t ulp_button_count;
+RTC_DATA_ATTR uint32_t ulp_battery_ticks;
+RTC_DATA_ATTR uint32_t ulp_battery_reading;
+RTC_DATA_ATTR uint32_t ulp_battery_sample_count;
+RTC_DATA_ATTR uint32_t ulp_wake_reason;
+RTC_DATA_ATTR volatile uint32_t mockRtcCntlState0Reg;
+// Only an address to count offsets from, as the variables of the program
+// are separate on the host
+uint32_t mockRtcSlowMem[MOCK_RTC_SLOW_MEM_WORDS];
+
+// Stands in for the program that the build embeds from ulp/standby.S
+const uint8_t mockUlpProgram[MOCK_ULP_PROGRAM_SIZE] asm(
+    "_binary_ulp_main_bin_start") = {0};
+__asm__(".globl _binary_ulp_main_bin_end\n"
+        ".set _binary_ulp_main_bin_end, _binary_ulp_main_bin_start + 64");
+
+static const MockButtonPress* buttonPresses = NULL;
+static size_t buttonPressCount = 0;
+static SharedMemory* sharedMemory = NULL;
+
+static gpio_isr_t interruptHandler = NULL;
+static void* interruptHandlerArg = NULL;
+static gpio_int_type_t interruptType = GPIO_INTR_DISABLE;
+static bool interruptEnabled = false;
+static esp_timer_handle_t interruptTimer = NULL;
+
+void setMockButtonPresses(const MockButtonPress* presses, size_t count) {
+    buttonPresses = presses;
+    buttonPressCount = count;
+}
+
+static bool isButtonPressedAt(uint64_t timeInUs) {
+    for (size_t i = 0; i < buttonPressCount; ++i) {
+        if (timeInUs >= buttonPresses[i].pressTimeInUs &&
+            timeInUs < buttonPresses[i].releaseTimeInUs) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// First time from the given one at which the button has the level,
+// UINT64_MAX if never
+static uint64_t findButtonLevel(uint64_t timeInUs, bool pressed) {
+    for (size_t i = 0; i < buttonPressCount; ++i) {
+        const MockButtonPress* press = &buttonPresses[i];
+
+        if (timeInUs < press->pressTimeInUs) {
+            return pressed ? press->pressTimeInUs : timeInUs;
+        }
+
+        if (timeInUs < press->releaseTimeInUs) {
+            return pressed ? timeInUs : press->releaseTimeInUs;
+        }
+    }
+
+    return pressed ? UINT64_MAX : timeInUs;
+}
+
+static size_t getSectionSize(const char* start, const char* stop) {
+    return start ? stop - start : 0;
+}
+
+static void copySections(bool save) {
+    const size_t rtcSize = getSectionSize(__start_rtc_data, __stop_rtc_data);
+    const size_t retainedSize =
+        getSectionSize(__start_retained, __stop_retained);
+    char* rtc = sharedMemory->sections;
+    char* retained = sharedMemory->sections + rtcSize;
+
+    if (save) {
+        memcpy(rtc, __start_rtc_data, rtcSize);
+        memcpy(retained, __start_retained, retainedSize);
+    } else {
+        memcpy(__start_rtc_data, rtc, rtcSize);
+        memcpy(__start_retained, retained, retainedSize);
+    }
+}
+
+static MockWake runWake(esp_sleep_wakeup_cause_t cause, uint64_t timeInUs) {
+    if (!sharedMemory) {
+        const size_t size =
+            sizeof(SharedMemory) +
+            getSectionSize(__start_rtc_data, __stop_rtc_data) +
+            getSectionSize(__start_retained, __stop_retained);
+        sharedMemory = mmap(
+            NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+            -1, 0);
+
+        if (sharedMemory == MAP_FAILED) {
+            perror("mmap");
+            abort();
+        }
+    }
+
+    sleepState.cause = cause;
+    resetVirtualClock(timeInUs);
+    sharedMemory->asleep = false;
+    fflush(stdout);
+    fflush(stderr);
+
+    const pid_t pid = fork();
+
+    if (pid == 0) {
+        app_main();
+        _exit(1);
+    }
+
+    int status = 0;
+
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0 || !sharedMemory->asleep) {
+        fprintf(stderr, "The firmware stopped before going to sleep.\n");
+        abort();
+    }
+
+    copySections(false);
+    resetVirtualClock(sleepState.sleepTimeInUs);
+    return (MockWake){
+        .cause = cause,
+        .wakeTimeInUs = timeInUs,
+        .sleepTimeInUs = sleepState.sleepTimeInUs};
+}
+
+MockWake coldBootMockDevice(void) {
+    resetRtcMemory();
+    return runWake(ESP_SLEEP_WAKEUP_UNDEFINED, 0);
+}
+
+// Runs the ULP program until it wakes the chip or the deadline passes
+static uint64_t runStandby(uint64_t timeInUs, uint64_t deadlineInUs) {
+    StandbyState state = {
+        .buttonArmed = ulp_button_armed,
+        .buttonCount = ulp_button_count,
+        .batteryTicks = ulp_battery_ticks,
+        .batteryReading = ulp_battery_reading,
+        .batterySampleCount = ulp_battery_sample_count,
+        .wakeReason = ulp_wake_reason};
+    const StandbyConfig config = {
+        .debounceSamples = ulp_debounce_samples,
+        .batteryInterval = ulp_battery_interval};
+    bool woken = false;
+
+    while (!woken && timeInUs + sleepState.ulpPeriodInUs < deadlineInUs) {
+        timeInUs += sleepState.ulpPeriodInUs;
+        // Only read when the program samples the battery, so that it takes
+        // readings from the trace at the same pace
+        const bool sampling = config.batteryInterval > 0 &&
+                              state.batteryTicks + 1 == config.batteryInterval;
+        woken = StandbyModel_step(
+            &state, &config, isButtonPressedAt(timeInUs),
+            sampling ? adc1_get_raw(BATTERY_ADC_CHANNEL) : 0);
+    }
+
+    ulp_button_armed = state.buttonArmed;
+    ulp_button_count = state.buttonCount;
+    ulp_battery_ticks = state.batteryTicks;
+    ulp_battery_reading = state.batteryReading;
+    ulp_battery_sample_count = state.batterySampleCount;
+    ulp_wake_reason = state.wakeReason;
+
+    if (woken) {
+        // The program stops itself when it wakes the chip
+        mockRtcCntlState0Reg &= ~RTC_CNTL_ULP_CP_SLP_TIMER_EN;
+        return timeInUs;
+    }
+
+    return UINT64_MAX;
+}
+
+MockWake wakeMockDevice(void) {
+    const uint64_t sleepTime = sleepState.sleepTimeInUs;
+    const uint64_t timerDeadline =
+        sleepState.timerEnabled ? sleepTime + sleepState.timerDurationInUs
+                                : UINT64_MAX;
+    uint64_t wakeTime = UINT64_MAX;
+    esp_sleep_wakeup_cause_t cause = ESP_SLEEP_WAKEUP_TIMER;
+
+    if (sleepState.ulpEnabled &&
+        (mockRtcCntlState0Reg & RTC_CNTL_ULP_CP_SLP_TIMER_EN)) {
+        wakeTime = runStandby(sleepTime, timerDeadline);
+        cause = ESP_SLEEP_WAKEUP_ULP;
+    } else if (
+        sleepState.ext1Enabled &&
+        (sleepState.ext1Mask & (1ULL << RING_BUTTON_PIN))) {
+        wakeTime = findButtonLevel(sleepTime, true);
+        cause = ESP_SLEEP_WAKEUP_EXT1;
+    }
+
+    if (wakeTime >= timerDeadline) {
+        wakeTime = timerDeadline;
+        cause = ESP_SLEEP_WAKEUP_TIMER;
+    }
+
+    if (wakeTime == UINT64_MAX) {
+        fprintf(stderr, "The device sleeps without a wakeup source.\n");
+        abort();
+    }
+
+    return runWake(cause, wakeTime);
+}
+
+static void handleInterruptTimer(void* arg) {
+    if (interruptEnabled && interruptHandler) {
+        interruptHandler(interruptHandlerArg);
+    }
+}
+
+// Only level interrupts are modeled, which fire as long as the level holds
+static void armInterruptTimer(void) {
+    esp_timer_stop(interruptTimer);
+
+    if (!interruptEnabled || (interruptType != GPIO_INTR_LOW_LEVEL &&
+                              interruptType != GPIO_INTR_HIGH_LEVEL)) {
+        return;
+    }
+
+    const uint64_t now = getClockTimeInUs();
+    const uint64_t levelTime =
+        findButtonLevel(now, interruptType == GPIO_INTR_HIGH_LEVEL);
+
+    if (levelTime != UINT64_MAX) {
+        ESP_ERROR_CHECK(esp_timer_start_once(interruptTimer, levelTime - now));
+    }
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+    return gpio_num == RING_BUTTON_PIN && isButtonPressedAt(getClockTimeInUs());
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode) {
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags) {
+    if (interruptTimer) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_timer_create_args_t timerArgs = {
+        .callback = handleInterruptTimer,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "gpio"};
+    return esp_timer_create(&timerArgs, &interruptTimer);
+}
+
+esp_err_t
+gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void* args) {
+    if (gpio_num != RING_BUTTON_PIN || !interruptTimer) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    interruptHandler = isr_handler;
+    interruptHandlerArg = args;
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num) {
+    interruptEnabled = true;
+    armInterruptTimer();
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num) {
+    interruptEnabled = false;
+    armInterruptTimer();
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type) {
+    interruptType = intr_type;
+    armInterruptTimer();
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio_num) {
+    interruptType = GPIO_INTR_DISABLE;
+    armInterruptTimer();
+    return ESP_OK;
+}
+
+esp_err_t rtc_gpio_init(gpio_num_t gpio_num) { return ESP_OK; }
+
+esp_err_t rtc_gpio_deinit(gpio_num_t gpio_num) { return ESP_OK; }
+
+esp_err_t rtc_gpio_set_direction(gpio_num_t gpio_num, rtc_gpio_mode_t mode) {
+    return ESP_OK;
+}
+
+esp_err_t rtc_gpio_isolate(gpio_num_t gpio_num) { return ESP_OK; }
+
+esp_err_t uart_wait_tx_idle_polling(uart_port_t uart_num) {
+    fflush(stdout);
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_configure(const void* config) { return ESP_OK; }
+
+esp_err_t ulp_load_binary(
+    uint32_t load_addr, const uint8_t* program_binary, size_t program_size) {
+    return program_size > 0 ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+esp_err_t ulp_set_wakeup_period(size_t period_index, uint32_t period_us) {
+    sleepState.ulpPeriodInUs = period_us;
+    return ESP_OK;
+}
+
+esp_err_t ulp_run(uint32_t entry_point) {
+    if (sleepState.ulpPeriodInUs == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    mockRtcCntlState0Reg |= RTC_CNTL_ULP_CP_SLP_TIMER_EN;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_pd_config(
+    esp_sleep_pd_domain_t domain, esp_sleep_pd_option_t option) {
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_source_t source) {
+    if (source == ESP_SLEEP_WAKEUP_ALL || source == ESP_SLEEP_WAKEUP_TIMER) {
+        sleepState.timerEnabled = false;
+    }
+    if (source == ESP_SLEEP_WAKEUP_ALL || source == ESP_SLEEP_WAKEUP_EXT1) {
+        sleepState.ext1Enabled = false;
+    }
+    if (source == ESP_SLEEP_WAKEUP_ALL || source == ESP_SLEEP_WAKEUP_GPIO) {
+        sleepState.gpioEnabled = false;
+    }
+    if (source == ESP_SLEEP_WAKEUP_ALL || source == ESP_SLEEP_WAKEUP_ULP) {
+        sleepState.ulpEnabled = false;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us) {
+    sleepState.timerEnabled = true;
+    sleepState.timerDurationInUs = time_in_us;
+    return ESP_OK;
+}
+
+esp_err_t
+esp_sleep_enable_ext1_wakeup(uint64_t mask, esp_sleep_ext1_wakeup_mode_t mode) {
+    if (mode != ESP_EXT1_WAKEUP_ANY_HIGH) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    sleepState.ext1Enabled = true;
+    sleepState.ext1Mask = mask;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup(void) {
+    sleepState.gpioEnabled = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ulp_wakeup(void) {
+    sleepState.ulpEnabled = true;
+    return ESP_OK;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void) {
+    return sleepState.cause;
+}
+
+uint64_t esp_sleep_get_ext1_wakeup_status(void) {
+    return sleepState.cause == ESP_SLEEP_WAKEUP_EXT1
+               ? sleepState.ext1Mask & (1ULL << RING_BUTTON_PIN)
+               : 0;
+}
+
+esp_err_t esp_light_sleep_start(void) {
+    fprintf(stderr, "Light sleep isn't modeled.\n");
+    abort();
+}
+
+void esp_deep_sleep_start(void) {
+    sleepState.sleepTimeInUs = getClockTimeInUs();
+    copySections(true);
+    sharedMemory->asleep = true;
+    fflush(stdout);
+    fflush(stderr);
+    _exit(0);
+}
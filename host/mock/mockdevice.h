@@ -0,0 +1,35 @@
+#pragma once
+
+#include <esp_sleep.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Runs app_main() of main.c from a boot until it enters deep sleep, one
+// wake at a time. Each wake is a child process forked from the test, so
+// that memory starts over as on the chip, but for RTC memory and what is
+// declared RETAINED_ATTR, which the test gets back as the firmware left it.
+// The tasks of the firmware end with the wake. In between wakes the test
+// models deep sleep: the ULP program of standbymodel.c samples the button
+// every 20 ms and the battery from the trace of mockadc.h, ext1 wakes on a
+// press, or the timer runs out.
+
+typedef struct {
+    // On the RTC clock
+    uint64_t pressTimeInUs;
+    uint64_t releaseTimeInUs;
+} MockButtonPress;
+
+typedef struct {
+    esp_sleep_wakeup_cause_t cause;
+    // On the RTC clock
+    uint64_t wakeTimeInUs;
+    uint64_t sleepTimeInUs;
+} MockWake;
+
+// The ring button follows them, in order of time. The caller keeps them
+// valid.
+void setMockButtonPresses(const MockButtonPress* presses, size_t count);
+// Clears RTC memory and the clock and powers the device up
+MockWake coldBootMockDevice(void);
+// Sleeps until a wakeup source fires and runs the wake
+MockWake wakeMockDevice(void);
@@ -0,0 +1,148 @@
+#include "mockflash.h"
+
+#include <string.h>
+
+#define MOCK_FLASH_MAX_SECTORS 64
+// Odd, so that stepping by it modulo a sector visits every byte once
+#define MOCK_FLASH_ERASE_STRIDE 1031
+
+static uint8_t flashData[MOCK_FLASH_MAX_SECTORS * FLASH_SECTOR_SIZE];
+static size_t flashSize = 0;
+static uint32_t readCount = 0;
+static bool powerLossArmed = false;
+static size_t powerLossBudget = 0;
+static bool poweredOff = false;
+static MockFlashPowerLoss powerLoss;
+
+// Returns how much of the operation gets done before the power goes
+static size_t
+spendPowerLossBudget(MockFlashOperation operation, size_t offset, size_t size) {
+    if (!powerLossArmed) {
+        return size;
+    }
+
+    if (size < powerLossBudget) {
+        powerLossBudget -= size;
+        return size;
+    }
+
+    powerLossArmed = false;
+    poweredOff = true;
+    powerLoss.operation = operation;
+    powerLoss.offset = offset;
+    powerLoss.size = size;
+    powerLoss.doneSize = powerLossBudget;
+    return powerLossBudget;
+}
+
+static esp_err_t checkRange(size_t offset, size_t size) {
+    if (offset > flashSize || size > flashSize - offset) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t readFlash(
+    void* context, size_t offset, void* data, size_t size) {
+    esp_err_t error = checkRange(offset, size);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    if (poweredOff) {
+        return ESP_FAIL;
+    }
+
+    memcpy(data, flashData + offset, size);
+    readCount += size;
+    return ESP_OK;
+}
+
+static esp_err_t writeFlash(
+    void* context, size_t offset, const void* data, size_t size) {
+    esp_err_t error = checkRange(offset, size);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    if (poweredOff) {
+        return ESP_FAIL;
+    }
+
+    const size_t doneSize =
+        spendPowerLossBudget(MOCK_FLASH_WRITE, offset, size);
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < doneSize; ++i) {
+        flashData[offset + i] &= bytes[i];
+    }
+    return doneSize == size ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t eraseFlash(void* context, size_t offset, size_t size) {
+    esp_err_t error = checkRange(offset, size);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    if (offset % FLASH_SECTOR_SIZE != 0 || size % FLASH_SECTOR_SIZE != 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (poweredOff) {
+        return ESP_FAIL;
+    }
+
+    const size_t doneSize =
+        spendPowerLossBudget(MOCK_FLASH_ERASE, offset, size);
+
+    if (doneSize == size) {
+        memset(flashData + offset, 0xff, size);
+        return ESP_OK;
+    }
+
+    for (size_t i = 0; i < doneSize; ++i) {
+        flashData[offset + (i * MOCK_FLASH_ERASE_STRIDE) % size] = 0xff;
+    }
+    return ESP_FAIL;
+}
+
+void initMockFlash(FlashStorage* storage, uint32_t sectorCount) {
+    if (sectorCount > MOCK_FLASH_MAX_SECTORS) {
+        sectorCount = MOCK_FLASH_MAX_SECTORS;
+    }
+
+    flashSize = sectorCount * FLASH_SECTOR_SIZE;
+    memset(flashData, 0xff, sizeof(flashData));
+    readCount = 0;
+    powerLossArmed = false;
+    poweredOff = false;
+
+    storage->read = readFlash;
+    storage->write = writeFlash;
+    storage->erase = eraseFlash;
+    storage->context = NULL;
+    storage->size = flashSize;
+}
+
+uint8_t* getMockFlashData(void) { return flashData; }
+
+uint32_t getMockFlashReadCount(void) { return readCount; }
+
+void setMockFlashPowerLoss(size_t byteCount) {
+    powerLossArmed = true;
+    powerLossBudget = byteCount;
+}
+
+bool restoreMockFlashPower(MockFlashPowerLoss* result) {
+    const bool lost = poweredOff;
+    powerLossArmed = false;
+    poweredOff = false;
+
+    if (lost && result) {
+        *result = powerLoss;
+    }
+    return lost;
+}
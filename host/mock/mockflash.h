@@ -0,0 +1,33 @@
+#pragma once
+
+#include <flash.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Flash region in memory with the rules of NOR flash. Erased flash reads as
+// 0xff, writes can only clear bits and erasing works on whole sectors.
+void initMockFlash(FlashStorage* storage, uint32_t sectorCount);
+uint8_t* getMockFlashData(void);
+// Bytes read since the last init
+uint32_t getMockFlashReadCount(void);
+
+typedef enum { MOCK_FLASH_WRITE, MOCK_FLASH_ERASE } MockFlashOperation;
+
+// The operation that was under way when power was lost
+typedef struct {
+    MockFlashOperation operation;
+    size_t offset;
+    size_t size;
+    // Bytes that were written or erased before the power went
+    size_t doneSize;
+} MockFlashPowerLoss;
+
+// Loses power once the given number of bytes have been written or erased
+// from now on. The operation that crosses it is left partly done: a write
+// stops after a prefix, an erase after bytes spread over the whole range,
+// as the bits of a real sector don't all flip at once. Everything after it
+// fails, as nothing runs until the next boot.
+void setMockFlashPowerLoss(size_t byteCount);
+// Powers up again with the contents as they were left. Returns false if
+// power was never lost.
+bool restoreMockFlashPower(MockFlashPowerLoss* powerLoss);
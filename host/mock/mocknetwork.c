@@ -0,0 +1,296 @@
+#include "mocknetwork.h"
+#include "clock.h"
+#include "mocksystem.h"
+#include "mockwifi.h"
+#include "resolver.h"
+#include "ringdatagram.h"
+#include "tls.h"
+#include "tlv.h"
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MOCK_CONNECTION_MAX_COUNT 4
+// The largest header of https.c and request body of api.c
+#define MOCK_REQUEST_MAX_SIZE (512 + 1536)
+#define MOCK_RESPONSE_BODY_MAX_SIZE 512
+#define MOCK_RESPONSE_MAX_SIZE (128 + MOCK_RESPONSE_BODY_MAX_SIZE)
+#define MOCK_TLS_HANDSHAKE_TIME_IN_MS 300
+#define MOCK_SERVER_DEFAULT_RESPONSE_TIME_IN_MS 50
+// Report fields, see apischema.def
+#define MOCK_REPORT_RING_ID 1
+#define MOCK_REPORT_FIRST_HEALTH_ID 16
+
+typedef struct {
+    bool open;
+    char request[MOCK_REQUEST_MAX_SIZE + 1];
+    size_t requestLength;
+    // Of the request being answered, -1 if none
+    int requestIndex;
+    int64_t responseTimeInUs;
+    char response[MOCK_RESPONSE_MAX_SIZE];
+    size_t responseLength;
+    size_t responseOffset;
+} MockConnection;
+
+static RETAINED_ATTR MockServerRequest requests[MOCK_SERVER_MAX_REQUESTS];
+static RETAINED_ATTR size_t requestCount = 0;
+static RETAINED_ATTR uint32_t handshakeCount = 0;
+
+static RETAINED_ATTR char lastRequestBody[MOCK_REQUEST_MAX_SIZE];
+static RETAINED_ATTR size_t lastRequestBodyLength = 0;
+
+static uint32_t responseTimeInMs = MOCK_SERVER_DEFAULT_RESPONSE_TIME_IN_MS;
+static char responseBody[MOCK_RESPONSE_BODY_MAX_SIZE];
+static size_t responseBodyLength = 0;
+// The socket of a connection is 1 + its index
+static MockConnection connections[MOCK_CONNECTION_MAX_COUNT];
+
+void resetMockServer(void) {
+    requestCount = 0;
+    handshakeCount = 0;
+    lastRequestBodyLength = 0;
+    responseTimeInMs = MOCK_SERVER_DEFAULT_RESPONSE_TIME_IN_MS;
+    responseBodyLength = 0;
+}
+
+void setMockServerResponseTime(uint32_t timeInMs) {
+    responseTimeInMs = timeInMs;
+}
+
+void setMockServerResponseBody(const void* body, size_t length) {
+    if (length > sizeof(responseBody)) {
+        fprintf(stderr, "The response body is too long.\n");
+        abort();
+    }
+
+    memcpy(responseBody, body, length);
+    responseBodyLength = length;
+}
+
+size_t getMockServerRequests(const MockServerRequest** result) {
+    *result = requests;
+    return requestCount;
+}
+
+size_t getMockServerLastRequestBody(const char** body) {
+    *body = lastRequestBody;
+    return lastRequestBodyLength;
+}
+
+uint32_t getMockServerHandshakeCount(void) { return handshakeCount; }
+
+static MockConnection* findConnection(const TlsConnection* connection) {
+    const int index = connection->socket.fd - 1;
+
+    if (!connection->connected || index < 0 ||
+        index >= MOCK_CONNECTION_MAX_COUNT || !connections[index].open) {
+        return NULL;
+    }
+
+    return &connections[index];
+}
+
+static void parseReportField(const TlvField* field, void* userData) {
+    MockServerRequest* request = userData;
+
+    if (field->id == MOCK_REPORT_RING_ID) {
+        ++request->ringCount;
+    } else if (field->id >= MOCK_REPORT_FIRST_HEALTH_ID) {
+        request->health = true;
+    }
+}
+
+static void parseBody(
+    MockServerRequest* request,
+    const char* header,
+    const char* body,
+    size_t bodyLength) {
+    if (strstr(header, "Content-Type: application/vnd.doorbell.tlv")) {
+        TlvParser parser;
+        TlvParser_init(&parser, parseReportField, request);
+        TlvParser_feed(&parser, body, bodyLength);
+        TlvParser_finish(&parser);
+        return;
+    }
+
+    const char* ringCount = strstr(body, "ring.count=");
+    if (ringCount) {
+        request->ringCount =
+            strtoul(ringCount + strlen("ring.count="), NULL, 10);
+    }
+
+    request->health = strstr(body, "battery.level=") != NULL;
+}
+
+// Answers once the whole request arrived
+static void receiveRequest(MockConnection* connection) {
+    char* headerEnd = strstr(connection->request, "\r\n\r\n");
+
+    if (!headerEnd) {
+        return;
+    }
+
+    const char* contentLength = strstr(connection->request, "Content-Length:");
+    const size_t bodyLength =
+        contentLength && contentLength < headerEnd
+            ? strtoul(contentLength + strlen("Content-Length:"), NULL, 10)
+            : 0;
+    const char* body = headerEnd + 4;
+
+    if (connection->requestLength <
+        (size_t)(body - connection->request) + bodyLength) {
+        return;
+    }
+
+    *headerEnd = 0;
+    MockServerRequest request = {.timeInUs = getClockTimeInUs()};
+    char method[8] = {0};
+    sscanf(connection->request, "%7s %15s", method, request.path);
+    parseBody(&request, connection->request, body, bodyLength);
+    for (size_t i = 0; i < MOCK_CONNECTION_MAX_COUNT; ++i) {
+        request.openConnections += connections[i].open;
+    }
+    memcpy(lastRequestBody, body, bodyLength);
+    lastRequestBodyLength = bodyLength;
+
+    const bool known = strcmp(method, "POST") == 0 &&
+                       (strcmp(request.path, "/report") == 0 ||
+                        strcmp(request.path, "/ring") == 0 ||
+                        strcmp(request.path, "/heartbeat") == 0);
+    const size_t sentBodyLength = known ? responseBodyLength : 0;
+    connection->responseLength = snprintf(
+        connection->response, sizeof(connection->response),
+        "HTTP/1.1 %s\r\nContent-Length: %u\r\n\r\n",
+        known ? "200 OK" : "404 Not Found", (unsigned)sentBodyLength);
+    memcpy(
+        &connection->response[connection->responseLength], responseBody,
+        sentBodyLength);
+    connection->responseLength += sentBodyLength;
+    connection->responseOffset = 0;
+    connection->responseTimeInUs =
+        esp_timer_get_time() + responseTimeInMs * 1000LL;
+    connection->requestLength = 0;
+    connection->requestIndex = -1;
+
+    if (requestCount < MOCK_SERVER_MAX_REQUESTS) {
+        connection->requestIndex = requestCount;
+        requests[requestCount++] = request;
+    }
+}
+
+esp_err_t initTls(void) { return ESP_OK; }
+
+const char* getTlsServerCertificate(void) { return ""; }
+
+void getTlsSessionStats(TlsSessionStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+void clearTlsSession(void) {}
+
+esp_err_t TlsConnection_open(
+    TlsConnection* connection,
+    const char* host,
+    uint16_t port,
+    uint32_t timeoutMs) {
+    memset(connection, 0, sizeof(*connection));
+
+    if (!isMockStationConnected()) {
+        return ESP_FAIL;
+    }
+
+    for (size_t i = 0; i < MOCK_CONNECTION_MAX_COUNT; ++i) {
+        if (!connections[i].open) {
+            vTaskDelay(pdMS_TO_TICKS(MOCK_TLS_HANDSHAKE_TIME_IN_MS));
+            ++handshakeCount;
+            connections[i] = (MockConnection){.open = true, .requestIndex = -1};
+            connection->socket.fd = i + 1;
+            connection->timeoutMs = timeoutMs;
+            connection->connected = true;
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NO_MEM;
+}
+
+int TlsConnection_write(
+    TlsConnection* connection, const void* data, size_t length) {
+    MockConnection* mock = findConnection(connection);
+
+    if (!mock || !isMockStationConnected() ||
+        length > MOCK_REQUEST_MAX_SIZE - mock->requestLength) {
+        return -1;
+    }
+
+    memcpy(&mock->request[mock->requestLength], data, length);
+    mock->requestLength += length;
+    mock->request[mock->requestLength] = 0;
+    receiveRequest(mock);
+    return length;
+}
+
+int TlsConnection_read(TlsConnection* connection, void* data, size_t size) {
+    MockConnection* mock = findConnection(connection);
+
+    if (!mock || !isMockStationConnected()) {
+        return -1;
+    }
+
+    // Nothing more to come, as if the server closed the connection
+    if (mock->responseOffset == mock->responseLength) {
+        return 0;
+    }
+
+    const int64_t waitInUs = mock->responseTimeInUs - esp_timer_get_time();
+
+    if (waitInUs > connection->timeoutMs * 1000LL) {
+        vTaskDelay(pdMS_TO_TICKS(connection->timeoutMs));
+        return MBEDTLS_ERR_SSL_TIMEOUT;
+    }
+
+    if (waitInUs > 0) {
+        vTaskDelay(pdMS_TO_TICKS((waitInUs + 999) / 1000));
+    }
+
+    if (mock->requestIndex >= 0) {
+        requests[mock->requestIndex].answered = true;
+    }
+
+    const size_t count = mock->responseLength - mock->responseOffset < size
+                             ? mock->responseLength - mock->responseOffset
+                             : size;
+    memcpy(data, &mock->response[mock->responseOffset], count);
+    mock->responseOffset += count;
+    return count;
+}
+
+void TlsConnection_close(TlsConnection* connection) {
+    MockConnection* mock = findConnection(connection);
+
+    if (mock) {
+        mock->open = false;
+    }
+
+    connection->connected = false;
+}
+
+void invalidateResolvedHost(const char* host) {}
+
+void getResolverStats(ResolverStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+esp_err_t sendRingDatagram(
+    const char* host,
+    uint16_t port,
+    uint32_t logId,
+    uint32_t sequence,
+    uint32_t timeoutInMs) {
+    return ESP_ERR_NOT_FOUND;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Stands in for tls.c, resolver.c and ringdatagram.c. TLS connections go to
+// a server in the same process while the station of mockwifi.h has an IP,
+// so https.c and the API client run as on the device. The server takes
+// posts to /report, /ring and /heartbeat in either encoding and keeps what
+// it was sent from one wake of mockdevice.h to the next. No device key is
+// provisioned, so rings always go over HTTPS.
+
+#define MOCK_SERVER_MAX_REQUESTS 64
+
+typedef struct {
+    // On the RTC clock, once the whole request arrived
+    uint64_t timeInUs;
+    char path[16];
+    uint32_t ringCount;
+    bool health;
+    // Including the one it arrived on
+    uint32_t openConnections;
+    // Set once the response reached the client within its timeout
+    bool answered;
+} MockServerRequest;
+
+// Forgets the requests and goes back to the default response time and an
+// empty response body
+void resetMockServer(void);
+// From the end of a request to the end of its response, 50 ms by default
+void setMockServerResponseTime(uint32_t timeInMs);
+// Sent with every successful response that follows, in whatever encoding
+// it's in. Copied, at most 512 bytes.
+void setMockServerResponseBody(const void* body, size_t length);
+size_t getMockServerRequests(const MockServerRequest** requests);
+// Of the last request, not null-terminated
+size_t getMockServerLastRequestBody(const char** body);
+// One per new connection, each taking 300 ms like a full handshake with
+// ECDHE on the chip
+uint32_t getMockServerHandshakeCount(void);
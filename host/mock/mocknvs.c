@@ -0,0 +1,142 @@
+#include "mocknvs.h"
+#include "mocksystem.h"
+
+#include <nvs.h>
+#include <nvs_flash.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define MOCK_NVS_MAX_ENTRIES 16
+#define MOCK_NVS_MAX_NAMESPACES 8
+#define MOCK_NVS_MAX_NAME_LENGTH 16
+#define MOCK_NVS_MAX_BLOB_SIZE 1024
+
+typedef struct {
+    bool used;
+    nvs_handle_t handle;
+    char key[MOCK_NVS_MAX_NAME_LENGTH];
+    uint8_t value[MOCK_NVS_MAX_BLOB_SIZE];
+    size_t length;
+} NvsEntry;
+
+// Handles are 1 + the index of the namespace
+static RETAINED_ATTR char
+    namespaces[MOCK_NVS_MAX_NAMESPACES][MOCK_NVS_MAX_NAME_LENGTH];
+static RETAINED_ATTR NvsEntry entries[MOCK_NVS_MAX_ENTRIES];
+
+void eraseMockNvs(void) {
+    memset(namespaces, 0, sizeof(namespaces));
+    memset(entries, 0, sizeof(entries));
+}
+
+esp_err_t nvs_flash_init(void) { return ESP_OK; }
+
+esp_err_t nvs_flash_erase(void) {
+    eraseMockNvs();
+    return ESP_OK;
+}
+
+static NvsEntry* findEntry(nvs_handle_t handle, const char* key) {
+    for (size_t i = 0; i < MOCK_NVS_MAX_ENTRIES; ++i) {
+        NvsEntry* entry = &entries[i];
+        if (entry->used && entry->handle == handle &&
+            strcmp(entry->key, key) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+esp_err_t nvs_open(
+    const char* name, nvs_open_mode_t open_mode, nvs_handle_t* out_handle) {
+    if (strlen(name) >= MOCK_NVS_MAX_NAME_LENGTH) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (size_t i = 0; i < MOCK_NVS_MAX_NAMESPACES; ++i) {
+        if (strcmp(namespaces[i], name) == 0) {
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+
+    // Only created when opened for writing
+    if (open_mode == NVS_READONLY) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    for (size_t i = 0; i < MOCK_NVS_MAX_NAMESPACES; ++i) {
+        if (namespaces[i][0] == '\0') {
+            strcpy(namespaces[i], name);
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t nvs_get_blob(
+    nvs_handle_t handle, const char* key, void* out_value, size_t* length) {
+    const NvsEntry* entry = findEntry(handle, key);
+
+    if (!entry) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    if (!out_value) {
+        *length = entry->length;
+        return ESP_OK;
+    }
+
+    if (*length < entry->length) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    memcpy(out_value, entry->value, entry->length);
+    *length = entry->length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(
+    nvs_handle_t handle, const char* key, const void* value, size_t length) {
+    if (strlen(key) >= MOCK_NVS_MAX_NAME_LENGTH ||
+        length > MOCK_NVS_MAX_BLOB_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    NvsEntry* entry = findEntry(handle, key);
+
+    for (size_t i = 0; !entry && i < MOCK_NVS_MAX_ENTRIES; ++i) {
+        if (!entries[i].used) {
+            entry = &entries[i];
+            entry->used = true;
+            entry->handle = handle;
+            strcpy(entry->key, key);
+        }
+    }
+
+    if (!entry) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    memcpy(entry->value, value, length);
+    entry->length = length;
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+    NvsEntry* entry = findEntry(handle, key);
+
+    if (!entry) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+
+    entry->used = false;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) { return ESP_OK; }
+
+void nvs_close(nvs_handle_t handle) {}
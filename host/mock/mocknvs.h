@@ -0,0 +1,6 @@
+#pragma once
+
+// Entries are kept from one wake of mockdevice.h to the next, as in flash
+
+// Forgets everything, like erasing the NVS partition
+void eraseMockNvs(void);
@@ -0,0 +1,237 @@
+#include "mockota.h"
+#include "mocksystem.h"
+
+#include <esp_ota_ops.h>
+#include <string.h>
+
+#define MOCK_PARTITION_SIZE (1536 * 1024)
+#define MOCK_STORAGE_PARTITION_SIZE (256 * 1024)
+#define MOCK_SECTOR_SIZE 4096
+#define MOCK_APP_HASH_SIZE 32
+#define MOCK_OTA_HANDLE 1
+
+typedef struct {
+    esp_partition_t partition;
+    uint8_t data[MOCK_PARTITION_SIZE];
+} MockPartition;
+
+static RETAINED_ATTR MockPartition partitions[] = {
+    {.partition =
+         {.type = ESP_PARTITION_TYPE_APP,
+          .address = 0x10000,
+          .size = MOCK_PARTITION_SIZE,
+          .label = "ota_0"}},
+    {.partition =
+         {.type = ESP_PARTITION_TYPE_APP,
+          .address = 0x190000,
+          .size = MOCK_PARTITION_SIZE,
+          .label = "ota_1"}},
+    {.partition = {
+         .type = ESP_PARTITION_TYPE_DATA,
+         .address = 0x310000,
+         .size = MOCK_STORAGE_PARTITION_SIZE,
+         .label = "storage"}}};
+
+static const esp_app_desc_t appDescription = {
+    .version = "1.0", .project_name = "doorbell"};
+
+// Kept in flash on the device, like otadata
+static RETAINED_ATTR const esp_partition_t* bootPartition = NULL;
+static RETAINED_ATTR uint32_t writeCount = 0;
+static RETAINED_ATTR size_t runningImageSize = 0;
+// Of the one update that can be written with esp_ota_write() at a time
+static const esp_partition_t* otaPartition = NULL;
+static uint32_t otaOffset = 0;
+
+static MockPartition* findPartition(const esp_partition_t* partition) {
+    for (size_t i = 0; i < sizeof(partitions) / sizeof(partitions[0]); ++i) {
+        if (&partitions[i].partition == partition) {
+            return &partitions[i];
+        }
+    }
+
+    return NULL;
+}
+
+void resetMockOta(void) {
+    for (size_t i = 0; i < sizeof(partitions) / sizeof(partitions[0]); ++i) {
+        memset(partitions[i].data, 0xff, partitions[i].partition.size);
+    }
+
+    bootPartition = NULL;
+    writeCount = 0;
+    runningImageSize = 0;
+    otaPartition = NULL;
+}
+
+void setMockRunningImage(const uint8_t* image, size_t size) {
+    memset(partitions[0].data, 0xff, MOCK_PARTITION_SIZE);
+    memcpy(partitions[0].data, image, size);
+    runningImageSize = size;
+}
+
+const uint8_t* getMockPartitionData(const esp_partition_t* partition) {
+    return findPartition(partition)->data;
+}
+
+const esp_partition_t* getMockBootPartition(void) { return bootPartition; }
+
+uint32_t getMockPartitionWriteCount(void) { return writeCount; }
+
+const esp_partition_t* esp_partition_find_first(
+    esp_partition_type_t type,
+    esp_partition_subtype_t subtype,
+    const char* label) {
+    for (size_t i = 0; i < sizeof(partitions) / sizeof(partitions[0]); ++i) {
+        const esp_partition_t* partition = &partitions[i].partition;
+        if (partition->type == type &&
+            (!label || strcmp(partition->label, label) == 0)) {
+            return partition;
+        }
+    }
+
+    return NULL;
+}
+
+esp_err_t esp_partition_read(
+    const esp_partition_t* partition,
+    size_t src_offset,
+    void* dst,
+    size_t size) {
+    MockPartition* mock = findPartition(partition);
+
+    if (!mock || src_offset > partition->size ||
+        size > partition->size - src_offset) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(dst, &mock->data[src_offset], size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(
+    const esp_partition_t* partition,
+    size_t dst_offset,
+    const void* src,
+    size_t size) {
+    MockPartition* mock = findPartition(partition);
+
+    if (!mock || dst_offset > partition->size ||
+        size > partition->size - dst_offset) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const uint8_t* data = src;
+
+    for (size_t i = 0; i < size; ++i) {
+        mock->data[dst_offset + i] &= data[i];
+    }
+
+    writeCount += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(
+    const esp_partition_t* partition, size_t offset, size_t size) {
+    MockPartition* mock = findPartition(partition);
+
+    if (!mock || offset % MOCK_SECTOR_SIZE != 0 ||
+        size % MOCK_SECTOR_SIZE != 0 || offset > partition->size ||
+        size > partition->size - offset) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(&mock->data[offset], 0xff, size);
+    return ESP_OK;
+}
+
+esp_err_t
+esp_partition_get_sha256(const esp_partition_t* partition, uint8_t* sha_256) {
+    if (partition != &partitions[0].partition ||
+        runningImageSize < MOCK_APP_HASH_SIZE) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    memcpy(
+        sha_256,
+        &partitions[0].data[runningImageSize - MOCK_APP_HASH_SIZE],
+        MOCK_APP_HASH_SIZE);
+    return ESP_OK;
+}
+
+const esp_app_desc_t* esp_ota_get_app_description(void) {
+    return &appDescription;
+}
+
+const esp_partition_t* esp_ota_get_running_partition(void) {
+    return &partitions[0].partition;
+}
+
+const esp_partition_t*
+esp_ota_get_next_update_partition(const esp_partition_t* start_from) {
+    return &partitions[1].partition;
+}
+
+esp_err_t esp_ota_begin(
+    const esp_partition_t* partition,
+    size_t image_size,
+    esp_ota_handle_t* out_handle) {
+    if (partition != &partitions[1].partition || otaPartition) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Like OTA_SIZE_UNKNOWN, erases the whole partition
+    esp_err_t error = esp_partition_erase_range(partition, 0, partition->size);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    otaPartition = partition;
+    otaOffset = 0;
+    *out_handle = MOCK_OTA_HANDLE;
+    return ESP_OK;
+}
+
+esp_err_t
+esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size) {
+    if (handle != MOCK_OTA_HANDLE || !otaPartition) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t error = esp_partition_write(otaPartition, otaOffset, data, size);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    otaOffset += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+    if (handle != MOCK_OTA_HANDLE || !otaPartition) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    otaPartition = NULL;
+    return otaOffset > 0 ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle) {
+    if (handle != MOCK_OTA_HANDLE || !otaPartition) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    otaPartition = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+    if (partition != &partitions[1].partition) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    bootPartition = partition;
+    return ESP_OK;
+}
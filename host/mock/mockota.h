@@ -0,0 +1,19 @@
+#pragma once
+
+#include <esp_partition.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Two OTA partitions and the storage data partition of partitions.csv in
+// memory. The running one is ota_0 and updates go to ota_1. Erased flash
+// reads as 0xff and writes can only clear bits. Flash keeps its contents
+// from one wake of mockdevice.h to the next.
+void resetMockOta(void);
+// Writes the image to ota_0. Its last 32 bytes are taken as the SHA-256
+// that ESP-IDF appends to app images.
+void setMockRunningImage(const uint8_t* image, size_t size);
+const uint8_t* getMockPartitionData(const esp_partition_t* partition);
+// ota_1 once esp_ota_set_boot_partition() accepted it, otherwise NULL
+const esp_partition_t* getMockBootPartition(void);
+// Bytes written to a partition since the last reset
+uint32_t getMockPartitionWriteCount(void);
@@ -0,0 +1,9 @@
+#pragma once
+
+// Sets everything declared with RTC_DATA_ATTR back to zero, as after a cold
+// boot. Only valid as long as none of it has another initial value.
+void resetRtcMemory(void);
+
+// Keeps memory that stands for flash or the world outside the chip from one
+// wake of mockdevice.h to the next, along with RTC memory
+#define RETAINED_ATTR __attribute__((section("retained")))
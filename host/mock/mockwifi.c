@@ -0,0 +1,491 @@
+#include "mockwifi.h"
+#include "mocksystem.h"
+#include "provisioning.h"
+
+#include <esp_event.h>
+#include <esp_netif.h>
+#include <esp_netif_net_stack.h>
+#include <esp_task.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <lwip/dhcp.h>
+#include <string.h>
+
+#define MOCK_EVENT_QUEUE_LENGTH 16
+#define MOCK_EVENT_DATA_MAX_SIZE 64
+#define MOCK_EVENT_HANDLER_MAX_COUNT 8
+#define MOCK_EVENT_TASK_STACK_SIZE 4096
+
+#define MOCK_AP_SSID "doorbell"
+#define MOCK_AP_CHANNEL 6
+#define MOCK_WIFI_CHANNEL_COUNT 13
+// Calibrating the PHY in esp_wifi_start()
+#define MOCK_WIFI_START_TIME_IN_US (30 * 1000)
+// Active scans wait this long on every channel, but a probe of the set
+// BSSID on the set channel is answered right away
+#define MOCK_WIFI_CHANNEL_SCAN_TIME_IN_US (120 * 1000)
+#define MOCK_WIFI_PROBE_TIME_IN_US (10 * 1000)
+#define MOCK_WIFI_ASSOCIATION_TIME_IN_US (40 * 1000)
+// lwIP checks the offered address with ARP before taking it
+#define MOCK_WIFI_DHCP_TIME_IN_US (1000 * 1000)
+#define MOCK_WIFI_STATIC_IP_TIME_IN_US (5 * 1000)
+// What home routers tend to give out
+#define MOCK_WIFI_DEFAULT_LEASE_TIME_IN_S (24 * 60 * 60)
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    uint8_t data[MOCK_EVENT_DATA_MAX_SIZE];
+} MockEvent;
+
+struct VirtualEventHandler {
+    bool registered;
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void* arg;
+};
+
+struct esp_netif_obj {
+    bool dhcpcRunning;
+    esp_netif_ip_info_t ipInfo;
+    esp_netif_dns_info_t dnsInfo;
+    struct netif lwipNetif;
+    struct dhcp dhcp;
+};
+
+// Each waits for the station timer, which moves on to the next
+typedef enum {
+    STATION_STOPPED,
+    STATION_IDLE,
+    STATION_SCANNING,
+    STATION_ASSOCIATING,
+    STATION_WAITING_FOR_IP,
+    STATION_CONNECTED
+} StationState;
+
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+static const uint8_t MOCK_AP_BSSID[6] = {0x24, 0x0a, 0xc4, 0x5e, 0x31, 0x07};
+
+static const wifi_config_t PROVISIONED_CONFIG = {
+    .sta = {.ssid = MOCK_AP_SSID, .password = "doorbell-password"}};
+
+// Persisted in flash by the driver
+static RETAINED_ATTR wifi_config_t wifiConfig = PROVISIONED_CONFIG;
+static RETAINED_ATTR uint64_t radioOnTimeInUs = 0;
+
+static bool accessPointUp = true;
+static uint32_t leaseTimeInS = MOCK_WIFI_DEFAULT_LEASE_TIME_IN_S;
+static RETAINED_ATTR uint32_t leaseCount = 0;
+
+static QueueHandle_t eventQueue = NULL;
+static struct VirtualEventHandler eventHandlers[MOCK_EVENT_HANDLER_MAX_COUNT];
+
+static esp_netif_t stationNetif;
+static esp_timer_handle_t stationTimer = NULL;
+static StationState stationState = STATION_STOPPED;
+static uint64_t radioStartTimeInUs = 0;
+
+void resetMockWifi(void) {
+    wifiConfig = PROVISIONED_CONFIG;
+    radioOnTimeInUs = 0;
+    accessPointUp = true;
+    leaseTimeInS = MOCK_WIFI_DEFAULT_LEASE_TIME_IN_S;
+    leaseCount = 0;
+}
+
+void setMockAccessPointUp(bool up) { accessPointUp = up; }
+
+void setMockDhcpLeaseTime(uint32_t timeInS) { leaseTimeInS = timeInS; }
+
+uint32_t getMockDhcpLeaseCount(void) { return leaseCount; }
+
+uint64_t getMockRadioOnTimeInUs(void) { return radioOnTimeInUs; }
+
+bool isMockStationConnected(void) {
+    return stationState == STATION_CONNECTED;
+}
+
+// The station is provisioned from the start
+void runFirstTimeProvisioning(void) {}
+
+static void runEventLoop(void* parameter) {
+    while (true) {
+        MockEvent event;
+
+        if (xQueueReceive(eventQueue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        for (size_t i = 0; i < MOCK_EVENT_HANDLER_MAX_COUNT; ++i) {
+            const struct VirtualEventHandler* handler = &eventHandlers[i];
+
+            if (handler->registered && handler->base == event.base &&
+                (handler->id == ESP_EVENT_ANY_ID ||
+                 handler->id == event.id)) {
+                handler->handler(
+                    handler->arg, event.base, event.id, event.data);
+            }
+        }
+    }
+}
+
+esp_err_t esp_event_loop_create_default(void) {
+    if (eventQueue) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    eventQueue = xQueueCreate(MOCK_EVENT_QUEUE_LENGTH, sizeof(MockEvent));
+
+    if (!eventQueue) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    return xTaskCreatePinnedToCore(
+               runEventLoop, "sys_evt", MOCK_EVENT_TASK_STACK_SIZE, NULL,
+               ESP_TASK_EVENT_PRIO, NULL, 0) == pdPASS
+               ? ESP_OK
+               : ESP_FAIL;
+}
+
+esp_err_t esp_event_handler_instance_register(
+    esp_event_base_t event_base,
+    int32_t event_id,
+    esp_event_handler_t event_handler,
+    void* event_handler_arg,
+    esp_event_handler_instance_t* instance) {
+    for (size_t i = 0; i < MOCK_EVENT_HANDLER_MAX_COUNT; ++i) {
+        struct VirtualEventHandler* handler = &eventHandlers[i];
+
+        if (!handler->registered) {
+            *handler = (struct VirtualEventHandler){
+                .registered = true,
+                .base = event_base,
+                .id = event_id,
+                .handler = event_handler,
+                .arg = event_handler_arg};
+            *instance = handler;
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_event_handler_instance_unregister(
+    esp_event_base_t event_base,
+    int32_t event_id,
+    esp_event_handler_instance_t instance) {
+    if (!instance || !instance->registered) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    instance->registered = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(
+    esp_event_base_t event_base,
+    int32_t event_id,
+    const void* event_data,
+    size_t event_data_size,
+    TickType_t ticks_to_wait) {
+    if (!eventQueue) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (event_data_size > MOCK_EVENT_DATA_MAX_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    MockEvent event = {.base = event_base, .id = event_id};
+    if (event_data) {
+        memcpy(event.data, event_data, event_data_size);
+    }
+
+    return xQueueSend(eventQueue, &event, ticks_to_wait) == pdTRUE
+               ? ESP_OK
+               : ESP_ERR_TIMEOUT;
+}
+
+// In network byte order
+static uint32_t makeAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    return a | b << 8 | c << 16 | (uint32_t)d << 24;
+}
+
+static void postStationEvent(int32_t id, const void* data, size_t size) {
+    // Also called from the station timer, which must not wait
+    ESP_ERROR_CHECK(esp_event_post(WIFI_EVENT, id, data, size, 0));
+}
+
+static void postDisconnected(uint8_t reason) {
+    wifi_event_sta_disconnected_t event = {
+        .ssid_len = strlen(MOCK_AP_SSID), .reason = reason};
+    memcpy(event.ssid, MOCK_AP_SSID, event.ssid_len);
+    memcpy(event.bssid, MOCK_AP_BSSID, sizeof(event.bssid));
+    postStationEvent(WIFI_EVENT_STA_DISCONNECTED, &event, sizeof(event));
+}
+
+static void startStationTimer(StationState state, uint64_t timeInUs) {
+    stationState = state;
+    esp_timer_stop(stationTimer);
+    ESP_ERROR_CHECK(esp_timer_start_once(stationTimer, timeInUs));
+}
+
+static bool isAccessPointFound(void) {
+    if (!accessPointUp ||
+        memcmp(wifiConfig.sta.ssid, MOCK_AP_SSID, sizeof(MOCK_AP_SSID)) != 0) {
+        return false;
+    }
+
+    return !wifiConfig.sta.bssid_set ||
+           memcmp(wifiConfig.sta.bssid, MOCK_AP_BSSID, sizeof(MOCK_AP_BSSID)) ==
+               0;
+}
+
+static uint64_t getScanTimeInUs(bool found) {
+    if (wifiConfig.sta.channel != 0) {
+        return found && wifiConfig.sta.channel == MOCK_AP_CHANNEL
+                   ? MOCK_WIFI_PROBE_TIME_IN_US
+                   : MOCK_WIFI_CHANNEL_SCAN_TIME_IN_US;
+    }
+
+    // A fast scan stops at the first channel with the network
+    return (found ? MOCK_AP_CHANNEL : MOCK_WIFI_CHANNEL_COUNT) *
+           MOCK_WIFI_CHANNEL_SCAN_TIME_IN_US;
+}
+
+static void handleStationTimer(void* arg) {
+    switch (stationState) {
+    case STATION_SCANNING:
+        if (isAccessPointFound() &&
+            (wifiConfig.sta.channel == 0 ||
+             wifiConfig.sta.channel == MOCK_AP_CHANNEL)) {
+            startStationTimer(
+                STATION_ASSOCIATING, MOCK_WIFI_ASSOCIATION_TIME_IN_US);
+        } else {
+            stationState = STATION_IDLE;
+            postDisconnected(WIFI_REASON_NO_AP_FOUND);
+        }
+        break;
+    case STATION_ASSOCIATING:
+        postStationEvent(WIFI_EVENT_STA_CONNECTED, NULL, 0);
+
+        if (stationNetif.dhcpcRunning) {
+            startStationTimer(
+                STATION_WAITING_FOR_IP, MOCK_WIFI_DHCP_TIME_IN_US);
+        } else if (stationNetif.ipInfo.ip.addr != 0) {
+            startStationTimer(
+                STATION_WAITING_FOR_IP, MOCK_WIFI_STATIC_IP_TIME_IN_US);
+        } else {
+            stationState = STATION_WAITING_FOR_IP;
+        }
+        break;
+    case STATION_WAITING_FOR_IP: {
+        if (stationNetif.dhcpcRunning) {
+            stationNetif.ipInfo = (esp_netif_ip_info_t){
+                .ip = {makeAddress(192, 168, 1, 57)},
+                .netmask = {makeAddress(255, 255, 255, 0)},
+                .gw = {makeAddress(192, 168, 1, 1)}};
+            stationNetif.dnsInfo.ip.u_addr.ip4 = stationNetif.ipInfo.gw;
+            // T1 and T2 as lwIP sets them when the server leaves them out
+            stationNetif.dhcp = (struct dhcp){
+                .offered_t0_lease = leaseTimeInS,
+                .offered_t1_renew = leaseTimeInS / 2,
+                .offered_t2_rebind = leaseTimeInS / 8 * 7};
+            stationNetif.lwipNetif.dhcp = &stationNetif.dhcp;
+            ++leaseCount;
+        }
+
+        stationState = STATION_CONNECTED;
+        ip_event_got_ip_t event = {
+            .esp_netif = &stationNetif,
+            .ip_info = stationNetif.ipInfo,
+            .ip_changed = true};
+        ESP_ERROR_CHECK(esp_event_post(
+            IP_EVENT, IP_EVENT_STA_GOT_IP, &event, sizeof(event), 0));
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+esp_err_t esp_netif_init(void) { return ESP_OK; }
+
+esp_netif_t* esp_netif_create_default_wifi_sta(void) {
+    stationNetif = (esp_netif_t){.dhcpcRunning = true};
+    return &stationNetif;
+}
+
+void* esp_netif_get_netif_impl(esp_netif_t* esp_netif) {
+    return &esp_netif->lwipNetif;
+}
+
+esp_err_t esp_netif_dhcpc_start(esp_netif_t* esp_netif) {
+    if (esp_netif->dhcpcRunning) {
+        return ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED;
+    }
+
+    esp_netif->dhcpcRunning = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t* esp_netif) {
+    if (!esp_netif->dhcpcRunning) {
+        return ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED;
+    }
+
+    esp_netif->dhcpcRunning = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_ip_info(
+    esp_netif_t* esp_netif, const esp_netif_ip_info_t* ip_info) {
+    if (esp_netif->dhcpcRunning) {
+        return ESP_ERR_ESP_NETIF_DHCP_NOT_STOPPED;
+    }
+
+    esp_netif->ipInfo = *ip_info;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_ip_info(
+    esp_netif_t* esp_netif, esp_netif_ip_info_t* ip_info) {
+    *ip_info = esp_netif->ipInfo;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_dns_info(
+    esp_netif_t* esp_netif,
+    esp_netif_dns_type_t type,
+    esp_netif_dns_info_t* dns) {
+    esp_netif->dnsInfo = *dns;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_dns_info(
+    esp_netif_t* esp_netif,
+    esp_netif_dns_type_t type,
+    esp_netif_dns_info_t* dns) {
+    *dns = esp_netif->dnsInfo;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t* config) {
+    if (stationTimer) {
+        return ESP_OK;
+    }
+
+    esp_timer_create_args_t timerArgs = {
+        .callback = handleStationTimer,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "wifi"};
+    return esp_timer_create(&timerArgs, &stationTimer);
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+    return stationTimer ? ESP_OK : ESP_ERR_WIFI_NOT_INIT;
+}
+
+esp_err_t esp_wifi_get_config(esp_interface_t interface, wifi_config_t* conf) {
+    if (!stationTimer) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+
+    *conf = wifiConfig;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(esp_interface_t interface, wifi_config_t* conf) {
+    if (!stationTimer) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+
+    wifiConfig = *conf;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void) {
+    if (!stationTimer) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+
+    if (stationState != STATION_STOPPED) {
+        return ESP_OK;
+    }
+
+    radioStartTimeInUs = esp_timer_get_time();
+    vTaskDelay(pdMS_TO_TICKS(MOCK_WIFI_START_TIME_IN_US / 1000));
+    stationState = STATION_IDLE;
+    postStationEvent(WIFI_EVENT_STA_START, NULL, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void) {
+    if (!stationTimer) {
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+
+    if (stationState == STATION_STOPPED) {
+        return ESP_OK;
+    }
+
+    esp_timer_stop(stationTimer);
+    stationState = STATION_STOPPED;
+    radioOnTimeInUs += esp_timer_get_time() - radioStartTimeInUs;
+    postStationEvent(WIFI_EVENT_STA_STOP, NULL, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void) {
+    if (stationState == STATION_STOPPED) {
+        return ESP_ERR_WIFI_NOT_STARTED;
+    }
+
+    if (stationState != STATION_IDLE) {
+        return ESP_ERR_WIFI_CONN;
+    }
+
+    startStationTimer(
+        STATION_SCANNING, getScanTimeInUs(isAccessPointFound()));
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect(void) {
+    if (stationState == STATION_STOPPED) {
+        return ESP_ERR_WIFI_NOT_STARTED;
+    }
+
+    const bool associated = stationState == STATION_WAITING_FOR_IP ||
+                            stationState == STATION_CONNECTED;
+    esp_timer_stop(stationTimer);
+    stationState = STATION_IDLE;
+
+    if (associated) {
+        postDisconnected(WIFI_REASON_ASSOC_LEAVE);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type) { return ESP_OK; }
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t* ap_info) {
+    if (stationState != STATION_WAITING_FOR_IP &&
+        stationState != STATION_CONNECTED) {
+        return ESP_ERR_WIFI_NOT_CONNECT;
+    }
+
+    memset(ap_info, 0, sizeof(*ap_info));
+    memcpy(ap_info->bssid, MOCK_AP_BSSID, sizeof(ap_info->bssid));
+    memcpy(ap_info->ssid, MOCK_AP_SSID, sizeof(MOCK_AP_SSID));
+    ap_info->primary = MOCK_AP_CHANNEL;
+    ap_info->rssi = -60;
+    return ESP_OK;
+}
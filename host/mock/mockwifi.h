@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A station and one access point on channel 6, on the virtual clock and
+// with roughly the delays of an ESP32 in a home network: a scan takes 120 ms
+// per channel up to the one of the access point, unless the BSSID and
+// channel are set, associating 40 ms and DHCP 1 s, for a lease of 24 hours
+// unless set otherwise. Events go to the default event loop, whose handlers
+// run on a task of their own as in ESP-IDF. The station is provisioned with
+// the network of the access point.
+
+// Restores the provisioned config and lease time, brings the access point
+// up and clears the radio-on time and lease count
+void resetMockWifi(void);
+// While down, scans don't find the access point
+void setMockAccessPointUp(bool up);
+// For the leases that follow
+void setMockDhcpLeaseTime(uint32_t timeInS);
+// Leases given out since the reset, kept from one wake to the next
+uint32_t getMockDhcpLeaseCount(void);
+// Total time between esp_wifi_start() and esp_wifi_stop(), which is kept
+// from one wake of mockdevice.h to the next
+uint64_t getMockRadioOnTimeInUs(void);
+// Set from getting an IP until disconnecting
+bool isMockStationConnected(void);
@@ -0,0 +1,90 @@
+#include "script.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SCRIPT_MAX_FILES 4
+#define SCRIPT_PATH_SIZE 64
+#define SCRIPT_COMMAND_SIZE 512
+
+static void createTemporaryFile(char* path, const void* data, size_t size) {
+    strcpy(path, "/tmp/doorbell-scriptXXXXXX");
+    const int fd = mkstemp(path);
+    FILE* file = fd >= 0 ? fdopen(fd, "wb") : NULL;
+
+    if (!file || fwrite(data, 1, size, file) != size || fclose(file) != 0) {
+        fprintf(stderr, "Unable to write %s.\n", path);
+        abort();
+    }
+}
+
+static uint8_t* readFile(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    uint8_t* data = NULL;
+
+    if (file && fseek(file, 0, SEEK_END) == 0) {
+        const long length = ftell(file);
+        data = length >= 0 ? malloc(length > 0 ? length : 1) : NULL;
+        rewind(file);
+
+        if (data && fread(data, 1, length, file) == (size_t)length) {
+            *size = length;
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    if (file) {
+        fclose(file);
+    }
+
+    if (!data) {
+        fprintf(stderr, "Unable to read %s.\n", path);
+        abort();
+    }
+
+    return data;
+}
+
+uint8_t* runScript(
+    const char* name,
+    const ScriptFile* inputs,
+    size_t inputCount,
+    size_t* outputSize) {
+    char paths[SCRIPT_MAX_FILES + 1][SCRIPT_PATH_SIZE];
+    char command[SCRIPT_COMMAND_SIZE];
+
+    if (inputCount > SCRIPT_MAX_FILES) {
+        abort();
+    }
+
+    int length =
+        snprintf(command, sizeof(command), "python3 %s/%s", SCRIPTS_DIR, name);
+
+    for (size_t i = 0; i <= inputCount; ++i) {
+        // The output is created empty, so that its name is taken
+        createTemporaryFile(
+            paths[i], i < inputCount ? inputs[i].data : "",
+            i < inputCount ? inputs[i].size : 0);
+        length += snprintf(
+            &command[length], sizeof(command) - length, " %s", paths[i]);
+    }
+
+    const int status = system(command);
+    uint8_t* output =
+        status == 0 ? readFile(paths[inputCount], outputSize) : NULL;
+
+    for (size_t i = 0; i <= inputCount; ++i) {
+        unlink(paths[i]);
+    }
+
+    if (!output) {
+        fprintf(stderr, "%s failed (%d).\n", command, status);
+        abort();
+    }
+
+    return output;
+}
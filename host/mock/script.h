@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    const void* data;
+    size_t size;
+} ScriptFile;
+
+// Runs a Python script from scripts/ like "name input... output", with the
+// inputs and output in temporary files, so that main/ can be checked against
+// the tools that make its data. Aborts if the script fails. Returns the
+// output, which the caller frees.
+uint8_t* runScript(
+    const char* name,
+    const ScriptFile* inputs,
+    size_t inputCount,
+    size_t* outputSize);
@@ -0,0 +1,678 @@
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// mbedTLS of ESP-IDF 4.2 only speaks TLS 1.2, whose sessions are resumed
+// with the master secret
+#define SSL_SESSION_TIMEOUT_IN_S (24 * 60 * 60)
+// Tags of SSL_SESSION_ASN1 in ssl/ssl_asn1.c of OpenSSL
+#define SSL_ASN1_TICKET_LIFETIME_TAG 0xa9
+#define SSL_ASN1_TICKET_TAG 0xaa
+#define ASN1_SEQUENCE_TAG 0x30
+#define ASN1_INTEGER_TAG 0x02
+#define ASN1_OCTET_STRING_TAG 0x04
+#define ASN1_MAX_HEADER_SIZE 4
+// Of the constructed ones, as in explicit tagging
+#define ASN1_MAX_CONTEXT_TAG 0xbe
+#define CIPHERSUITE_MAX_COUNT 128
+#define CIPHERSUITE_NAME_MAX_LENGTH 64
+
+static BIO_METHOD* bioMethod = NULL;
+static mbedtls_ssl_ciphersuite_t ciphersuites[CIPHERSUITE_MAX_COUNT];
+// Of the above, terminated by 0
+static int ciphersuiteIds[CIPHERSUITE_MAX_COUNT + 1];
+
+static mbedtls_key_exchange_type_t getKeyExchange(const SSL_CIPHER* cipher) {
+    switch (SSL_CIPHER_get_kx_nid(cipher)) {
+    case NID_kx_rsa:
+        return MBEDTLS_KEY_EXCHANGE_RSA;
+    case NID_kx_dhe:
+        return MBEDTLS_KEY_EXCHANGE_DHE_RSA;
+    case NID_kx_ecdhe:
+        return SSL_CIPHER_get_auth_nid(cipher) == NID_auth_ecdsa
+                   ? MBEDTLS_KEY_EXCHANGE_ECDHE_ECDSA
+                   : MBEDTLS_KEY_EXCHANGE_ECDHE_RSA;
+    case NID_kx_psk:
+        return MBEDTLS_KEY_EXCHANGE_PSK;
+    case NID_kx_dhe_psk:
+        return MBEDTLS_KEY_EXCHANGE_DHE_PSK;
+    case NID_kx_rsa_psk:
+        return MBEDTLS_KEY_EXCHANGE_RSA_PSK;
+    case NID_kx_ecdhe_psk:
+        return MBEDTLS_KEY_EXCHANGE_ECDHE_PSK;
+    default:
+        return MBEDTLS_KEY_EXCHANGE_NONE;
+    }
+}
+
+// The default ones of OpenSSL, in its order of preference, but for those
+// of TLS 1.3
+const int* mbedtls_ssl_list_ciphersuites(void) {
+    if (ciphersuiteIds[0] != 0) {
+        return ciphersuiteIds;
+    }
+
+    SSL_CTX* context = SSL_CTX_new(TLS_client_method());
+    const STACK_OF(SSL_CIPHER)* ciphers =
+        context ? SSL_CTX_get_ciphers(context) : NULL;
+    size_t count = 0;
+
+    for (int i = 0; ciphers && i < sk_SSL_CIPHER_num(ciphers) &&
+                    count < CIPHERSUITE_MAX_COUNT;
+         ++i) {
+        const SSL_CIPHER* cipher = sk_SSL_CIPHER_value(ciphers, i);
+
+        if (SSL_CIPHER_get_kx_nid(cipher) != NID_kx_any) {
+            ciphersuites[count] = (mbedtls_ssl_ciphersuite_t){
+                .id = SSL_CIPHER_get_protocol_id(cipher),
+                .name = SSL_CIPHER_get_name(cipher),
+                .key_exchange = getKeyExchange(cipher)};
+            ciphersuiteIds[count] = ciphersuites[count].id;
+            ++count;
+        }
+    }
+
+    SSL_CTX_free(context);
+    return ciphersuiteIds;
+}
+
+const mbedtls_ssl_ciphersuite_t* mbedtls_ssl_ciphersuite_from_id(int id) {
+    mbedtls_ssl_list_ciphersuites();
+
+    for (size_t i = 0; ciphersuiteIds[i] != 0; ++i) {
+        if (ciphersuites[i].id == id) {
+            return &ciphersuites[i];
+        }
+    }
+
+    return NULL;
+}
+
+void mbedtls_x509_crt_init(mbedtls_x509_crt* crt) {
+    memset(crt, 0, sizeof(*crt));
+}
+
+int mbedtls_x509_crt_parse_der(
+    mbedtls_x509_crt* chain, const unsigned char* buf, size_t buflen) {
+    const unsigned char* next = buf;
+    X509_free(chain->openssl);
+    chain->openssl = d2i_X509(NULL, &next, buflen);
+    return chain->openssl && next == buf + buflen
+               ? 0
+               : MBEDTLS_ERR_X509_INVALID_FORMAT;
+}
+
+void mbedtls_x509_crt_free(mbedtls_x509_crt* crt) {
+    X509_free(crt->openssl);
+    crt->openssl = NULL;
+}
+
+void mbedtls_net_init(mbedtls_net_context* ctx) { ctx->fd = -1; }
+
+int mbedtls_net_send(
+    mbedtls_net_context* ctx, const unsigned char* buf, size_t len) {
+    const ssize_t sent = send(ctx->fd, buf, len, MSG_NOSIGNAL);
+    return sent >= 0 ? (int)sent : MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+int mbedtls_net_recv_timeout(
+    mbedtls_net_context* ctx, unsigned char* buf, size_t len,
+    uint32_t timeout) {
+    struct pollfd readable = {.fd = ctx->fd, .events = POLLIN};
+    const int ready = poll(&readable, 1, timeout > 0 ? (int)timeout : -1);
+
+    if (ready == 0) {
+        return MBEDTLS_ERR_SSL_TIMEOUT;
+    }
+
+    const ssize_t received = ready > 0 ? recv(ctx->fd, buf, len, 0) : -1;
+    return received >= 0 ? (int)received : MBEDTLS_ERR_NET_RECV_FAILED;
+}
+
+void mbedtls_net_free(mbedtls_net_context* ctx) {
+    if (ctx->fd >= 0) {
+        close(ctx->fd);
+    }
+
+    ctx->fd = -1;
+}
+
+void mbedtls_ssl_config_init(mbedtls_ssl_config* conf) {
+    memset(conf, 0, sizeof(*conf));
+}
+
+int mbedtls_ssl_config_defaults(
+    mbedtls_ssl_config* conf, int endpoint, int transport, int preset) {
+    if (endpoint != MBEDTLS_SSL_IS_CLIENT ||
+        transport != MBEDTLS_SSL_TRANSPORT_STREAM) {
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+
+    conf->endpoint = endpoint;
+    conf->authmode = MBEDTLS_SSL_VERIFY_REQUIRED;
+    conf->session_tickets = MBEDTLS_SSL_SESSION_TICKETS_ENABLED;
+    return 0;
+}
+
+void mbedtls_ssl_config_free(mbedtls_ssl_config* conf) {
+    if (conf->psk) {
+        memset(conf->psk, 0, conf->psk_len);
+    }
+
+    free(conf->psk);
+    free(conf->psk_identity);
+    memset(conf, 0, sizeof(*conf));
+}
+
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config* conf, int authmode) {
+    conf->authmode = authmode;
+}
+
+void mbedtls_ssl_conf_ca_chain(
+    mbedtls_ssl_config* conf, mbedtls_x509_crt* ca_chain, void* ca_crl) {
+    conf->ca_chain = ca_chain;
+}
+
+void mbedtls_ssl_conf_rng(
+    mbedtls_ssl_config* conf,
+    int (*f_rng)(void* context, unsigned char* output, size_t length),
+    void* p_rng) {}
+
+void mbedtls_ssl_conf_session_tickets(
+    mbedtls_ssl_config* conf, int use_tickets) {
+    conf->session_tickets = use_tickets;
+}
+
+void mbedtls_ssl_conf_ciphersuites(
+    mbedtls_ssl_config* conf, const int* ciphersuites) {
+    conf->ciphersuite_list = ciphersuites;
+}
+
+int mbedtls_ssl_conf_psk(
+    mbedtls_ssl_config* conf, const unsigned char* psk, size_t psk_len,
+    const unsigned char* psk_identity, size_t psk_identity_len) {
+    if (conf->psk || psk_len == 0 || psk_identity_len == 0) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    conf->psk = malloc(psk_len);
+    conf->psk_identity = malloc(psk_identity_len);
+
+    if (!conf->psk || !conf->psk_identity) {
+        free(conf->psk);
+        free(conf->psk_identity);
+        conf->psk = NULL;
+        conf->psk_identity = NULL;
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    memcpy(conf->psk, psk, psk_len);
+    conf->psk_len = psk_len;
+    memcpy(conf->psk_identity, psk_identity, psk_identity_len);
+    conf->psk_identity_len = psk_identity_len;
+    return 0;
+}
+
+static int writeBio(BIO* bio, const char* data, int length) {
+    mbedtls_ssl_context* ssl = BIO_get_data(bio);
+    const int ret =
+        ssl->f_send(ssl->p_bio, (const unsigned char*)data, length);
+    BIO_clear_retry_flags(bio);
+
+    if (ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        BIO_set_retry_write(bio);
+        return -1;
+    }
+
+    if (ret < 0) {
+        ssl->bio_error = ret;
+        return -1;
+    }
+
+    return ret;
+}
+
+static int readBio(BIO* bio, char* data, int size) {
+    mbedtls_ssl_context* ssl = BIO_get_data(bio);
+    const int ret = ssl->f_recv(ssl->p_bio, (unsigned char*)data, size);
+    BIO_clear_retry_flags(bio);
+
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ) {
+        BIO_set_retry_read(bio);
+        return -1;
+    }
+
+    if (ret < 0) {
+        ssl->bio_error = ret;
+        return -1;
+    }
+
+    return ret;
+}
+
+static long controlBio(BIO* bio, int command, long number, void* pointer) {
+    return command == BIO_CTRL_FLUSH ? 1 : 0;
+}
+
+static int createBio(BIO* bio) {
+    BIO_set_init(bio, 1);
+    return 1;
+}
+
+// Sends and receives through the callbacks of mbedtls_ssl_set_bio()
+static BIO_METHOD* getBioMethod(void) {
+    if (!bioMethod) {
+        bioMethod = BIO_meth_new(
+            BIO_get_new_index() | BIO_TYPE_SOURCE_SINK, "mbedtls_ssl_bio");
+        BIO_meth_set_write(bioMethod, writeBio);
+        BIO_meth_set_read(bioMethod, readBio);
+        BIO_meth_set_ctrl(bioMethod, controlBio);
+        BIO_meth_set_create(bioMethod, createBio);
+    }
+
+    return bioMethod;
+}
+
+static unsigned int getPsk(
+    SSL* openssl,
+    const char* hint,
+    char* identity,
+    unsigned int maxIdentityLength,
+    unsigned char* psk,
+    unsigned int maxPskLength) {
+    const mbedtls_ssl_context* ssl = SSL_get_app_data(openssl);
+    const mbedtls_ssl_config* conf = ssl->conf;
+
+    if (conf->psk_identity_len >= maxIdentityLength ||
+        conf->psk_len > maxPskLength) {
+        return 0;
+    }
+
+    memcpy(identity, conf->psk_identity, conf->psk_identity_len);
+    identity[conf->psk_identity_len] = '\0';
+    memcpy(psk, conf->psk, conf->psk_len);
+    return conf->psk_len;
+}
+
+// As an OpenSSL cipher list
+static bool setCiphersuites(SSL_CTX* context, const int* ids) {
+    size_t count = 0;
+
+    while (ids[count] != 0) {
+        ++count;
+    }
+
+    char* list = calloc(count + 1, CIPHERSUITE_NAME_MAX_LENGTH);
+    size_t length = 0;
+
+    for (size_t i = 0; list && i < count; ++i) {
+        const mbedtls_ssl_ciphersuite_t* info =
+            mbedtls_ssl_ciphersuite_from_id(ids[i]);
+
+        if (info) {
+            length += snprintf(
+                &list[length], CIPHERSUITE_NAME_MAX_LENGTH, "%s%s",
+                length > 0 ? ":" : "", info->name);
+        }
+    }
+
+    const bool set = list && SSL_CTX_set_cipher_list(context, list) == 1;
+    free(list);
+    return set;
+}
+
+void mbedtls_ssl_init(mbedtls_ssl_context* ssl) {
+    memset(ssl, 0, sizeof(*ssl));
+}
+
+int mbedtls_ssl_setup(
+    mbedtls_ssl_context* ssl, const mbedtls_ssl_config* conf) {
+    SSL_CTX* context = SSL_CTX_new(TLS_client_method());
+
+    if (!context) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(context, TLS1_2_VERSION);
+    // mbedtls_ssl_session has nowhere to keep it
+    SSL_CTX_set_options(context, SSL_OP_NO_EXTENDED_MASTER_SECRET);
+
+    if (conf->session_tickets != MBEDTLS_SSL_SESSION_TICKETS_ENABLED) {
+        SSL_CTX_set_options(context, SSL_OP_NO_TICKET);
+    }
+
+    if (conf->ciphersuite_list &&
+        !setCiphersuites(context, conf->ciphersuite_list)) {
+        SSL_CTX_free(context);
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (conf->psk) {
+        SSL_CTX_set_psk_client_callback(context, getPsk);
+    }
+
+    if (conf->ca_chain && conf->ca_chain->openssl) {
+        X509_STORE_add_cert(
+            SSL_CTX_get_cert_store(context), conf->ca_chain->openssl);
+    }
+
+    SSL_CTX_set_verify(
+        context,
+        conf->authmode == MBEDTLS_SSL_VERIFY_REQUIRED ? SSL_VERIFY_PEER
+                                                      : SSL_VERIFY_NONE,
+        NULL);
+
+    ssl->conf = conf;
+    ssl->openssl = SSL_new(context);
+    // Kept alive by the SSL
+    SSL_CTX_free(context);
+
+    if (!ssl->openssl) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    BIO* bio = BIO_new(getBioMethod());
+
+    if (!bio) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    SSL_set_app_data(ssl->openssl, ssl);
+    BIO_set_data(bio, ssl);
+    SSL_set_bio(ssl->openssl, bio, bio);
+    return 0;
+}
+
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context* ssl, const char* hostname) {
+    if (!SSL_set_tlsext_host_name(ssl->openssl, hostname) ||
+        !SSL_set1_host(ssl->openssl, hostname)) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    return 0;
+}
+
+void mbedtls_ssl_set_bio(
+    mbedtls_ssl_context* ssl, void* p_bio, mbedtls_ssl_send_t* f_send,
+    mbedtls_ssl_recv_t* f_recv, mbedtls_ssl_recv_timeout_t* f_recv_timeout) {
+    ssl->p_bio = p_bio;
+    ssl->f_send = f_send;
+    ssl->f_recv = f_recv;
+}
+
+static size_t getDerHeaderSize(const unsigned char* element) {
+    return element[1] & 0x80 ? 2 + (element[1] & 0x7f) : 2;
+}
+
+static size_t getDerSize(const unsigned char* element) {
+    size_t length = element[1];
+
+    if (element[1] & 0x80) {
+        length = 0;
+
+        for (size_t i = 0; i < (element[1] & 0x7f); ++i) {
+            length = length << 8 | element[2 + i];
+        }
+    }
+
+    return getDerHeaderSize(element) + length;
+}
+
+static size_t putDerLength(unsigned char* output, size_t length) {
+    if (length < 0x80) {
+        output[0] = length;
+        return 1;
+    }
+
+    if (length < 0x100) {
+        output[0] = 0x81;
+        output[1] = length;
+        return 2;
+    }
+
+    output[0] = 0x82;
+    output[1] = length >> 8;
+    output[2] = length;
+    return 3;
+}
+
+static size_t putDer(
+    unsigned char* output,
+    unsigned char tag,
+    const unsigned char* content,
+    size_t length) {
+    output[0] = tag;
+    const size_t headerSize = 1 + putDerLength(&output[1], length);
+    memmove(&output[headerSize], content, length);
+    return headerSize + length;
+}
+
+// Explicitly tagged, as in SSL_SESSION_ASN1
+static size_t putDerOctets(
+    unsigned char* output,
+    unsigned char tag,
+    const unsigned char* content,
+    size_t length) {
+    unsigned char* inner = malloc(length + ASN1_MAX_HEADER_SIZE);
+    const size_t innerSize =
+        putDer(inner, ASN1_OCTET_STRING_TAG, content, length);
+    const size_t size = putDer(output, tag, inner, innerSize);
+    free(inner);
+    return size;
+}
+
+static size_t
+putDerInteger(unsigned char* output, unsigned char tag, uint32_t value) {
+    // Leads with a zero byte so that it stays positive
+    unsigned char bytes[5] = {
+        0, value >> 24, value >> 16, value >> 8, value};
+    size_t start = 0;
+
+    while (start < sizeof(bytes) - 1 && bytes[start] == 0 &&
+           !(bytes[start + 1] & 0x80)) {
+        ++start;
+    }
+
+    unsigned char inner[ASN1_MAX_HEADER_SIZE + sizeof(bytes)];
+    const size_t innerSize = putDer(
+        inner, ASN1_INTEGER_TAG, &bytes[start], sizeof(bytes) - start);
+    return putDer(output, tag, inner, innerSize);
+}
+
+// OpenSSL has no setter for the ticket of a session, so the session is
+// encoded with the fields it has setters for and the ticket is appended
+// to the encoding
+static SSL_SESSION*
+decodeSession(SSL* ssl, const mbedtls_ssl_session* session) {
+    const unsigned char cipherId[2] = {
+        session->ciphersuite >> 8, session->ciphersuite};
+    const SSL_CIPHER* cipher = SSL_CIPHER_find(ssl, cipherId);
+    SSL_SESSION* fields = SSL_SESSION_new();
+
+    if (!cipher || !fields || !SSL_SESSION_set_cipher(fields, cipher) ||
+        !SSL_SESSION_set_protocol_version(fields, TLS1_2_VERSION) ||
+        !SSL_SESSION_set1_id(fields, session->id, session->id_len) ||
+        !SSL_SESSION_set1_master_key(
+            fields, session->master, sizeof(session->master))) {
+        SSL_SESSION_free(fields);
+        return NULL;
+    }
+
+    SSL_SESSION_set_time(fields, time(NULL));
+    SSL_SESSION_set_timeout(fields, SSL_SESSION_TIMEOUT_IN_S);
+
+    const size_t fieldsSize = i2d_SSL_SESSION(fields, NULL);
+    unsigned char* encodedFields = malloc(fieldsSize);
+    unsigned char* next = encodedFields;
+    i2d_SSL_SESSION(fields, &next);
+    SSL_SESSION_free(fields);
+
+    // The fields of the sequence are in the order of their tags, so the
+    // ticket goes in before the first one tagged higher
+    const size_t headerSize = getDerHeaderSize(encodedFields);
+    const unsigned char* fieldsContent = &encodedFields[headerSize];
+    const size_t fieldsContentSize = fieldsSize - headerSize;
+    size_t split = 0;
+
+    while (split < fieldsContentSize &&
+           !(fieldsContent[split] > SSL_ASN1_TICKET_TAG &&
+             fieldsContent[split] <= ASN1_MAX_CONTEXT_TAG)) {
+        split += getDerSize(&fieldsContent[split]);
+    }
+
+    const size_t maxSize =
+        fieldsSize + session->ticket_len + 8 * ASN1_MAX_HEADER_SIZE;
+    unsigned char* encoded = malloc(maxSize);
+    unsigned char* content = &encoded[ASN1_MAX_HEADER_SIZE];
+    memcpy(content, fieldsContent, split);
+    size_t size = split;
+
+    if (session->ticket_lifetime > 0) {
+        size += putDerInteger(
+            &content[size], SSL_ASN1_TICKET_LIFETIME_TAG,
+            session->ticket_lifetime);
+    }
+
+    if (session->ticket && session->ticket_len > 0) {
+        size += putDerOctets(
+            &content[size], SSL_ASN1_TICKET_TAG, session->ticket,
+            session->ticket_len);
+    }
+
+    memcpy(&content[size], &fieldsContent[split], fieldsContentSize - split);
+    size += fieldsContentSize - split;
+    free(encodedFields);
+
+    size = putDer(encoded, ASN1_SEQUENCE_TAG, content, size);
+    const unsigned char* input = encoded;
+    SSL_SESSION* decoded = d2i_SSL_SESSION(NULL, &input, size);
+    free(encoded);
+    return decoded;
+}
+
+int mbedtls_ssl_set_session(
+    mbedtls_ssl_context* ssl, const mbedtls_ssl_session* session) {
+    SSL_SESSION* decoded = decodeSession(ssl->openssl, session);
+    const int ret = decoded && SSL_set_session(ssl->openssl, decoded)
+                        ? 0
+                        : MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    SSL_SESSION_free(decoded);
+    return ret;
+}
+
+static void freeSession(mbedtls_ssl_session* session) {
+    if (session) {
+        free(session->ticket);
+        memset(session, 0, sizeof(*session));
+        free(session);
+    }
+}
+
+// Copies the session that OpenSSL negotiated to ssl->session
+static int exportSession(mbedtls_ssl_context* ssl) {
+    const SSL_SESSION* negotiated = SSL_get_session(ssl->openssl);
+    mbedtls_ssl_session* session = calloc(1, sizeof(*session));
+
+    if (!negotiated || !session) {
+        free(session);
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    unsigned int idLength = 0;
+    const unsigned char* id = SSL_SESSION_get_id(negotiated, &idLength);
+    const unsigned char* ticket = NULL;
+    size_t ticketLength = 0;
+    SSL_SESSION_get0_ticket(negotiated, &ticket, &ticketLength);
+
+    session->ciphersuite =
+        SSL_CIPHER_get_protocol_id(SSL_SESSION_get0_cipher(negotiated));
+    session->id_len = idLength < sizeof(session->id) ? idLength
+                                                     : sizeof(session->id);
+    memcpy(session->id, id, session->id_len);
+    SSL_SESSION_get_master_key(
+        negotiated, session->master, sizeof(session->master));
+    session->ticket_lifetime =
+        SSL_SESSION_get_ticket_lifetime_hint(negotiated);
+
+    if (ticketLength > 0) {
+        session->ticket = malloc(ticketLength);
+        memcpy(session->ticket, ticket, ticketLength);
+        session->ticket_len = ticketLength;
+    }
+
+    freeSession(ssl->session);
+    ssl->session = session;
+    return 0;
+}
+
+static int translateError(mbedtls_ssl_context* ssl, int ret) {
+    const int error = SSL_get_error(ssl->openssl, ret);
+    const int bioError = ssl->bio_error;
+    ssl->bio_error = 0;
+
+    switch (error) {
+    case SSL_ERROR_WANT_READ:
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    case SSL_ERROR_WANT_WRITE:
+        return MBEDTLS_ERR_SSL_WANT_WRITE;
+    case SSL_ERROR_ZERO_RETURN:
+        return MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY;
+    }
+
+    ERR_clear_error();
+
+    if (bioError != 0) {
+        return bioError;
+    }
+
+    if (SSL_get_verify_result(ssl->openssl) != X509_V_OK) {
+        return MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;
+    }
+
+    return error == SSL_ERROR_SYSCALL ? MBEDTLS_ERR_SSL_CONN_EOF
+                                      : MBEDTLS_ERR_SSL_FATAL_ALERT_MESSAGE;
+}
+
+int mbedtls_ssl_handshake(mbedtls_ssl_context* ssl) {
+    const int ret = SSL_connect(ssl->openssl);
+
+    if (ret != 1) {
+        return translateError(ssl, ret);
+    }
+
+    return exportSession(ssl);
+}
+
+int mbedtls_ssl_read(mbedtls_ssl_context* ssl, unsigned char* buf, size_t len) {
+    const int ret = SSL_read(ssl->openssl, buf, len);
+    return ret > 0 ? ret : translateError(ssl, ret);
+}
+
+int mbedtls_ssl_write(
+    mbedtls_ssl_context* ssl, const unsigned char* buf, size_t len) {
+    const int ret = SSL_write(ssl->openssl, buf, len);
+    return ret > 0 ? ret : translateError(ssl, ret);
+}
+
+int mbedtls_ssl_close_notify(mbedtls_ssl_context* ssl) {
+    const int ret = SSL_shutdown(ssl->openssl);
+    return ret >= 0 ? 0 : translateError(ssl, ret);
+}
+
+void mbedtls_ssl_free(mbedtls_ssl_context* ssl) {
+    SSL_free(ssl->openssl);
+    freeSession(ssl->session);
+    memset(ssl, 0, sizeof(*ssl));
+}
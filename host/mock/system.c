@@ -0,0 +1,49 @@
+#include "mocksystem.h"
+
+#include <esp_system.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bounds of the section RTC_DATA_ATTR puts variables in, from the linker.
+// Weak, as the section is missing if a test links nothing that uses it.
+extern char __start_rtc_data[] __attribute__((weak));
+extern char __stop_rtc_data[] __attribute__((weak));
+
+static uint32_t randomState = 0x12345678;
+// Of Espressif, as on the chip
+static const uint8_t MAC_ADDRESS[6] = {0x24, 0x0a, 0xc4, 0x00, 0x00, 0x01};
+
+void esp_restart(void) {
+    fprintf(stderr, "esp_restart() called.\n");
+    abort();
+}
+
+uint32_t esp_random(void) {
+    // xorshift32
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+void esp_fill_random(void* buf, size_t len) {
+    uint8_t* bytes = buf;
+
+    for (size_t i = 0; i < len; ++i) {
+        bytes[i] = esp_random();
+    }
+}
+
+esp_err_t esp_read_mac(uint8_t* mac, esp_mac_type_t type) {
+    memcpy(mac, MAC_ADDRESS, sizeof(MAC_ADDRESS));
+    return ESP_OK;
+}
+
+void resetRtcMemory(void) {
+    if (!__start_rtc_data) {
+        return;
+    }
+
+    memset(__start_rtc_data, 0, __stop_rtc_data - __start_rtc_data);
+}
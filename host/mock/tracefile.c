@@ -0,0 +1,56 @@
+#include "tracefile.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+size_t readTraceFile(
+    const char* name, int64_t* values, size_t columnCount, size_t maxRows) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", TRACE_DIR, name);
+    FILE* file = fopen(path, "r");
+
+    if (!file) {
+        fprintf(stderr, "Unable to open %s.\n", path);
+        abort();
+    }
+
+    char line[256];
+    size_t rowCount = 0;
+    unsigned int lineNumber = 0;
+
+    while (fgets(line, sizeof(line), file)) {
+        ++lineNumber;
+
+        if (line[0] == '#' || line[strspn(line, " \r\n")] == '\0') {
+            continue;
+        }
+
+        if (rowCount == maxRows) {
+            fprintf(stderr, "%s has more than %zu rows.\n", path, maxRows);
+            abort();
+        }
+
+        char* cursor = line;
+
+        for (size_t column = 0; column < columnCount; ++column) {
+            char* end;
+            values[rowCount * columnCount + column] =
+                strtoll(cursor, &end, 10);
+
+            if (end == cursor ||
+                (column + 1 < columnCount ? *end != ',' : *end == ',')) {
+                fprintf(stderr, "%s:%u: Malformed row.\n", path, lineNumber);
+                abort();
+            }
+
+            cursor = end + 1;
+        }
+
+        ++rowCount;
+    }
+
+    fclose(file);
+    return rowCount;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Reads rows of comma separated integers from a file in host/traces into
+// values, row after row. Lines starting with # are comments. Aborts if the
+// file can't be read or a row doesn't have the given number of columns.
+// Returns the number of rows read.
+size_t readTraceFile(
+    const char* name, int64_t* values, size_t columnCount, size_t maxRows);
@@ -0,0 +1,155 @@
+#include "virtualclock.h"
+#include "clock.h"
+#include "virtualtasks.h"
+
+#include <esp_timer.h>
+
+#define VIRTUAL_TIMER_MAX_COUNT 16
+
+struct esp_timer {
+    bool created;
+    bool armed;
+    esp_timer_cb_t callback;
+    void* arg;
+    uint64_t deadlineInUs;
+    // 0 for one-shot timers
+    uint64_t periodInUs;
+};
+
+static uint64_t clockTimeInUs = 0;
+static uint64_t bootTimeInUs = 0;
+static struct esp_timer timers[VIRTUAL_TIMER_MAX_COUNT];
+static bool timerRunning = false;
+
+uint64_t getClockTimeInUs(void) { return clockTimeInUs; }
+
+int64_t esp_timer_get_time(void) {
+    return (int64_t)(clockTimeInUs - bootTimeInUs);
+}
+
+void resetVirtualClock(uint64_t timeInUs) {
+    clockTimeInUs = timeInUs;
+    bootVirtualClock();
+}
+
+void bootVirtualClock(void) {
+    bootTimeInUs = clockTimeInUs;
+
+    for (size_t i = 0; i < VIRTUAL_TIMER_MAX_COUNT; ++i) {
+        timers[i].armed = false;
+    }
+}
+
+static struct esp_timer* findNextTimer(void) {
+    struct esp_timer* next = NULL;
+
+    for (size_t i = 0; i < VIRTUAL_TIMER_MAX_COUNT; ++i) {
+        struct esp_timer* timer = &timers[i];
+        if (timer->armed &&
+            (!next || timer->deadlineInUs < next->deadlineInUs)) {
+            next = timer;
+        }
+    }
+
+    return next;
+}
+
+uint64_t getNextVirtualTimerDeadline(void) {
+    const struct esp_timer* timer = findNextTimer();
+    return timer ? timer->deadlineInUs : UINT64_MAX;
+}
+
+bool isVirtualTimerRunning(void) { return timerRunning; }
+
+bool runNextVirtualTimer(uint64_t maxDurationInUs) {
+    struct esp_timer* timer = findNextTimer();
+
+    if (!timer || (timer->deadlineInUs > clockTimeInUs &&
+                   timer->deadlineInUs - clockTimeInUs > maxDurationInUs)) {
+        return false;
+    }
+
+    if (timer->deadlineInUs > clockTimeInUs) {
+        clockTimeInUs = timer->deadlineInUs;
+    }
+
+    // The callback may stop or restart the timer
+    if (timer->periodInUs > 0) {
+        timer->deadlineInUs += timer->periodInUs;
+    } else {
+        timer->armed = false;
+    }
+
+    timerRunning = true;
+    timer->callback(timer->arg);
+    timerRunning = false;
+    return true;
+}
+
+void advanceVirtualClock(uint64_t durationInUs) {
+    const uint64_t endInUs = clockTimeInUs + durationInUs;
+
+    // The caller is busy, but tasks that the timers wake may preempt it
+    while (runNextVirtualTimer(endInUs - clockTimeInUs)) {
+        yieldToHigherPriorityTask();
+    }
+
+    clockTimeInUs = endInUs;
+}
+
+esp_err_t esp_timer_create(
+    const esp_timer_create_args_t* create_args,
+    esp_timer_handle_t* out_handle) {
+    for (size_t i = 0; i < VIRTUAL_TIMER_MAX_COUNT; ++i) {
+        struct esp_timer* timer = &timers[i];
+
+        if (!timer->created) {
+            timer->created = true;
+            timer->armed = false;
+            timer->callback = create_args->callback;
+            timer->arg = create_args->arg;
+            *out_handle = timer;
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NO_MEM;
+}
+
+static esp_err_t
+startTimer(esp_timer_handle_t timer, uint64_t timeoutInUs, uint64_t period) {
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->armed = true;
+    timer->deadlineInUs = clockTimeInUs + timeoutInUs;
+    timer->periodInUs = period;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return startTimer(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    return startTimer(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->armed = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (timer->armed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    timer->created = false;
+    return ESP_OK;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Replaces clock.c and esp_timer. Time only passes when a test advances it
+// or every task waits, see virtualtasks.h, and timers fire in deadline order
+// as it passes them. They run on whichever task let the time pass.
+
+// Starts over at the given RTC time, e.g. after a cold boot
+void resetVirtualClock(uint64_t timeInUs);
+// Like a wake from deep sleep: the RTC time carries on while esp_timer
+// starts from 0 and its timers are gone
+void bootVirtualClock(void);
+void advanceVirtualClock(uint64_t durationInUs);
+// Advances to the next timer deadline, if it's within the duration, and
+// fires the timer. Returns false if no timer is due.
+bool runNextVirtualTimer(uint64_t maxDurationInUs);
+// UINT64_MAX if no timer is armed
+uint64_t getNextVirtualTimerDeadline(void);
+// Set while a timer callback runs, which must not wait
+bool isVirtualTimerRunning(void);
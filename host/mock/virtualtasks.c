@@ -0,0 +1,632 @@
+#include "virtualtasks.h"
+#include "clock.h"
+#include "virtualclock.h"
+
+#include <esp_task.h>
+#include <freertos/event_groups.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define VIRTUAL_TASK_MAX_COUNT 32
+// Code built for the host needs more stack than on the chip, so the stack
+// sizes given to FreeRTOS are only checked against
+#define VIRTUAL_TASK_STACK_SIZE (512 * 1024)
+#define VIRTUAL_SEMAPHORE_MAX_COUNT 32
+#define VIRTUAL_QUEUE_MAX_COUNT 16
+#define VIRTUAL_EVENT_GROUP_MAX_COUNT 8
+
+struct VirtualTask {
+    bool created;
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t priority;
+    uint32_t stackDepth;
+    TaskFunction_t function;
+    void* parameter;
+    // Set while waiting until it returns true or the deadline passes
+    bool (*isDone)(const struct VirtualTask* task);
+    void* waitObject;
+    uint64_t deadlineInUs;
+    // Of a wait for an event group, which decides when setting the bits
+    EventBits_t waitBits;
+    bool waitForAll;
+    bool clearOnExit;
+    bool released;
+    EventBits_t releasedBits;
+    // Tasks of the same priority take turns in the order they stopped
+    // running, as the ready lists of FreeRTOS do
+    uint64_t sequence;
+};
+
+struct VirtualSemaphore {
+    bool created;
+    bool isStatic;
+    uint32_t count;
+};
+
+struct VirtualQueue {
+    bool created;
+    uint8_t* storage;
+    bool ownsStorage;
+    size_t itemSize;
+    size_t length;
+    size_t head;
+    size_t count;
+};
+
+struct VirtualEventGroup {
+    bool created;
+    EventBits_t bits;
+};
+
+_Static_assert(
+    sizeof(struct VirtualSemaphore) <= sizeof(StaticSemaphore_t),
+    "StaticSemaphore_t must hold a semaphore");
+
+static struct VirtualTask tasks[VIRTUAL_TASK_MAX_COUNT];
+static struct VirtualSemaphore semaphores[VIRTUAL_SEMAPHORE_MAX_COUNT];
+static struct VirtualQueue queues[VIRTUAL_QUEUE_MAX_COUNT];
+static struct VirtualEventGroup eventGroups[VIRTUAL_EVENT_GROUP_MAX_COUNT];
+
+// Only the thread of the running task goes on, the others wait for the
+// condition until they are switched to
+static struct VirtualTask* runningTask = NULL;
+static pthread_mutex_t switchLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t taskSwitched = PTHREAD_COND_INITIALIZER;
+// Set while looking for the next task, when timers may run
+static bool scheduling = false;
+static uint64_t nextSequence = 0;
+
+static struct VirtualTask*
+allocateTask(const char* name, UBaseType_t priority) {
+    for (size_t i = 0; i < VIRTUAL_TASK_MAX_COUNT; ++i) {
+        struct VirtualTask* task = &tasks[i];
+
+        if (!task->created) {
+            memset(task, 0, sizeof(*task));
+            task->created = true;
+            strncpy(task->name, name, sizeof(task->name) - 1);
+            // vTaskPrioritySet() asserts, but creating a task clamps
+            task->priority = priority < configMAX_PRIORITIES
+                                 ? priority
+                                 : configMAX_PRIORITIES - 1;
+            task->sequence = ++nextSequence;
+            return task;
+        }
+    }
+
+    return NULL;
+}
+
+static struct VirtualTask* getRunningTask(void) {
+    if (!runningTask) {
+        runningTask = allocateTask("main", ESP_TASK_MAIN_PRIO);
+        runningTask->stackDepth = ESP_TASK_MAIN_STACK;
+    }
+
+    return runningTask;
+}
+
+static bool isWaiting(const struct VirtualTask* task) {
+    return task->isDone && !task->isDone(task) &&
+           getClockTimeInUs() < task->deadlineInUs;
+}
+
+static bool isBefore(
+    const struct VirtualTask* task, const struct VirtualTask* other) {
+    return task->priority > other->priority ||
+           (task->priority == other->priority &&
+            task->sequence < other->sequence);
+}
+
+static struct VirtualTask* findReadyTask(void) {
+    struct VirtualTask* next = NULL;
+
+    for (size_t i = 0; i < VIRTUAL_TASK_MAX_COUNT; ++i) {
+        struct VirtualTask* task = &tasks[i];
+
+        if (task->created && !isWaiting(task) &&
+            (!next || isBefore(task, next))) {
+            next = task;
+        }
+    }
+
+    return next;
+}
+
+static uint64_t getNextTaskDeadline(void) {
+    uint64_t deadline = UINT64_MAX;
+
+    for (size_t i = 0; i < VIRTUAL_TASK_MAX_COUNT; ++i) {
+        const struct VirtualTask* task = &tasks[i];
+
+        if (task->created && task->isDone && task->deadlineInUs < deadline) {
+            deadline = task->deadlineInUs;
+        }
+    }
+
+    return deadline;
+}
+
+static void abortOnDeadlock(void) {
+    fprintf(stderr, "Deadlock: waiting forever without timers in");
+
+    for (size_t i = 0; i < VIRTUAL_TASK_MAX_COUNT; ++i) {
+        if (tasks[i].created) {
+            fprintf(stderr, " \"%s\"", tasks[i].name);
+        }
+    }
+
+    fprintf(stderr, ".\n");
+    abort();
+}
+
+// Lets time pass while every task waits
+static struct VirtualTask* waitForReadyTask(void) {
+    struct VirtualTask* next = NULL;
+    scheduling = true;
+
+    while (!(next = findReadyTask())) {
+        const uint64_t timerDeadline = getNextVirtualTimerDeadline();
+        const uint64_t taskDeadline = getNextTaskDeadline();
+
+        if (timerDeadline == UINT64_MAX && taskDeadline == UINT64_MAX) {
+            abortOnDeadlock();
+        }
+
+        if (timerDeadline <= taskDeadline) {
+            runNextVirtualTimer(UINT64_MAX);
+        } else {
+            advanceVirtualClock(taskDeadline - getClockTimeInUs());
+        }
+    }
+
+    scheduling = false;
+    return next;
+}
+
+static void handOver(struct VirtualTask* next) {
+    pthread_mutex_lock(&switchLock);
+    runningTask = next;
+    pthread_cond_broadcast(&taskSwitched);
+    pthread_mutex_unlock(&switchLock);
+}
+
+static void waitUntilRunning(struct VirtualTask* task) {
+    pthread_mutex_lock(&switchLock);
+    while (runningTask != task) {
+        pthread_cond_wait(&taskSwitched, &switchLock);
+    }
+    pthread_mutex_unlock(&switchLock);
+}
+
+static void switchTo(struct VirtualTask* next) {
+    struct VirtualTask* self = getRunningTask();
+
+    if (next == self) {
+        return;
+    }
+
+    self->sequence = ++nextSequence;
+    handOver(next);
+    waitUntilRunning(self);
+}
+
+void yieldToHigherPriorityTask(void) {
+    if (scheduling || isVirtualTimerRunning() || !runningTask) {
+        return;
+    }
+
+    struct VirtualTask* next = findReadyTask();
+
+    if (next && next->priority > runningTask->priority) {
+        switchTo(next);
+    }
+}
+
+// Returns false if the deadline passed first. Checks on the condition
+// without waiting are left to the callers, as timers may make them.
+static bool waitFor(
+    bool (*isDone)(const struct VirtualTask* task),
+    void* object,
+    TickType_t ticks) {
+    if (ticks == 0) {
+        return false;
+    }
+
+    if (isVirtualTimerRunning()) {
+        fprintf(stderr, "Timer callbacks must not wait.\n");
+        abort();
+    }
+
+    struct VirtualTask* self = getRunningTask();
+    self->isDone = isDone;
+    self->waitObject = object;
+    self->deadlineInUs = ticks == portMAX_DELAY
+                             ? UINT64_MAX
+                             : getClockTimeInUs() + ticks * 1000ULL;
+    switchTo(waitForReadyTask());
+
+    const bool done = isDone(self);
+    self->isDone = NULL;
+    self->waitObject = NULL;
+    return done;
+}
+
+size_t getVirtualTaskCount(void) {
+    size_t count = 0;
+
+    for (size_t i = 0; i < VIRTUAL_TASK_MAX_COUNT; ++i) {
+        count += tasks[i].created;
+    }
+
+    return count;
+}
+
+static void deleteRunningTask(void) {
+    getRunningTask()->created = false;
+    handOver(waitForReadyTask());
+}
+
+static void* runTaskThread(void* argument) {
+    struct VirtualTask* task = argument;
+
+    waitUntilRunning(task);
+    task->function(task->parameter);
+    // Returning isn't allowed by FreeRTOS, but deleting is
+    deleteRunningTask();
+    return NULL;
+}
+
+static TaskHandle_t startTask(
+    TaskFunction_t function,
+    const char* name,
+    uint32_t stackDepth,
+    void* parameter,
+    UBaseType_t priority) {
+    if (stackDepth > VIRTUAL_TASK_STACK_SIZE) {
+        return NULL;
+    }
+
+    // The creator runs first
+    getRunningTask();
+    struct VirtualTask* task = allocateTask(name, priority);
+
+    if (!task) {
+        return NULL;
+    }
+
+    task->function = function;
+    task->parameter = parameter;
+    task->stackDepth = stackDepth;
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, VIRTUAL_TASK_STACK_SIZE);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    const int error =
+        pthread_create(&thread, &attributes, runTaskThread, task);
+    pthread_attr_destroy(&attributes);
+
+    if (error != 0) {
+        task->created = false;
+        return NULL;
+    }
+
+    yieldToHigherPriorityTask();
+    return task;
+}
+
+BaseType_t xTaskCreate(
+    TaskFunction_t function,
+    const char* name,
+    uint32_t stackDepth,
+    void* parameter,
+    UBaseType_t priority,
+    TaskHandle_t* createdTask) {
+    return xTaskCreatePinnedToCore(
+        function, name, stackDepth, parameter, priority, createdTask, 0);
+}
+
+BaseType_t xTaskCreatePinnedToCore(
+    TaskFunction_t function,
+    const char* name,
+    uint32_t stackDepth,
+    void* parameter,
+    UBaseType_t priority,
+    TaskHandle_t* createdTask,
+    BaseType_t core) {
+    TaskHandle_t task =
+        startTask(function, name, stackDepth, parameter, priority);
+
+    if (createdTask) {
+        *createdTask = task;
+    }
+
+    return task ? pdPASS : pdFALSE;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(
+    TaskFunction_t function,
+    const char* name,
+    uint32_t stackDepth,
+    void* parameter,
+    UBaseType_t priority,
+    StackType_t* stack,
+    StaticTask_t* taskBuffer,
+    BaseType_t core) {
+    taskBuffer->handle =
+        startTask(function, name, stackDepth, parameter, priority);
+    return taskBuffer->handle;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task && task != getRunningTask()) {
+        fprintf(stderr, "Tasks can only delete themselves.\n");
+        abort();
+    }
+
+    deleteRunningTask();
+    pthread_exit(NULL);
+}
+
+static bool isNeverDone(const struct VirtualTask* task) { return false; }
+
+void vTaskDelay(TickType_t ticks) { waitFor(isNeverDone, NULL, ticks); }
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) {
+    if (priority >= configMAX_PRIORITIES) {
+        fprintf(stderr, "Priority %u is out of range.\n", priority);
+        abort();
+    }
+
+    (task ? task : getRunningTask())->priority = priority;
+    yieldToHigherPriorityTask();
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    return (task ? task : getRunningTask())->priority;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return getRunningTask(); }
+
+char* pcTaskGetTaskName(TaskHandle_t task) {
+    return (task ? task : getRunningTask())->name;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return (task ? task : getRunningTask())->stackDepth;
+}
+
+static SemaphoreHandle_t initSemaphore(
+    struct VirtualSemaphore* semaphore, bool isStatic, uint32_t count) {
+    semaphore->created = true;
+    semaphore->isStatic = isStatic;
+    semaphore->count = count;
+    return semaphore;
+}
+
+static SemaphoreHandle_t createSemaphore(uint32_t count) {
+    for (size_t i = 0; i < VIRTUAL_SEMAPHORE_MAX_COUNT; ++i) {
+        if (!semaphores[i].created) {
+            return initSemaphore(&semaphores[i], false, count);
+        }
+    }
+
+    return NULL;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) { return createSemaphore(0); }
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t* buffer) {
+    return initSemaphore((struct VirtualSemaphore*)buffer, true, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) { return createSemaphore(1); }
+
+static bool isSemaphoreAvailable(const struct VirtualTask* task) {
+    const struct VirtualSemaphore* semaphore = task->waitObject;
+    return semaphore->count > 0;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    if (semaphore->count == 0 &&
+        !waitFor(isSemaphoreAvailable, semaphore, ticks)) {
+        return pdFALSE;
+    }
+
+    --semaphore->count;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    if (semaphore->count > 0) {
+        return pdFALSE;
+    }
+
+    semaphore->count = 1;
+    yieldToHigherPriorityTask();
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+    semaphore->created = false;
+}
+
+static QueueHandle_t initQueue(
+    UBaseType_t length, UBaseType_t itemSize, uint8_t* storage) {
+    for (size_t i = 0; i < VIRTUAL_QUEUE_MAX_COUNT; ++i) {
+        struct VirtualQueue* queue = &queues[i];
+
+        if (!queue->created) {
+            *queue = (struct VirtualQueue){
+                .created = true,
+                .storage = storage ? storage : malloc(length * itemSize),
+                .ownsStorage = !storage,
+                .itemSize = itemSize,
+                .length = length};
+            return queue->storage ? queue : NULL;
+        }
+    }
+
+    return NULL;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+    return initQueue(length, itemSize, NULL);
+}
+
+QueueHandle_t xQueueCreateStatic(
+    UBaseType_t length,
+    UBaseType_t itemSize,
+    uint8_t* storage,
+    StaticQueue_t* queueBuffer) {
+    queueBuffer->handle = initQueue(length, itemSize, storage);
+    return queueBuffer->handle;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    if (queue->ownsStorage) {
+        free(queue->storage);
+    }
+
+    queue->created = false;
+}
+
+static bool hasQueueSpace(const struct VirtualTask* task) {
+    const struct VirtualQueue* queue = task->waitObject;
+    return queue->count < queue->length;
+}
+
+static bool hasQueueItem(const struct VirtualTask* task) {
+    const struct VirtualQueue* queue = task->waitObject;
+    return queue->count > 0;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+    if (queue->count == queue->length &&
+        !waitFor(hasQueueSpace, queue, ticks)) {
+        return pdFALSE;
+    }
+
+    const size_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->storage[tail * queue->itemSize], item, queue->itemSize);
+    ++queue->count;
+    yieldToHigherPriorityTask();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+    if (queue->count == 0 && !waitFor(hasQueueItem, queue, ticks)) {
+        return pdFALSE;
+    }
+
+    memcpy(item, &queue->storage[queue->head * queue->itemSize],
+           queue->itemSize);
+    queue->head = (queue->head + 1) % queue->length;
+    --queue->count;
+    yieldToHigherPriorityTask();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    queue->head = 0;
+    queue->count = 0;
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    return queue->count;
+}
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    for (size_t i = 0; i < VIRTUAL_EVENT_GROUP_MAX_COUNT; ++i) {
+        if (!eventGroups[i].created) {
+            eventGroups[i].created = true;
+            eventGroups[i].bits = 0;
+            return &eventGroups[i];
+        }
+    }
+
+    return NULL;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) { group->created = false; }
+
+static bool areBitsSet(EventBits_t set, EventBits_t bits, bool all) {
+    return all ? (set & bits) == bits : (set & bits) != 0;
+}
+
+static bool isReleased(const struct VirtualTask* task) {
+    return task->released;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    group->bits |= bits;
+    EventBits_t clearedBits = 0;
+
+    // Waits end with the bits as they are now, even if they are cleared
+    // before the waiting tasks run
+    for (size_t i = 0; i < VIRTUAL_TASK_MAX_COUNT; ++i) {
+        struct VirtualTask* task = &tasks[i];
+
+        if (task->created && task->isDone == isReleased &&
+            task->waitObject == group && !task->released &&
+            areBitsSet(group->bits, task->waitBits, task->waitForAll)) {
+            task->released = true;
+            task->releasedBits = group->bits;
+
+            if (task->clearOnExit) {
+                clearedBits |= task->waitBits;
+            }
+        }
+    }
+
+    group->bits &= ~clearedBits;
+    const EventBits_t result = group->bits;
+    yieldToHigherPriorityTask();
+    return result;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    const EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(
+    EventGroupHandle_t group,
+    EventBits_t bits,
+    BaseType_t clearOnExit,
+    BaseType_t waitForAll,
+    TickType_t ticks) {
+    const EventBits_t current = group->bits;
+
+    if (areBitsSet(current, bits, waitForAll)) {
+        if (clearOnExit) {
+            group->bits &= ~bits;
+        }
+        return current;
+    }
+
+    if (ticks == 0) {
+        return current;
+    }
+
+    struct VirtualTask* self = getRunningTask();
+    self->waitBits = bits;
+    self->waitForAll = waitForAll;
+    self->clearOnExit = clearOnExit;
+    self->released = false;
+
+    return waitFor(isReleased, group, ticks) ? self->releasedBits
+                                             : group->bits;
+}
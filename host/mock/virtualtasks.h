@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Replaces the FreeRTOS scheduler. Every task is a thread, but only one of
+// them runs at a time: the one of the highest priority that isn't waiting,
+// as on a single core. The thread that calls into it first becomes the main
+// task. Time stands still while a task runs, and passes on the virtual clock
+// once every task waits, up to the next timer or timeout. Waiting forever
+// with nothing left that could end the wait aborts.
+
+// Lets a task of higher priority run if a timer or the caller made it ready,
+// as FreeRTOS does right away
+void yieldToHigherPriorityTask(void);
+// Tasks that were created and haven't been deleted, including the main task
+size_t getVirtualTaskCount(void);
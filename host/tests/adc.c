@@ -0,0 +1,179 @@
+#include "adc.h"
+#include "check.h"
+#include "clock.h"
+#include "mockadc.h"
+#include "tracefile.h"
+#include "virtualclock.h"
+
+#include <esp_adc_cal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TRACE_MAX_ROWS 8192
+// Of the trace
+#define TRACE_TRUE_READING 3630
+
+// As in battery.c, and before it was reduced
+#define BATTERY_SAMPLE_COUNT 32
+#define OLD_BATTERY_SAMPLE_COUNT 128
+
+#define BENCHMARK_ROUNDS 20000
+
+static uint16_t traceReadings[TRACE_MAX_ROWS];
+// Keeps the benchmarked calls from being optimized away
+static volatile uint32_t benchmarkSink;
+static size_t traceLength = 0;
+
+// What sampleVoltage() did before, apart from the conversion: a mean of
+// blocking samples taken back to back, truncated when converted to mV
+static uint32_t oldMean(const uint16_t* samples, uint32_t sampleCount) {
+    uint32_t readings = 0;
+
+    for (uint32_t i = 0; i < sampleCount; ++i) {
+        readings += samples[i];
+    }
+
+    return (uint32_t)((double)readings / sampleCount);
+}
+
+static uint32_t newFilter(const uint16_t* samples, uint32_t sampleCount) {
+    uint16_t copy[ADC_MAX_SAMPLES];
+    memcpy(copy, samples, sampleCount * sizeof(samples[0]));
+    return filterSamples(copy, sampleCount);
+}
+
+static uint32_t getError(uint32_t reading) {
+    return reading > TRACE_TRUE_READING ? reading - TRACE_TRUE_READING
+                                        : TRACE_TRUE_READING - reading;
+}
+
+static void loadTrace(void) {
+    static int64_t rows[TRACE_MAX_ROWS];
+    traceLength = readTraceFile("adc.csv", rows, 1, TRACE_MAX_ROWS);
+
+    for (size_t i = 0; i < traceLength; ++i) {
+        traceReadings[i] = rows[i];
+    }
+
+    CHECK(traceLength >= OLD_BATTERY_SAMPLE_COUNT);
+}
+
+static void testFilterSamples(void) {
+    uint16_t samples[] = {100, 103, 101, 4095, 102, 0, 100, 101};
+
+    CHECK_EQUAL(0, filterSamples(samples, 0));
+    CHECK_EQUAL(100, filterSamples(samples, 1));
+    // The lowest and highest quarter are dropped, the rest rounded
+    CHECK_EQUAL(101, filterSamples(samples, 8));
+
+    // Sorted in place
+    for (size_t i = 1; i < 8; ++i) {
+        CHECK(samples[i - 1] <= samples[i]);
+    }
+
+    // Interference in more than a quarter of the samples gets through,
+    // which is why callers sample while the radio is off
+    uint16_t burst[] = {100, 240, 100, 240, 100, 240, 100, 100};
+    CHECK_EQUAL(135, filterSamples(burst, 8));
+
+    uint16_t even[] = {10, 11, 11, 12};
+    CHECK_EQUAL(11, filterSamples(even, 4));
+    uint16_t half[] = {10, 11};
+    CHECK_EQUAL(11, filterSamples(half, 2));
+}
+
+// Every window of the trace, filtered both ways
+static void testTrace(void) {
+    uint32_t oldMaxError = 0;
+    uint32_t newMaxError = 0;
+    uint64_t oldTotalError = 0;
+    uint64_t newTotalError = 0;
+    size_t windowCount = 0;
+
+    for (size_t start = 0; start + OLD_BATTERY_SAMPLE_COUNT <= traceLength;
+         start += BATTERY_SAMPLE_COUNT) {
+        const uint32_t oldError = getError(
+            oldMean(&traceReadings[start], OLD_BATTERY_SAMPLE_COUNT));
+        const uint32_t newError = getError(
+            newFilter(&traceReadings[start], BATTERY_SAMPLE_COUNT));
+
+        oldMaxError = oldError > oldMaxError ? oldError : oldMaxError;
+        newMaxError = newError > newMaxError ? newError : newMaxError;
+        oldTotalError += oldError;
+        newTotalError += newError;
+        ++windowCount;
+    }
+
+    printf(
+        "trace: %zu windows, error in ADC steps, old mean of %d: max %u, "
+        "mean %.2f; trimmed mean of %d: max %u, mean %.2f\n",
+        windowCount, OLD_BATTERY_SAMPLE_COUNT, oldMaxError,
+        (double)oldTotalError / windowCount, BATTERY_SAMPLE_COUNT,
+        newMaxError, (double)newTotalError / windowCount);
+
+    // A quarter of the samples is enough to reject spikes and short bursts
+    // that a plain mean averages in
+    CHECK(newMaxError < oldMaxError);
+    CHECK(newTotalError <= oldTotalError);
+    // About 2 mV at the battery
+    CHECK(newMaxError <= 4);
+}
+
+// sampleVoltage() paces its samples with a timer instead of blocking
+static void testSampleVoltage(void) {
+    setAdcTrace(traceReadings, traceLength);
+    const uint64_t start = getClockTimeInUs();
+    const uint32_t voltage = sampleVoltage(0, BATTERY_SAMPLE_COUNT);
+    const uint64_t duration = getClockTimeInUs() - start;
+
+    CHECK_EQUAL(BATTERY_SAMPLE_COUNT, getAdcReadCount());
+    CHECK_EQUAL(BATTERY_SAMPLE_COUNT * 250, duration);
+    CHECK_EQUAL(
+        convertAdcReading(newFilter(traceReadings, BATTERY_SAMPLE_COUNT)),
+        voltage);
+
+    // Limited to what fits the buffer
+    setAdcTrace(traceReadings, traceLength);
+    sampleVoltage(0, 2 * ADC_MAX_SAMPLES);
+    CHECK_EQUAL(ADC_MAX_SAMPLES, getAdcReadCount());
+}
+
+// Only printed, as the host says little about the timing on the chip
+static void benchmark(void) {
+    clock_t start = clock();
+
+    for (int i = 0; i < BENCHMARK_ROUNDS; ++i) {
+        const uint16_t* samples =
+            &traceReadings[i % (traceLength - OLD_BATTERY_SAMPLE_COUNT)];
+        benchmarkSink += oldMean(samples, OLD_BATTERY_SAMPLE_COUNT);
+    }
+
+    const double oldTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+    start = clock();
+
+    for (int i = 0; i < BENCHMARK_ROUNDS; ++i) {
+        const uint16_t* samples =
+            &traceReadings[i % (traceLength - OLD_BATTERY_SAMPLE_COUNT)];
+        benchmarkSink += newFilter(samples, BATTERY_SAMPLE_COUNT);
+    }
+
+    const double newTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf(
+        "benchmark: old mean of %d %.0f ns, trimmed mean of %d %.0f ns\n",
+        OLD_BATTERY_SAMPLE_COUNT, oldTime * 1e9 / BENCHMARK_ROUNDS,
+        BATTERY_SAMPLE_COUNT, newTime * 1e9 / BENCHMARK_ROUNDS);
+}
+
+int main(void) {
+    resetVirtualClock(0);
+    initAdc();
+    loadTrace();
+    testFilterSamples();
+    testTrace();
+    testSampleVoltage();
+    benchmark();
+    return CHECK_RESULT();
+}
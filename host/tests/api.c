@@ -0,0 +1,365 @@
+#include "adc.h"
+#include "api.h"
+#include "check.h"
+#include "flatmap.h"
+#include "jobs.h"
+#include "mocknetwork.h"
+#include "mockota.h"
+#include "mockwifi.h"
+#include "tasks.h"
+#include "tlv.h"
+#include "wifi.h"
+
+#include <esp_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FIELD_TEXT_SIZE 600
+#define RING_COUNT API_MAX_RING_COUNT
+// Fits in the TLV parser, which a trace as long as allowed wouldn't
+#define SHORT_TRACE_LENGTH 64
+// As long as apischema.def allows
+#define LONGEST_TRACE_LENGTH 512
+#define UPDATE_VERSION "2.0.0"
+#define UPDATE_PATH "/firmware/2.0.0.bin"
+#define UPDATE_PATCH_PATH "/firmware/2.0.0.patch"
+#define HEARTBEAT_INTERVAL_IN_S 7200
+// Of reports, see apischema.def
+#define REPORT_RING_ID 1
+
+typedef enum { FIELD_NUMBER, FIELD_SIGNED_NUMBER, FIELD_TEXT } FieldType;
+
+typedef struct {
+    uint32_t id;
+    const char* key;
+    FieldType type;
+} SchemaField;
+
+// A field as formatted from DeviceHealth, and as the server got it in
+// either encoding
+typedef struct {
+    char expected[FIELD_TEXT_SIZE];
+    char tlv[FIELD_TEXT_SIZE];
+    char flatmap[FIELD_TEXT_SIZE];
+} FieldValues;
+
+typedef struct {
+    char version[32];
+    char path[64];
+    char patchPath[64];
+    uint32_t count;
+} UpdateHint;
+
+#define FIELD_TYPE_UINT FIELD_NUMBER
+#define FIELD_TYPE_INT FIELD_SIGNED_NUMBER
+#define FIELD_TYPE_STRING FIELD_TEXT
+#define FIELD_TYPE_BASE64 FIELD_TEXT
+
+static const SchemaField HEALTH_FIELDS[] = {
+#define API_DEVICE_HEALTH_FIELD(id, member, key, type, maxLength)              \
+    {id, key, FIELD_TYPE_##type},
+#include "apischema.def"
+#undef API_DEVICE_HEALTH_FIELD
+};
+
+#define HEALTH_FIELD_COUNT (sizeof(HEALTH_FIELDS) / sizeof(HEALTH_FIELDS[0]))
+
+static FieldValues values[HEALTH_FIELD_COUNT];
+static uint32_t tlvRingCount = 0;
+static uint32_t flatmapRingCount = 0;
+static size_t flatmapTruncatedLength = 0;
+
+static esp_err_t connectNetwork(void) {
+    return waitForWifiConnection(WIFI_WAIT_FOREVER) == WIFI_WAIT_RESULT_OK
+               ? ESP_OK
+               : ESP_FAIL;
+}
+
+static void handleUpdate(
+    const char* updateVersion,
+    const char* updatePath,
+    const char* updatePatchPath,
+    void* userData) {
+    UpdateHint* hint = userData;
+    snprintf(hint->version, sizeof(hint->version), "%s", updateVersion);
+    snprintf(hint->path, sizeof(hint->path), "%s", updatePath);
+    snprintf(
+        hint->patchPath, sizeof(hint->patchPath), "%s",
+        updatePatchPath ? updatePatchPath : "");
+    ++hint->count;
+}
+
+#define FORMAT_UINT(text, value) snprintf(text, FIELD_TEXT_SIZE, "%u", value)
+#define FORMAT_INT(text, value) snprintf(text, FIELD_TEXT_SIZE, "%d", value)
+#define FORMAT_STRING(text, value) snprintf(text, FIELD_TEXT_SIZE, "%s", value)
+#define FORMAT_BASE64 FORMAT_STRING
+
+static void formatHealth(const DeviceHealth* health) {
+    size_t i = 0;
+#define API_DEVICE_HEALTH_FIELD(id, member, key, type, maxLength)              \
+    FORMAT_##type(values[i++].expected, health->member);
+#include "apischema.def"
+#undef API_DEVICE_HEALTH_FIELD
+}
+
+static void parseTlvField(const TlvField* field, void* userData) {
+    if (field->id == REPORT_RING_ID) {
+        ++tlvRingCount;
+        return;
+    }
+
+    for (size_t i = 0; i < HEALTH_FIELD_COUNT; ++i) {
+        char* text = values[i].tlv;
+
+        if (HEALTH_FIELDS[i].id != field->id) {
+            continue;
+        }
+
+        if (HEALTH_FIELDS[i].type == FIELD_NUMBER) {
+            snprintf(
+                text, FIELD_TEXT_SIZE, "%llu",
+                (unsigned long long)field->value);
+        } else if (HEALTH_FIELDS[i].type == FIELD_SIGNED_NUMBER) {
+            snprintf(
+                text, FIELD_TEXT_SIZE, "%lld", (long long)getTlvInt(field));
+        } else {
+            copyTlvString(text, FIELD_TEXT_SIZE, field);
+        }
+    }
+}
+
+static void parseFlatmapLine(
+    const char* key,
+    size_t keyLength,
+    const char* value,
+    size_t valueLength,
+    void* userData) {
+    char text[FIELD_TEXT_SIZE];
+    copyFlatmapValue(text, sizeof(text), value, valueLength);
+
+    if (flatmapKeyEquals(key, keyLength, "ring.count")) {
+        flatmapRingCount = strtoul(text, NULL, 10);
+    } else if (flatmapKeyEquals(key, keyLength, "trace.truncated")) {
+        flatmapTruncatedLength = strtoul(text, NULL, 10);
+    }
+
+    for (size_t i = 0; i < HEALTH_FIELD_COUNT; ++i) {
+        if (flatmapKeyEquals(key, keyLength, HEALTH_FIELDS[i].key)) {
+            memcpy(values[i].flatmap, text, sizeof(text));
+        }
+    }
+}
+
+static void parseRequest(ApiEncoding encoding) {
+    const char* body;
+    const size_t length = getMockServerLastRequestBody(&body);
+
+    if (encoding == API_ENCODING_TLV) {
+        TlvParser parser;
+        TlvParser_init(&parser, parseTlvField, NULL);
+        TlvParser_feed(&parser, body, length);
+        TlvParser_finish(&parser);
+    } else {
+        FlatmapParser parser;
+        FlatmapParser_init(&parser, parseFlatmapLine, NULL);
+        FlatmapParser_feed(&parser, body, length);
+        FlatmapParser_finish(&parser);
+    }
+}
+
+static void setResponse(ApiEncoding encoding) {
+    if (encoding == API_ENCODING_TLV) {
+        uint8_t body[256];
+        TlvWriter writer;
+        TlvWriter_init(&writer, body, sizeof(body));
+        TlvWriter_putString(&writer, 1, UPDATE_VERSION, 32);
+        TlvWriter_putString(&writer, 2, UPDATE_PATH, 256);
+        TlvWriter_putString(&writer, 3, UPDATE_PATCH_PATH, 256);
+        TlvWriter_putUint(&writer, 4, HEARTBEAT_INTERVAL_IN_S);
+        // From a newer server
+        TlvWriter_putUint(&writer, 99, 1);
+        setMockServerResponseBody(body, writer.length);
+    } else {
+        char body[256];
+        const int length = snprintf(
+            body, sizeof(body),
+            "update.version=" UPDATE_VERSION "\n"
+            "update.path=" UPDATE_PATH "\n"
+            "update.patch=" UPDATE_PATCH_PATH "\n"
+            "heartbeat.interval=%u\n"
+            "server.extra=1\n",
+            HEARTBEAT_INTERVAL_IN_S);
+        setMockServerResponseBody(body, length);
+    }
+}
+
+static size_t report(
+    ApiClientContext* context,
+    ApiEncoding encoding,
+    const DeviceHealth* health) {
+    RingEvent rings[RING_COUNT];
+
+    for (size_t i = 0; i < RING_COUNT; ++i) {
+        rings[i] = (RingEvent){
+            .logId = 0x5eed0001, .sequence = 1000 + i, .ageInMs = i * 90000};
+    }
+
+    UpdateHint hint = {0};
+    const WakeReport wakeReport = {
+        .rings = rings, .ringCount = RING_COUNT, .health = health};
+    context->encoding = encoding;
+    context->heartbeatIntervalHint = 0;
+    setResponse(encoding);
+    CHECK_EQUAL(
+        ESP_OK, ApiClient_report(context, &wakeReport, handleUpdate, &hint));
+    parseRequest(encoding);
+
+    CHECK_EQUAL(1, hint.count);
+    CHECK(strcmp(hint.version, UPDATE_VERSION) == 0);
+    CHECK(strcmp(hint.path, UPDATE_PATH) == 0);
+    CHECK(strcmp(hint.patchPath, UPDATE_PATCH_PATH) == 0);
+    CHECK_EQUAL(HEARTBEAT_INTERVAL_IN_S, context->heartbeatIntervalHint);
+
+    const char* body;
+    return getMockServerLastRequestBody(&body);
+}
+
+static void makeHealth(DeviceHealth* health, const char* trace) {
+    *health = (DeviceHealth){
+        .battery =
+            {.level = "good",
+             .voltage = 3712,
+             .charge = 842,
+             .dischargeRate = 12,
+             .remainingHours = -1},
+        .firmware = {.version = "1.4.2"},
+        .wifi = {.fastConnectAttempts = 41, .fastConnectSuccesses = 39},
+        .dns = {.cacheHits = 40, .cacheMisses = 2},
+        .tls =
+            {.connectionHeapPeak = 28315,
+             .heapPeak = 41020,
+             .untrackedConnections = 1},
+        .jobs =
+            {.count = 96,
+             .meanLatencyInUs = 412,
+             .maxLatencyInUs = 9120,
+             .maxQueueDepth = 2},
+        .rings = {.uploadFailures = 3, .lastUploadError = -1},
+        .trace = {.data = trace, .dropped = 5},
+        // In µAh, above 1 mAh so that a mix-up with mAh shows
+        .energy = {
+            .cpu = 123456,
+            .wifi = 2345678,
+            .buzzer = 3456,
+            .lightSleep = 45,
+            .standby = 567890}};
+}
+
+// Both encodings carry every field of DeviceHealth with the same value
+static void testEncodingsAgree(ApiClientContext* context) {
+    char trace[SHORT_TRACE_LENGTH + 1];
+    memset(trace, 'Q', SHORT_TRACE_LENGTH);
+    trace[SHORT_TRACE_LENGTH] = 0;
+    DeviceHealth health;
+    makeHealth(&health, trace);
+    memset(values, 0, sizeof(values));
+    formatHealth(&health);
+
+    const size_t tlvLength = report(context, API_ENCODING_TLV, &health);
+    const size_t flatmapLength =
+        report(context, API_ENCODING_FLATMAP, &health);
+
+    CHECK_EQUAL(RING_COUNT, tlvRingCount);
+    CHECK_EQUAL(RING_COUNT, flatmapRingCount);
+
+    for (size_t i = 0; i < HEALTH_FIELD_COUNT; ++i) {
+        const FieldValues* field = &values[i];
+
+        if (strcmp(field->expected, field->tlv) != 0 ||
+            strcmp(field->expected, field->flatmap) != 0) {
+            fprintf(
+                stderr, "%s is \"%s\" in TLV and \"%s\" in flatmap, "
+                        "expected \"%s\"\n",
+                HEALTH_FIELDS[i].key, field->tlv, field->flatmap,
+                field->expected);
+            ++checkFailures;
+        }
+    }
+
+    printf(
+        "%d rings and health: tlv %zu bytes, flatmap %zu bytes\n", RING_COUNT,
+        tlvLength, flatmapLength);
+}
+
+// The body has room for all rings and the longest trace, which flatmap
+// would otherwise cut short
+static void testLongestTrace(ApiClientContext* context) {
+    char trace[LONGEST_TRACE_LENGTH + 1];
+    memset(trace, 'Q', LONGEST_TRACE_LENGTH);
+    trace[LONGEST_TRACE_LENGTH] = 0;
+    DeviceHealth health;
+    makeHealth(&health, trace);
+    memset(values, 0, sizeof(values));
+    formatHealth(&health);
+    flatmapTruncatedLength = 0;
+
+    const size_t length = report(context, API_ENCODING_FLATMAP, &health);
+
+    CHECK_EQUAL(0, flatmapTruncatedLength);
+    for (size_t i = 0; i < HEALTH_FIELD_COUNT; ++i) {
+        CHECK(strcmp(values[i].expected, values[i].flatmap) == 0);
+    }
+
+    printf(
+        "%d rings and health with a %d character trace: flatmap %zu bytes\n",
+        RING_COUNT, LONGEST_TRACE_LENGTH, length);
+}
+
+// The download of an offered update only starts once the API connection is
+// closed, so that there's never a second TLS connection
+static void testUpdateAfterReport(ApiClientContext* context) {
+    context->encoding = API_ENCODING_TLV;
+    setResponse(API_ENCODING_TLV);
+    const MockServerRequest* requests;
+    const size_t firstRequest = getMockServerRequests(&requests);
+
+    runHeartbeatTask(context, true);
+
+    const size_t requestCount = getMockServerRequests(&requests);
+    size_t downloads = 0;
+    CHECK(requestCount > firstRequest + 1);
+    CHECK(strcmp(requests[firstRequest].path, "/report") == 0);
+
+    for (size_t i = firstRequest; i < requestCount; ++i) {
+        CHECK_EQUAL(1, requests[i].openConnections);
+        downloads += strncmp(requests[i].path, "/firmware/", 10) == 0;
+    }
+
+    CHECK_EQUAL(requestCount - firstRequest - 1, downloads);
+}
+
+int main(void) {
+    resetMockOta();
+    resetMockWifi();
+    resetMockServer();
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    // For the battery readings of heartbeats
+    initAdc();
+    ESP_ERROR_CHECK(initJobs());
+    initWifi();
+    startWifi();
+
+    ApiClientContext context = {
+        .serverUrl = DEFAULT_API_SERVER_URL, .mode = API_MODE_REPORT};
+    ESP_ERROR_CHECK(ApiClient_init(&context));
+    ApiClient_setNetworkConnectHandler(connectNetwork);
+
+    testEncodingsAgree(&context);
+    testLongestTrace(&context);
+    testUpdateAfterReport(&context);
+
+    ApiClient_disconnect(&context);
+    stopWifi();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,155 @@
+#include "battery.h"
+#include "check.h"
+#include "tracefile.h"
+
+#include <stdio.h>
+
+#define HOUR_IN_US (60 * 60 * 1000000ULL)
+#define TRACE_MAX_ROWS 256
+
+// Of the trace
+#define TRACE_DISCHARGE_RATE 60
+#define TRACE_REPLACEMENT_TIME_IN_S (73 * 60 * 60)
+
+static BatteryInfo update(
+    BatteryEstimator* estimator, uint32_t voltage, uint64_t timeInUs) {
+    BatteryInfo info;
+    BatteryEstimator_update(estimator, voltage, timeInUs);
+    BatteryEstimator_getInfo(estimator, &info);
+    return info;
+}
+
+static void testMovingAverage(void) {
+    BatteryEstimator estimator = {0};
+    BatteryInfo info = update(&estimator, 3900, 0);
+
+    // The first reading is taken as is
+    CHECK_EQUAL(3900, info.voltage);
+    CHECK_EQUAL(getBatteryCharge(3900), info.charge);
+    CHECK_EQUAL(0, info.dischargeRate);
+    CHECK_EQUAL(-1, info.remainingHours);
+
+    // Moves 1/8 of the way towards each new reading
+    info = update(&estimator, 3820, HOUR_IN_US);
+    CHECK_EQUAL(3890, info.voltage);
+    info = update(&estimator, 3820, 2 * HOUR_IN_US);
+    CHECK_EQUAL(3881, info.voltage);
+
+    for (int i = 3; i < 40; ++i) {
+        info = update(&estimator, 3820, i * HOUR_IN_US);
+    }
+
+    CHECK(info.voltage >= 3820 && info.voltage <= 3821);
+
+    // A single outlier barely moves it
+    info = update(&estimator, 3600, 40 * HOUR_IN_US);
+    CHECK(info.voltage >= 3792 && info.voltage <= 3793);
+}
+
+static void testResetOnVoltageJump(void) {
+    BatteryEstimator estimator = {0};
+    update(&estimator, 3850, 0);
+    BatteryInfo info = update(&estimator, 3820, 12 * HOUR_IN_US);
+    CHECK(info.dischargeRate > 0);
+
+    // Noise of up to 150 mV is smoothed out
+    info = update(&estimator, 3846 + 150, 13 * HOUR_IN_US);
+    CHECK(info.dischargeRate > 0);
+    CHECK(info.voltage < 3900);
+
+    // A new battery starts over
+    info = update(&estimator, 4150, 14 * HOUR_IN_US);
+    CHECK_EQUAL(4150, info.voltage);
+    CHECK_EQUAL(0, info.dischargeRate);
+    CHECK_EQUAL(-1, info.remainingHours);
+
+    // So does a clock that went backwards, e.g. after a cold boot
+    update(&estimator, 4140, 20 * HOUR_IN_US);
+    info = update(&estimator, 4100, HOUR_IN_US);
+    CHECK_EQUAL(4100, info.voltage);
+    CHECK_EQUAL(0, info.dischargeRate);
+}
+
+static void testMinimumRatePeriod(void) {
+    BatteryEstimator estimator = {0};
+    update(&estimator, 3900, HOUR_IN_US);
+
+    // Measured over 6 h at least, from the first reading
+    BatteryInfo info = update(&estimator, 3800, 7 * HOUR_IN_US - 1);
+    CHECK_EQUAL(0, info.dischargeRate);
+    CHECK_EQUAL(-1, info.remainingHours);
+
+    info = update(&estimator, 3800, 7 * HOUR_IN_US);
+    const uint32_t used = getBatteryCharge(3900) - info.charge;
+    CHECK(used > 0);
+    // Scaled from 6 h to a day
+    CHECK_EQUAL(used * 4, info.dischargeRate);
+
+    // The next period starts where the last one ended
+    const uint32_t rate = info.dischargeRate;
+    info = update(&estimator, 3800, 12 * HOUR_IN_US);
+    CHECK_EQUAL(rate, info.dischargeRate);
+}
+
+static void testRemainingHours(void) {
+    BatteryEstimator estimator = {0};
+    update(&estimator, 3900, 0);
+    BatteryInfo info = update(&estimator, 3850, 6 * HOUR_IN_US);
+
+    CHECK(info.dischargeRate > 0);
+    CHECK_EQUAL(info.charge * 24 / info.dischargeRate, info.remainingHours);
+
+    // Nothing used, so nothing is known about the rate
+    BatteryEstimator steady = {0};
+    update(&steady, 3900, 0);
+    info = update(&steady, 3900, 6 * HOUR_IN_US);
+    CHECK_EQUAL(0, info.dischargeRate);
+    CHECK_EQUAL(-1, info.remainingHours);
+}
+
+static void testTrace(void) {
+    int64_t rows[TRACE_MAX_ROWS][2];
+    const size_t rowCount =
+        readTraceFile("battery.csv", &rows[0][0], 2, TRACE_MAX_ROWS);
+    BatteryEstimator estimator = {0};
+    BatteryInfo info = {0};
+    BatteryInfo beforeReplacement = {0};
+
+    CHECK(rowCount > 0);
+
+    for (size_t i = 0; i < rowCount; ++i) {
+        const int64_t timeInS = rows[i][0];
+
+        if (timeInS == TRACE_REPLACEMENT_TIME_IN_S) {
+            beforeReplacement = info;
+        }
+
+        info = update(&estimator, rows[i][1], timeInS * 1000000ULL);
+    }
+
+    printf(
+        "trace: %u permille per day, %d h remaining before the battery was "
+        "replaced\n",
+        beforeReplacement.dischargeRate, beforeReplacement.remainingHours);
+
+    CHECK(beforeReplacement.dischargeRate >= TRACE_DISCHARGE_RATE * 3 / 4);
+    CHECK(beforeReplacement.dischargeRate <= TRACE_DISCHARGE_RATE * 5 / 4);
+    CHECK(beforeReplacement.remainingHours > 0);
+    CHECK_EQUAL(
+        beforeReplacement.charge * 24 / beforeReplacement.dischargeRate,
+        beforeReplacement.remainingHours);
+
+    // Measured afresh since the replacement
+    CHECK(info.level == BATTERY_LEVEL_HIGH);
+    CHECK(info.charge >= 950);
+    CHECK(info.dischargeRate <= TRACE_DISCHARGE_RATE * 2);
+}
+
+int main(void) {
+    testMovingAverage();
+    testResetOnVoltageJump();
+    testMinimumRatePeriod();
+    testRemainingHours();
+    testTrace();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,234 @@
+#include "buzzer.h"
+#include "check.h"
+#include "clock.h"
+#include "energy.h"
+#include "mockdac.h"
+#include "tone.h"
+#include "virtualclock.h"
+
+#include <driver/dac.h>
+
+#define STEPS(steps) steps, sizeof(steps) / sizeof(steps[0])
+
+// As in tasks.c
+static const Tone RING_CHIME[] = {
+    {.frequency = 2500,
+     .durationInMs = 500,
+     .attackInMs = 15,
+     .releaseInMs = 30},
+    {.frequency = 2000,
+     .durationInMs = 1000,
+     .attackInMs = 15,
+     .releaseInMs = 300}};
+
+static const Tone CONFIRMATION_BEEP[] = {
+    {.frequency = 2500, .durationInMs = 50}};
+
+static const Tone DOUBLE_CONFIRMATION_BEEP[] = {
+    {.frequency = 2500, .durationInMs = 50},
+    {.frequency = 0, .durationInMs = 100},
+    {.frequency = 2500, .durationInMs = 50},
+    {.frequency = 0, .durationInMs = 100}};
+
+static const ToneStep RING_CHIME_STEPS[] = {
+    {2500, 1, 5},   {2500, 2, 5},   {2500, 3, 5},   {2500, 4, 455},
+    {2500, 3, 10},  {2500, 2, 10},  {2500, 1, 10},  {2000, 1, 5},
+    {2000, 2, 5},   {2000, 3, 5},   {2000, 4, 685}, {2000, 3, 100},
+    {2000, 2, 100}, {2000, 1, 100}};
+
+// Ramps longer than the tone are cut, and uneven ones add up
+static const Tone LONG_RAMPS[] = {
+    {.frequency = 1000,
+     .durationInMs = 100,
+     .attackInMs = 80,
+     .releaseInMs = 80},
+    {.frequency = 1000,
+     .durationInMs = 10,
+     .attackInMs = 10,
+     .releaseInMs = 10}};
+
+static const ToneStep LONG_RAMPS_STEPS[] = {
+    {1000, 1, 26}, {1000, 2, 27}, {1000, 3, 27}, {1000, 3, 6},
+    {1000, 2, 7},  {1000, 1, 7},  {1000, 1, 3},  {1000, 2, 3},
+    {1000, 3, 4}};
+
+// Steps too short to be heard are left out, and silence has no ramps
+static const Tone SHORT_STEPS[] = {
+    {.frequency = 1000, .durationInMs = 0, .attackInMs = 5},
+    {.frequency = 1000, .durationInMs = 1, .attackInMs = 1},
+    {.frequency = 0, .durationInMs = 30, .attackInMs = 10, .releaseInMs = 10},
+    {.frequency = 1000, .durationInMs = 20, .releaseInMs = 2}};
+
+static const ToneStep SHORT_STEPS_STEPS[] = {
+    {1000, 3, 1}, {0, 0, 30}, {1000, 4, 18}, {1000, 2, 1}, {1000, 1, 1}};
+
+static void checkSteps(
+    const Tone* tones,
+    size_t toneCount,
+    const ToneStep* expected,
+    size_t expectedCount) {
+    ToneSequencer sequencer;
+    ToneSequencer_init(&sequencer, tones, toneCount);
+
+    ToneStep step;
+    size_t count = 0;
+
+    while (ToneSequencer_next(&sequencer, &step)) {
+        if (count < expectedCount) {
+            CHECK_EQUAL(expected[count].frequency, step.frequency);
+            CHECK_EQUAL(expected[count].level, step.level);
+            CHECK_EQUAL(expected[count].durationInMs, step.durationInMs);
+        }
+        ++count;
+    }
+
+    CHECK_EQUAL(expectedCount, count);
+    // Stays at the end
+    CHECK(!ToneSequencer_next(&sequencer, &step));
+}
+
+static void testSequencer(void) {
+    checkSteps(RING_CHIME, 2, STEPS(RING_CHIME_STEPS));
+    checkSteps(LONG_RAMPS, 2, STEPS(LONG_RAMPS_STEPS));
+    checkSteps(SHORT_STEPS, 4, STEPS(SHORT_STEPS_STEPS));
+    checkSteps(RING_CHIME, 0, NULL, 0);
+}
+
+// Time relative to the start of playback
+typedef struct {
+    uint32_t timeInMs;
+    uint32_t frequency;
+    dac_cw_scale_t scale;
+} ExpectedChange;
+
+static const ExpectedChange RING_CHIME_CHANGES[] = {
+    {0, 2500, DAC_CW_SCALE_8},    {5, 2500, DAC_CW_SCALE_4},
+    {10, 2500, DAC_CW_SCALE_2},   {15, 2500, DAC_CW_SCALE_1},
+    {470, 2500, DAC_CW_SCALE_2},  {480, 2500, DAC_CW_SCALE_4},
+    {490, 2500, DAC_CW_SCALE_8},  {500, 2000, DAC_CW_SCALE_8},
+    {505, 2000, DAC_CW_SCALE_4},  {510, 2000, DAC_CW_SCALE_2},
+    {515, 2000, DAC_CW_SCALE_1},  {1200, 2000, DAC_CW_SCALE_2},
+    {1300, 2000, DAC_CW_SCALE_4}, {1400, 2000, DAC_CW_SCALE_8},
+    {1500, 0, 0}};
+
+static const ExpectedChange DOUBLE_CONFIRMATION_BEEP_CHANGES[] = {
+    {0, 2500, DAC_CW_SCALE_1},
+    {50, 0, 0},
+    {150, 2500, DAC_CW_SCALE_1},
+    {200, 0, 0}};
+
+static void checkChanges(
+    uint64_t startInUs, const ExpectedChange* expected, size_t expectedCount) {
+    const DacChange* changes = NULL;
+    const size_t count = getMockDacChanges(&changes);
+    CHECK_EQUAL(expectedCount, count);
+
+    for (size_t i = 0; i < count && i < expectedCount; ++i) {
+        CHECK_EQUAL(
+            expected[i].timeInMs, (changes[i].timeInUs - startInUs) / 1000);
+        CHECK_EQUAL(expected[i].frequency, changes[i].frequency);
+        CHECK_EQUAL(expected[i].scale, changes[i].scale);
+    }
+}
+
+static uint64_t callbackTimeInUs = 0;
+static int callbackCount = 0;
+
+static void recordCallback(void* userData) {
+    callbackTimeInUs = getClockTimeInUs();
+    ++callbackCount;
+    CHECK_EQUAL(0, getMockPmLockCount());
+}
+
+static void testRingChime(void) {
+    resetMockDac();
+    callbackCount = 0;
+    const uint64_t startInUs = getClockTimeInUs();
+    EnergyInfo before;
+    getEnergyInfo(&before);
+
+    CHECK_EQUAL(ESP_OK, playTones(RING_CHIME, 2, recordCallback, NULL));
+    // Returns right away and holds off light sleep, which stops the DAC
+    CHECK_EQUAL(startInUs, getClockTimeInUs());
+    CHECK_EQUAL(1, getMockPmLockCount());
+
+    // Busy until the end
+    advanceVirtualClock(1499 * 1000);
+    CHECK_EQUAL(0, callbackCount);
+    CHECK_EQUAL(
+        ESP_ERR_INVALID_STATE,
+        playTones(CONFIRMATION_BEEP, 1, recordCallback, NULL));
+
+    waitForBuzzer();
+    CHECK_EQUAL(1, callbackCount);
+    CHECK_EQUAL(1500 * 1000, callbackTimeInUs - startInUs);
+    CHECK_EQUAL(callbackTimeInUs, getClockTimeInUs());
+    CHECK_EQUAL(0, getMockPmLockCount());
+    checkChanges(startInUs, STEPS(RING_CHIME_CHANGES));
+
+    // 15 mA for 1.5 s
+    EnergyInfo after;
+    getEnergyInfo(&after);
+    CHECK_EQUAL(
+        6, after.chargeInUAh[ENERGY_CONSUMER_BUZZER] -
+               before.chargeInUAh[ENERGY_CONSUMER_BUZZER]);
+}
+
+// Silence keeps the buzzer busy for its duration
+static void testSilence(void) {
+    resetMockDac();
+    callbackCount = 0;
+    const uint64_t startInUs = getClockTimeInUs();
+
+    CHECK_EQUAL(
+        ESP_OK, playTones(DOUBLE_CONFIRMATION_BEEP, 4, recordCallback, NULL));
+    waitForBuzzer();
+
+    CHECK_EQUAL(1, callbackCount);
+    CHECK_EQUAL(300 * 1000, callbackTimeInUs - startInUs);
+    checkChanges(startInUs, STEPS(DOUBLE_CONFIRMATION_BEEP_CHANGES));
+}
+
+static void playConfirmation(void* userData) {
+    recordCallback(userData);
+    CHECK_EQUAL(
+        ESP_OK, playTones(CONFIRMATION_BEEP, 1, recordCallback, NULL));
+}
+
+// The buzzer is free again by the time the callback runs
+static void testChaining(void) {
+    resetMockDac();
+    callbackCount = 0;
+    const uint64_t startInUs = getClockTimeInUs();
+
+    CHECK_EQUAL(
+        ESP_OK, playTones(CONFIRMATION_BEEP, 1, playConfirmation, NULL));
+    advanceVirtualClock(50 * 1000);
+    CHECK_EQUAL(1, callbackCount);
+    CHECK_EQUAL(1, getMockPmLockCount());
+
+    waitForBuzzer();
+    CHECK_EQUAL(2, callbackCount);
+    CHECK_EQUAL(100 * 1000, callbackTimeInUs - startInUs);
+    CHECK_EQUAL(0, getMockPmLockCount());
+
+    // The output is off for no time in between
+    const ExpectedChange expected[] = {
+        {0, 2500, DAC_CW_SCALE_1},
+        {50, 0, 0},
+        {50, 2500, DAC_CW_SCALE_1},
+        {100, 0, 0}};
+    checkChanges(startInUs, STEPS(expected));
+}
+
+int main(void) {
+    testSequencer();
+
+    resetVirtualClock(0);
+    initEnergy();
+    CHECK_EQUAL(ESP_OK, initBuzzer());
+    testRingChime();
+    testSilence();
+    testChaining();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdio.h>
+
+// Failed checks are reported and counted, and the test carries on
+static int checkFailures = 0;
+
+#define CHECK(condition)                                                       \
+    do {                                                                       \
+        if (!(condition)) {                                                    \
+            fprintf(                                                           \
+                stderr, "%s:%d: Check failed: %s\n", __FILE__, __LINE__,       \
+                #condition);                                                   \
+            ++checkFailures;                                                   \
+        }                                                                      \
+    } while (0)
+
+#define CHECK_EQUAL(expected, actual)                                          \
+    do {                                                                       \
+        const long long expected_ = (expected);                                \
+        const long long actual_ = (actual);                                    \
+        if (expected_ != actual_) {                                            \
+            fprintf(                                                           \
+                stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__,        \
+                __LINE__, #actual, actual_, expected_);                        \
+            ++checkFailures;                                                   \
+        }                                                                      \
+    } while (0)
+
+// Returned from main()
+#define CHECK_RESULT() (checkFailures == 0 ? 0 : 1)
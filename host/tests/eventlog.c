@@ -0,0 +1,377 @@
+#include "check.h"
+#include "eventlog.h"
+#include "mockflash.h"
+#include "mocksystem.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define SLOT_SIZE 32
+#define SLOTS_PER_SECTOR (FLASH_SECTOR_SIZE / SLOT_SIZE)
+#define POWER_LOSS_SECTOR_COUNT 3
+#define POWER_LOSS_EVENT_COUNT 500
+// Power is cut at every this many bytes written or erased
+#define POWER_LOSS_STEP 7
+
+static void appendEvents(EventLog* log, uint32_t count) {
+    for (uint32_t i = 0; i < count; ++i) {
+        CHECK_EQUAL(
+            ESP_OK,
+            EventLog_append(log, EVENT_TYPE_RING, 1, log->nextSequence, NULL));
+    }
+}
+
+static void acknowledgeEvents(EventLog* log, size_t count) {
+    LoggedEvent events[8];
+
+    while (count > 0) {
+        size_t peekedCount = 0;
+        const size_t maxCount = count < 8 ? count : 8;
+        CHECK_EQUAL(
+            ESP_OK, EventLog_peek(log, events, maxCount, &peekedCount));
+        CHECK_EQUAL(maxCount, peekedCount);
+        CHECK_EQUAL(ESP_OK, EventLog_acknowledge(log, events, peekedCount));
+        count -= maxCount;
+    }
+}
+
+// Both must hand out the same events from here on
+static void checkSameLog(EventLog* expected, EventLog* actual) {
+    CHECK_EQUAL(expected->logId, actual->logId);
+    CHECK_EQUAL(expected->headSector, actual->headSector);
+    CHECK_EQUAL(expected->headSectorSequence, actual->headSectorSequence);
+    CHECK_EQUAL(expected->headSlot, actual->headSlot);
+    CHECK_EQUAL(expected->nextSequence, actual->nextSequence);
+    CHECK_EQUAL(expected->pendingCount, actual->pendingCount);
+
+    LoggedEvent expectedEvent;
+    LoggedEvent actualEvent;
+    size_t expectedCount = 0;
+    size_t actualCount = 0;
+    CHECK_EQUAL(
+        ESP_OK, EventLog_peek(expected, &expectedEvent, 1, &expectedCount));
+    CHECK_EQUAL(ESP_OK, EventLog_peek(actual, &actualEvent, 1, &actualCount));
+    CHECK_EQUAL(expectedCount, actualCount);
+    if (expectedCount > 0 && actualCount > 0) {
+        CHECK_EQUAL(expectedEvent.sequence, actualEvent.sequence);
+        CHECK_EQUAL(expectedEvent.offset, actualEvent.offset);
+    }
+}
+
+// Opens the log as after deep sleep, and then as after a cold boot
+static void checkReopen(const EventLog* log, uint32_t maxReadSize) {
+    EventLog warmLog;
+    EventLog coldLog;
+
+    const uint32_t readCount = getMockFlashReadCount();
+    CHECK_EQUAL(ESP_OK, EventLog_open(&warmLog, &log->storage));
+    CHECK(getMockFlashReadCount() - readCount <= maxReadSize);
+    // Only known to the log that dropped them
+    CHECK_EQUAL(log->droppedCount, warmLog.droppedCount);
+
+    resetRtcMemory();
+    CHECK_EQUAL(ESP_OK, EventLog_open(&coldLog, &log->storage));
+    checkSameLog(&coldLog, &warmLog);
+}
+
+static void testWakeWithoutScan(void) {
+    FlashStorage storage;
+    EventLog log;
+
+    initMockFlash(&storage, 16);
+    resetRtcMemory();
+    CHECK_EQUAL(ESP_OK, EventLog_open(&log, &storage));
+    appendEvents(&log, 5);
+    acknowledgeEvents(&log, 2);
+    CHECK_EQUAL(3, EventLog_getPendingCount(&log));
+
+    // The head sector header and the slot after the head
+    checkReopen(&log, 2 * SLOT_SIZE);
+}
+
+static void testWrappedLog(void) {
+    FlashStorage storage;
+    EventLog log;
+
+    // Overwrites the oldest sector a few times
+    initMockFlash(&storage, 4);
+    resetRtcMemory();
+    CHECK_EQUAL(ESP_OK, EventLog_open(&log, &storage));
+    appendEvents(&log, 1000);
+    acknowledgeEvents(&log, 20);
+    CHECK(log.droppedCount > 0);
+
+    checkReopen(&log, 2 * SLOT_SIZE);
+}
+
+static void testFullHeadSector(void) {
+    FlashStorage storage;
+    EventLog log;
+
+    // The next append takes a new sector
+    initMockFlash(&storage, 4);
+    resetRtcMemory();
+    CHECK_EQUAL(ESP_OK, EventLog_open(&log, &storage));
+    appendEvents(&log, FLASH_SECTOR_SIZE / SLOT_SIZE - 1);
+    CHECK_EQUAL(FLASH_SECTOR_SIZE / SLOT_SIZE, log.headSlot);
+
+    checkReopen(&log, SLOT_SIZE);
+}
+
+static void testWrittenPastHead(void) {
+    FlashStorage storage;
+    EventLog log;
+    EventLog reopenedLog;
+    const uint8_t garbage[SLOT_SIZE] = {0};
+
+    initMockFlash(&storage, 4);
+    resetRtcMemory();
+    CHECK_EQUAL(ESP_OK, EventLog_open(&log, &storage));
+    appendEvents(&log, 3);
+
+    // Not by this log, so the state kept through deep sleep is stale
+    const size_t offset =
+        log.headSector * FLASH_SECTOR_SIZE + log.headSlot * SLOT_SIZE;
+    CHECK_EQUAL(
+        ESP_OK, storage.write(storage.context, offset, garbage, SLOT_SIZE));
+
+    CHECK_EQUAL(ESP_OK, EventLog_open(&reopenedLog, &storage));
+    CHECK_EQUAL(log.headSlot + 1, reopenedLog.headSlot);
+    CHECK_EQUAL(3, reopenedLog.pendingCount);
+}
+
+static void testErasedStorage(void) {
+    FlashStorage storage;
+    EventLog log;
+    EventLog reopenedLog;
+
+    initMockFlash(&storage, 4);
+    resetRtcMemory();
+    CHECK_EQUAL(ESP_OK, EventLog_open(&log, &storage));
+    appendEvents(&log, 3);
+
+    initMockFlash(&storage, 4);
+    CHECK_EQUAL(ESP_OK, EventLog_open(&reopenedLog, &storage));
+    CHECK(reopenedLog.logId != log.logId);
+    CHECK_EQUAL(0, reopenedLog.pendingCount);
+}
+
+typedef enum {
+    MODEL_STATE_NONE,
+    MODEL_STATE_PENDING,
+    MODEL_STATE_ACKNOWLEDGED,
+    MODEL_STATE_DROPPED
+} ModelState;
+
+// What the log must hold, by sequence. Events that the operation cut short
+// was about to append, drop or acknowledge are uncertain and may or may not
+// be recovered.
+typedef struct {
+    ModelState states[POWER_LOSS_EVENT_COUNT];
+    uint32_t offsets[POWER_LOSS_EVENT_COUNT];
+    bool uncertain[POWER_LOSS_EVENT_COUNT];
+} LogModel;
+
+static uint64_t getEventTime(uint32_t sequence) {
+    return sequence * 1000ULL + 7;
+}
+
+static void clearUncertain(LogModel* model, ModelState state) {
+    for (uint32_t i = 0; i < POWER_LOSS_EVENT_COUNT; ++i) {
+        if (model->uncertain[i]) {
+            model->states[i] = state;
+            model->uncertain[i] = false;
+        }
+    }
+}
+
+static bool acknowledgeOldest(EventLog* log, LogModel* model, size_t count) {
+    LoggedEvent events[3];
+    size_t peekedCount = 0;
+
+    if (EventLog_peek(log, events, count, &peekedCount) != ESP_OK) {
+        return false;
+    }
+
+    for (size_t i = 0; i < peekedCount; ++i) {
+        model->uncertain[events[i].sequence] = true;
+    }
+
+    if (EventLog_acknowledge(log, events, peekedCount) != ESP_OK) {
+        return false;
+    }
+
+    clearUncertain(model, MODEL_STATE_ACKNOWLEDGED);
+    return true;
+}
+
+static bool appendEvent(EventLog* log, LogModel* model) {
+    const uint32_t sequence = log->nextSequence;
+    LoggedEvent appended;
+
+    // Pending events in the sector it takes into use are dropped
+    if (log->headSlot >= SLOTS_PER_SECTOR) {
+        const uint32_t sector = (log->headSector + 1) % log->sectorCount;
+        for (uint32_t i = 0; i < sequence; ++i) {
+            model->uncertain[i] =
+                model->states[i] == MODEL_STATE_PENDING &&
+                model->offsets[i] / FLASH_SECTOR_SIZE == sector;
+        }
+    }
+
+    model->uncertain[sequence] = true;
+
+    if (EventLog_append(
+            log, EVENT_TYPE_RING, 1, getEventTime(sequence), &appended) !=
+        ESP_OK) {
+        return false;
+    }
+
+    model->uncertain[sequence] = false;
+    clearUncertain(model, MODEL_STATE_DROPPED);
+    model->states[sequence] = MODEL_STATE_PENDING;
+    model->offsets[sequence] = appended.offset;
+    return true;
+}
+
+// Fills the log past its capacity, acknowledging a few events, then
+// acknowledges most of what comes after. Returns false once an operation
+// fails.
+static bool runPowerLossWorkload(FlashStorage* storage, LogModel* model) {
+    EventLog log;
+
+    if (EventLog_open(&log, storage) != ESP_OK) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < POWER_LOSS_EVENT_COUNT; ++i) {
+        if (!appendEvent(&log, model)) {
+            return false;
+        }
+
+        const size_t acknowledgeCount =
+            i < 400 ? (i % 8 == 7 ? 1 : 0) : (i % 4 == 3 ? 3 : 0);
+
+        if (acknowledgeCount > 0 &&
+            !acknowledgeOldest(&log, model, acknowledgeCount)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Opens the log as after the power came back and checks that it holds
+// exactly the events that were pending, each as it was written
+static void checkRecoveredLog(FlashStorage* storage, const LogModel* model) {
+    static LoggedEvent events[POWER_LOSS_SECTOR_COUNT * SLOTS_PER_SECTOR];
+    const size_t maxCount = sizeof(events) / sizeof(events[0]);
+    bool recovered[POWER_LOSS_EVENT_COUNT] = {false};
+    EventLog log;
+    size_t count = 0;
+
+    resetRtcMemory();
+    CHECK_EQUAL(ESP_OK, EventLog_open(&log, storage));
+    CHECK_EQUAL(ESP_OK, EventLog_peek(&log, events, maxCount, &count));
+    CHECK_EQUAL(count, EventLog_getPendingCount(&log));
+
+    uint32_t nextSequence = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t sequence = events[i].sequence;
+        CHECK(sequence < POWER_LOSS_EVENT_COUNT);
+        if (sequence >= POWER_LOSS_EVENT_COUNT) {
+            continue;
+        }
+
+        CHECK(
+            model->states[sequence] == MODEL_STATE_PENDING ||
+            model->uncertain[sequence]);
+        CHECK(!recovered[sequence]);
+        CHECK_EQUAL(getEventTime(sequence), events[i].time);
+        CHECK_EQUAL(1, events[i].clockId);
+        recovered[sequence] = true;
+        if (sequence >= nextSequence) {
+            nextSequence = sequence + 1;
+        }
+    }
+
+    for (uint32_t i = 0; i < POWER_LOSS_EVENT_COUNT; ++i) {
+        if (model->states[i] == MODEL_STATE_PENDING && !model->uncertain[i]) {
+            CHECK(recovered[i]);
+        }
+    }
+
+    // And carries on from there
+    LoggedEvent appended;
+    CHECK_EQUAL(
+        ESP_OK, EventLog_append(&log, EVENT_TYPE_RING, 1, 0, &appended));
+    CHECK(appended.sequence >= nextSequence);
+    CHECK_EQUAL(ESP_OK, EventLog_peek(&log, events, 1, &count));
+    CHECK_EQUAL(1, count);
+}
+
+static bool isTorn(const MockFlashPowerLoss* powerLoss) {
+    return powerLoss->doneSize > 0 && powerLoss->doneSize < powerLoss->size;
+}
+
+// Cuts the power at every point of the workload in turn
+static void testPowerLoss(void) {
+    static LogModel model;
+    FlashStorage storage;
+    MockFlashPowerLoss powerLoss;
+    int tornRecordCount = 0;
+    int tornHeaderCount = 0;
+    int interruptedEraseCount = 0;
+
+    for (size_t cut = 0;; cut += POWER_LOSS_STEP) {
+        initMockFlash(&storage, POWER_LOSS_SECTOR_COUNT);
+        resetRtcMemory();
+        memset(&model, 0, sizeof(model));
+        setMockFlashPowerLoss(cut);
+
+        const bool completed = runPowerLossWorkload(&storage, &model);
+        const bool lost = restoreMockFlashPower(&powerLoss);
+
+        if (!lost) {
+            CHECK(completed);
+            break;
+        }
+
+        if (isTorn(&powerLoss)) {
+            if (powerLoss.operation == MOCK_FLASH_ERASE) {
+                ++interruptedEraseCount;
+            } else if (powerLoss.offset % FLASH_SECTOR_SIZE == 0) {
+                ++tornHeaderCount;
+            } else {
+                ++tornRecordCount;
+            }
+        }
+
+        const int failures = checkFailures;
+        checkRecoveredLog(&storage, &model);
+
+        if (checkFailures != failures) {
+            fprintf(stderr, "With power lost after %zu bytes\n", cut);
+            return;
+        }
+    }
+
+    CHECK(tornRecordCount > 0);
+    CHECK(tornHeaderCount > 0);
+    CHECK(interruptedEraseCount > 0);
+    printf(
+        "power loss: %d torn records, %d torn headers, %d interrupted "
+        "erases\n",
+        tornRecordCount, tornHeaderCount, interruptedEraseCount);
+}
+
+int main(void) {
+    testWakeWithoutScan();
+    testWrappedLog();
+    testFullHeadSector();
+    testWrittenPastHead();
+    testErasedStorage();
+    testPowerLoss();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,641 @@
+#include "firmware.h"
+#include "check.h"
+#include "https.h"
+#include "lzss.h"
+#include "mocknvs.h"
+#include "mockota.h"
+#include "script.h"
+
+#include <esp_ota_ops.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define IMAGE_SIZE (1200 * 1024 + 123)
+// Small enough for scripts/mkcompressed.py to be quick, over a few blocks
+#define COMPRESSIBLE_IMAGE_SIZE (260 * 1024 + 123)
+#define COMPRESSED_BLOCK_SIZE (64 * 1024)
+#define COMPRESSED_HEADER_SIZE 16
+#define CHUNK_SIZE (16 * 4096)
+#define MAX_REQUESTS 256
+// Body bytes passed to the event handler at once
+#define SERVER_PIECE_SIZE 1400
+
+static const char* IMAGE_URL = "https://example.com/doorbell.bin";
+static const char* PATCH_URL = "https://example.com/doorbell.patch";
+
+typedef struct {
+    uint32_t rangeStart;
+    uint32_t rangeLength;
+} RecordedRequest;
+
+static uint8_t image[IMAGE_SIZE];
+static size_t imageSize = IMAGE_SIZE;
+// The image itself unless it's served compressed
+static const uint8_t* servedFile = image;
+static size_t servedFileSize = IMAGE_SIZE;
+static RecordedRequest requests[MAX_REQUESTS];
+static size_t requestCount = 0;
+// Body bytes that are sent before the connection drops once, -1 to not drop
+static int64_t bytesUntilDrop = -1;
+// Served at PATCH_URL, which is not found while NULL
+static const uint8_t* patch = NULL;
+static size_t patchSize = 0;
+static size_t patchRequestCount = 0;
+// Answers every request with the whole file, like servers without Range
+static bool ignoreRange = false;
+
+esp_err_t parseHttpsUrl(const char* url, HttpsUrl* parsedUrl) {
+    strcpy(parsedUrl->host, "example.com");
+    parsedUrl->port = HTTPS_DEFAULT_PORT;
+    parsedUrl->path = url;
+    return ESP_OK;
+}
+
+// Serves the patch without support for Range
+esp_err_t httpsRequest(const HttpsRequest* request, HttpsResponse* response) {
+    ++patchRequestCount;
+    CHECK(strcmp(request->path, PATCH_URL) == 0);
+
+    if (!patch) {
+        *response = (HttpsResponse){.statusCode = 404};
+        return ESP_OK;
+    }
+
+    *response = (HttpsResponse){
+        .statusCode = 200,
+        .contentLength = patchSize,
+        .rangeStart = -1,
+        .totalLength = -1};
+
+    for (size_t sent = 0; sent < patchSize;) {
+        size_t count = patchSize - sent;
+        count = count < SERVER_PIECE_SIZE ? count : SERVER_PIECE_SIZE;
+
+        HttpsEvent event = {
+            .id = HTTPS_EVENT_ON_DATA,
+            .statusCode = 200,
+            .rangeStart = -1,
+            .data = (const char*)&patch[sent],
+            .dataLength = count,
+            .userData = request->userData};
+        esp_err_t error = request->eventHandler(&event);
+
+        if (error != ESP_OK) {
+            return error;
+        }
+
+        sent += count;
+        response->bodyLength = sent;
+    }
+
+    return ESP_OK;
+}
+
+// Serves the file with support for Range unless ignoreRange is set
+esp_err_t HttpsClient_request(
+    HttpsClient* client,
+    const HttpsRequest* request,
+    HttpsResponse* response) {
+    CHECK(requestCount < MAX_REQUESTS);
+    requests[requestCount++] = (RecordedRequest){
+        .rangeStart = request->rangeStart,
+        .rangeLength = request->rangeLength};
+
+    const bool ranged = request->rangeLength > 0 && !ignoreRange;
+    const uint32_t start = ranged ? request->rangeStart : 0;
+
+    if (start >= servedFileSize) {
+        *response = (HttpsResponse){.statusCode = 416};
+        return ESP_OK;
+    }
+
+    uint32_t length = servedFileSize - start;
+    length = ranged && request->rangeLength < length ? request->rangeLength
+                                                     : length;
+
+    *response = (HttpsResponse){
+        .statusCode = ranged ? 206 : 200,
+        .contentLength = length,
+        .rangeStart = ranged ? start : -1,
+        .totalLength = ranged ? servedFileSize : -1};
+
+    for (uint32_t sent = 0; sent < length;) {
+        uint32_t count = length - sent;
+        count = count < SERVER_PIECE_SIZE ? count : SERVER_PIECE_SIZE;
+
+        if (bytesUntilDrop >= 0 && count > bytesUntilDrop) {
+            count = bytesUntilDrop;
+        }
+
+        if (count == 0) {
+            bytesUntilDrop = -1;
+            return ESP_FAIL;
+        }
+
+        HttpsEvent event = {
+            .id = HTTPS_EVENT_ON_DATA,
+            .statusCode = response->statusCode,
+            .rangeStart = response->rangeStart,
+            .data = (const char*)&servedFile[start + sent],
+            .dataLength = count,
+            .userData = request->userData};
+        esp_err_t error = request->eventHandler(&event);
+
+        if (error != ESP_OK) {
+            return error;
+        }
+
+        sent += count;
+        response->bodyLength = sent;
+
+        if (bytesUntilDrop >= 0) {
+            bytesUntilDrop -= count;
+        }
+    }
+
+    return ESP_OK;
+}
+
+void HttpsClient_close(HttpsClient* client) {}
+
+static void resetServer(void) {
+    resetMockOta();
+    eraseMockNvs();
+    requestCount = 0;
+    bytesUntilDrop = -1;
+    patch = NULL;
+    patchSize = 0;
+    patchRequestCount = 0;
+    ignoreRange = false;
+    imageSize = IMAGE_SIZE;
+    servedFile = image;
+    servedFileSize = IMAGE_SIZE;
+
+    // Anything but the magic of a compressed image
+    uint32_t state = 12345;
+    for (size_t i = 0; i < IMAGE_SIZE; ++i) {
+        state = state * 1103515245 + 12345;
+        image[i] = state >> 16;
+    }
+}
+
+static bool isImageWritten(void) {
+    const esp_partition_t* partition = esp_ota_get_next_update_partition(NULL);
+    return memcmp(getMockPartitionData(partition), image, imageSize) == 0;
+}
+
+// Where the chunks of a call ended
+static uint32_t getEndOfLastChunk(void) {
+    const RecordedRequest* last = &requests[requestCount - 1];
+    return last->rangeStart + last->rangeLength;
+}
+
+static void testRawImageResumes(void) {
+    resetServer();
+
+    CHECK_EQUAL(
+        ESP_ERR_TIMEOUT, applyFirmwareUpdate(IMAGE_URL, NULL, "2.0", false));
+    CHECK(isFirmwareUpdateInProgress("2.0"));
+
+    // The first 512 bytes tell raw and compressed images apart, and are
+    // downloaded again with the first chunk
+    CHECK(requestCount >= 3);
+    CHECK_EQUAL(0, requests[0].rangeStart);
+    CHECK_EQUAL(512, requests[0].rangeLength);
+
+    for (size_t i = 1; i < requestCount; ++i) {
+        CHECK_EQUAL((i - 1) * CHUNK_SIZE, requests[i].rangeStart);
+        CHECK_EQUAL(CHUNK_SIZE, requests[i].rangeLength);
+    }
+
+    // Continues without the header and without writing anything twice
+    const uint32_t savedOffset = getEndOfLastChunk();
+    const size_t firstCallRequestCount = requestCount;
+    CHECK_EQUAL(savedOffset, getMockPartitionWriteCount());
+
+    CHECK_EQUAL(
+        ESP_ERR_TIMEOUT, applyFirmwareUpdate(IMAGE_URL, NULL, "2.0", false));
+    CHECK(requestCount > firstCallRequestCount);
+    CHECK_EQUAL(savedOffset, requests[firstCallRequestCount].rangeStart);
+
+    CHECK_EQUAL(ESP_OK, applyFirmwareUpdate(IMAGE_URL, NULL, "2.0", false));
+    CHECK_EQUAL(IMAGE_SIZE, getMockPartitionWriteCount());
+    CHECK(isImageWritten());
+    CHECK(getMockBootPartition() == esp_ota_get_next_update_partition(NULL));
+    CHECK(!isFirmwareUpdateInProgress("2.0"));
+}
+
+// Drops the connection once after the given number of body bytes, counted
+// over all calls, and checks that the download carries on from the last
+// checkpoint
+static void checkDroppedConnection(uint32_t dropAt) {
+    resetServer();
+    bytesUntilDrop = dropAt;
+
+    // The first 512 bytes are the header, and the image follows from 0
+    const bool dropped = dropAt < IMAGE_SIZE + 512;
+    const uint32_t writtenBeforeDrop =
+        !dropped ? IMAGE_SIZE : dropAt > 512 ? dropAt - 512 : 0;
+    const uint32_t checkpoint =
+        !dropped ? IMAGE_SIZE : writtenBeforeDrop / CHUNK_SIZE * CHUNK_SIZE;
+    esp_err_t error = ESP_ERR_TIMEOUT;
+    size_t resumeRequest = 0;
+
+    for (int i = 0; i < 10 && error != ESP_OK; ++i) {
+        if (error != ESP_ERR_TIMEOUT) {
+            // The call after the drop
+            resumeRequest = requestCount;
+        }
+
+        error = applyFirmwareUpdate(IMAGE_URL, NULL, "2.0", false);
+    }
+
+    CHECK_EQUAL(ESP_OK, error);
+    CHECK(isImageWritten());
+    // Nothing is written twice but what came after the checkpoint
+    CHECK_EQUAL(
+        IMAGE_SIZE + writtenBeforeDrop - checkpoint,
+        getMockPartitionWriteCount());
+
+    if (!dropped) {
+        CHECK_EQUAL(0, resumeRequest);
+    } else if (dropAt <= 512) {
+        // Within the header, which is requested again
+        CHECK_EQUAL(0, requests[resumeRequest].rangeStart);
+        CHECK_EQUAL(512, requests[resumeRequest].rangeLength);
+    } else {
+        CHECK(resumeRequest > 0);
+        CHECK_EQUAL(checkpoint, requests[resumeRequest].rangeStart);
+    }
+}
+
+static void testDroppedConnectionResumesAtCheckpoint(void) {
+    // In the header, at the end of it and right around checkpoints
+    const uint32_t DROPS[] = {
+        0,
+        1,
+        511,
+        512,
+        513,
+        512 + CHUNK_SIZE - 1,
+        512 + CHUNK_SIZE,
+        512 + CHUNK_SIZE + 1,
+        512 + 8 * CHUNK_SIZE,
+        512 + IMAGE_SIZE - 1,
+        512 + IMAGE_SIZE};
+
+    for (size_t i = 0; i < sizeof(DROPS) / sizeof(DROPS[0]); ++i) {
+        const int failures = checkFailures;
+        checkDroppedConnection(DROPS[i]);
+        if (checkFailures != failures) {
+            fprintf(stderr, "With the drop after %u bytes\n", DROPS[i]);
+        }
+    }
+
+    // Anywhere else, from a fixed seed so that failures can be repeated
+    uint32_t state = 2024;
+
+    for (int i = 0; i < 40; ++i) {
+        state = state * 1103515245 + 12345;
+        const uint32_t dropAt = (state >> 8) % (IMAGE_SIZE + 512);
+        const int failures = checkFailures;
+        checkDroppedConnection(dropAt);
+        if (checkFailures != failures) {
+            fprintf(stderr, "With the drop after %u bytes\n", dropAt);
+        }
+    }
+}
+
+// The whole image comes with the request for the header, which is only
+// used to tell the format, and again with the first chunk
+static void testServerIgnoringRange(void) {
+    resetServer();
+    ignoreRange = true;
+
+    CHECK_EQUAL(ESP_OK, applyFirmwareUpdate(IMAGE_URL, NULL, "2.0", false));
+    CHECK_EQUAL(2, requestCount);
+    CHECK(isImageWritten());
+    CHECK_EQUAL(IMAGE_SIZE, getMockPartitionWriteCount());
+    CHECK(getMockBootPartition() == esp_ota_get_next_update_partition(NULL));
+}
+
+// A server that stops honoring Range halfway sends the image from the
+// start, which is written over what was there
+static void testServerIgnoringRangeOnResume(void) {
+    resetServer();
+
+    CHECK_EQUAL(
+        ESP_ERR_TIMEOUT, applyFirmwareUpdate(IMAGE_URL, NULL, "2.0", false));
+    const uint32_t writtenBefore = getMockPartitionWriteCount();
+    CHECK(writtenBefore > 0);
+
+    ignoreRange = true;
+    const size_t resumeRequest = requestCount;
+    CHECK_EQUAL(ESP_OK, applyFirmwareUpdate(IMAGE_URL, NULL, "2.0", false));
+    CHECK_EQUAL(writtenBefore, requests[resumeRequest].rangeStart);
+    CHECK_EQUAL(resumeRequest + 1, requestCount);
+    CHECK(isImageWritten());
+    CHECK_EQUAL(writtenBefore + IMAGE_SIZE, getMockPartitionWriteCount());
+    CHECK(!isFirmwareUpdateInProgress("2.0"));
+}
+
+static void testOtherVersionStartsOver(void) {
+    resetServer();
+
+    CHECK_EQUAL(
+        ESP_ERR_TIMEOUT, applyFirmwareUpdate(IMAGE_URL, NULL, "2.0", false));
+    CHECK(!isFirmwareUpdateInProgress("2.1"));
+
+    const size_t firstCallRequestCount = requestCount;
+    CHECK_EQUAL(
+        ESP_ERR_TIMEOUT, applyFirmwareUpdate(IMAGE_URL, NULL, "2.1", false));
+    CHECK_EQUAL(0, requests[firstCallRequestCount].rangeStart);
+    CHECK_EQUAL(512, requests[firstCallRequestCount].rangeLength);
+    CHECK(isFirmwareUpdateInProgress("2.1"));
+}
+
+// The image that is running, from which the served image is patched
+static uint8_t runningImage[IMAGE_SIZE];
+
+// Like an older build: some bytes differ and a block was added since
+static void makeRunningImage(void) {
+    memcpy(runningImage, image, 100000);
+    memcpy(&runningImage[100000], &image[102000], IMAGE_SIZE - 102000);
+    memset(&runningImage[IMAGE_SIZE - 2000], 0x42, 2000);
+
+    for (size_t i = 5000; i < IMAGE_SIZE; i += 65521) {
+        runningImage[i] ^= 0x11;
+    }
+
+    setMockRunningImage(runningImage, IMAGE_SIZE);
+}
+
+// Returns a copy that the caller may change and frees. The images are the
+// same for every test, so the script only runs once.
+static uint8_t* makePatch(size_t* size) {
+    static uint8_t* madePatch = NULL;
+    static size_t madePatchSize = 0;
+
+    if (!madePatch) {
+        const ScriptFile files[] = {
+            {runningImage, IMAGE_SIZE}, {image, IMAGE_SIZE}};
+        madePatch = runScript("mkpatch.py", files, 2, &madePatchSize);
+    }
+
+    uint8_t* copy = malloc(madePatchSize);
+    memcpy(copy, madePatch, madePatchSize);
+    *size = madePatchSize;
+    return copy;
+}
+
+static void testPatchUpdate(void) {
+    resetServer();
+    makeRunningImage();
+    uint8_t* servedPatch = makePatch(&patchSize);
+    patch = servedPatch;
+
+    CHECK_EQUAL(
+        ESP_OK, applyFirmwareUpdate(IMAGE_URL, PATCH_URL, "2.0", false));
+    CHECK_EQUAL(1, patchRequestCount);
+    CHECK_EQUAL(0, requestCount);
+    CHECK(isImageWritten());
+    CHECK(getMockBootPartition() == esp_ota_get_next_update_partition(NULL));
+    CHECK(!isFirmwareUpdateInProgress("2.0"));
+    free(servedPatch);
+}
+
+// Downloads the full image once the patch failed, and doesn't try the patch
+// again on later calls
+static void checkFallback(void) {
+    CHECK_EQUAL(
+        ESP_ERR_TIMEOUT,
+        applyFirmwareUpdate(IMAGE_URL, PATCH_URL, "2.0", false));
+    CHECK_EQUAL(1, patchRequestCount);
+    CHECK(requestCount > 0);
+    CHECK_EQUAL(0, requests[0].rangeStart);
+    CHECK(getMockBootPartition() == NULL);
+
+    esp_err_t error = ESP_ERR_TIMEOUT;
+    for (int i = 0; i < 10 && error == ESP_ERR_TIMEOUT; ++i) {
+        error = applyFirmwareUpdate(IMAGE_URL, PATCH_URL, "2.0", false);
+    }
+
+    CHECK_EQUAL(ESP_OK, error);
+    CHECK_EQUAL(1, patchRequestCount);
+    CHECK(isImageWritten());
+    CHECK(getMockBootPartition() == esp_ota_get_next_update_partition(NULL));
+}
+
+static void testPatchNotFoundFallsBack(void) {
+    resetServer();
+    makeRunningImage();
+    checkFallback();
+}
+
+static void testPatchForOtherImageFallsBack(void) {
+    resetServer();
+    makeRunningImage();
+    uint8_t* servedPatch = makePatch(&patchSize);
+    patch = servedPatch;
+
+    // The running image was changed since the patch was made
+    runningImage[IMAGE_SIZE - 1] ^= 1;
+    setMockRunningImage(runningImage, IMAGE_SIZE);
+    checkFallback();
+    free(servedPatch);
+}
+
+static void testTruncatedPatchFallsBack(void) {
+    resetServer();
+    makeRunningImage();
+    uint8_t* servedPatch = makePatch(&patchSize);
+    patch = servedPatch;
+
+    patchSize -= 10;
+    checkFallback();
+    free(servedPatch);
+}
+
+static void testPatchWithWrongTargetHashFallsBack(void) {
+    resetServer();
+    makeRunningImage();
+    uint8_t* servedPatch = makePatch(&patchSize);
+    patch = servedPatch;
+
+    // The target hash, see scripts/mkpatch.py
+    servedPatch[48] ^= 1;
+    checkFallback();
+    free(servedPatch);
+}
+
+static uint32_t readUint32(const uint8_t* data) {
+    return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+// Like code, made of a few recurring sequences with some noise in between
+static void makeCompressibleImage(void) {
+    uint8_t words[64][12];
+    uint8_t wordLengths[64];
+    uint32_t state = 54321;
+
+    for (size_t i = 0; i < 64; ++i) {
+        state = state * 1103515245 + 12345;
+        wordLengths[i] = 4 + (state >> 16) % 9;
+
+        for (size_t j = 0; j < wordLengths[i]; ++j) {
+            state = state * 1103515245 + 12345;
+            words[i][j] = state >> 16;
+        }
+    }
+
+    imageSize = COMPRESSIBLE_IMAGE_SIZE;
+
+    for (size_t length = 0; length < imageSize;) {
+        state = state * 1103515245 + 12345;
+        const uint32_t choice = (state >> 16) % 640;
+
+        if (choice >= 64) {
+            const size_t word = choice % 64;
+            const size_t count = imageSize - length < wordLengths[word]
+                                     ? imageSize - length
+                                     : wordLengths[word];
+            memcpy(&image[length], words[word], count);
+            length += count;
+        } else {
+            image[length++] = choice;
+        }
+    }
+}
+
+// Serves the image compressed with scripts/mkcompressed.py. The image is the
+// same for every test, so the script only runs once.
+static void serveCompressedImage(void) {
+    static uint8_t* compressed = NULL;
+    static size_t compressedSize = 0;
+
+    makeCompressibleImage();
+
+    if (!compressed) {
+        const ScriptFile files[] = {{image, imageSize}};
+        compressed = runScript("mkcompressed.py", files, 1, &compressedSize);
+    }
+
+    servedFile = compressed;
+    servedFileSize = compressedSize;
+}
+
+// Where a block starts in the served file, or ends for the block count
+static uint32_t getBlockOffset(uint32_t block) {
+    return readUint32(&servedFile[COMPRESSED_HEADER_SIZE + 4 * block]);
+}
+
+static uint32_t getBlockCount(void) {
+    return (imageSize + COMPRESSED_BLOCK_SIZE - 1) / COMPRESSED_BLOCK_SIZE;
+}
+
+static void testCompressedImage(void) {
+    resetServer();
+    serveCompressedImage();
+    CHECK(servedFileSize < imageSize / 2);
+    CHECK_EQUAL(5, getBlockCount());
+
+    const clock_t start = clock();
+    CHECK_EQUAL(ESP_OK, applyFirmwareUpdate(IMAGE_URL, NULL, "2.0", false));
+    const double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    CHECK(isImageWritten());
+    CHECK_EQUAL(imageSize, getMockPartitionWriteCount());
+    CHECK(getMockBootPartition() == esp_ota_get_next_update_partition(NULL));
+    CHECK(!isFirmwareUpdateInProgress("2.0"));
+
+    // The header, then one request per block
+    CHECK_EQUAL(1 + getBlockCount(), requestCount);
+    CHECK_EQUAL(0, requests[0].rangeStart);
+    CHECK_EQUAL(512, requests[0].rangeLength);
+
+    for (uint32_t block = 0; block < getBlockCount(); ++block) {
+        const RecordedRequest* request = &requests[1 + block];
+        CHECK_EQUAL(getBlockOffset(block), request->rangeStart);
+        CHECK_EQUAL(
+            getBlockOffset(block + 1) - getBlockOffset(block),
+            request->rangeLength);
+    }
+
+    printf(
+        "benchmark: compressed update of %zu bytes from %zu, %.1f MB/s of "
+        "image, decoder uses %zu bytes\n",
+        imageSize, servedFileSize, imageSize / seconds / 1e6,
+        sizeof(LzssDecoder));
+}
+
+// Drops the connection in the middle of every block, and before the block
+// after it, and checks that the download carries on at the block that was
+// cut short
+static void testCompressedImageResumesAtBlock(void) {
+    for (uint32_t block = 0; block < getBlockCount(); ++block) {
+        for (int atEnd = 0; atEnd <= 1; ++atEnd) {
+            resetServer();
+            serveCompressedImage();
+
+            const uint32_t blockLength =
+                getBlockOffset(block + 1) - getBlockOffset(block);
+            const uint32_t resumeBlock = block + atEnd;
+            bytesUntilDrop = 512 + getBlockOffset(block) - getBlockOffset(0) +
+                             (atEnd ? blockLength : blockLength / 2);
+
+            const esp_err_t error =
+                applyFirmwareUpdate(IMAGE_URL, NULL, "2.0", false);
+
+            if (resumeBlock == getBlockCount()) {
+                CHECK_EQUAL(ESP_OK, error);
+                CHECK(isImageWritten());
+                continue;
+            }
+
+            CHECK(error != ESP_OK);
+            CHECK(isFirmwareUpdateInProgress("2.0") == (resumeBlock > 0));
+            // The header and the blocks up to the one that was cut short
+            CHECK_EQUAL(2 + resumeBlock, requestCount);
+
+            bytesUntilDrop = -1;
+            const size_t resumeRequest = requestCount;
+            CHECK_EQUAL(
+                ESP_OK, applyFirmwareUpdate(IMAGE_URL, NULL, "2.0", false));
+            CHECK_EQUAL(0, requests[resumeRequest].rangeStart);
+            CHECK_EQUAL(
+                getBlockOffset(resumeBlock),
+                requests[resumeRequest + 1].rangeStart);
+            CHECK(isImageWritten());
+        }
+    }
+}
+
+// Blocks can't be decompressed from the start of the file
+static void testServerIgnoringRangeWithCompressedImage(void) {
+    resetServer();
+    serveCompressedImage();
+    ignoreRange = true;
+
+    CHECK_EQUAL(
+        ESP_ERR_NOT_SUPPORTED,
+        applyFirmwareUpdate(IMAGE_URL, NULL, "2.0", false));
+    CHECK(getMockBootPartition() == NULL);
+}
+
+int main(void) {
+    testRawImageResumes();
+    testDroppedConnectionResumesAtCheckpoint();
+    testOtherVersionStartsOver();
+    testCompressedImage();
+    testCompressedImageResumesAtBlock();
+    testServerIgnoringRange();
+    testServerIgnoringRangeOnResume();
+    testServerIgnoringRangeWithCompressedImage();
+    testPatchUpdate();
+    testPatchNotFoundFallsBack();
+    testPatchForOtherImageFallsBack();
+    testTruncatedPatchFallsBack();
+    testPatchWithWrongTargetHashFallsBack();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,242 @@
+#include "flatmap.h"
+#include "check.h"
+
+#include <string.h>
+#include <time.h>
+
+#define MAX_LINES 16
+#define BENCHMARK_BODY_SIZE (64 * 1024)
+#define BENCHMARK_CHUNK_SIZE 1460
+#define BENCHMARK_ROUNDS 200
+
+// Lines as "key=value", so that they compare with strcmp()
+typedef struct {
+    char lines[MAX_LINES][FLATMAP_LINE_MAX_LENGTH * 2];
+    size_t count;
+} ParsedLines;
+
+static size_t benchmarkSink = 0;
+
+static void collectLine(
+    const char* key,
+    size_t keyLength,
+    const char* value,
+    size_t valueLength,
+    void* userData) {
+    ParsedLines* parsed = userData;
+
+    if (parsed->count == MAX_LINES) {
+        ++parsed->count;
+        return;
+    }
+
+    snprintf(
+        parsed->lines[parsed->count++], sizeof(parsed->lines[0]), "%.*s=%.*s",
+        (int)keyLength, key, (int)valueLength, value);
+}
+
+static void countLine(
+    const char* key,
+    size_t keyLength,
+    const char* value,
+    size_t valueLength,
+    void* userData) {
+    benchmarkSink += keyLength + valueLength;
+}
+
+// Feeds the body split at the given offsets, which must be increasing
+static void parse(
+    ParsedLines* parsed,
+    const char* body,
+    const size_t* splits,
+    size_t splitCount) {
+    FlatmapParser parser;
+    const size_t length = strlen(body);
+    size_t offset = 0;
+
+    memset(parsed, 0, sizeof(*parsed));
+    FlatmapParser_init(&parser, collectLine, parsed);
+
+    for (size_t i = 0; i <= splitCount; ++i) {
+        const size_t end = i < splitCount ? splits[i] : length;
+        FlatmapParser_feed(&parser, body + offset, end - offset);
+        offset = end;
+    }
+
+    FlatmapParser_finish(&parser);
+}
+
+static void checkLines(
+    const ParsedLines* parsed, const char* const* expected, size_t count) {
+    CHECK_EQUAL(count, parsed->count);
+
+    for (size_t i = 0; i < count && i < parsed->count; ++i) {
+        if (strcmp(expected[i], parsed->lines[i]) != 0) {
+            fprintf(
+                stderr, "Line %zu is \"%s\", expected \"%s\"\n", i,
+                parsed->lines[i], expected[i]);
+            ++checkFailures;
+        }
+    }
+}
+
+// Every way of splitting the body in two, and then in three
+static void checkEverySplit(
+    const char* body, const char* const* expected, size_t count) {
+    const size_t length = strlen(body);
+    ParsedLines parsed;
+
+    parse(&parsed, body, NULL, 0);
+    checkLines(&parsed, expected, count);
+
+    for (size_t i = 0; i <= length; ++i) {
+        const size_t splits[] = {i};
+        parse(&parsed, body, splits, 1);
+        checkLines(&parsed, expected, count);
+
+        for (size_t j = i; j <= length; ++j) {
+            const size_t moreSplits[] = {i, j};
+            parse(&parsed, body, moreSplits, 2);
+            checkLines(&parsed, expected, count);
+        }
+    }
+}
+
+static void testLines(void) {
+    const char* body = "update.version=1.2.3\n"
+                       "update.path=/firmware/1.2.3.bin\n"
+                       "\n"
+                       "no separator\n"
+                       "empty=\n"
+                       "=no key\n"
+                       "a=b=c\n";
+    const char* expected[] = {
+        "update.version=1.2.3", "update.path=/firmware/1.2.3.bin", "empty=",
+        "=no key", "a=b=c"};
+    checkEverySplit(body, expected, sizeof(expected) / sizeof(expected[0]));
+}
+
+static void testCrLf(void) {
+    const char* body = "heartbeat.interval=3600\r\n"
+                       "\r\n"
+                       "update.version=1.2.3\r\n"
+                       "value=with\rinside\r\n";
+    const char* expected[] = {
+        "heartbeat.interval=3600", "update.version=1.2.3",
+        "value=with\rinside"};
+    checkEverySplit(body, expected, sizeof(expected) / sizeof(expected[0]));
+}
+
+// A last line without a newline is passed on by finish()
+static void testTruncatedLastLine(void) {
+    const char* body = "a=1\nupdate.version=1.2";
+    const char* expected[] = {"a=1", "update.version=1.2"};
+    checkEverySplit(body, expected, sizeof(expected) / sizeof(expected[0]));
+
+    const char* crBody = "a=1\nb=2\r";
+    const char* crExpected[] = {"a=1", "b=2"};
+    checkEverySplit(
+        crBody, crExpected, sizeof(crExpected) / sizeof(crExpected[0]));
+}
+
+static void testLongLines(void) {
+    static char body[4 * FLATMAP_LINE_MAX_LENGTH];
+    static char longLine[2 * FLATMAP_LINE_MAX_LENGTH];
+    static char longestLine[FLATMAP_LINE_MAX_LENGTH + 1];
+    ParsedLines parsed;
+
+    memset(longLine, 'x', sizeof(longLine) - 1);
+    memcpy(longLine, "long=", 5);
+    memset(longestLine, 'y', sizeof(longestLine) - 1);
+    memcpy(longestLine, "longest=", 8);
+    snprintf(
+        body, sizeof(body), "a=1\n%s\nb=2\n%s\nc=3\n", longLine, longestLine);
+
+    // In one chunk, lines are passed on without copying, whatever their
+    // length
+    parse(&parsed, body, NULL, 0);
+    const char* whole[] = {"a=1", longLine, "b=2", longestLine, "c=3"};
+    checkLines(&parsed, whole, 5);
+
+    // Split, a line only fits if it's no longer than the line buffer
+    const size_t longStart = 4;
+    const size_t longestStart = longStart + strlen(longLine) + 5;
+    const size_t splits[] = {
+        longStart + 1, longStart + FLATMAP_LINE_MAX_LENGTH + 1,
+        longestStart + 1};
+    parse(&parsed, body, splits, 3);
+    const char* split[] = {"a=1", "b=2", longestLine, "c=3"};
+    checkLines(&parsed, split, 4);
+
+    // Skipped up to the newline, even if that's in a later chunk
+    const size_t byteSplits[] = {
+        longStart + 1, longStart + 2, longStart + 3,
+        longStart + FLATMAP_LINE_MAX_LENGTH + 10,
+        longStart + strlen(longLine)};
+    parse(&parsed, body, byteSplits, 5);
+    checkLines(&parsed, split, 4);
+
+    // Nor is a long line passed on by finish()
+    snprintf(body, sizeof(body), "a=1\n%s", longLine);
+    const size_t lastSplits[] = {longStart + 1};
+    parse(&parsed, body, lastSplits, 1);
+    checkLines(&parsed, whole, 1);
+}
+
+static void testHelpers(void) {
+    char value[4];
+
+    CHECK(flatmapKeyEquals("update.path", 11, "update.path"));
+    CHECK(!flatmapKeyEquals("update.path", 6, "update.path"));
+    CHECK(!flatmapKeyEquals("update.patch", 12, "update.path"));
+
+    copyFlatmapValue(value, sizeof(value), "123456", 6);
+    CHECK(strcmp(value, "123") == 0);
+    copyFlatmapValue(value, sizeof(value), "12", 2);
+    CHECK(strcmp(value, "12") == 0);
+}
+
+// Only printed, as the host says little about the speed on the chip
+static void benchmark(void) {
+    static char body[BENCHMARK_BODY_SIZE];
+    size_t length = 0;
+
+    while (length + 64 < sizeof(body)) {
+        length += snprintf(
+            body + length, sizeof(body) - length, "key.%zu=value %zu\n",
+            length, length);
+    }
+
+    const clock_t start = clock();
+
+    for (int round = 0; round < BENCHMARK_ROUNDS; ++round) {
+        FlatmapParser parser;
+        FlatmapParser_init(&parser, countLine, NULL);
+
+        for (size_t offset = 0; offset < length;
+             offset += BENCHMARK_CHUNK_SIZE) {
+            const size_t left = length - offset;
+            FlatmapParser_feed(
+                &parser, body + offset,
+                left < BENCHMARK_CHUNK_SIZE ? left : BENCHMARK_CHUNK_SIZE);
+        }
+
+        FlatmapParser_finish(&parser);
+    }
+
+    const double time = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf(
+        "benchmark: %.0f MB/s in chunks of %d bytes, parser is %zu bytes\n",
+        length * (double)BENCHMARK_ROUNDS / time / 1e6, BENCHMARK_CHUNK_SIZE,
+        sizeof(FlatmapParser));
+}
+
+int main(void) {
+    testLines();
+    testCrLf();
+    testTruncatedLastLine();
+    testLongLines();
+    testHelpers();
+    benchmark();
+    return CHECK_RESULT();
+}
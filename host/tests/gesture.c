@@ -0,0 +1,198 @@
+#include "gesture.h"
+#include "check.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define TIMELINE(steps) steps, sizeof(steps) / sizeof(steps[0])
+
+// As in tasks.c
+static const GestureConfig BUTTON_GESTURE_CONFIG = {
+    .ringCoalescingMs = 3000,
+    .longPressMs = 5000,
+    .seriesPressCount = 5,
+    .seriesWindowMs = 5000};
+
+typedef enum { STEP_PRESS, STEP_RELEASE, STEP_POLL } StepType;
+
+// Times are relative to the start of the timeline
+typedef struct {
+    StepType type;
+    uint32_t timeMs;
+    Gesture expected;
+} Step;
+
+static const Step RING_COALESCING[] = {
+    {STEP_PRESS, 0, GESTURE_RING},
+    {STEP_RELEASE, 200, GESTURE_NONE},
+    {STEP_PRESS, 1000, GESTURE_NONE},
+    {STEP_RELEASE, 1200, GESTURE_NONE},
+    // Coalesced presses don't extend the window
+    {STEP_PRESS, 2999, GESTURE_NONE},
+    {STEP_RELEASE, 2999, GESTURE_NONE},
+    {STEP_PRESS, 3000, GESTURE_RING},
+    {STEP_RELEASE, 3100, GESTURE_NONE},
+    {STEP_PRESS, 10000, GESTURE_RING}};
+
+static const Step SERIES_IN_WINDOW[] = {
+    {STEP_PRESS, 0, GESTURE_RING},
+    {STEP_POLL, 4999, GESTURE_NONE},
+    {STEP_POLL, 5000, GESTURE_LONG_PRESS},
+    // Reported once
+    {STEP_POLL, 6000, GESTURE_NONE},
+    {STEP_RELEASE, 6000, GESTURE_NONE},
+    {STEP_PRESS, 6500, GESTURE_NONE},
+    {STEP_RELEASE, 6600, GESTURE_NONE},
+    {STEP_PRESS, 7000, GESTURE_NONE},
+    {STEP_RELEASE, 7100, GESTURE_NONE},
+    {STEP_PRESS, 7500, GESTURE_NONE},
+    {STEP_RELEASE, 7600, GESTURE_NONE},
+    {STEP_PRESS, 8000, GESTURE_NONE},
+    {STEP_RELEASE, 8100, GESTURE_NONE},
+    // The window ends 5000 ms after the long press was reported
+    {STEP_PRESS, 10000, GESTURE_PRESS_SERIES},
+    // Holding the last press of the series isn't a long press
+    {STEP_POLL, 16000, GESTURE_NONE},
+    {STEP_RELEASE, 16000, GESTURE_NONE},
+    {STEP_PRESS, 20000, GESTURE_RING}};
+
+static const Step SERIES_OUT_OF_WINDOW[] = {
+    {STEP_PRESS, 0, GESTURE_RING},
+    {STEP_POLL, 5000, GESTURE_LONG_PRESS},
+    {STEP_RELEASE, 5100, GESTURE_NONE},
+    {STEP_PRESS, 6000, GESTURE_NONE},
+    {STEP_RELEASE, 6100, GESTURE_NONE},
+    {STEP_PRESS, 7000, GESTURE_NONE},
+    {STEP_RELEASE, 7100, GESTURE_NONE},
+    {STEP_PRESS, 8000, GESTURE_NONE},
+    {STEP_RELEASE, 8100, GESTURE_NONE},
+    {STEP_PRESS, 9000, GESTURE_NONE},
+    {STEP_RELEASE, 9100, GESTURE_NONE},
+    // Too late for the series, so it's a ring of its own
+    {STEP_PRESS, 10001, GESTURE_RING}};
+
+static const Step SERIES_EXPIRED_BY_POLL[] = {
+    {STEP_PRESS, 0, GESTURE_RING},
+    {STEP_POLL, 5000, GESTURE_LONG_PRESS},
+    {STEP_RELEASE, 5100, GESTURE_NONE},
+    {STEP_PRESS, 6000, GESTURE_NONE},
+    {STEP_RELEASE, 6100, GESTURE_NONE},
+    {STEP_POLL, 10001, GESTURE_NONE},
+    // Starts over, within the coalescing window of the ring it makes
+    {STEP_PRESS, 10500, GESTURE_RING},
+    {STEP_RELEASE, 10600, GESTURE_NONE},
+    {STEP_PRESS, 11000, GESTURE_NONE}};
+
+static const Step MISSED_RELEASE[] = {
+    {STEP_PRESS, 0, GESTURE_RING},
+    // The release in between was lost, so this doesn't restart the press
+    {STEP_PRESS, 4000, GESTURE_NONE},
+    {STEP_POLL, 5000, GESTURE_LONG_PRESS},
+    {STEP_RELEASE, 5200, GESTURE_NONE},
+    // A lost release after the long press only leaves the series short
+    {STEP_PRESS, 5500, GESTURE_NONE},
+    {STEP_PRESS, 6000, GESTURE_NONE},
+    {STEP_RELEASE, 6100, GESTURE_NONE},
+    {STEP_PRESS, 6500, GESTURE_NONE},
+    {STEP_RELEASE, 6600, GESTURE_NONE},
+    {STEP_PRESS, 7000, GESTURE_NONE},
+    {STEP_RELEASE, 7100, GESTURE_NONE},
+    {STEP_PRESS, 7500, GESTURE_NONE},
+    {STEP_RELEASE, 7600, GESTURE_NONE},
+    {STEP_PRESS, 8000, GESTURE_PRESS_SERIES}};
+
+static void runTimeline(
+    const char* name, const Step* steps, size_t stepCount, uint32_t startMs) {
+    GestureRecognizer recognizer;
+    GestureRecognizer_init(&recognizer, &BUTTON_GESTURE_CONFIG);
+
+    for (size_t i = 0; i < stepCount; ++i) {
+        const Step* step = &steps[i];
+        // Wraps around like the button clock does
+        const uint32_t timeMs = startMs + step->timeMs;
+        Gesture gesture;
+
+        if (step->type == STEP_POLL) {
+            gesture = GestureRecognizer_poll(&recognizer, timeMs);
+        } else {
+            const ButtonEvent event = {
+                .type = step->type == STEP_PRESS ? BUTTON_EVENT_PRESS
+                                                 : BUTTON_EVENT_RELEASE,
+                .timeMs = timeMs};
+            gesture = GestureRecognizer_feed(&recognizer, &event);
+        }
+
+        if (gesture != step->expected) {
+            fprintf(
+                stderr, "%s, starting at %u ms, step %zu:\n", name, startMs,
+                i);
+        }
+
+        CHECK_EQUAL(step->expected, gesture);
+    }
+}
+
+static void runTimelines(uint32_t startMs) {
+    runTimeline("ring coalescing", TIMELINE(RING_COALESCING), startMs);
+    runTimeline("series in window", TIMELINE(SERIES_IN_WINDOW), startMs);
+    runTimeline(
+        "series out of window", TIMELINE(SERIES_OUT_OF_WINDOW), startMs);
+    runTimeline(
+        "series expired by poll", TIMELINE(SERIES_EXPIRED_BY_POLL), startMs);
+    runTimeline("missed release", TIMELINE(MISSED_RELEASE), startMs);
+}
+
+static void testDeadlines(uint32_t startMs) {
+    GestureRecognizer recognizer;
+    GestureRecognizer_init(&recognizer, &BUTTON_GESTURE_CONFIG);
+
+    CHECK(GestureRecognizer_isIdle(&recognizer));
+    CHECK_EQUAL(
+        GESTURE_NO_DEADLINE,
+        GestureRecognizer_getTimeUntilDeadline(&recognizer, startMs));
+
+    const ButtonEvent press = {
+        .type = BUTTON_EVENT_PRESS, .timeMs = startMs};
+    GestureRecognizer_feed(&recognizer, &press);
+
+    CHECK(!GestureRecognizer_isIdle(&recognizer));
+    CHECK_EQUAL(
+        5000, GestureRecognizer_getTimeUntilDeadline(&recognizer, startMs));
+    CHECK_EQUAL(
+        1, GestureRecognizer_getTimeUntilDeadline(&recognizer, startMs + 4999));
+    CHECK_EQUAL(
+        0, GestureRecognizer_getTimeUntilDeadline(&recognizer, startMs + 6000));
+
+    GestureRecognizer_poll(&recognizer, startMs + 5000);
+    const ButtonEvent release = {
+        .type = BUTTON_EVENT_RELEASE, .timeMs = startMs + 5500};
+    GestureRecognizer_feed(&recognizer, &release);
+
+    // The series window is still open
+    CHECK(!GestureRecognizer_isIdle(&recognizer));
+    CHECK_EQUAL(
+        4501,
+        GestureRecognizer_getTimeUntilDeadline(&recognizer, startMs + 5500));
+    CHECK_EQUAL(
+        0,
+        GestureRecognizer_getTimeUntilDeadline(&recognizer, startMs + 10001));
+
+    GestureRecognizer_poll(&recognizer, startMs + 10001);
+    CHECK(GestureRecognizer_isIdle(&recognizer));
+    CHECK_EQUAL(
+        GESTURE_NO_DEADLINE,
+        GestureRecognizer_getTimeUntilDeadline(&recognizer, startMs + 10001));
+}
+
+int main(void) {
+    // The button clock wraps around after about 49 days
+    const uint32_t startTimes[] = {
+        0, 123456789, UINT32_MAX - 2999, UINT32_MAX - 7000, UINT32_MAX};
+
+    for (size_t i = 0; i < sizeof(startTimes) / sizeof(startTimes[0]); ++i) {
+        runTimelines(startTimes[i]);
+        testDeadlines(startTimes[i]);
+    }
+
+    return CHECK_RESULT();
+}
@@ -0,0 +1,244 @@
+#include "patch.h"
+#include "check.h"
+#include "script.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SOURCE_SIZE (256 * 1024 + 77)
+#define TARGET_MAX_SIZE (SOURCE_SIZE + 16 * 1024)
+// Offsets of the fields of the header, see scripts/mkpatch.py
+#define PATCH_SOURCE_HASH_OFFSET 16
+#define PATCH_TARGET_HASH_OFFSET 48
+
+typedef struct {
+    const uint8_t* source;
+    size_t sourceSize;
+    uint8_t* target;
+    size_t targetLength;
+} PatchContext;
+
+static uint8_t source[SOURCE_SIZE];
+static uint8_t target[TARGET_MAX_SIZE];
+static size_t targetSize = 0;
+static uint8_t patched[TARGET_MAX_SIZE];
+
+static esp_err_t
+readSource(void* context, uint32_t offset, void* data, size_t size) {
+    const PatchContext* patch = context;
+
+    if (offset > patch->sourceSize || size > patch->sourceSize - offset) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(data, &patch->source[offset], size);
+    return ESP_OK;
+}
+
+static esp_err_t writeTarget(void* context, const void* data, size_t size) {
+    PatchContext* patch = context;
+
+    if (size > TARGET_MAX_SIZE - patch->targetLength) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memcpy(&patch->target[patch->targetLength], data, size);
+    patch->targetLength += size;
+    return ESP_OK;
+}
+
+static void fillRandom(uint8_t* data, size_t size, uint32_t seed) {
+    for (size_t i = 0; i < size; ++i) {
+        seed = seed * 1103515245 + 12345;
+        data[i] = seed >> 16;
+    }
+}
+
+// Like a new build: a few changed bytes, code added and removed, and blocks
+// that moved. Both end in a hash, as ESP-IDF appends to app images.
+static void makeImages(void) {
+    fillRandom(source, SOURCE_SIZE, 1);
+    size_t length = 0;
+
+    memcpy(&target[length], source, 40000);
+    length += 40000;
+    fillRandom(&target[length], 3000, 2);
+    length += 3000;
+    memcpy(&target[length], &source[40000], 60000);
+    length += 60000;
+    // Skips 1000 bytes, and moves a block to the end
+    memcpy(&target[length], &source[121000], SOURCE_SIZE - 121000 - 32);
+    length += SOURCE_SIZE - 121000 - 32;
+    memcpy(&target[length], &source[101000], 20000);
+    length += 20000;
+    fillRandom(&target[length], 32, 3);
+    length += 32;
+    targetSize = length;
+
+    for (size_t i = 1000; i < targetSize; i += 9973) {
+        target[i] ^= 0x5a;
+    }
+}
+
+static uint8_t* makePatch(size_t* patchSize) {
+    const ScriptFile files[] = {
+        {source, SOURCE_SIZE}, {target, targetSize}};
+    return runScript("mkpatch.py", files, 2, patchSize);
+}
+
+// Feeds the patch in pieces of the given size and returns the first error
+static esp_err_t applyPatch(
+    const uint8_t* patch,
+    size_t patchSize,
+    size_t pieceSize,
+    const uint8_t* sourceHash,
+    PatchContext* context) {
+    static PatchApplier applier;
+    *context = (PatchContext){
+        .source = source,
+        .sourceSize = SOURCE_SIZE,
+        .target = patched,
+        .targetLength = 0};
+    PatchApplier_init(
+        &applier, readSource, writeTarget, context, SOURCE_SIZE, sourceHash);
+
+    esp_err_t error = ESP_OK;
+
+    for (size_t offset = 0; offset < patchSize && error == ESP_OK;
+         offset += pieceSize) {
+        const size_t count =
+            patchSize - offset < pieceSize ? patchSize - offset : pieceSize;
+        error = PatchApplier_feed(&applier, &patch[offset], count);
+    }
+
+    if (error == ESP_OK) {
+        error = PatchApplier_finish(&applier);
+    }
+
+    PatchApplier_free(&applier);
+    return error;
+}
+
+static void testPatch(const uint8_t* patch, size_t patchSize) {
+    static const size_t PIECE_SIZES[] = {1, 5, 9, 80, 1400, SIZE_MAX};
+    const uint8_t* sourceHash = &source[SOURCE_SIZE - PATCH_HASH_SIZE];
+
+    for (size_t i = 0; i < sizeof(PIECE_SIZES) / sizeof(PIECE_SIZES[0]);
+         ++i) {
+        PatchContext context;
+        CHECK_EQUAL(
+            ESP_OK, applyPatch(
+                        patch, patchSize, PIECE_SIZES[i], sourceHash,
+                        &context));
+        CHECK_EQUAL(targetSize, context.targetLength);
+        CHECK(memcmp(patched, target, targetSize) == 0);
+    }
+
+    // Without a hash to check the source against
+    PatchContext context;
+    CHECK_EQUAL(ESP_OK, applyPatch(patch, patchSize, 1400, NULL, &context));
+
+    // Mostly copies
+    CHECK(patchSize < targetSize / 10);
+    printf(
+        "patch: %zu bytes for a %zu byte image\n", patchSize, targetSize);
+}
+
+static void testWrongSourceHash(const uint8_t* patch, size_t patchSize) {
+    uint8_t otherHash[PATCH_HASH_SIZE];
+    memcpy(
+        otherHash, &source[SOURCE_SIZE - PATCH_HASH_SIZE], sizeof(otherHash));
+    otherHash[7] ^= 1;
+
+    PatchContext context;
+    CHECK_EQUAL(
+        ESP_ERR_INVALID_VERSION,
+        applyPatch(patch, patchSize, 1400, otherHash, &context));
+    // Nothing is written for another image
+    CHECK_EQUAL(0, context.targetLength);
+}
+
+static void testTruncatedPatch(const uint8_t* patch, size_t patchSize) {
+    const uint8_t* sourceHash = &source[SOURCE_SIZE - PATCH_HASH_SIZE];
+    // Within the header and the first command, and at the end
+    const size_t LENGTHS[] = {0, 10, PATCH_HEADER_SIZE, PATCH_HEADER_SIZE + 3,
+                              patchSize / 2, patchSize - 2, patchSize - 1};
+
+    for (size_t i = 0; i < sizeof(LENGTHS) / sizeof(LENGTHS[0]); ++i) {
+        PatchContext context;
+        CHECK_EQUAL(
+            ESP_ERR_INVALID_SIZE,
+            applyPatch(patch, LENGTHS[i], 1400, sourceHash, &context));
+    }
+
+    // Trailing data
+    uint8_t* longer = malloc(patchSize + 1);
+    memcpy(longer, patch, patchSize);
+    longer[patchSize] = 0;
+    PatchContext context;
+    CHECK_EQUAL(
+        ESP_ERR_INVALID_SIZE,
+        applyPatch(longer, patchSize + 1, 1400, sourceHash, &context));
+    free(longer);
+}
+
+static size_t findInPatch(
+    const uint8_t* patch, size_t patchSize, const uint8_t* data, size_t size) {
+    for (size_t offset = PATCH_HEADER_SIZE; offset + size <= patchSize;
+         ++offset) {
+        if (memcmp(&patch[offset], data, size) == 0) {
+            return offset;
+        }
+    }
+
+    fprintf(stderr, "Data isn't inserted by the patch.\n");
+    abort();
+}
+
+static void testWrongTargetHash(const uint8_t* patch, size_t patchSize) {
+    const uint8_t* sourceHash = &source[SOURCE_SIZE - PATCH_HASH_SIZE];
+    uint8_t* corrupted = malloc(patchSize);
+    PatchContext context;
+
+    memcpy(corrupted, patch, patchSize);
+    corrupted[PATCH_TARGET_HASH_OFFSET + 3] ^= 1;
+    CHECK_EQUAL(
+        ESP_ERR_INVALID_CRC,
+        applyPatch(corrupted, patchSize, 1400, sourceHash, &context));
+
+    // Inserted data that was changed on the way
+    memcpy(corrupted, patch, patchSize);
+    corrupted[findInPatch(patch, patchSize, &target[41000], 16)] ^= 1;
+    CHECK_EQUAL(
+        ESP_ERR_INVALID_CRC,
+        applyPatch(corrupted, patchSize, 1400, sourceHash, &context));
+
+    // Not a patch
+    memcpy(corrupted, patch, patchSize);
+    corrupted[0] = 'X';
+    CHECK_EQUAL(
+        ESP_ERR_NOT_SUPPORTED,
+        applyPatch(corrupted, patchSize, 1400, sourceHash, &context));
+
+    free(corrupted);
+}
+
+int main(void) {
+    makeImages();
+
+    size_t patchSize = 0;
+    uint8_t* patch = makePatch(&patchSize);
+    CHECK(
+        memcmp(
+            &patch[PATCH_SOURCE_HASH_OFFSET],
+            &source[SOURCE_SIZE - PATCH_HASH_SIZE], PATCH_HASH_SIZE) == 0);
+
+    testPatch(patch, patchSize);
+    testWrongSourceHash(patch, patchSize);
+    testTruncatedPatch(patch, patchSize);
+    testWrongTargetHash(patch, patchSize);
+
+    free(patch);
+    return CHECK_RESULT();
+}
@@ -0,0 +1,213 @@
+#include "check.h"
+#include "devicekey.h"
+#include "mocknvs.h"
+#include "resolver.h"
+#include "ringdatagram.h"
+
+#include <esp_system.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RECEIVER_HOST "127.0.0.1"
+#define RING_COUNT 10
+#define LOG_ID 0x5eed0001
+// Time stands still on the virtual clock, so rings are sent until they're
+// acknowledged, which the receiver always does in the end
+#define TIMEOUT_IN_MS 500
+// First retransmission after 50 ms, and the next after another 100 ms
+#define DROPPED_COPIES 2
+#define MIN_DROPPED_LATENCY_IN_US (150 * 1000)
+
+typedef struct {
+    pid_t pid;
+    // Of scripts/ringreceiver.py, stderr included
+    FILE* output;
+} Receiver;
+
+static const uint8_t KEY[DEVICE_KEY_SIZE] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa,
+    0xbb, 0xcc, 0xdd, 0xee, 0xff, 0x01, 0x23, 0x45, 0x67, 0x89, 0xab,
+    0xcd, 0xef, 0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10};
+
+static char keysPath[] = "/tmp/doorbell-keysXXXXXX";
+
+// Without mDNS, only the receiver on localhost can be reached
+esp_err_t
+resolveHost(const char* host, uint16_t port, struct sockaddr_in* address) {
+    memset(address, 0, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_port = htons(port);
+    return inet_pton(AF_INET, host, &address->sin_addr) == 1 ? ESP_OK
+                                                              : ESP_FAIL;
+}
+
+static uint64_t getMonotonicTimeInUs(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000ULL + time.tv_nsec / 1000;
+}
+
+static void writeKeys(void) {
+    const int fd = mkstemp(keysPath);
+    FILE* keys = fd >= 0 ? fdopen(fd, "w") : NULL;
+
+    if (!keys) {
+        fprintf(stderr, "Unable to write %s.\n", keysPath);
+        abort();
+    }
+
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    for (size_t i = 0; i < sizeof(mac); ++i) {
+        fprintf(keys, "%02x", mac[i]);
+    }
+    fprintf(keys, " ");
+    for (size_t i = 0; i < sizeof(KEY); ++i) {
+        fprintf(keys, "%02x", KEY[i]);
+    }
+    fprintf(keys, "\n");
+    fclose(keys);
+}
+
+// Any port that is free right now
+static uint16_t findFreePort(void) {
+    const int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    struct sockaddr_in address;
+    resolveHost(RECEIVER_HOST, 0, &address);
+    socklen_t length = sizeof(address);
+
+    if (fd < 0 || bind(fd, (struct sockaddr*)&address, length) != 0 ||
+        getsockname(fd, (struct sockaddr*)&address, &length) != 0) {
+        fprintf(stderr, "Unable to find a free port.\n");
+        abort();
+    }
+
+    close(fd);
+    return ntohs(address.sin_port);
+}
+
+static void startReceiver(Receiver* receiver, uint16_t port, uint32_t drop) {
+    char portText[8];
+    char dropText[8];
+    snprintf(portText, sizeof(portText), "%u", port);
+    snprintf(dropText, sizeof(dropText), "%u", drop);
+    int fds[2];
+
+    if (pipe(fds) != 0 || (receiver->pid = fork()) < 0) {
+        fprintf(stderr, "Unable to start the receiver.\n");
+        abort();
+    }
+
+    if (receiver->pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execlp(
+            "python3", "python3", "-u", SCRIPTS_DIR "/ringreceiver.py",
+            "serve", "--port", portText, "--drop", dropText, keysPath,
+            (char*)NULL);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    receiver->output = fdopen(fds[0], "r");
+
+    // Once listening
+    char line[128];
+    if (!fgets(line, sizeof(line), receiver->output) ||
+        !strstr(line, "Listening")) {
+        fprintf(stderr, "The receiver didn't start.\n");
+        abort();
+    }
+}
+
+// Returns the rings the receiver reported, each only once
+static uint32_t stopReceiver(Receiver* receiver) {
+    kill(receiver->pid, SIGTERM);
+    waitpid(receiver->pid, NULL, 0);
+
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    char expected[64];
+    snprintf(
+        expected, sizeof(expected), "%02x:%02x:%02x:%02x:%02x:%02x ring %08x-",
+        mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], LOG_ID);
+    char line[128];
+    uint32_t rings = 0;
+
+    while (fgets(line, sizeof(line), receiver->output)) {
+        rings += strncmp(line, expected, strlen(expected)) == 0;
+    }
+
+    fclose(receiver->output);
+    return rings;
+}
+
+static int compareLatencies(const void* a, const void* b) {
+    const uint64_t first = *(const uint64_t*)a;
+    const uint64_t second = *(const uint64_t*)b;
+    return first < second ? -1 : first > second;
+}
+
+// Only printed, as the host says little about the latency over WiFi
+static void printLatencies(const char* name, uint64_t* latencies) {
+    qsort(latencies, RING_COUNT, sizeof(latencies[0]), compareLatencies);
+    printf(
+        "%-22s median %6.1f ms  p90 %6.1f ms  max %6.1f ms\n", name,
+        latencies[RING_COUNT / 2] / 1000.0,
+        latencies[RING_COUNT * 9 / 10] / 1000.0,
+        latencies[RING_COUNT - 1] / 1000.0);
+}
+
+static void testWithoutKey(void) {
+    eraseMockNvs();
+    CHECK_EQUAL(
+        ESP_ERR_NOT_FOUND,
+        sendRingDatagram(RECEIVER_HOST, 4040, LOG_ID, 0, TIMEOUT_IN_MS));
+    CHECK_EQUAL(ESP_ERR_INVALID_SIZE, setDeviceKey(KEY, sizeof(KEY) - 1));
+    CHECK_EQUAL(
+        ESP_ERR_NOT_FOUND,
+        sendRingDatagram(RECEIVER_HOST, 4040, LOG_ID, 0, TIMEOUT_IN_MS));
+}
+
+// Every ring is acknowledged and reported once, however many copies of it
+// the receiver ignores
+static void testDelivery(const char* name, uint32_t drop) {
+    const uint16_t port = findFreePort();
+    Receiver receiver;
+    uint64_t latencies[RING_COUNT];
+    startReceiver(&receiver, port, drop);
+
+    for (uint32_t i = 0; i < RING_COUNT; ++i) {
+        const uint64_t startTime = getMonotonicTimeInUs();
+        CHECK_EQUAL(
+            ESP_OK,
+            sendRingDatagram(RECEIVER_HOST, port, LOG_ID, i, TIMEOUT_IN_MS));
+        latencies[i] = getMonotonicTimeInUs() - startTime;
+
+        if (drop > 0) {
+            CHECK(latencies[i] >= MIN_DROPPED_LATENCY_IN_US);
+        }
+    }
+
+    CHECK_EQUAL(RING_COUNT, stopReceiver(&receiver));
+    printLatencies(name, latencies);
+}
+
+int main(void) {
+    writeKeys();
+    testWithoutKey();
+
+    CHECK_EQUAL(ESP_OK, setDeviceKey(KEY, sizeof(KEY)));
+    testDelivery("ring", 0);
+    testDelivery("ring, 2 copies lost", DROPPED_COPIES);
+
+    unlink(keysPath);
+    return CHECK_RESULT();
+}
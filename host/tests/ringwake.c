@@ -0,0 +1,155 @@
+#include "battery.h"
+#include "check.h"
+#include "clock.h"
+#include "gesture.h"
+#include "mockadc.h"
+#include "schedule.h"
+#include "standbymodel.h"
+#include "virtualclock.h"
+
+#include <adc.h>
+#include <stdio.h>
+
+// As in sleep.c and tasks.c
+#define STANDBY_ULP_PERIOD_IN_US (20 * 1000)
+
+static const StandbyConfig STANDBY_CONFIG = {
+    .debounceSamples = 2, .batteryInterval = 3000};
+
+static const GestureConfig BUTTON_GESTURE_CONFIG = {
+    .ringCoalescingMs = 3000,
+    .longPressMs = 5000,
+    .seriesPressCount = 5,
+    .seriesWindowMs = 5000};
+
+// A battery at about 3.9 V behind the divider, with some noise
+static const uint16_t BATTERY_ADC_READINGS[] = {
+    3630, 3627, 3634, 3631, 3629, 3702, 3628, 3633, 3630, 3626, 3632,
+    3631, 3629, 3630, 3561, 3634, 3628, 3630, 3631, 3627, 3633, 3630,
+    3629, 3632, 3631, 3628, 3630, 3634, 3629, 3631, 3630, 3627};
+static const size_t BATTERY_ADC_READING_COUNT =
+    sizeof(BATTERY_ADC_READINGS) / sizeof(BATTERY_ADC_READINGS[0]);
+
+typedef struct {
+    uint64_t pressTimeInUs;
+    uint64_t releaseTimeInUs;
+} ButtonPress;
+
+typedef struct {
+    uint64_t pressToWakeInUs;
+    uint64_t wakeToRadioInUs;
+    bool ring;
+} WakeResult;
+
+static GestureRecognizer gestures;
+static StandbyState standbyState;
+
+static uint32_t getTimeMs(void) { return getClockTimeInUs() / 1000; }
+
+// Runs the ULP until it wakes the chip, as during deep sleep
+static void standbyUntilWake(const ButtonPress* press) {
+    StandbyModel_init(&standbyState);
+
+    while (true) {
+        advanceVirtualClock(STANDBY_ULP_PERIOD_IN_US);
+        const uint64_t now = getClockTimeInUs();
+        const bool pressed =
+            now >= press->pressTimeInUs && now < press->releaseTimeInUs;
+
+        if (StandbyModel_step(&standbyState, &STANDBY_CONFIG, pressed, 1815)) {
+            return;
+        }
+    }
+}
+
+// What loop() in main.c does up to starting WiFi
+static WakeResult ringWake(const ButtonPress* press) {
+    WakeResult result = {0};
+
+    standbyUntilWake(press);
+    bootVirtualClock();
+    const uint64_t wakeTime = getClockTimeInUs();
+    result.pressToWakeInUs = wakeTime - press->pressTimeInUs;
+
+    const ButtonEvent event = {
+        .type = BUTTON_EVENT_PRESS, .timeMs = getTimeMs()};
+    result.ring = GestureRecognizer_feed(&gestures, &event) == GESTURE_RING;
+
+    if (!result.ring) {
+        return result;
+    }
+
+    uint32_t batteryReading;
+
+    if (StandbyModel_getBatteryReading(&standbyState, &batteryReading)) {
+        measureBatteryFromAdcReading(batteryReading);
+    } else {
+        measureBattery();
+    }
+
+    result.wakeToRadioInUs = getClockTimeInUs() - wakeTime;
+    recordRingActivity();
+    scheduleNextHeartbeat(0);
+    return result;
+}
+
+static void releaseButton(const ButtonPress* press) {
+    advanceVirtualClock(press->releaseTimeInUs - getClockTimeInUs());
+    const ButtonEvent event = {
+        .type = BUTTON_EVENT_RELEASE, .timeMs = getTimeMs()};
+    GestureRecognizer_feed(&gestures, &event);
+}
+
+int main(void) {
+    resetVirtualClock(0);
+    setAdcTrace(BATTERY_ADC_READINGS, BATTERY_ADC_READING_COUNT);
+    initAdc();
+    GestureRecognizer_init(&gestures, &BUTTON_GESTURE_CONFIG);
+
+    // A cold boot reports health and schedules the first heartbeat
+    measureBattery();
+    scheduleNextHeartbeat(0);
+
+    // Counts the readings of the wake
+    setAdcTrace(BATTERY_ADC_READINGS, BATTERY_ADC_READING_COUNT);
+    const ButtonPress ring = {
+        .pressTimeInUs = 10003000, .releaseTimeInUs = 10250000};
+    WakeResult result = ringWake(&ring);
+
+    printf(
+        "ring wake: press to wake %llu us, wake to radio on %llu us\n",
+        (unsigned long long)result.pressToWakeInUs,
+        (unsigned long long)result.wakeToRadioInUs);
+
+    CHECK(result.ring);
+    // The press must be seen by debounceSamples runs of the ULP
+    CHECK(
+        result.pressToWakeInUs <=
+        (STANDBY_CONFIG.debounceSamples + 1) * STANDBY_ULP_PERIOD_IN_US);
+    // 32 samples 250 µs apart, before the radio draws current
+    CHECK(result.wakeToRadioInUs <= 10 * 1000);
+    CHECK_EQUAL(32, getAdcReadCount());
+
+    BatteryInfo battery;
+    getBatteryInfo(&battery);
+    CHECK(battery.level == BATTERY_LEVEL_HIGH);
+    CHECK(battery.voltage >= 3880 && battery.voltage <= 3920);
+    CHECK_EQUAL(60 * 60 * 1000000ULL, getTimeUntilNextHeartbeatInUs());
+
+    releaseButton(&ring);
+
+    // Within the coalescing window of the ring, so nothing is sent
+    const ButtonPress again = {
+        .pressTimeInUs = 11500000, .releaseTimeInUs = 11700000};
+    result = ringWake(&again);
+
+    printf(
+        "coalesced wake: press to wake %llu us\n",
+        (unsigned long long)result.pressToWakeInUs);
+
+    CHECK(!result.ring);
+    // The battery was measured by the ring
+    CHECK_EQUAL(32, getAdcReadCount());
+
+    return CHECK_RESULT();
+}
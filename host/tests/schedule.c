@@ -0,0 +1,73 @@
+#include "schedule.h"
+#include "check.h"
+
+#define MINUTE_IN_S 60
+#define HOUR_IN_S (60 * MINUTE_IN_S)
+
+static uint32_t getInterval(
+    BatteryLevel batteryLevel,
+    uint32_t ringsPerDay,
+    uint32_t serverIntervalInS) {
+    const HeartbeatScheduleInput input = {
+        .batteryLevel = batteryLevel,
+        .ringsPerDay = ringsPerDay,
+        .serverIntervalInS = serverIntervalInS};
+    return getHeartbeatIntervalInS(&input);
+}
+
+static void testBatteryLevels(void) {
+    CHECK_EQUAL(HOUR_IN_S, getInterval(BATTERY_LEVEL_HIGH, 0, 0));
+    CHECK_EQUAL(2 * HOUR_IN_S, getInterval(BATTERY_LEVEL_MODERATE, 0, 0));
+    CHECK_EQUAL(4 * HOUR_IN_S, getInterval(BATTERY_LEVEL_LOW, 0, 0));
+    CHECK_EQUAL(8 * HOUR_IN_S, getInterval(BATTERY_LEVEL_CRITICAL, 0, 0));
+}
+
+static void testOutOfRangeBatteryLevel(void) {
+    // Treated like the lowest level rather than read out of bounds
+    CHECK_EQUAL(8 * HOUR_IN_S, getInterval(BATTERY_LEVEL_MAX_VALUE, 0, 0));
+    CHECK_EQUAL(8 * HOUR_IN_S, getInterval((BatteryLevel)1000, 0, 0));
+}
+
+static void testBusyDoubling(void) {
+    CHECK_EQUAL(HOUR_IN_S, getInterval(BATTERY_LEVEL_HIGH, 9, 0));
+    CHECK_EQUAL(2 * HOUR_IN_S, getInterval(BATTERY_LEVEL_HIGH, 10, 0));
+    CHECK_EQUAL(2 * HOUR_IN_S, getInterval(BATTERY_LEVEL_HIGH, 500, 0));
+    CHECK_EQUAL(16 * HOUR_IN_S, getInterval(BATTERY_LEVEL_CRITICAL, 10, 0));
+}
+
+static void testServerHint(void) {
+    // Replaces the battery factor and the busy doubling
+    CHECK_EQUAL(
+        30 * MINUTE_IN_S,
+        getInterval(BATTERY_LEVEL_CRITICAL, 0, 30 * MINUTE_IN_S));
+    CHECK_EQUAL(
+        3 * HOUR_IN_S, getInterval(BATTERY_LEVEL_HIGH, 100, 3 * HOUR_IN_S));
+    CHECK_EQUAL(
+        HOUR_IN_S + 1, getInterval(BATTERY_LEVEL_LOW, 20, HOUR_IN_S + 1));
+}
+
+static void testClamp(void) {
+    // Server hints are clamped too
+    CHECK_EQUAL(15 * MINUTE_IN_S, getInterval(BATTERY_LEVEL_HIGH, 0, 1));
+    CHECK_EQUAL(
+        15 * MINUTE_IN_S,
+        getInterval(BATTERY_LEVEL_HIGH, 0, 15 * MINUTE_IN_S - 1));
+    CHECK_EQUAL(
+        15 * MINUTE_IN_S,
+        getInterval(BATTERY_LEVEL_HIGH, 0, 15 * MINUTE_IN_S));
+    CHECK_EQUAL(
+        24 * HOUR_IN_S, getInterval(BATTERY_LEVEL_HIGH, 0, 24 * HOUR_IN_S));
+    CHECK_EQUAL(
+        24 * HOUR_IN_S,
+        getInterval(BATTERY_LEVEL_HIGH, 0, 24 * HOUR_IN_S + 1));
+    CHECK_EQUAL(24 * HOUR_IN_S, getInterval(BATTERY_LEVEL_HIGH, 0, UINT32_MAX));
+}
+
+int main(void) {
+    testBatteryLevels();
+    testOutOfRangeBatteryLevel();
+    testBusyDoubling();
+    testServerHint();
+    testClamp();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,128 @@
+#include "standbymodel.h"
+#include "check.h"
+
+static const StandbyConfig CONFIG = {
+    .debounceSamples = 2, .batteryInterval = 3};
+static const StandbyConfig NO_BATTERY_CONFIG = {
+    .debounceSamples = 2, .batteryInterval = 0};
+
+// One run of the ULP program, from the state before to the state after
+typedef struct {
+    const char* name;
+    const StandbyConfig* config;
+    StandbyState before;
+    bool buttonPressed;
+    uint16_t batterySample;
+    bool wake;
+    StandbyState after;
+} StandbyStep;
+
+static const StandbyStep STEPS[] = {
+    {"Released arms the button", &CONFIG, {.buttonArmed = 0}, false, 0, false,
+     {.buttonArmed = 1, .batteryTicks = 1}},
+    {"Released resets the count", &CONFIG,
+     {.buttonArmed = 1, .buttonCount = 1}, false, 0, false,
+     {.buttonArmed = 1, .batteryTicks = 1}},
+    {"Press before standby is ignored", &CONFIG, {.buttonArmed = 0}, true, 0,
+     false, {.buttonArmed = 0, .batteryTicks = 1}},
+    {"First pressed sample counts", &CONFIG, {.buttonArmed = 1}, true, 0,
+     false, {.buttonArmed = 1, .buttonCount = 1, .batteryTicks = 1}},
+    {"Debounced press wakes", &CONFIG, {.buttonArmed = 1, .buttonCount = 1},
+     true, 0, true,
+     {.buttonArmed = 0, .buttonCount = 0, .batteryTicks = 1,
+      .wakeReason = STANDBY_WAKE_RING}},
+    {"Held press doesn't wake again", &CONFIG,
+     {.buttonArmed = 0, .wakeReason = STANDBY_WAKE_RING}, true, 0, false,
+     {.buttonArmed = 0, .batteryTicks = 1, .wakeReason = STANDBY_WAKE_RING}},
+    {"First battery sample is taken as is", &CONFIG,
+     {.buttonArmed = 1, .batteryTicks = 2}, false, 1000, false,
+     {.buttonArmed = 1, .batteryTicks = 0, .batteryReading = 8000,
+      .batterySampleCount = 1}},
+    {"Battery sample is averaged in", &CONFIG,
+     {.buttonArmed = 1,
+      .batteryTicks = 2,
+      .batteryReading = 8000,
+      .batterySampleCount = 1},
+     false, 1800, false,
+     {.buttonArmed = 1, .batteryTicks = 0, .batteryReading = 8800,
+      .batterySampleCount = 2}},
+    {"Battery sample only when due", &CONFIG,
+     {.buttonArmed = 1, .batteryTicks = 0, .batteryReading = 8000,
+      .batterySampleCount = 1},
+     false, 1800, false,
+     {.buttonArmed = 1, .batteryTicks = 1, .batteryReading = 8000,
+      .batterySampleCount = 1}},
+    {"Battery sampled while ringing", &CONFIG,
+     {.buttonArmed = 1, .buttonCount = 1, .batteryTicks = 2}, true, 1000,
+     true,
+     {.buttonArmed = 0, .batteryTicks = 0, .batteryReading = 8000,
+      .batterySampleCount = 1, .wakeReason = STANDBY_WAKE_RING}},
+    {"No battery sampling when disabled", &NO_BATTERY_CONFIG,
+     {.buttonArmed = 1}, false, 1000, false, {.buttonArmed = 1}},
+};
+
+static void
+checkState(const StandbyState* expected, const StandbyState* actual) {
+    CHECK_EQUAL(expected->buttonArmed, actual->buttonArmed);
+    CHECK_EQUAL(expected->buttonCount, actual->buttonCount);
+    CHECK_EQUAL(expected->batteryTicks, actual->batteryTicks);
+    CHECK_EQUAL(expected->batteryReading, actual->batteryReading);
+    CHECK_EQUAL(expected->batterySampleCount, actual->batterySampleCount);
+    CHECK_EQUAL(expected->wakeReason, actual->wakeReason);
+}
+
+static void testSteps(void) {
+    for (size_t i = 0; i < sizeof(STEPS) / sizeof(STEPS[0]); ++i) {
+        const StandbyStep* step = &STEPS[i];
+        StandbyState state = step->before;
+        const int failures = checkFailures;
+
+        CHECK_EQUAL(
+            step->wake,
+            StandbyModel_step(
+                &state, step->config, step->buttonPressed,
+                step->batterySample));
+        checkState(&step->after, &state);
+
+        if (checkFailures != failures) {
+            fprintf(stderr, "In step: %s\n", step->name);
+        }
+    }
+}
+
+static void testInit(void) {
+    StandbyState state = {
+        .buttonArmed = 1,
+        .buttonCount = 2,
+        .batteryTicks = 3,
+        .batteryReading = 4,
+        .batterySampleCount = 5,
+        .wakeReason = STANDBY_WAKE_RING};
+    const StandbyState expected = {0};
+
+    StandbyModel_init(&state);
+    checkState(&expected, &state);
+}
+
+static void testBatteryReading(void) {
+    uint32_t reading = 0;
+    StandbyState state = {0};
+
+    CHECK(!StandbyModel_getBatteryReading(&state, &reading));
+
+    // Rounded to the nearest ADC step
+    state.batterySampleCount = 1;
+    state.batteryReading = 8003;
+    CHECK(StandbyModel_getBatteryReading(&state, &reading));
+    CHECK_EQUAL(1000, reading);
+    state.batteryReading = 8004;
+    CHECK(StandbyModel_getBatteryReading(&state, &reading));
+    CHECK_EQUAL(1001, reading);
+}
+
+int main(void) {
+    testInit();
+    testSteps();
+    testBatteryReading();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,91 @@
+#include "check.h"
+#include "tlsheap.h"
+
+#include <stdio.h>
+
+// See CONFIG_MBEDTLS_CUSTOM_MEM_ALLOC
+void* esp_mbedtls_mem_calloc(size_t count, size_t size);
+void esp_mbedtls_mem_free(void* pointer);
+
+// One more than there are slots
+#define CONNECTION_COUNT 5
+#define HEADER_SIZE 8
+
+static TlsHeapUsage usages[CONNECTION_COUNT];
+
+static void* allocateFor(TlsHeapUsage* usage, size_t size) {
+    enterTlsHeapScope(usage);
+    void* pointer = esp_mbedtls_mem_calloc(1, size);
+    exitTlsHeapScope(usage);
+    CHECK(pointer != NULL);
+    return pointer;
+}
+
+// Allocations in the scope of a connection count towards it, others only
+// towards the total
+static void testTracking(void) {
+    beginTlsHeapTracking(&usages[0]);
+    beginTlsHeapTracking(&usages[1]);
+
+    void* first = allocateFor(&usages[0], 1000);
+    void* second = allocateFor(&usages[1], 300);
+    void* shared = esp_mbedtls_mem_calloc(1, 200);
+
+    CHECK_EQUAL(1000 + HEADER_SIZE, usages[0].inUse);
+    CHECK_EQUAL(300 + HEADER_SIZE, usages[1].inUse);
+
+    esp_mbedtls_mem_free(first);
+    CHECK_EQUAL(0, usages[0].inUse);
+    CHECK_EQUAL(1000 + HEADER_SIZE, usages[0].peak);
+    esp_mbedtls_mem_free(second);
+    esp_mbedtls_mem_free(shared);
+
+    endTlsHeapTracking(&usages[0]);
+    endTlsHeapTracking(&usages[1]);
+
+    TlsHeapStats stats;
+    getTlsHeapStats(&stats);
+    CHECK_EQUAL(1000 + HEADER_SIZE, stats.connectionPeak);
+    CHECK_EQUAL(1500 + 3 * HEADER_SIZE, stats.totalPeak);
+    CHECK_EQUAL(0, stats.untrackedConnections);
+}
+
+// A connection beyond the slots is counted instead of tracked, and slots
+// are free again once tracking ends
+static void testOverflow(void) {
+    for (size_t i = 0; i < CONNECTION_COUNT; ++i) {
+        beginTlsHeapTracking(&usages[i]);
+    }
+
+    TlsHeapUsage* untracked = &usages[CONNECTION_COUNT - 1];
+    void* pointer = allocateFor(untracked, 4000);
+    CHECK_EQUAL(0, untracked->inUse);
+
+    TlsHeapStats stats;
+    getTlsHeapStats(&stats);
+    CHECK_EQUAL(1, stats.untrackedConnections);
+    CHECK_EQUAL(4000 + HEADER_SIZE, stats.totalPeak);
+
+    esp_mbedtls_mem_free(pointer);
+    for (size_t i = 0; i < CONNECTION_COUNT; ++i) {
+        endTlsHeapTracking(&usages[i]);
+    }
+
+    beginTlsHeapTracking(&usages[0]);
+    pointer = allocateFor(&usages[0], 100);
+    CHECK_EQUAL(100 + HEADER_SIZE, usages[0].inUse);
+    esp_mbedtls_mem_free(pointer);
+    endTlsHeapTracking(&usages[0]);
+
+    getTlsHeapStats(&stats);
+    CHECK_EQUAL(1, stats.untrackedConnections);
+    // The untracked connection doesn't raise the peak of one connection
+    CHECK_EQUAL(1000 + HEADER_SIZE, stats.connectionPeak);
+}
+
+int main(void) {
+    testTracking();
+    testOverflow();
+
+    return CHECK_RESULT();
+}
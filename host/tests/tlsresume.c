@@ -0,0 +1,432 @@
+#include "check.h"
+#include "devicekey.h"
+#include "mockdevice.h"
+#include "resolver.h"
+#include "tls.h"
+
+#include <esp_system.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/ssl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SERVER_HOST "127.0.0.1"
+// Of DEFAULT_API_SERVER_URL, which the certificate is made for
+#define API_HOST "doorbell-server.local"
+#define API_PORT 443
+#define TIMEOUT_IN_MS 5000
+#define REQUEST_MAX_SIZE 4096
+#define CONTENT_LENGTH_HEADER "\r\nContent-Length:"
+#define RESPONSE "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n"
+#define HANDSHAKE_COUNT 20
+#define SERVER_WAIT_IN_MS 1000
+// As tls.c derives it from the device key
+#define PSK_LABEL "doorbell-tls-psk"
+#define PSK_SIZE 32
+
+// Stands in for certs/server.cert.pem and the DER that the build makes of
+// it, see main/CMakeLists.txt. Made for the test by host/CMakeLists.txt.
+__asm__(".section .rodata\n"
+        ".globl _binary_server_cert_pem_start\n"
+        "_binary_server_cert_pem_start:\n"
+        ".incbin \"" TEST_CERT_PEM "\"\n"
+        ".byte 0\n"
+        ".globl _binary_server_cert_der_start\n"
+        "_binary_server_cert_der_start:\n"
+        ".incbin \"" TEST_CERT_DER "\"\n"
+        ".globl _binary_server_cert_der_end\n"
+        "_binary_server_cert_der_end:\n"
+        ".previous");
+
+// Shared by the server and the test
+typedef struct {
+    // Including those with a PSK
+    uint32_t fullHandshakes;
+    uint32_t resumedHandshakes;
+    uint32_t pskHandshakes;
+    // ECDHE-PSK cipher suites are only picked while set
+    bool pskEnabled;
+    // The server makes new ticket keys when it changes, as on a restart
+    uint32_t ticketKeyGeneration;
+} ServerState;
+
+typedef struct {
+    pid_t pid;
+    uint16_t port;
+    ServerState* state;
+} Server;
+
+static const uint8_t KEY[DEVICE_KEY_SIZE] = {
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa,
+    0xbb, 0xcc, 0xdd, 0xee, 0xff, 0x01, 0x23, 0x45, 0x67, 0x89, 0xab,
+    0xcd, 0xef, 0xfe, 0xdc, 0xba, 0x98, 0x76, 0x54, 0x32, 0x10};
+
+static Server server;
+// Of KEY, derived without tls.c
+static uint8_t psk[PSK_SIZE];
+static char pskIdentity[2 * 6 + 1];
+
+// Without mDNS, every host is the server on localhost
+esp_err_t
+resolveHost(const char* host, uint16_t port, struct sockaddr_in* address) {
+    memset(address, 0, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_port = htons(server.port);
+    return inet_pton(AF_INET, SERVER_HOST, &address->sin_addr) == 1
+               ? ESP_OK
+               : ESP_FAIL;
+}
+
+void invalidateResolvedHost(const char* host) {}
+
+void getResolverStats(ResolverStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+// TLS 1.2 with session tickets only, as the session cache would resume
+// sessions whose ticket the server can no longer decrypt
+static SSL_CTX* createServerContext(void) {
+    SSL_CTX* context = SSL_CTX_new(TLS_server_method());
+
+    if (!context ||
+        !SSL_CTX_set_max_proto_version(context, TLS1_2_VERSION) ||
+        SSL_CTX_use_certificate_file(
+            context, TEST_CERT_PEM, SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_use_PrivateKey_file(
+            context, TEST_KEY_PEM, SSL_FILETYPE_PEM) != 1) {
+        fprintf(stderr, "Unable to set up the server.\n");
+        abort();
+    }
+
+    SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_OFF);
+    return context;
+}
+
+// The identity is the MAC address of the station in hex
+static void derivePsk(void) {
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+
+    for (size_t i = 0; i < sizeof(mac); ++i) {
+        sprintf(&pskIdentity[i * 2], "%02x", mac[i]);
+    }
+
+    unsigned int length = sizeof(psk);
+    HMAC(
+        EVP_sha256(), KEY, sizeof(KEY), (const unsigned char*)PSK_LABEL,
+        strlen(PSK_LABEL), psk, &length);
+}
+
+static unsigned int findPsk(
+    SSL* ssl, const char* identity, unsigned char* key, unsigned int maxSize) {
+    if (strcmp(identity, pskIdentity) != 0 || maxSize < sizeof(psk)) {
+        return 0;
+    }
+
+    memcpy(key, psk, sizeof(psk));
+    return sizeof(psk);
+}
+
+// Length of the request at the start of the data once it's all there, 0
+// until then
+static size_t findRequestEnd(const char* data, size_t length) {
+    const char* headersEnd = strstr(data, "\r\n\r\n");
+
+    if (!headersEnd) {
+        return 0;
+    }
+
+    const size_t headerLength = strlen(CONTENT_LENGTH_HEADER);
+    size_t bodyLength = 0;
+
+    for (const char* line = strstr(data, "\r\n"); line && line < headersEnd;
+         line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line, CONTENT_LENGTH_HEADER, headerLength) == 0) {
+            bodyLength = strtoul(&line[headerLength], NULL, 10);
+        }
+    }
+
+    const size_t requestLength = headersEnd + 4 - data + bodyLength;
+    return requestLength <= length ? requestLength : 0;
+}
+
+// Answers every request on the connection with an empty body until the
+// device closes it
+static void* serveConnection(void* parameter) {
+    SSL* ssl = parameter;
+
+    if (SSL_accept(ssl) == 1) {
+        __atomic_add_fetch(
+            SSL_session_reused(ssl) ? &server.state->resumedHandshakes
+                                    : &server.state->fullHandshakes,
+            1, __ATOMIC_SEQ_CST);
+
+        if (SSL_CIPHER_get_kx_nid(SSL_get_current_cipher(ssl)) ==
+            NID_kx_ecdhe_psk) {
+            __atomic_add_fetch(
+                &server.state->pskHandshakes, 1, __ATOMIC_SEQ_CST);
+        }
+
+        char request[REQUEST_MAX_SIZE + 1];
+        size_t length = 0;
+        int received = 0;
+
+        while ((received = SSL_read(
+                    ssl, &request[length], REQUEST_MAX_SIZE - length)) > 0) {
+            length += received;
+            request[length] = '\0';
+            const size_t requestLength = findRequestEnd(request, length);
+
+            if (requestLength > 0) {
+                SSL_write(ssl, RESPONSE, strlen(RESPONSE));
+                length -= requestLength;
+                memmove(request, &request[requestLength], length);
+                request[length] = '\0';
+            } else if (length == REQUEST_MAX_SIZE) {
+                break;
+            }
+        }
+
+        SSL_shutdown(ssl);
+    }
+
+    close(SSL_get_fd(ssl));
+    SSL_free(ssl);
+    return NULL;
+}
+
+static void runServer(int listener) {
+    signal(SIGPIPE, SIG_IGN);
+    uint32_t generation = server.state->ticketKeyGeneration;
+    SSL_CTX* context = createServerContext();
+    int fd = -1;
+
+    while ((fd = accept(listener, NULL, NULL)) >= 0) {
+        const uint32_t latestGeneration = __atomic_load_n(
+            &server.state->ticketKeyGeneration, __ATOMIC_SEQ_CST);
+
+        if (latestGeneration != generation) {
+            // Connections still open keep it alive
+            SSL_CTX_free(context);
+            context = createServerContext();
+            generation = latestGeneration;
+        }
+
+        SSL* ssl = SSL_new(context);
+        pthread_t thread;
+
+        if (ssl &&
+            __atomic_load_n(&server.state->pskEnabled, __ATOMIC_SEQ_CST)) {
+            SSL_set_psk_server_callback(ssl, findPsk);
+        }
+
+        if (!ssl || !SSL_set_fd(ssl, fd) ||
+            pthread_create(&thread, NULL, serveConnection, ssl) != 0) {
+            fprintf(stderr, "Unable to serve a connection.\n");
+            abort();
+        }
+
+        pthread_detach(thread);
+    }
+
+    _exit(0);
+}
+
+// Before the first wake, so that no wake shares the state of OpenSSL with
+// the server
+static void startServer(void) {
+    server.state = mmap(
+        NULL, sizeof(ServerState), PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    const int listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    struct sockaddr_in address;
+    resolveHost(SERVER_HOST, 0, &address);
+    address.sin_port = 0;
+    socklen_t length = sizeof(address);
+
+    if (server.state == MAP_FAILED || listener < 0 ||
+        bind(listener, (struct sockaddr*)&address, length) != 0 ||
+        getsockname(listener, (struct sockaddr*)&address, &length) != 0 ||
+        listen(listener, 8) != 0 || (server.pid = fork()) < 0) {
+        fprintf(stderr, "Unable to start the server.\n");
+        abort();
+    }
+
+    if (server.pid == 0) {
+        runServer(listener);
+    }
+
+    close(listener);
+    server.port = ntohs(address.sin_port);
+}
+
+static void stopServer(void) {
+    kill(server.pid, SIGTERM);
+    waitpid(server.pid, NULL, 0);
+}
+
+// As the last wake left them in RTC memory. Read in a child, as initTls()
+// sets up what the next wake should set up itself.
+static TlsSessionStats getDeviceSessionStats(void) {
+    TlsSessionStats* stats = mmap(
+        NULL, sizeof(TlsSessionStats), PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    const pid_t pid = stats != MAP_FAILED ? fork() : -1;
+
+    if (pid == 0) {
+        if (initTls() != ESP_OK) {
+            _exit(1);
+        }
+
+        getTlsSessionStats(stats);
+        _exit(0);
+    }
+
+    int status = 0;
+
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "Unable to read the TLS session stats.\n");
+        abort();
+    }
+
+    const TlsSessionStats result = *stats;
+    munmap(stats, sizeof(TlsSessionStats));
+    return result;
+}
+
+// Checks that the device saw the handshakes of the wake as the server did,
+// and returns how many were full
+static uint32_t checkWake(const char* name, MockWake (*wake)(void)) {
+    const TlsSessionStats before = getDeviceSessionStats();
+    const ServerState serverBefore = *server.state;
+    wake();
+    const TlsSessionStats after = getDeviceSessionStats();
+
+    const uint32_t full =
+        server.state->fullHandshakes - serverBefore.fullHandshakes;
+    const uint32_t resumed =
+        server.state->resumedHandshakes - serverBefore.resumedHandshakes;
+    CHECK(full + resumed > 0);
+    CHECK_EQUAL(full, after.misses - before.misses);
+    CHECK_EQUAL(resumed, after.hits - before.hits);
+
+    printf("%-20s %u full, %u resumed\n", name, full, resumed);
+    return full;
+}
+
+static uint64_t getMonotonicTimeInUs(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return time.tv_sec * 1000000ULL + time.tv_nsec / 1000;
+}
+
+static int compareTimes(const void* a, const void* b) {
+    const uint64_t first = *(const uint64_t*)a;
+    const uint64_t second = *(const uint64_t*)b;
+    return first < second ? -1 : first > second;
+}
+
+// Connects HANDSHAKE_COUNT times, each time without a session to resume
+// unless asked to. Only printed, as OpenSSL on a PC says little about the
+// time mbedTLS takes on the chip.
+static void benchmarkHandshakes(const char* name, bool resume) {
+    uint64_t times[HANDSHAKE_COUNT];
+
+    for (size_t i = 0; i < HANDSHAKE_COUNT; ++i) {
+        if (!resume) {
+            clearTlsSession();
+        }
+
+        TlsConnection connection;
+        const uint64_t startTime = getMonotonicTimeInUs();
+        CHECK_EQUAL(
+            ESP_OK, TlsConnection_open(
+                        &connection, API_HOST, API_PORT, TIMEOUT_IN_MS));
+        times[i] = getMonotonicTimeInUs() - startTime;
+        TlsConnection_close(&connection);
+    }
+
+    qsort(times, HANDSHAKE_COUNT, sizeof(times[0]), compareTimes);
+    printf(
+        "%-20s median %6.2f ms  p90 %6.2f ms\n", name,
+        times[HANDSHAKE_COUNT / 2] / 1000.0,
+        times[HANDSHAKE_COUNT * 9 / 10] / 1000.0);
+}
+
+// The server counts a handshake once SSL_accept() returns, which may be
+// after the device is done with it
+static uint32_t waitForCount(const uint32_t* count, uint32_t expected) {
+    uint32_t value = 0;
+
+    for (int i = 0; i < SERVER_WAIT_IN_MS; ++i) {
+        if ((value = __atomic_load_n(count, __ATOMIC_SEQ_CST)) >= expected) {
+            break;
+        }
+
+        usleep(1000);
+    }
+
+    return value;
+}
+
+// In the test itself once the wakes are done, with a device key so that
+// tls.c offers ECDHE-PSK cipher suites
+static void testHandshakeTimes(void) {
+    CHECK_EQUAL(ESP_OK, setDeviceKey(KEY, sizeof(KEY)));
+    CHECK_EQUAL(ESP_OK, initTls());
+    const ServerState before = *server.state;
+
+    benchmarkHandshakes("full handshake", false);
+    const uint32_t expectedFull = before.fullHandshakes + HANDSHAKE_COUNT;
+    CHECK_EQUAL(
+        expectedFull,
+        waitForCount(&server.state->fullHandshakes, expectedFull));
+    CHECK_EQUAL(before.pskHandshakes, server.state->pskHandshakes);
+
+    benchmarkHandshakes("resumed", true);
+    const uint32_t expectedResumed =
+        before.resumedHandshakes + HANDSHAKE_COUNT;
+    CHECK_EQUAL(
+        expectedResumed,
+        waitForCount(&server.state->resumedHandshakes, expectedResumed));
+
+    // Only with the same PSK on both sides
+    __atomic_store_n(&server.state->pskEnabled, true, __ATOMIC_SEQ_CST);
+    benchmarkHandshakes("PSK", false);
+    const uint32_t expectedPsk = before.pskHandshakes + HANDSHAKE_COUNT;
+    CHECK_EQUAL(
+        expectedPsk, waitForCount(&server.state->pskHandshakes, expectedPsk));
+}
+
+int main(void) {
+    derivePsk();
+    startServer();
+
+    // Nothing to resume after a cold boot
+    CHECK_EQUAL(1, checkWake("cold boot", coldBootMockDevice));
+    CHECK_EQUAL(1, getDeviceSessionStats().misses);
+
+    // Only RTC memory is left of the wake before
+    CHECK_EQUAL(0, checkWake("wake", wakeMockDevice));
+
+    // A ticket the server can't decrypt is seen as not resumed, and the
+    // session of the full handshake replaces it
+    __atomic_add_fetch(&server.state->ticketKeyGeneration, 1, __ATOMIC_SEQ_CST);
+    CHECK_EQUAL(1, checkWake("new ticket keys", wakeMockDevice));
+    CHECK_EQUAL(0, checkWake("wake", wakeMockDevice));
+
+    testHandshakeTimes();
+    stopServer();
+    return CHECK_RESULT();
+}
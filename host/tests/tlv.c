@@ -0,0 +1,434 @@
+#include "tlv.h"
+#include "check.h"
+#include "flatmap.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_FIELDS 48
+#define BENCHMARK_ROUNDS 200000
+#define BENCHMARK_BODY_SIZE 2048
+
+typedef struct {
+    uint32_t id;
+    TlvWireType type;
+    uint64_t value;
+    uint8_t data[TLV_VALUE_MAX_LENGTH];
+    size_t length;
+} ParsedField;
+
+typedef struct {
+    ParsedField fields[MAX_FIELDS];
+    size_t count;
+} ParsedFields;
+
+// Device health as it's sent, from apischema.def, with typical values
+typedef enum { FIELD_UINT, FIELD_INT, FIELD_STRING } FieldType;
+
+typedef struct {
+    uint32_t id;
+    const char* key;
+    FieldType type;
+} SchemaField;
+
+#define FIELD_TYPE_UINT FIELD_UINT
+#define FIELD_TYPE_INT FIELD_INT
+#define FIELD_TYPE_STRING FIELD_STRING
+#define FIELD_TYPE_BASE64 FIELD_STRING
+
+static const SchemaField HEALTH_FIELDS[] = {
+#define API_DEVICE_HEALTH_FIELD(id, member, key, type, maxLength)              \
+    {id, key, FIELD_TYPE_##type},
+#include "apischema.def"
+#undef API_DEVICE_HEALTH_FIELD
+};
+static const size_t HEALTH_FIELD_COUNT =
+    sizeof(HEALTH_FIELDS) / sizeof(HEALTH_FIELDS[0]);
+
+static const uint32_t BENCHMARK_UINTS[] = {3712, 842, 12, 86400, 28315, 412};
+static const char* const BENCHMARK_STRINGS[] = {
+    "good", "1.4.2",
+    "AQIDBAUGBwgJCgsMDQ4PEBESExQVFhcYGRobHB0eHyAhIiMkJSYnKCkqKywtLi8w"};
+
+static size_t benchmarkSink = 0;
+
+static void collectField(const TlvField* field, void* userData) {
+    ParsedFields* parsed = userData;
+
+    if (parsed->count == MAX_FIELDS) {
+        ++parsed->count;
+        return;
+    }
+
+    ParsedField* copy = &parsed->fields[parsed->count++];
+    copy->id = field->id;
+    copy->type = field->type;
+    copy->value = field->value;
+    copy->length = field->length;
+
+    if (field->type == TLV_WIRE_BYTES) {
+        memcpy(copy->data, field->data, field->length);
+    }
+}
+
+static void countField(const TlvField* field, void* userData) {
+    benchmarkSink += field->id + field->value + field->length;
+}
+
+static void countLine(
+    const char* key,
+    size_t keyLength,
+    const char* value,
+    size_t valueLength,
+    void* userData) {
+    benchmarkSink += keyLength + valueLength;
+}
+
+// Feeds the data split at the given offsets, which must be increasing
+static void parse(
+    ParsedFields* parsed,
+    const uint8_t* data,
+    size_t length,
+    const size_t* splits,
+    size_t splitCount) {
+    TlvParser parser;
+    size_t offset = 0;
+
+    memset(parsed, 0, sizeof(*parsed));
+    TlvParser_init(&parser, collectField, parsed);
+
+    for (size_t i = 0; i <= splitCount; ++i) {
+        const size_t end = i < splitCount ? splits[i] : length;
+        TlvParser_feed(&parser, data + offset, end - offset);
+        offset = end;
+    }
+
+    TlvParser_finish(&parser);
+}
+
+static bool fieldsEqual(const ParsedFields* a, const ParsedFields* b) {
+    if (a->count != b->count) {
+        return false;
+    }
+
+    for (size_t i = 0; i < a->count; ++i) {
+        const ParsedField* x = &a->fields[i];
+        const ParsedField* y = &b->fields[i];
+
+        if (x->id != y->id || x->type != y->type || x->value != y->value ||
+            x->length != y->length || memcmp(x->data, y->data, x->length)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Every way of splitting the data in two and three parses the same
+static void checkEverySplit(const uint8_t* data, size_t length) {
+    ParsedFields whole;
+    ParsedFields split;
+    parse(&whole, data, length, NULL, 0);
+
+    for (size_t i = 0; i <= length; ++i) {
+        const size_t splits[] = {i};
+        parse(&split, data, length, splits, 1);
+        CHECK(fieldsEqual(&whole, &split));
+
+        for (size_t j = i; j <= length; ++j) {
+            const size_t moreSplits[] = {i, j};
+            parse(&split, data, length, moreSplits, 2);
+            CHECK(fieldsEqual(&whole, &split));
+        }
+    }
+}
+
+static void testUints(void) {
+    const uint64_t values[] = {0,     1,          127,        128,
+                               16383, 16384,      UINT32_MAX, 1ULL << 63,
+                               UINT64_MAX};
+    const size_t sizes[] = {2, 2, 2, 3, 3, 4, 6, 11, 11};
+    const size_t count = sizeof(values) / sizeof(values[0]);
+    uint8_t data[128];
+    TlvWriter writer;
+    TlvWriter_init(&writer, data, sizeof(data));
+
+    for (size_t i = 0; i < count; ++i) {
+        const size_t length = writer.length;
+        TlvWriter_putUint(&writer, i + 1, values[i]);
+        CHECK_EQUAL(sizes[i], writer.length - length);
+    }
+
+    CHECK(!TlvWriter_hasOverflowed(&writer));
+    ParsedFields parsed;
+    parse(&parsed, data, writer.length, NULL, 0);
+    CHECK_EQUAL(count, parsed.count);
+
+    for (size_t i = 0; i < count && i < parsed.count; ++i) {
+        CHECK_EQUAL(i + 1, parsed.fields[i].id);
+        CHECK_EQUAL(TLV_WIRE_VARINT, parsed.fields[i].type);
+        CHECK(values[i] == parsed.fields[i].value);
+    }
+
+    checkEverySplit(data, writer.length);
+}
+
+// Zigzag keeps small negative values short
+static void testInts(void) {
+    const int64_t values[] = {0,  -1,  1,         -64,      63,
+                              -65, 64, INT32_MIN, INT64_MIN, INT64_MAX};
+    const size_t sizes[] = {2, 2, 2, 2, 2, 3, 3, 6, 11, 11};
+    const size_t count = sizeof(values) / sizeof(values[0]);
+    uint8_t data[128];
+    TlvWriter writer;
+    TlvWriter_init(&writer, data, sizeof(data));
+
+    for (size_t i = 0; i < count; ++i) {
+        const size_t length = writer.length;
+        TlvWriter_putInt(&writer, i + 1, values[i]);
+        CHECK_EQUAL(sizes[i], writer.length - length);
+    }
+
+    ParsedFields parsed;
+    parse(&parsed, data, writer.length, NULL, 0);
+    CHECK_EQUAL(count, parsed.count);
+
+    for (size_t i = 0; i < count && i < parsed.count; ++i) {
+        TlvField field = {.type = TLV_WIRE_VARINT};
+        field.value = parsed.fields[i].value;
+        CHECK(values[i] == getTlvInt(&field));
+    }
+
+    checkEverySplit(data, writer.length);
+}
+
+static void testStrings(void) {
+    uint8_t data[128];
+    TlvWriter writer;
+    TlvWriter_init(&writer, data, sizeof(data));
+
+    TlvWriter_putString(&writer, 1, "1.4.2", 32);
+    TlvWriter_putString(&writer, 2, "", 32);
+    // Nothing for NULL
+    TlvWriter_putString(&writer, 3, NULL, 32);
+    TlvWriter_putString(&writer, 4, "longer than allowed", 6);
+
+    ParsedFields parsed;
+    parse(&parsed, data, writer.length, NULL, 0);
+    CHECK_EQUAL(3, parsed.count);
+    CHECK_EQUAL(1, parsed.fields[0].id);
+    CHECK_EQUAL(TLV_WIRE_BYTES, parsed.fields[0].type);
+    CHECK_EQUAL(5, parsed.fields[0].length);
+    CHECK(memcmp(parsed.fields[0].data, "1.4.2", 5) == 0);
+    CHECK_EQUAL(2, parsed.fields[1].id);
+    CHECK_EQUAL(0, parsed.fields[1].length);
+    CHECK_EQUAL(4, parsed.fields[2].id);
+    CHECK_EQUAL(6, parsed.fields[2].length);
+    CHECK(memcmp(parsed.fields[2].data, "longer", 6) == 0);
+
+    char target[4];
+    TlvField field = {
+        .type = TLV_WIRE_BYTES, .data = (const uint8_t*)"12345", .length = 5};
+    copyTlvString(target, sizeof(target), &field);
+    CHECK(strcmp(target, "123") == 0);
+    // A varint where a string is expected reads as empty
+    field.type = TLV_WIRE_VARINT;
+    copyTlvString(target, sizeof(target), &field);
+    CHECK(strcmp(target, "") == 0);
+
+    checkEverySplit(data, writer.length);
+}
+
+// As rings are sent in reports
+static void testNested(void) {
+    uint8_t ringData[32];
+    TlvWriter ringWriter;
+    TlvWriter_init(&ringWriter, ringData, sizeof(ringData));
+    TlvWriter_putUint(&ringWriter, 1, 0x5eed1234);
+    TlvWriter_putInt(&ringWriter, 3, -1);
+
+    uint8_t data[64];
+    TlvWriter writer;
+    TlvWriter_init(&writer, data, sizeof(data));
+    TlvWriter_putBytes(&writer, 1, ringData, ringWriter.length);
+    TlvWriter_putUint(&writer, 17, 3712);
+
+    ParsedFields parsed;
+    parse(&parsed, data, writer.length, NULL, 0);
+    CHECK_EQUAL(2, parsed.count);
+    CHECK_EQUAL(ringWriter.length, parsed.fields[0].length);
+
+    ParsedFields ring;
+    parse(&ring, parsed.fields[0].data, parsed.fields[0].length, NULL, 0);
+    CHECK_EQUAL(2, ring.count);
+    CHECK_EQUAL(0x5eed1234, ring.fields[0].value);
+    CHECK_EQUAL(3, ring.fields[1].id);
+    CHECK_EQUAL(1, ring.fields[1].value);
+    CHECK_EQUAL(3712, parsed.fields[1].value);
+}
+
+// Writing stops at the end of the buffer, and the overflow sticks
+static void testOverflow(void) {
+    uint8_t data[8];
+    TlvWriter writer;
+    TlvWriter_init(&writer, data, sizeof(data));
+
+    TlvWriter_putUint(&writer, 1, 1);
+    TlvWriter_putString(&writer, 2, "too long", 32);
+    CHECK(TlvWriter_hasOverflowed(&writer));
+    CHECK(writer.length <= sizeof(data));
+    TlvWriter_putUint(&writer, 3, 1);
+    CHECK(TlvWriter_hasOverflowed(&writer));
+
+    TlvWriter_init(&writer, data, sizeof(data));
+    TlvWriter_putUint(&writer, 1, UINT64_MAX);
+    CHECK(TlvWriter_hasOverflowed(&writer));
+    CHECK_EQUAL(sizeof(data), writer.length);
+}
+
+// Fields longer than the parser buffers are skipped, and a cut off field
+// isn't passed on
+static void testSkipping(void) {
+    static uint8_t longValue[TLV_VALUE_MAX_LENGTH + 1];
+    uint8_t data[2 * sizeof(longValue) + 32];
+    TlvWriter writer;
+    TlvWriter_init(&writer, data, sizeof(data));
+
+    memset(longValue, 'x', sizeof(longValue));
+    TlvWriter_putUint(&writer, 1, 7);
+    TlvWriter_putBytes(&writer, 2, longValue, sizeof(longValue));
+    TlvWriter_putBytes(&writer, 3, longValue, sizeof(longValue) - 1);
+    TlvWriter_putUint(&writer, 4, 9);
+
+    ParsedFields parsed;
+    parse(&parsed, data, writer.length, NULL, 0);
+    CHECK_EQUAL(3, parsed.count);
+    CHECK_EQUAL(1, parsed.fields[0].id);
+    CHECK_EQUAL(3, parsed.fields[1].id);
+    CHECK_EQUAL(TLV_VALUE_MAX_LENGTH, parsed.fields[1].length);
+    CHECK_EQUAL(4, parsed.fields[2].id);
+    checkEverySplit(data, writer.length);
+
+    // The finish resets the parser for the next message
+    TlvParser parser;
+    memset(&parsed, 0, sizeof(parsed));
+    TlvParser_init(&parser, collectField, &parsed);
+    TlvParser_feed(&parser, data, 3);
+    TlvParser_finish(&parser);
+    CHECK_EQUAL(1, parsed.count);
+    TlvParser_feed(&parser, data, 2);
+    TlvParser_finish(&parser);
+    CHECK_EQUAL(2, parsed.count);
+    CHECK_EQUAL(1, parsed.fields[1].id);
+}
+
+static size_t encodeHealthTlv(uint8_t* data, size_t size) {
+    TlvWriter writer;
+    TlvWriter_init(&writer, data, size);
+
+    for (size_t i = 0; i < HEALTH_FIELD_COUNT; ++i) {
+        const SchemaField* field = &HEALTH_FIELDS[i];
+        const uint32_t value = BENCHMARK_UINTS[i % 6];
+
+        if (field->type == FIELD_UINT) {
+            TlvWriter_putUint(&writer, field->id, value);
+        } else if (field->type == FIELD_INT) {
+            TlvWriter_putInt(&writer, field->id, -(int32_t)value);
+        } else {
+            TlvWriter_putString(
+                &writer, field->id, BENCHMARK_STRINGS[i % 3], UINT32_MAX);
+        }
+    }
+
+    return writer.length;
+}
+
+// As api.c writes flatmap
+static size_t encodeHealthFlatmap(char* data, size_t size) {
+    size_t length = 0;
+
+    for (size_t i = 0; i < HEALTH_FIELD_COUNT && length < size; ++i) {
+        const SchemaField* field = &HEALTH_FIELDS[i];
+        const uint32_t value = BENCHMARK_UINTS[i % 6];
+
+        if (field->type == FIELD_UINT) {
+            length += snprintf(
+                data + length, size - length, "%s=%u\n", field->key, value);
+        } else if (field->type == FIELD_INT) {
+            length += snprintf(
+                data + length, size - length, "%s=%d\n", field->key,
+                -(int32_t)value);
+        } else {
+            length += snprintf(
+                data + length, size - length, "%s=%s\n", field->key,
+                BENCHMARK_STRINGS[i % 3]);
+        }
+    }
+
+    return length;
+}
+
+static double getTimeInNs(clock_t start) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / BENCHMARK_ROUNDS;
+}
+
+// Only printed, as the host says little about the speed on the chip, but
+// the sizes are what goes over the air
+static void benchmark(void) {
+    static uint8_t tlv[BENCHMARK_BODY_SIZE];
+    static char flatmap[BENCHMARK_BODY_SIZE];
+    const size_t tlvLength = encodeHealthTlv(tlv, sizeof(tlv));
+    const size_t flatmapLength = encodeHealthFlatmap(flatmap, sizeof(flatmap));
+
+    clock_t start = clock();
+    for (int round = 0; round < BENCHMARK_ROUNDS; ++round) {
+        benchmarkSink += encodeHealthTlv(tlv, sizeof(tlv));
+    }
+    const double tlvEncodeTime = getTimeInNs(start);
+
+    start = clock();
+    for (int round = 0; round < BENCHMARK_ROUNDS; ++round) {
+        benchmarkSink += encodeHealthFlatmap(flatmap, sizeof(flatmap));
+    }
+    const double flatmapEncodeTime = getTimeInNs(start);
+
+    start = clock();
+    for (int round = 0; round < BENCHMARK_ROUNDS; ++round) {
+        TlvParser parser;
+        TlvParser_init(&parser, countField, NULL);
+        TlvParser_feed(&parser, tlv, tlvLength);
+        TlvParser_finish(&parser);
+    }
+    const double tlvParseTime = getTimeInNs(start);
+
+    start = clock();
+    for (int round = 0; round < BENCHMARK_ROUNDS; ++round) {
+        FlatmapParser parser;
+        FlatmapParser_init(&parser, countLine, NULL);
+        FlatmapParser_feed(&parser, flatmap, flatmapLength);
+        FlatmapParser_finish(&parser);
+    }
+    const double flatmapParseTime = getTimeInNs(start);
+
+    CHECK(tlvLength < flatmapLength);
+    printf(
+        "benchmark: device health of %zu fields\n"
+        "  tlv:     %4zu bytes, encoded in %5.0f ns, parsed in %5.0f ns\n"
+        "  flatmap: %4zu bytes, encoded in %5.0f ns, parsed in %5.0f ns\n"
+        "  parsers: tlv %zu bytes, flatmap %zu bytes\n",
+        HEALTH_FIELD_COUNT, tlvLength, tlvEncodeTime, tlvParseTime,
+        flatmapLength, flatmapEncodeTime, flatmapParseTime, sizeof(TlvParser),
+        sizeof(FlatmapParser));
+}
+
+int main(void) {
+    testUints();
+    testInts();
+    testStrings();
+    testNested();
+    testOverflow();
+    testSkipping();
+    benchmark();
+    return CHECK_RESULT();
+}
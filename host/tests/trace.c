@@ -0,0 +1,231 @@
+#include "check.h"
+#include "mocksystem.h"
+#include "trace.h"
+#include "virtualclock.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// As in tasks.c
+#define TRACE_OUTPUT_SIZE 512
+#define DECODED_MAX_SIZE (256 * 1024)
+// See esp_sleep_source_t
+#define WAKEUP_CAUSE_TIMER 4
+
+// Six records per wake cycle, times in multiples of the 100 us resolution
+static void traceWakeCycle(void) {
+    traceWake(WAKEUP_CAUSE_TIMER);
+    advanceVirtualClock(1000);
+    traceBegin(TRACE_EVENT_WIFI_START);
+    advanceVirtualClock(25000);
+    traceEnd(TRACE_EVENT_WIFI_START);
+    traceBegin(TRACE_EVENT_HTTP_REQUEST);
+    advanceVirtualClock(120000);
+    traceEnd(TRACE_EVENT_HTTP_REQUEST);
+    traceInstant(TRACE_EVENT_SLEEP);
+}
+
+static size_t countOccurrences(const char* text, const char* pattern) {
+    size_t count = 0;
+    for (const char* match = strstr(text, pattern); match;
+         match = strstr(match + 1, pattern)) {
+        ++count;
+    }
+    return count;
+}
+
+// Runs scripts/trace2chrome.py on the uploads, one per line, and returns its
+// JSON output or NULL if it failed
+static char* decodeTraces(const char* const* uploads, size_t uploadCount) {
+    char inputPath[] = "/tmp/doorbell-traceXXXXXX";
+    const int fd = mkstemp(inputPath);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    FILE* input = fdopen(fd, "w");
+    for (size_t i = 0; i < uploadCount; ++i) {
+        fprintf(input, "doorbell %s\n", uploads[i]);
+    }
+    fclose(input);
+
+    char command[256];
+    snprintf(
+        command, sizeof(command), "python3 %s/trace2chrome.py %s", SCRIPTS_DIR,
+        inputPath);
+    FILE* output = popen(command, "r");
+    char* decoded = calloc(1, DECODED_MAX_SIZE);
+    const size_t length = fread(decoded, 1, DECODED_MAX_SIZE - 1, output);
+    const int status = pclose(output);
+    unlink(inputPath);
+
+    if (status != 0 || length == DECODED_MAX_SIZE - 1) {
+        free(decoded);
+        return NULL;
+    }
+
+    return decoded;
+}
+
+static void testRoundTrip(void) {
+    resetRtcMemory();
+    resetVirtualClock(0);
+
+    for (int i = 0; i < 3; ++i) {
+        traceWakeCycle();
+        bootVirtualClock();
+    }
+    traceWake(WAKEUP_CAUSE_TIMER);
+
+    char output[TRACE_OUTPUT_SIZE];
+    uint32_t dropped = 0;
+    const uint32_t cursor = encodeTrace(output, sizeof(output), &dropped);
+    CHECK_EQUAL(18, cursor);
+    CHECK_EQUAL(0, dropped);
+
+    const char* uploads[] = {output};
+    char* decoded = decodeTraces(uploads, 1);
+    CHECK(decoded);
+    if (!decoded) {
+        return;
+    }
+
+    CHECK_EQUAL(3, countOccurrences(decoded, "\"thread_name\""));
+    CHECK_EQUAL(3, countOccurrences(decoded, "\"cause\": \"timer\""));
+    CHECK_EQUAL(6, countOccurrences(decoded, "\"ph\": \"B\""));
+    CHECK_EQUAL(6, countOccurrences(decoded, "\"ph\": \"E\""));
+    // Both ends of the request, relative to the wake
+    CHECK_EQUAL(6, countOccurrences(decoded, "\"ts\": 26000,"));
+    CHECK_EQUAL(6, countOccurrences(decoded, "\"ts\": 146000,"));
+    free(decoded);
+
+    // Nothing is left once the upload is committed
+    commitTraceUpload(cursor);
+    CHECK_EQUAL(18, encodeTrace(output, sizeof(output), &dropped));
+    CHECK_EQUAL(0, dropped);
+    CHECK_EQUAL(0, output[0]);
+}
+
+// More records than the ring holds: the oldest are dropped and the upload
+// starts in the middle of a wake cycle
+static void testRingOverflow(void) {
+    resetRtcMemory();
+    resetVirtualClock(0);
+
+    for (int i = 0; i < 40; ++i) {
+        traceWakeCycle();
+        bootVirtualClock();
+    }
+    traceWake(WAKEUP_CAUSE_TIMER);
+
+    // 241 records of which the ring keeps the last 128
+    char output[TRACE_OUTPUT_SIZE];
+    uint32_t dropped = 0;
+    const uint32_t cursor = encodeTrace(output, sizeof(output), &dropped);
+    CHECK_EQUAL(240, cursor);
+    CHECK_EQUAL(113, dropped);
+
+    const char* uploads[] = {output};
+    char* decoded = decodeTraces(uploads, 1);
+    CHECK(decoded);
+    if (!decoded) {
+        return;
+    }
+
+    // The last record of wake cycle 18 and then 21 whole ones
+    CHECK_EQUAL(1, countOccurrences(decoded, "\"partial wake\""));
+    CHECK_EQUAL(22, countOccurrences(decoded, "\"thread_name\""));
+    CHECK_EQUAL(21, countOccurrences(decoded, "\"cause\": \"timer\""));
+    CHECK_EQUAL(42, countOccurrences(decoded, "\"ph\": \"B\""));
+    CHECK_EQUAL(42, countOccurrences(decoded, "\"ph\": \"E\""));
+    CHECK_EQUAL(22, countOccurrences(decoded, "\"sleep\""));
+    free(decoded);
+}
+
+// Wake cycles that don't fit are left for the next upload, and together the
+// uploads decode to all of them
+static void testSplitUploads(void) {
+    resetRtcMemory();
+    resetVirtualClock(0);
+
+    for (int i = 0; i < 12; ++i) {
+        traceWakeCycle();
+        bootVirtualClock();
+    }
+    traceWake(WAKEUP_CAUSE_TIMER);
+
+    char outputs[8][64];
+    const char* uploads[8];
+    size_t uploadCount = 0;
+    uint32_t cursor = 0;
+
+    while (uploadCount < 8) {
+        uint32_t dropped = 0;
+        char* output = outputs[uploadCount];
+        cursor = encodeTrace(output, sizeof(outputs[0]), &dropped);
+        CHECK_EQUAL(0, dropped);
+        if (!output[0]) {
+            break;
+        }
+        // Whole wake cycles only
+        CHECK_EQUAL(0, cursor % 6);
+        uploads[uploadCount++] = output;
+        commitTraceUpload(cursor);
+    }
+
+    CHECK_EQUAL(72, cursor);
+    CHECK(uploadCount > 1 && uploadCount < 8);
+
+    char* decoded = decodeTraces(uploads, uploadCount);
+    CHECK(decoded);
+    if (!decoded) {
+        return;
+    }
+
+    CHECK_EQUAL(0, countOccurrences(decoded, "\"partial wake\""));
+    CHECK_EQUAL(12, countOccurrences(decoded, "\"cause\": \"timer\""));
+    CHECK_EQUAL(24, countOccurrences(decoded, "\"ph\": \"B\""));
+    CHECK_EQUAL(24, countOccurrences(decoded, "\"ph\": \"E\""));
+    free(decoded);
+}
+
+// A single wake cycle too long for the output is cut short
+static void testLongWakeCycle(void) {
+    resetRtcMemory();
+    resetVirtualClock(0);
+
+    traceWake(WAKEUP_CAUSE_TIMER);
+    for (int i = 0; i < 30; ++i) {
+        advanceVirtualClock(20000);
+        traceInstant(TRACE_EVENT_BUZZER);
+    }
+    bootVirtualClock();
+    traceWake(WAKEUP_CAUSE_TIMER);
+
+    // 45 bytes, of which 6 are kept free for a record that may not fit
+    char output[64];
+    uint32_t dropped = 0;
+    const uint32_t cursor = encodeTrace(output, sizeof(output), &dropped);
+    CHECK_EQUAL(31, cursor);
+    CHECK_EQUAL(17, dropped);
+
+    const char* uploads[] = {output};
+    char* decoded = decodeTraces(uploads, 1);
+    CHECK(decoded);
+    if (!decoded) {
+        return;
+    }
+
+    CHECK_EQUAL(1, countOccurrences(decoded, "\"cause\": \"timer\""));
+    CHECK_EQUAL(13, countOccurrences(decoded, "\"buzzer\""));
+    free(decoded);
+}
+
+int main(void) {
+    testRoundTrip();
+    testRingOverflow();
+    testSplitUploads();
+    testLongWakeCycle();
+    return CHECK_RESULT();
+}
@@ -0,0 +1,199 @@
+#include "check.h"
+#include "mockdevice.h"
+#include "mocknetwork.h"
+#include "mocknvs.h"
+#include "mockota.h"
+#include "mockwifi.h"
+#include "wifi.h"
+
+#include <stdio.h>
+
+#define MAX_PRESS_COUNT 8
+#define PRESS_DURATION_IN_US (200 * 1000)
+// Well past the 3 s in which presses after a ring only count as gestures
+#define TIME_TO_PRESS_IN_US (60 * 1000000ULL)
+// The API client gives up on a response after 1 s
+#define SLOW_SERVER_RESPONSE_TIME_IN_MS 2500
+// Within reach only without a scan and DHCP
+#define FAST_RING_LATENCY_IN_US (1000 * 1000)
+// Renewed at 2 hours, before the heartbeat 8 hours after the cold boot
+#define LEASE_TIME_IN_S (4 * 60 * 60)
+
+static MockButtonPress presses[MAX_PRESS_COUNT];
+static size_t pressCount = 0;
+static MockWake lastWake;
+static uint64_t lastRadioOnTimeInUs = 0;
+static size_t lastRequestCount = 0;
+static WifiFastConnectStats lastFastConnectStats;
+static uint32_t lastLeaseCount = 0;
+
+static void pressButton(uint64_t timeInUs) {
+    if (pressCount == MAX_PRESS_COUNT) {
+        fprintf(stderr, "Too many presses.\n");
+        abort();
+    }
+
+    presses[pressCount++] = (MockButtonPress){
+        .pressTimeInUs = timeInUs,
+        .releaseTimeInUs = timeInUs + PRESS_DURATION_IN_US};
+    setMockButtonPresses(presses, pressCount);
+}
+
+// Rings delivered since the last call
+static uint32_t countNewRings(void) {
+    const MockServerRequest* requests;
+    const size_t requestCount = getMockServerRequests(&requests);
+    uint32_t rings = 0;
+
+    for (size_t i = lastRequestCount; i < requestCount; ++i) {
+        if (requests[i].answered) {
+            rings += requests[i].ringCount;
+        }
+    }
+
+    return rings;
+}
+
+// Time from the press until the server has the ring, 0 if it doesn't
+static uint64_t getRingLatency(uint64_t pressTimeInUs) {
+    const MockServerRequest* requests;
+    const size_t requestCount = getMockServerRequests(&requests);
+
+    for (size_t i = lastRequestCount; i < requestCount; ++i) {
+        if (requests[i].answered && requests[i].ringCount > 0) {
+            return requests[i].timeInUs - pressTimeInUs;
+        }
+    }
+
+    return 0;
+}
+
+static void printWake(const char* name, uint64_t latencyInUs) {
+    const uint64_t radioOnTimeInUs = getMockRadioOnTimeInUs();
+    printf(
+        "%-12s awake %5llu ms, radio on %5llu ms", name,
+        (unsigned long long)(lastWake.sleepTimeInUs - lastWake.wakeTimeInUs) /
+            1000,
+        (unsigned long long)(radioOnTimeInUs - lastRadioOnTimeInUs) / 1000);
+    if (latencyInUs > 0) {
+        printf(", press to server %5llu ms",
+               (unsigned long long)latencyInUs / 1000);
+    }
+    printf("\n");
+}
+
+// Whether the wake fast connected, got through with it and got a lease.
+// The stats are read back from the RTC memory of the wake.
+static void checkConnection(
+    uint32_t fastConnectAttempts,
+    uint32_t fastConnectSuccesses,
+    uint32_t leases) {
+    WifiFastConnectStats stats;
+    getWifiFastConnectStats(&stats);
+    CHECK_EQUAL(
+        fastConnectAttempts, stats.attempts - lastFastConnectStats.attempts);
+    CHECK_EQUAL(
+        fastConnectSuccesses,
+        stats.successes - lastFastConnectStats.successes);
+    CHECK_EQUAL(leases, getMockDhcpLeaseCount() - lastLeaseCount);
+}
+
+static void finishWake(void) {
+    const MockServerRequest* requests;
+    lastRequestCount = getMockServerRequests(&requests);
+    lastRadioOnTimeInUs = getMockRadioOnTimeInUs();
+    getWifiFastConnectStats(&lastFastConnectStats);
+    lastLeaseCount = getMockDhcpLeaseCount();
+}
+
+static void testColdBoot(void) {
+    lastWake = coldBootMockDevice();
+
+    CHECK_EQUAL(ESP_SLEEP_WAKEUP_UNDEFINED, lastWake.cause);
+    const MockServerRequest* requests;
+    CHECK_EQUAL(1, getMockServerRequests(&requests));
+    CHECK(requests[0].health);
+    CHECK(requests[0].answered);
+    CHECK_EQUAL(1, getMockServerHandshakeCount());
+    checkConnection(0, 0, 1);
+    printWake("cold boot", 0);
+    finishWake();
+}
+
+// The cold boot left the channel, BSSID and IP for connecting fast
+static void testRing(const char* name) {
+    const uint64_t pressTime = lastWake.sleepTimeInUs + TIME_TO_PRESS_IN_US;
+    pressButton(pressTime);
+    lastWake = wakeMockDevice();
+
+    CHECK_EQUAL(ESP_SLEEP_WAKEUP_ULP, lastWake.cause);
+    CHECK(lastWake.wakeTimeInUs > pressTime);
+    CHECK_EQUAL(1, countNewRings());
+    const uint64_t latency = getRingLatency(pressTime);
+    CHECK(latency > 0);
+    CHECK(latency < FAST_RING_LATENCY_IN_US);
+    checkConnection(1, 1, 0);
+    printWake(name, latency);
+    finishWake();
+}
+
+static void testHeartbeat(void) {
+    lastWake = wakeMockDevice();
+
+    CHECK_EQUAL(ESP_SLEEP_WAKEUP_TIMER, lastWake.cause);
+    const MockServerRequest* requests;
+    const size_t requestCount = getMockServerRequests(&requests);
+    CHECK_EQUAL(lastRequestCount + 1, requestCount);
+    CHECK(requests[requestCount - 1].health);
+    CHECK_EQUAL(0, countNewRings());
+    // The lease was up for renewal
+    checkConnection(0, 0, 1);
+    printWake("heartbeat", 0);
+    finishWake();
+}
+
+// A ring that doesn't get through is kept in the event log until the next
+// wake that reaches the server
+static void testUndelivered(const char* name) {
+    const uint64_t pressTime = lastWake.sleepTimeInUs + TIME_TO_PRESS_IN_US;
+    pressButton(pressTime);
+    lastWake = wakeMockDevice();
+
+    CHECK_EQUAL(ESP_SLEEP_WAKEUP_ULP, lastWake.cause);
+    CHECK_EQUAL(0, countNewRings());
+    // Getting an IP isn't enough for a success
+    checkConnection(1, 0, 0);
+    printWake(name, 0);
+    finishWake();
+
+    setMockAccessPointUp(true);
+    setMockServerResponseTime(50);
+    lastWake = wakeMockDevice();
+
+    CHECK_EQUAL(ESP_SLEEP_WAKEUP_TIMER, lastWake.cause);
+    CHECK_EQUAL(1, countNewRings());
+    // The failure invalidated the fast connection
+    checkConnection(0, 0, 1);
+    printWake("redelivery", 0);
+    finishWake();
+}
+
+int main(void) {
+    resetMockOta();
+    eraseMockNvs();
+    resetMockWifi();
+    resetMockServer();
+    setMockDhcpLeaseTime(LEASE_TIME_IN_S);
+
+    testColdBoot();
+    testRing("ring");
+    testRing("second ring");
+    testHeartbeat();
+
+    setMockAccessPointUp(false);
+    testUndelivered("AP down");
+    setMockServerResponseTime(SLOW_SERVER_RESPONSE_TIME_IN_MS);
+    testUndelivered("slow server");
+
+    return CHECK_RESULT();
+}
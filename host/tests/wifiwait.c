@@ -0,0 +1,175 @@
+#include "check.h"
+#include "mockwifi.h"
+#include "virtualtasks.h"
+#include "wifi.h"
+
+#include <esp_event.h>
+#include <esp_timer.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <stdio.h>
+
+#define WAITER_COUNT 20
+#define WAITER_FIRST_PRIORITY 2
+#define WAITER_PRIORITY_COUNT 8
+// Ahead of the scan of the access point, which takes over 700 ms
+#define STOP_TIME_IN_MS 400
+
+typedef struct {
+    // After the start of WiFi
+    uint32_t arrivalInMs;
+    uint32_t timeoutInMs;
+    WifiWaitResult result;
+    uint64_t endTimeInUs;
+} Waiter;
+
+static Waiter waiters[WAITER_COUNT];
+static QueueHandle_t endedWaiters = NULL;
+static uint64_t startTimeInUs = 0;
+
+static const char* getResultName(WifiWaitResult result) {
+    switch (result) {
+    case WIFI_WAIT_RESULT_OK:
+        return "ok";
+    case WIFI_WAIT_RESULT_FAIL:
+        return "fail";
+    default:
+        return "timeout";
+    }
+}
+
+static void waiterTask(void* parameter) {
+    Waiter* waiter = parameter;
+
+    vTaskDelay(pdMS_TO_TICKS(waiter->arrivalInMs));
+    waiter->result = waitForWifiConnection(waiter->timeoutInMs);
+    waiter->endTimeInUs = esp_timer_get_time() - startTimeInUs;
+
+    const size_t index = waiter - waiters;
+    xQueueSend(endedWaiters, &index, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+// Deadlines that fall before and after the outcome, with waiters of
+// different priorities arriving before and after it
+static void startWaiters(void) {
+    startTimeInUs = esp_timer_get_time();
+
+    for (size_t i = 0; i < WAITER_COUNT; ++i) {
+        waiters[i] = (Waiter){
+            .arrivalInMs = (i % 5) * 1000,
+            .timeoutInMs = i % 4 == 3 ? WIFI_WAIT_FOREVER : i * 500};
+        char name[16];
+        snprintf(name, sizeof(name), "waiter%u", (unsigned)i);
+        CHECK_EQUAL(
+            pdPASS, xTaskCreate(
+                        waiterTask, name, 4096, &waiters[i],
+                        WAITER_FIRST_PRIORITY + i % WAITER_PRIORITY_COUNT,
+                        NULL));
+    }
+}
+
+static void waitForWaiters(void) {
+    bool ended[WAITER_COUNT] = {false};
+
+    for (size_t i = 0; i < WAITER_COUNT; ++i) {
+        size_t index;
+        CHECK_EQUAL(pdTRUE, xQueueReceive(endedWaiters, &index, portMAX_DELAY));
+        CHECK(!ended[index]);
+        ended[index] = true;
+    }
+}
+
+// Each waiter gets the outcome once it's there, or times out at its own
+// deadline. A deadline right on the outcome may go either way.
+static void checkWaiters(WifiWaitResult outcome, uint64_t outcomeTimeInUs) {
+    uint32_t outcomes = 0;
+    uint32_t timeouts = 0;
+
+    for (size_t i = 0; i < WAITER_COUNT; ++i) {
+        const Waiter* waiter = &waiters[i];
+        const uint64_t arrivalTime = waiter->arrivalInMs * 1000ULL;
+        const uint64_t deadline =
+            waiter->timeoutInMs == WIFI_WAIT_FOREVER
+                ? UINT64_MAX
+                : arrivalTime + waiter->timeoutInMs * 1000ULL;
+
+        if (deadline < outcomeTimeInUs) {
+            CHECK_EQUAL(WIFI_WAIT_RESULT_TIMEOUT, waiter->result);
+            CHECK_EQUAL(deadline, waiter->endTimeInUs);
+            ++timeouts;
+        } else if (deadline > outcomeTimeInUs) {
+            CHECK_EQUAL(outcome, waiter->result);
+            CHECK_EQUAL(
+                arrivalTime > outcomeTimeInUs ? arrivalTime : outcomeTimeInUs,
+                waiter->endTimeInUs);
+            ++outcomes;
+        }
+    }
+
+    printf(
+        "%-7s after %5llu ms: %2u waiters got it, %2u timed out\n",
+        getResultName(outcome), (unsigned long long)outcomeTimeInUs / 1000,
+        outcomes, timeouts);
+}
+
+// When the first waiter got the outcome, which the others are checked
+// against
+static uint64_t findOutcomeTime(WifiWaitResult outcome) {
+    uint64_t time = UINT64_MAX;
+
+    for (size_t i = 0; i < WAITER_COUNT; ++i) {
+        if (waiters[i].result == outcome && waiters[i].endTimeInUs < time) {
+            time = waiters[i].endTimeInUs;
+        }
+    }
+
+    CHECK(time != UINT64_MAX);
+    return time;
+}
+
+static void testConnected(void) {
+    startWifi();
+    startWaiters();
+    waitForWaiters();
+    checkWaiters(WIFI_WAIT_RESULT_OK, findOutcomeTime(WIFI_WAIT_RESULT_OK));
+    stopWifi();
+}
+
+// After every try
+static void testFailed(void) {
+    setMockAccessPointUp(false);
+    startWifi();
+    startWaiters();
+    waitForWaiters();
+    checkWaiters(WIFI_WAIT_RESULT_FAIL, findOutcomeTime(WIFI_WAIT_RESULT_FAIL));
+    stopWifi();
+    setMockAccessPointUp(true);
+}
+
+// Stopping WiFi releases the waiters
+static void testStopped(void) {
+    startWifi();
+    startWaiters();
+    vTaskDelay(pdMS_TO_TICKS(STOP_TIME_IN_MS));
+    stopWifi();
+    waitForWaiters();
+    CHECK_EQUAL(
+        STOP_TIME_IN_MS * 1000ULL, findOutcomeTime(WIFI_WAIT_RESULT_FAIL));
+    checkWaiters(WIFI_WAIT_RESULT_FAIL, STOP_TIME_IN_MS * 1000ULL);
+}
+
+int main(void) {
+    resetMockWifi();
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    initWifi();
+    endedWaiters = xQueueCreate(WAITER_COUNT, sizeof(size_t));
+    const size_t taskCount = getVirtualTaskCount();
+
+    testConnected();
+    testFailed();
+    testStopped();
+    CHECK_EQUAL(taskCount, getVirtualTaskCount());
+
+    return CHECK_RESULT();
+}
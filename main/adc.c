@@ -3,16 +3,43 @@
 
 #include <driver/adc.h>
 #include <esp_adc_cal.h>
-#include <math.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <string.h>
 
 static const adc_bits_width_t ADC_BIT_WIDTH = ADC_WIDTH_BIT_12;
 static const adc_atten_t ADC_ATTENUATION = ADC_ATTEN_DB_6;
 // Approximate ADC voltage reference in mV
 static const uint32_t ADC_VREF = 1100;
+// Spreads samples over time so that periodic noise averages out
+static const uint64_t ADC_SAMPLE_PERIOD_IN_US = 250;
 
 static esp_adc_cal_characteristics_t* adcCalChar;
 
+typedef struct {
+    adc1_channel_t channel;
+    uint16_t samples[ADC_MAX_SAMPLES];
+    uint32_t sampleCount;
+    uint32_t targetSampleCount;
+} AdcSampling;
+
+static AdcSampling adcSampling;
+static esp_timer_handle_t adcSampleTimer = NULL;
+static SemaphoreHandle_t adcSamplingDone = NULL;
+static SemaphoreHandle_t adcMutex = NULL;
+
+static void adcSampleTimerCallback(void* arg) {
+    AdcSampling* sampling = &adcSampling;
+    sampling->samples[sampling->sampleCount++] =
+        adc1_get_raw(sampling->channel);
+
+    if (sampling->sampleCount >= sampling->targetSampleCount) {
+        esp_timer_stop(adcSampleTimer);
+        xSemaphoreGive(adcSamplingDone);
+    }
+}
+
 void initAdc(void) {
     adcCalChar = malloc(sizeof(esp_adc_cal_characteristics_t));
     memset(adcCalChar, 0, sizeof(esp_adc_cal_characteristics_t));
@@ -23,17 +50,67 @@ void initAdc(void) {
     ESP_ERROR_CHECK(adc1_config_width(ADC_BIT_WIDTH));
     ESP_ERROR_CHECK(
         adc1_config_channel_atten(BATTERY_ADC_CHANNEL, ADC_ATTENUATION));
+
+    adcSamplingDone = xSemaphoreCreateBinary();
+    adcMutex = xSemaphoreCreateMutex();
+
+    esp_timer_create_args_t timerArgs = {
+        .callback = adcSampleTimerCallback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "adc"};
+
+    ESP_ERROR_CHECK(esp_timer_create(&timerArgs, &adcSampleTimer));
 }
 
-uint32_t sampleVoltage(int channel, uint32_t sampleCount) {
-    uint32_t readings = 0;
+uint32_t filterSamples(uint16_t* samples, uint32_t sampleCount) {
+    if (sampleCount == 0) {
+        return 0;
+    }
 
-    for (uint32_t i = 0; i < sampleCount; ++i) {
-        readings += adc1_get_raw((adc1_channel_t)channel);
+    // Insertion sort is fast enough for a few dozen samples
+    for (uint32_t i = 1; i < sampleCount; ++i) {
+        const uint16_t sample = samples[i];
+        uint32_t j = i;
+        for (; j > 0 && samples[j - 1] > sample; --j) {
+            samples[j] = samples[j - 1];
+        }
+        samples[j] = sample;
     }
 
-    double reading = (double)readings / sampleCount;
-    double voltage = esp_adc_cal_raw_to_voltage(reading, adcCalChar);
+    // Mean of the middle half, which drops outliers on both ends
+    const uint32_t first = sampleCount / 4;
+    const uint32_t count = sampleCount - 2 * first;
+    uint32_t sum = 0;
+
+    for (uint32_t i = first; i < first + count; ++i) {
+        sum += samples[i];
+    }
+
+    return (sum + count / 2) / count;
+}
+
+uint32_t sampleVoltage(int channel, uint32_t sampleCount) {
+    if (sampleCount > ADC_MAX_SAMPLES) {
+        sampleCount = ADC_MAX_SAMPLES;
+    }
+
+    xSemaphoreTake(adcMutex, portMAX_DELAY);
+
+    adcSampling.channel = (adc1_channel_t)channel;
+    adcSampling.sampleCount = 0;
+    adcSampling.targetSampleCount = sampleCount;
+
+    ESP_ERROR_CHECK(
+        esp_timer_start_periodic(adcSampleTimer, ADC_SAMPLE_PERIOD_IN_US));
+    xSemaphoreTake(adcSamplingDone, portMAX_DELAY);
+
+    uint32_t reading = filterSamples(adcSampling.samples, sampleCount);
+    xSemaphoreGive(adcMutex);
+
+    return convertAdcReading(reading);
+}
 
-    return voltage;
+uint32_t convertAdcReading(uint32_t reading) {
+    return esp_adc_cal_raw_to_voltage(reading, adcCalChar);
 }
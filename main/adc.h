@@ -2,5 +2,13 @@
 
 #include <stdint.h>
 
+#define ADC_MAX_SAMPLES 64
+
 void initAdc(void);
+// Integer trimmed mean of raw readings
+uint32_t filterSamples(uint16_t* samples, uint32_t sampleCount);
+// Takes evenly paced samples, blocking until done. Callers choose when to
+// sample, e.g. while the radio is off.
 uint32_t sampleVoltage(int channel, uint32_t sampleCount);
+// Converts a raw reading to mV
+uint32_t convertAdcReading(uint32_t reading);
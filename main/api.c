@@ -1,20 +1,86 @@
 #include "api.h"
 #include "adc.h"
 #include "esp_err.h"
+#include "flatmap.h"
+#include "https.h"
 #include "log.h"
+#include "ringdatagram.h"
 #include "sleep.h"
+#include "tls.h"
+#include "tlv.h"
 
-#include <esp_http_client.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define LOG_TAG "api"
 
 static const int HTTP_TIMEOUT_IN_MS = 1000;
+// Until the ring is uploaded over HTTPS instead
+static const uint32_t RING_DATAGRAM_TIMEOUT_IN_MS = 500;
 // static const int HTTP_MAX_CONTENT_LENGTH = 65536;
-static const char* API_CONTENT_TYPE = "application/flatmap";
-
-extern const uint8_t serverCertPemStart[] asm("_binary_server_cert_pem_start");
-extern const uint8_t serverCertPemEnd[] asm("_binary_server_cert_pem_end");
+static const char* API_FLATMAP_CONTENT_TYPE = "application/flatmap";
+static const char* API_TLV_CONTENT_TYPE = "application/vnd.doorbell.tlv";
+// Report field holding a ring, encoded as a nested message
+static const uint32_t API_REPORT_RING_ID = 1;
+// Large enough for API_MAX_RING_COUNT rings and health in either encoding,
+// but for a long trace in flatmap, which is cut short instead
+#define API_REQUEST_BODY_SIZE 1536
+
+// Field types of apischema.def
+#define API_MEMBER_UINT(member, maxLength) uint32_t member;
+#define API_MEMBER_INT(member, maxLength) int32_t member;
+#define API_MEMBER_STRING(member, maxLength) char member[maxLength];
+#define API_ENCODE_UINT(writer, id, value, maxLength)                          \
+    TlvWriter_putUint(writer, id, value)
+#define API_ENCODE_INT(writer, id, value, maxLength)                           \
+    TlvWriter_putInt(writer, id, value)
+#define API_ENCODE_STRING(writer, id, value, maxLength)                        \
+    TlvWriter_putString(writer, id, value, maxLength)
+#define API_ENCODE_BASE64 API_ENCODE_STRING
+#define API_DECODE_UINT(target, field) target = (field)->value
+#define API_DECODE_INT(target, field) target = getTlvInt(field)
+#define API_DECODE_STRING(target, field)                                       \
+    copyTlvString(target, sizeof(target), field)
+// The same in flatmap, where base64 comes after the other fields
+#define API_FLATMAP_ENCODE_UINT(body, key, value, maxLength)                   \
+    appendRequestBody(body, "%s=%u\n", key, value)
+#define API_FLATMAP_ENCODE_INT(body, key, value, maxLength)                    \
+    appendRequestBody(body, "%s=%d\n", key, value)
+#define API_FLATMAP_ENCODE_STRING(body, key, value, maxLength)                 \
+    appendFlatmapString(body, key, value, maxLength)
+#define API_FLATMAP_ENCODE_BASE64(body, key, value, maxLength)
+#define API_FLATMAP_ENCODE_LAST_UINT(body, key, value, maxLength)
+#define API_FLATMAP_ENCODE_LAST_INT(body, key, value, maxLength)
+#define API_FLATMAP_ENCODE_LAST_STRING(body, key, value, maxLength)
+#define API_FLATMAP_ENCODE_LAST_BASE64(body, key, value, maxLength)            \
+    appendFlatmapBase64(body, key, value, maxLength)
+#define API_FLATMAP_DECODE_UINT(target, value, valueLength)                    \
+    target = parseFlatmapInteger(value, valueLength)
+#define API_FLATMAP_DECODE_INT API_FLATMAP_DECODE_UINT
+#define API_FLATMAP_DECODE_STRING(target, value, valueLength)                  \
+    copyFlatmapValue(target, sizeof(target), value, valueLength)
+
+enum {
+    API_RING_EVENT_TLV_MAX_SIZE = 0
+#define API_RING_EVENT_FIELD(id, member, type, maxLength)                      \
+    +TLV_MAX_SIZE_##type(maxLength)
+#include "apischema.def"
+#undef API_RING_EVENT_FIELD
+    ,
+    API_DEVICE_HEALTH_TLV_MAX_SIZE = 0
+#define API_DEVICE_HEALTH_FIELD(id, member, key, type, maxLength)              \
+    +TLV_MAX_SIZE_##type(maxLength)
+#include "apischema.def"
+#undef API_DEVICE_HEALTH_FIELD
+};
+
+_Static_assert(
+    API_MAX_RING_COUNT * TLV_MAX_SIZE_STRING(API_RING_EVENT_TLV_MAX_SIZE) +
+            API_DEVICE_HEALTH_TLV_MAX_SIZE <=
+        API_REQUEST_BODY_SIZE,
+    "Request body buffer is too small");
 
 static esp_err_t (*networkConnectHandler)(void) = NULL;
 
@@ -25,249 +91,399 @@ esp_err_t invokeNetworkConnectHandler() {
     return ESP_FAIL;
 }
 
-esp_err_t httpEventHandler(esp_http_client_event_t* evt) { return ESP_OK; }
-
-esp_err_t httpRequest(
-    const char* url,
-    esp_http_client_method_t method,
-    const char* requestContentType,
-    const char* requestContent,
-    uint32_t requestContentLength,
-    char* responseBody,
-    size_t responseBodySize,
-    size_t* responseBodyBytesRead) {
-
-    if (invokeNetworkConnectHandler() != ESP_OK) {
-        return ESP_FAIL;
+// Responses come in the encoding of the request
+typedef struct {
+    ApiEncoding encoding;
+    union {
+        FlatmapParser flatmap;
+        TlvParser tlv;
+    };
+} ResponseParser;
+
+// Response bodies are parsed as they arrive instead of being buffered
+esp_err_t httpEventHandler(HttpsEvent* evt) {
+    ResponseParser* parser = (ResponseParser*)evt->userData;
+
+    if (!parser || evt->statusCode < 200 || evt->statusCode >= 300) {
+        return ESP_OK;
     }
 
-    esp_http_client_config_t config;
-    memset(&config, 0, sizeof(esp_http_client_config_t));
-
-    config.url = url;
-    config.method = method;
-    config.timeout_ms = HTTP_TIMEOUT_IN_MS;
-    config.event_handler = httpEventHandler;
-    config.user_data = NULL;
-    config.cert_pem = (const char*)serverCertPemStart;
-    // Async mode can cause infinite loop (SDK 4.2.4) because esp_http_client_perform()
-    // returns ESP_ERR_HTTP_EAGAIN if connection fails.
-    config.is_async = false;
-    // TODO: Should be set to false in production code
-    config.skip_cert_common_name_check = true;
-
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-
-    if (requestContentType) {
-        ESP_ERROR_CHECK(esp_http_client_set_header(
-            client, "Content-Type", requestContentType));
+    if (parser->encoding == API_ENCODING_TLV) {
+        if (evt->id == HTTPS_EVENT_ON_DATA) {
+            TlvParser_feed(&parser->tlv, evt->data, evt->dataLength);
+        } else if (evt->id == HTTPS_EVENT_ON_FINISH) {
+            TlvParser_finish(&parser->tlv);
+        }
+    } else if (evt->id == HTTPS_EVENT_ON_DATA) {
+        FlatmapParser_feed(&parser->flatmap, evt->data, evt->dataLength);
+    } else if (evt->id == HTTPS_EVENT_ON_FINISH) {
+        FlatmapParser_finish(&parser->flatmap);
     }
 
-    if (requestContent) {
-        ESP_ERROR_CHECK(esp_http_client_set_post_field(
-            client, requestContent, requestContentLength));
+    return ESP_OK;
+}
+
+// updatePatchPath is a patch against the running image, optional
+typedef struct {
+#define API_HEARTBEAT_RESPONSE_FIELD(id, member, key, type, maxLength)         \
+    API_MEMBER_##type(member, maxLength)
+#include "apischema.def"
+#undef API_HEARTBEAT_RESPONSE_FIELD
+} HeartbeatResponse;
+
+static void parseHeartbeatTlvCallback(const TlvField* field, void* userData) {
+    HeartbeatResponse* response = (HeartbeatResponse*)userData;
+
+    switch (field->id) {
+#define API_HEARTBEAT_RESPONSE_FIELD(id, member, key, type, maxLength)         \
+    case id:                                                                   \
+        API_DECODE_##type(response->member, field);                            \
+        break;
+#include "apischema.def"
+#undef API_HEARTBEAT_RESPONSE_FIELD
+    default:
+        // Added by newer servers
+        break;
     }
+}
 
-    esp_err_t error = ESP_FAIL;
+static int64_t parseFlatmapInteger(const char* value, size_t valueLength) {
+    char text[24];
+    copyFlatmapValue(text, sizeof(text), value, valueLength);
+    return strtoll(text, NULL, 10);
+}
 
-    yield();
-    // Note: Does not seem to respect the timeout we have set.
-    //       It takes way longer to time out on connection failure.
-    error = esp_http_client_perform(client);
-    yield();
+static void parseHeartbeatFlatmapCallback(
+    const char* key,
+    size_t keyLength,
+    const char* value,
+    size_t valueLength,
+    void* userData) {
+    HeartbeatResponse* response = (HeartbeatResponse*)userData;
 
-    if (error == ESP_OK) {
-        int statusCode = esp_http_client_get_status_code(client);
-        int contentLength = esp_http_client_get_content_length(client);
-
-        if (contentLength > 0 && responseBody && responseBodySize > 0) {
-            int bytesToRead = contentLength + 1 > responseBodySize
-                                  ? responseBodySize - 1
-                                  : contentLength;
-            int bytesRead = esp_http_client_read_response(
-                client, responseBody, bytesToRead);
-            responseBody[bytesRead] = 0;
-
-            if (responseBodyBytesRead) {
-                *responseBodyBytesRead = bytesRead;
-            }
-        }
-    } else {
-        LOGE(LOG_TAG, "HTTP request to %s failed.", url);
+#define API_HEARTBEAT_RESPONSE_FIELD(id, member, fieldKey, type, maxLength)    \
+    if (flatmapKeyEquals(key, keyLength, fieldKey)) {                          \
+        API_FLATMAP_DECODE_##type(response->member, value, valueLength);       \
+        return;                                                                \
     }
+#include "apischema.def"
+#undef API_HEARTBEAT_RESPONSE_FIELD
+}
 
-    ESP_ERROR_CHECK(esp_http_client_cleanup(client));
-    return error;
+void ApiClient_setNetworkConnectHandler(esp_err_t (*handler)(void)) {
+    networkConnectHandler = handler;
 }
 
-typedef void* (*AllocatorType)(size_t size);
-typedef void (*DeallocatorType)(void* memory);
+esp_err_t ApiClient_init(ApiClientContext* context) {
+    esp_err_t error =
+        parseHttpsUrl(context->serverUrl, &context->parsedServerUrl);
 
-char* createUrl(const char* base, const char* path, AllocatorType allocator) {
-    const unsigned int baseLength = strlen(base);
-    const unsigned int pathLength = strlen(path);
-    const unsigned int urlLength = baseLength + pathLength;
-    const unsigned int urlBufferLength = urlLength + 1;
+    if (error != ESP_OK) {
+        LOGE(LOG_TAG, "Invalid server URL: %s", context->serverUrl);
+        return error;
+    }
 
-    char* url = (char*)allocator(urlBufferLength);
-    assert(url);
+    memset(&context->client, 0, sizeof(context->client));
+    context->clientMutex = xSemaphoreCreateMutex();
+    return context->clientMutex ? ESP_OK : ESP_ERR_NO_MEM;
+}
 
-    memset(url, 0, urlBufferLength);
-    memcpy(url, base, baseLength);
-    memcpy(url + baseLength, path, pathLength);
-    url[urlLength] = 0;
+void ApiClient_disconnect(ApiClientContext* context) {
+    xSemaphoreTake(context->clientMutex, portMAX_DELAY);
+    HttpsClient_close(&context->client);
+    LOGD(
+        LOG_TAG, "API connection closed (reuses: %u, reconnects: %u)",
+        context->client.stats.reuses, context->client.stats.reconnects);
+    xSemaphoreGive(context->clientMutex);
+}
 
-    return url;
+void ApiClient_getConnectionStats(
+    ApiClientContext* context, HttpsClientStats* stats) {
+    xSemaphoreTake(context->clientMutex, portMAX_DELAY);
+    *stats = context->client.stats;
+    xSemaphoreGive(context->clientMutex);
 }
 
-void freeUrl(const char* url, DeallocatorType deallocator) {
-    deallocator((void*)url);
+// Only succeeds if the server responded with a 2xx status. Returns
+// ESP_ERR_NOT_SUPPORTED if it rejected the encoding.
+esp_err_t ApiClient_request(
+    ApiClientContext* context,
+    const char* path,
+    HttpsMethod method,
+    ApiEncoding encoding,
+    const char* content,
+    uint32_t contentLength,
+    ResponseParser* responseParser) {
+
+    if (invokeNetworkConnectHandler() != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    // The server URL may have a base path that the API path is appended to
+    const char* basePath = context->parsedServerUrl.path;
+    char fullPath[256];
+    int fullPathLength = snprintf(
+        fullPath, sizeof(fullPath), "%s%s",
+        strcmp(basePath, "/") == 0 ? "" : basePath, path);
+
+    if (fullPathLength >= sizeof(fullPath)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    HttpsRequest request = {
+        .method = method,
+        .host = context->parsedServerUrl.host,
+        .port = context->parsedServerUrl.port,
+        .path = fullPath,
+        .contentType = encoding == API_ENCODING_TLV ? API_TLV_CONTENT_TYPE
+                                                    : API_FLATMAP_CONTENT_TYPE,
+        .content = content,
+        .contentLength = content ? contentLength : 0,
+        .timeoutMs = HTTP_TIMEOUT_IN_MS,
+        .eventHandler = httpEventHandler,
+        .userData = responseParser};
+
+    HttpsResponse response;
+
+    xSemaphoreTake(context->clientMutex, portMAX_DELAY);
+    yield();
+    esp_err_t error =
+        HttpsClient_request(&context->client, &request, &response);
+    yield();
+    xSemaphoreGive(context->clientMutex);
+
+    if (error != ESP_OK) {
+        LOGE(LOG_TAG, "HTTP request to %s failed.", path);
+    } else if (response.statusCode == 415) {
+        // Unsupported Media Type
+        error = ESP_ERR_NOT_SUPPORTED;
+    } else if (response.statusCode < 200 || response.statusCode >= 300) {
+        LOGE(
+            LOG_TAG, "HTTP request to %s failed (HTTP %d).", path,
+            response.statusCode);
+        error = ESP_ERR_INVALID_RESPONSE;
+    }
+
+    return error;
 }
 
-typedef void (*ParseFlatmapCallback)(
-    const char* key, const char* value, void* userData);
+typedef struct {
+    char* data;
+    size_t size;
+    size_t length;
+} RequestBody;
 
-void parseFlatmap(
-    const char* input,
-    size_t length,
-    ParseFlatmapCallback callback,
-    void* userData) {
-    if (!input || length == 0 || !callback) {
+static void appendRequestBody(RequestBody* body, const char* format, ...) {
+    if (body->length >= body->size) {
         return;
     }
 
-    char* buffer = malloc(length);
+    va_list args;
+    va_start(args, format);
+    body->length += vsnprintf(
+        body->data + body->length, body->size - body->length, format, args);
+    va_end(args);
+}
 
-    for (size_t i = 0; i < length;) {
-        char* key = &buffer[i];
-        char* keyEnd = key;
-        while (i < length && input[i] != '=') {
-            buffer[i] = input[i];
-            ++i;
-            ++keyEnd;
-        }
+static void appendRings(
+    RequestBody* body, const RingEvent* rings, size_t ringCount) {
+    appendRequestBody(body, "ring.count=%u\n", ringCount);
 
-        buffer[i] = 0;
-        ++i;
+    for (size_t i = 0; i < ringCount; ++i) {
+        appendRequestBody(
+            body, "ring.%u.id=%08x-%u\n", i, rings[i].logId,
+            rings[i].sequence);
 
-        char* value = &buffer[i];
-        char* valueEnd = value;
-        while (i < length && input[i] != '\n') {
-            buffer[i] = input[i];
-            ++i;
-            ++valueEnd;
+        if (rings[i].ageInMs >= 0) {
+            appendRequestBody(body, "ring.%u.age=%lld\n", i, rings[i].ageInMs);
         }
+    }
+}
 
-        buffer[i] = 0;
-        ++i;
+// Nothing is written for NULL, as in tlv.h
+static void appendFlatmapString(
+    RequestBody* body, const char* key, const char* value, size_t maxLength) {
+    if (value) {
+        appendRequestBody(
+            body, "%s=%.*s\n", key, (int)strnlen(value, maxLength), value);
+    }
+}
 
-        callback(key, value, userData);
+// Keeps whole base64 groups that fit in what is left of the body, so that
+// the rings in the same request still go through, and says how much was
+// left out in "<key>.truncated"
+static void appendFlatmapBase64(
+    RequestBody* body, const char* key, const char* value, size_t maxLength) {
+    if (!value || !value[0]) {
+        return;
     }
 
-    buffer[length - 1] = 0;
+    const size_t length = strnlen(value, maxLength);
+    const size_t reserved = body->length + 2 * strlen(key) + sizeof("=\n") +
+                            sizeof(".truncated=4294967295\n");
+    const size_t space = body->size > reserved ? body->size - reserved : 0;
+    const size_t sentLength = length <= space ? length : space / 4 * 4;
+
+    if (sentLength > 0) {
+        appendRequestBody(body, "%s=%.*s\n", key, (int)sentLength, value);
+    }
 
-    free(buffer);
+    if (sentLength < length) {
+        LOGW(
+            LOG_TAG, "Left out %u characters of %s.", length - sentLength,
+            key);
+        appendRequestBody(
+            body, "%s.truncated=%u\n", key, length - sentLength);
+    }
 }
 
-typedef struct {
-    char updateVersion[32];
-    char updatePath[256];
-} HeartbeatResponse;
+static void appendDeviceHealth(RequestBody* body, const DeviceHealth* health) {
+#define API_DEVICE_HEALTH_FIELD(id, member, key, type, maxLength)              \
+    API_FLATMAP_ENCODE_##type(body, key, health->member, maxLength);
+#include "apischema.def"
+#undef API_DEVICE_HEALTH_FIELD
 
-void parseHeartbeatFlatmapCallback(
-    const char* key, const char* value, void* userData) {
+#define API_DEVICE_HEALTH_FIELD(id, member, key, type, maxLength)              \
+    API_FLATMAP_ENCODE_LAST_##type(body, key, health->member, maxLength);
+#include "apischema.def"
+#undef API_DEVICE_HEALTH_FIELD
+}
 
-    if (!userData) {
-        return;
+static void encodeRings(
+    TlvWriter* writer, const RingEvent* rings, size_t ringCount) {
+    for (size_t i = 0; i < ringCount; ++i) {
+        const RingEvent* ring = &rings[i];
+        uint8_t ringData[API_RING_EVENT_TLV_MAX_SIZE];
+        TlvWriter ringWriter;
+        TlvWriter_init(&ringWriter, ringData, sizeof(ringData));
+
+#define API_RING_EVENT_FIELD(id, member, type, maxLength)                      \
+    API_ENCODE_##type(&ringWriter, id, ring->member, maxLength);
+#include "apischema.def"
+#undef API_RING_EVENT_FIELD
+
+        TlvWriter_putBytes(
+            writer, API_REPORT_RING_ID, ringData, ringWriter.length);
     }
+}
 
-    HeartbeatResponse* response = (HeartbeatResponse*)userData;
+static void encodeDeviceHealth(TlvWriter* writer, const DeviceHealth* health) {
+#define API_DEVICE_HEALTH_FIELD(id, member, key, type, maxLength)              \
+    API_ENCODE_##type(writer, id, health->member, maxLength);
+#include "apischema.def"
+#undef API_DEVICE_HEALTH_FIELD
+}
 
-    if (strcmp(key, "update.version") == 0) {
-        const int targetSize = sizeof(response->updateVersion) /
-                               sizeof(response->updateVersion[0]);
-        response->updateVersion[0] = 0;
-        strncpy(response->updateVersion, value, targetSize);
-        response->updateVersion[targetSize - 1] = 0;
-        return;
+static esp_err_t encodeRequestBody(
+    ApiEncoding encoding, const WakeReport* content, RequestBody* body) {
+    body->length = 0;
+
+    if (encoding == API_ENCODING_TLV) {
+        TlvWriter writer;
+        TlvWriter_init(&writer, body->data, body->size);
+        encodeRings(&writer, content->rings, content->ringCount);
+
+        if (content->health) {
+            encodeDeviceHealth(&writer, content->health);
+        }
+
+        body->length = writer.length;
+        return TlvWriter_hasOverflowed(&writer) ? ESP_ERR_INVALID_SIZE
+                                                : ESP_OK;
     }
 
-    if (strcmp(key, "update.path") == 0) {
-        const int targetSize =
-            sizeof(response->updatePath) / sizeof(response->updatePath[0]);
-        response->updatePath[0] = 0;
-        strncpy(response->updatePath, value, targetSize);
-        response->updatePath[targetSize - 1] = 0;
-        return;
+    if (content->rings) {
+        appendRings(body, content->rings, content->ringCount);
     }
-}
 
-void ApiClient_setNetworkConnectHandler(esp_err_t (*handler)(void)) {
-    networkConnectHandler = handler;
+    if (content->health) {
+        appendDeviceHealth(body, content->health);
+    }
+
+    return body->length < body->size ? ESP_OK : ESP_ERR_INVALID_SIZE;
 }
 
-esp_err_t ApiClient_request(
+// Posts the content in the encoding of the context, falling back to flatmap
+// if the server doesn't support it. The response is parsed unless
+// heartbeatResponse is NULL.
+static esp_err_t postContent(
     ApiClientContext* context,
     const char* path,
-    esp_http_client_method_t method,
-    const char* content,
-    uint32_t contentLength,
-    char* responseBody,
-    size_t responseBodySize,
-    size_t* responseBodyBytesRead) {
-
-    const char* url = createUrl(context->serverUrl, path, malloc);
+    const WakeReport* content,
+    HeartbeatResponse* heartbeatResponse) {
 
-    if (!url) {
-        return ESP_ERR_NO_MEM;
+    if (content->ringCount > API_MAX_RING_COUNT) {
+        return ESP_ERR_INVALID_SIZE;
     }
 
-    esp_err_t error = httpRequest(
-        url, method, API_CONTENT_TYPE, content, contentLength, responseBody,
-        responseBodySize, responseBodyBytesRead);
+    char requestBodyData[API_REQUEST_BODY_SIZE];
+    RequestBody requestBody = {
+        .data = requestBodyData, .size = sizeof(requestBodyData)};
+    esp_err_t error;
 
-    freeUrl(url, free);
-    return error;
-}
+    do {
+        const ApiEncoding encoding = context->encoding;
+        error = encodeRequestBody(encoding, content, &requestBody);
+
+        if (error != ESP_OK) {
+            return error;
+        }
+
+        ResponseParser responseParser = {.encoding = encoding};
+
+        if (heartbeatResponse) {
+            memset(heartbeatResponse, 0, sizeof(*heartbeatResponse));
+
+            if (encoding == API_ENCODING_TLV) {
+                TlvParser_init(
+                    &responseParser.tlv, parseHeartbeatTlvCallback,
+                    heartbeatResponse);
+            } else {
+                FlatmapParser_init(
+                    &responseParser.flatmap, parseHeartbeatFlatmapCallback,
+                    heartbeatResponse);
+            }
+        }
 
-esp_err_t ApiClient_ring(ApiClientContext* context) {
-    return ApiClient_request(
-        context, "/ring", HTTP_METHOD_POST, NULL, 0, NULL, 0, NULL);
+        error = ApiClient_request(
+            context, path, HTTPS_METHOD_POST, encoding, requestBody.data,
+            requestBody.length, heartbeatResponse ? &responseParser : NULL);
+
+        if (error == ESP_ERR_NOT_SUPPORTED &&
+            encoding == API_ENCODING_TLV) {
+            LOGW(LOG_TAG, "Server rejected binary encoding, using flatmap.");
+            context->encoding = API_ENCODING_FLATMAP;
+        } else {
+            break;
+        }
+    } while (true);
+
+    return error;
 }
 
-esp_err_t ApiClient_heartbeat(
+// Posts the content and notifies about a firmware update in the response
+static esp_err_t postWithUpdateHint(
     ApiClientContext* context,
-    DeviceHealth* health,
+    const char* path,
+    const WakeReport* content,
     FirmwareUpdateAvailableCallback firmwareUpdateAvailableCallback,
     void* userData) {
 
-    const char* requestBodyFormat = "battery.level=%s\n"
-                                    "battery.voltage=%u\n"
-                                    "firmware.version=%s\n";
-    char requestBody[1024] = {0};
-
-    int requestBodyLength = snprintf(
-        requestBody, sizeof(requestBody), requestBodyFormat,
-        health->battery.level, health->battery.voltage,
-        health->firmware.version);
-
-    char responseBody[1024] = {0};
-    size_t responseBodyLength = 0;
+    HeartbeatResponse heartbeatResponse;
+    esp_err_t error = postContent(context, path, content, &heartbeatResponse);
 
-    esp_err_t error = ApiClient_request(
-        context, "/heartbeat", HTTP_METHOD_POST, requestBody, requestBodyLength,
-        responseBody, sizeof(responseBody), &responseBodyLength);
+    if (error == ESP_OK) {
+        context->heartbeatIntervalHint = heartbeatResponse.heartbeatInterval;
+    }
 
     if (error == ESP_OK && firmwareUpdateAvailableCallback) {
-        HeartbeatResponse heartbeatResponse;
-        memset(&heartbeatResponse, 0, sizeof(heartbeatResponse));
-        parseFlatmap(
-            responseBody, responseBodyLength, parseHeartbeatFlatmapCallback,
-            &heartbeatResponse);
         if (heartbeatResponse.updateVersion[0] &&
             heartbeatResponse.updatePath[0]) {
             firmwareUpdateAvailableCallback(
                 heartbeatResponse.updateVersion, heartbeatResponse.updatePath,
+                heartbeatResponse.updatePatchPath[0]
+                    ? heartbeatResponse.updatePatchPath
+                    : NULL,
                 userData);
         }
     }
@@ -275,25 +491,100 @@ esp_err_t ApiClient_heartbeat(
     return error;
 }
 
+esp_err_t ApiClient_ring(
+    ApiClientContext* context, const RingEvent* rings, size_t count) {
+    WakeReport content = {.rings = rings, .ringCount = count};
+    return postContent(context, "/ring", &content, NULL);
+}
+
+esp_err_t ApiClient_sendRingDatagram(
+    ApiClientContext* context, const RingEvent* ring) {
+    if (context->ringDatagramPort == 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (invokeNetworkConnectHandler() != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    esp_err_t error = sendRingDatagram(
+        context->parsedServerUrl.host, context->ringDatagramPort, ring->logId,
+        ring->sequence, RING_DATAGRAM_TIMEOUT_IN_MS);
+
+    if (error == ESP_ERR_TIMEOUT) {
+        LOGW(LOG_TAG, "Ring datagram not acknowledged, using HTTPS.");
+    }
+
+    return error;
+}
+
+esp_err_t ApiClient_heartbeat(
+    ApiClientContext* context,
+    DeviceHealth* health,
+    FirmwareUpdateAvailableCallback firmwareUpdateAvailableCallback,
+    void* userData) {
+
+    WakeReport content = {.health = health};
+    return postWithUpdateHint(
+        context, "/heartbeat", &content, firmwareUpdateAvailableCallback,
+        userData);
+}
+
+static esp_err_t reportPerEndpoint(
+    ApiClientContext* context,
+    const WakeReport* report,
+    FirmwareUpdateAvailableCallback firmwareUpdateAvailableCallback,
+    void* userData) {
+
+    if (report->ringCount > 0) {
+        esp_err_t error =
+            ApiClient_ring(context, report->rings, report->ringCount);
+
+        if (error != ESP_OK) {
+            return error;
+        }
+    }
+
+    if (!report->health) {
+        return ESP_OK;
+    }
+
+    return ApiClient_heartbeat(
+        context, (DeviceHealth*)report->health,
+        firmwareUpdateAvailableCallback, userData);
+}
+
+esp_err_t ApiClient_report(
+    ApiClientContext* context,
+    const WakeReport* report,
+    FirmwareUpdateAvailableCallback firmwareUpdateAvailableCallback,
+    void* userData) {
+
+    if (context->mode == API_MODE_PER_ENDPOINT) {
+        return reportPerEndpoint(
+            context, report, firmwareUpdateAvailableCallback, userData);
+    }
+
+    return postWithUpdateHint(
+        context, "/report", report, firmwareUpdateAvailableCallback, userData);
+}
+
 esp_err_t ApiClient_url(
     ApiClientContext* context, const char* path, char* url, size_t urlSize) {
     if (!path || !url || urlSize == 0) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    const char* url_ = createUrl(context->serverUrl, path, malloc);
+    int urlLength = snprintf(url, urlSize, "%s%s", context->serverUrl, path);
 
-    if (!url_) {
-        return ESP_ERR_NO_MEM;
+    if (urlLength >= urlSize) {
+        url[0] = 0;
+        return ESP_ERR_INVALID_SIZE;
     }
 
-    url[0] = 0;
-    strncpy(url, url_, urlSize - 1);
-
-    freeUrl(url_, free);
     return ESP_OK;
 }
 
 const char* ApiClient_getServerCertificate() {
-    return (const char*)serverCertPemStart;
+    return getTlsServerCertificate();
 }
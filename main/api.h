@@ -1,38 +1,177 @@
 #pragma once
 
+#include "https.h"
+
 #include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define DEFAULT_API_SERVER_URL "https://doorbell-server.local"
+#define DEFAULT_API_MODE API_MODE_REPORT
+#define DEFAULT_API_ENCODING API_ENCODING_TLV
+// UDP port of the server for rings, see ApiClient_sendRingDatagram()
+#define DEFAULT_API_RING_DATAGRAM_PORT 4040
+// Rings per request
+#define API_MAX_RING_COUNT 8
+
+typedef enum {
+    // One request to /report per wake
+    API_MODE_REPORT,
+    // Separate /ring and /heartbeat requests for older servers
+    API_MODE_PER_ENDPOINT
+} ApiMode;
+
+typedef enum {
+    // Binary fields defined in apischema.def, see tlv.h
+    API_ENCODING_TLV,
+    // "key=value" lines, used when the server rejects the binary encoding
+    API_ENCODING_FLATMAP
+} ApiEncoding;
 
 typedef struct {
     const char* level;
     uint32_t voltage;
+    // Permille
+    uint32_t charge;
+    // Permille per day, 0 if unknown
+    uint32_t dischargeRate;
+    // -1 if unknown
+    int32_t remainingHours;
 } BatteryHealth;
 
 typedef struct {
     const char* version;
 } FirmwareInfo;
 
+typedef struct {
+    uint32_t fastConnectAttempts;
+    uint32_t fastConnectSuccesses;
+} WifiInfo;
+
+typedef struct {
+    uint32_t cacheHits;
+    uint32_t cacheMisses;
+} DnsInfo;
+
+// Peak heap use of mbedTLS in bytes since the last cold boot
+typedef struct {
+    uint32_t connectionHeapPeak;
+    uint32_t heapPeak;
+    // Connections left out of connectionHeapPeak
+    uint32_t untrackedConnections;
+} TlsInfo;
+
+// Jobs run on workers since the last cold boot, see jobs.h
+typedef struct {
+    uint32_t count;
+    uint32_t meanLatencyInUs;
+    uint32_t maxLatencyInUs;
+    uint32_t maxQueueDepth;
+} JobsInfo;
+
+// Ring uploads that failed since the last cold boot. Logged rings stay
+// queued and are sent again later.
+typedef struct {
+    uint32_t uploadFailures;
+    // Of the last failure, ESP_OK if none
+    int32_t lastUploadError;
+} RingsInfo;
+
+typedef struct {
+    // Base64-encoded wake cycle trace, see trace.h
+    const char* data;
+    uint32_t dropped;
+} TraceInfo;
+
+// Cumulative charge per consumer in µAh since the last cold boot
+typedef struct {
+    uint32_t cpu;
+    uint32_t wifi;
+    uint32_t buzzer;
+    uint32_t lightSleep;
+    uint32_t standby;
+} EnergyHealth;
+
 typedef struct {
     BatteryHealth battery;
     FirmwareInfo firmware;
+    WifiInfo wifi;
+    DnsInfo dns;
+    TlsInfo tls;
+    JobsInfo jobs;
+    RingsInfo rings;
+    TraceInfo trace;
+    EnergyHealth energy;
 } DeviceHealth;
 
+typedef struct {
+    // Stays the same when the ring is uploaded again so that the server can
+    // discard duplicates
+    uint32_t logId;
+    uint32_t sequence;
+    // Time since the ring, or -1 if unknown
+    int64_t ageInMs;
+} RingEvent;
+
+// Everything to tell the server about during a wake
+typedef struct {
+    // At most API_MAX_RING_COUNT
+    const RingEvent* rings;
+    size_t ringCount;
+    // Optional
+    const DeviceHealth* health;
+} WakeReport;
+
+// updatePatchPath is NULL unless the server has a patch for the running
+// image
 typedef void (*FirmwareUpdateAvailableCallback)(
-    const char* updateVersion, const char* updatePath, void* userData);
+    const char* updateVersion,
+    const char* updatePath,
+    const char* updatePatchPath,
+    void* userData);
 
 typedef struct {
     const char* serverUrl;
+    ApiMode mode;
+    // Falls back to API_ENCODING_FLATMAP for good if the server rejects it
+    ApiEncoding encoding;
+    // 0 to only send rings over HTTPS
+    uint16_t ringDatagramPort;
+    HttpsUrl parsedServerUrl;
+    // Connection reused by all requests until ApiClient_disconnect()
+    HttpsClient client;
+    SemaphoreHandle_t clientMutex;
+    // heartbeat.interval of the last response in seconds, 0 if none
+    uint32_t heartbeatIntervalHint;
 } ApiClientContext;
 
+esp_err_t ApiClient_init(ApiClientContext* context);
+void ApiClient_disconnect(ApiClientContext* context);
+void ApiClient_getConnectionStats(
+    ApiClientContext* context, HttpsClientStats* stats);
 void ApiClient_setNetworkConnectHandler(esp_err_t (*handler)(void));
-esp_err_t ApiClient_ring(ApiClientContext* context);
+esp_err_t ApiClient_ring(
+    ApiClientContext* context, const RingEvent* rings, size_t count);
+// Tells the server about a ring with a single UDP datagram, which is much
+// faster than HTTPS. The ring must be uploaded over HTTPS unless this
+// returns ESP_OK, e.g. when no device key is provisioned.
+esp_err_t ApiClient_sendRingDatagram(
+    ApiClientContext* context, const RingEvent* ring);
 esp_err_t ApiClient_heartbeat(
     ApiClientContext* context,
     DeviceHealth* health,
     FirmwareUpdateAvailableCallback firmwareUpdateAvailableCallback,
     void* userData);
+// Returns ESP_OK only once the server accepted everything with a 2xx
+// status, after which the rings may be removed from the queue
+esp_err_t ApiClient_report(
+    ApiClientContext* context,
+    const WakeReport* report,
+    FirmwareUpdateAvailableCallback firmwareUpdateAvailableCallback,
+    void* userData);
 esp_err_t ApiClient_url(
     ApiClientContext* context, const char* path, char* url, size_t urlSize);
 const char* ApiClient_getServerCertificate();
@@ -1,16 +1,43 @@
 #include "battery.h"
 #include "adc.h"
+#include "clock.h"
 #include "pin.h"
 
+#include <esp_attr.h>
+
 // Should be less than rated battery voltage in mV
 static const uint32_t HIGH_BATTERY_VOLTAGE = 3600;
 static const uint32_t MODERATE_BATTERY_VOLTAGE = 3500;
 static const uint32_t LOW_BATTERY_VOLTAGE = 3400;
 static const uint32_t BATTERY_VOLTAGE_MULTIPLIER = 2;
-static const int MAX_BATTERY_VOLTAGE_SAMPLES = 128;
+static const int MAX_BATTERY_VOLTAGE_SAMPLES = 32;
 static const char* BATTERY_LEVEL_STRINGS[] = {
     "high", "moderate", "low", "critical"};
 
+// Weight of a new reading is 1/2^shift
+static const uint32_t BATTERY_FILTER_SHIFT = 3;
+// A jump this large means the battery was replaced or charged
+static const uint32_t BATTERY_RESET_VOLTAGE_JUMP = 150;
+// Shorter periods are dominated by noise
+static const uint64_t BATTERY_RATE_MIN_PERIOD_IN_US =
+    6ULL * 60 * 60 * 1000 * 1000;
+static const uint64_t DAY_IN_US = 24ULL * 60 * 60 * 1000 * 1000;
+
+typedef struct {
+    uint32_t voltage;
+    uint32_t charge;
+} BatteryCurvePoint;
+
+// Typical single cell LiPo discharge curve at low load, charge in permille
+static const BatteryCurvePoint BATTERY_CURVE[] = {
+    {4200, 1000}, {4150, 950}, {4110, 900}, {4080, 850}, {4020, 800},
+    {3980, 750},  {3950, 700}, {3910, 650}, {3870, 600}, {3850, 550},
+    {3840, 500},  {3820, 450}, {3800, 400}, {3790, 350}, {3770, 300},
+    {3750, 250},  {3730, 200}, {3710, 150}, {3690, 100}, {3610, 50},
+    {3270, 0}};
+
+static RTC_DATA_ATTR BatteryEstimator batteryEstimator = {0};
+
 uint32_t getCurrentBatteryVoltage(void) {
     uint32_t readVoltage =
         sampleVoltage(BATTERY_ADC_CHANNEL, MAX_BATTERY_VOLTAGE_SAMPLES);
@@ -40,8 +67,98 @@ const char* getBatteryLevelString(BatteryLevel level) {
     return BATTERY_LEVEL_STRINGS[level];
 }
 
+uint32_t getBatteryCharge(uint32_t voltage) {
+    const unsigned int pointCount =
+        sizeof(BATTERY_CURVE) / sizeof(BATTERY_CURVE[0]);
+
+    if (voltage >= BATTERY_CURVE[0].voltage) {
+        return BATTERY_CURVE[0].charge;
+    }
+
+    for (unsigned int i = 1; i < pointCount; ++i) {
+        const BatteryCurvePoint* upper = &BATTERY_CURVE[i - 1];
+        const BatteryCurvePoint* lower = &BATTERY_CURVE[i];
+
+        if (voltage >= lower->voltage) {
+            // Linear interpolation between the points
+            return lower->charge + (voltage - lower->voltage) *
+                                       (upper->charge - lower->charge) /
+                                       (upper->voltage - lower->voltage);
+        }
+    }
+
+    return 0;
+}
+
+void BatteryEstimator_update(
+    BatteryEstimator* estimator, uint32_t voltage, uint64_t timeInUs) {
+    const uint32_t scaledVoltage = voltage << 4;
+    const uint32_t previousVoltage = estimator->filteredVoltage >> 4;
+
+    if (!estimator->valid || timeInUs < estimator->anchorTimeInUs ||
+        voltage > previousVoltage + BATTERY_RESET_VOLTAGE_JUMP) {
+        estimator->valid = true;
+        estimator->filteredVoltage = scaledVoltage;
+        estimator->anchorCharge = getBatteryCharge(voltage);
+        estimator->anchorTimeInUs = timeInUs;
+        estimator->dischargeRate = 0;
+        return;
+    }
+
+    // Exponentially weighted moving average
+    estimator->filteredVoltage =
+        estimator->filteredVoltage -
+        (estimator->filteredVoltage >> BATTERY_FILTER_SHIFT) +
+        (scaledVoltage >> BATTERY_FILTER_SHIFT);
+
+    const uint64_t elapsed = timeInUs - estimator->anchorTimeInUs;
+
+    if (elapsed < BATTERY_RATE_MIN_PERIOD_IN_US) {
+        return;
+    }
+
+    const uint32_t charge = getBatteryCharge(estimator->filteredVoltage >> 4);
+    const uint32_t used = estimator->anchorCharge > charge
+                              ? estimator->anchorCharge - charge
+                              : 0;
+    const uint32_t rate = used * DAY_IN_US / elapsed;
+
+    // Average with the previous period to smooth out steps in the curve
+    estimator->dischargeRate = estimator->dischargeRate
+                                   ? (estimator->dischargeRate + rate + 1) / 2
+                                   : rate;
+    estimator->anchorCharge = charge;
+    estimator->anchorTimeInUs = timeInUs;
+}
+
+void BatteryEstimator_getInfo(
+    const BatteryEstimator* estimator, BatteryInfo* info) {
+    info->voltage = estimator->filteredVoltage >> 4;
+    info->level = getBatteryLevel(info->voltage);
+    info->charge = getBatteryCharge(info->voltage);
+    info->dischargeRate = estimator->dischargeRate;
+    info->remainingHours =
+        estimator->dischargeRate
+            ? (int32_t)(info->charge * 24 / estimator->dischargeRate)
+            : -1;
+}
+
+void measureBattery(void) {
+    BatteryEstimator_update(
+        &batteryEstimator, getCurrentBatteryVoltage(), getClockTimeInUs());
+}
+
+void measureBatteryFromAdcReading(uint32_t reading) {
+    BatteryEstimator_update(
+        &batteryEstimator,
+        convertAdcReading(reading) * BATTERY_VOLTAGE_MULTIPLIER,
+        getClockTimeInUs());
+}
+
 void getBatteryInfo(BatteryInfo* info) {
-    uint32_t voltage = getCurrentBatteryVoltage();
-    info->level = getBatteryLevel(voltage);
-    info->voltage = voltage;
+    if (!batteryEstimator.valid) {
+        measureBattery();
+    }
+
+    BatteryEstimator_getInfo(&batteryEstimator, info);
 }
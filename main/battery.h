@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 typedef enum {
@@ -13,7 +14,37 @@ typedef enum {
 typedef struct {
     BatteryLevel level;
     uint32_t voltage;
+    // State of charge in permille
+    uint32_t charge;
+    // Permille of charge used per day, 0 until known
+    uint32_t dischargeRate;
+    // -1 until the discharge rate is known
+    int32_t remainingHours;
 } BatteryInfo;
 
+// Smooths voltage readings and tracks how fast the charge drops. Updated
+// once per wake with integer arithmetic only.
+typedef struct {
+    bool valid;
+    // Smoothed voltage in 1/16 mV
+    uint32_t filteredVoltage;
+    // Charge and time that the discharge rate is measured from
+    uint32_t anchorCharge;
+    uint64_t anchorTimeInUs;
+    uint32_t dischargeRate;
+} BatteryEstimator;
+
+void BatteryEstimator_update(
+    BatteryEstimator* estimator, uint32_t voltage, uint64_t timeInUs);
+void BatteryEstimator_getInfo(
+    const BatteryEstimator* estimator, BatteryInfo* info);
+uint32_t getBatteryCharge(uint32_t voltage);
+
+// Measures the battery for getBatteryInfo() to report. Readings are less
+// noisy while the radio is off.
+void measureBattery(void);
+// Same as measureBattery() with a raw reading taken elsewhere, e.g. by the
+// ULP during standby
+void measureBatteryFromAdcReading(uint32_t reading);
 void getBatteryInfo(BatteryInfo* info);
 const char* getBatteryLevelString(BatteryLevel level);
@@ -0,0 +1,131 @@
+#include "button.h"
+#include "clock.h"
+#include "log.h"
+#include "pin.h"
+#include "sleep.h"
+
+#include <driver/gpio.h>
+#include <driver/rtc_io.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+
+#define LOG_TAG "button"
+
+#define BUTTON_EVENT_QUEUE_LENGTH 16
+
+static const uint64_t BUTTON_DEBOUNCE_TIME_IN_US = 20 * 1000;
+
+static QueueHandle_t buttonEventQueue = NULL;
+static esp_timer_handle_t debounceTimer = NULL;
+static volatile bool buttonMonitoring = false;
+// Last debounced level, the button is active high
+static int buttonLevel = 0;
+
+// Keeps counting through deep sleep
+uint32_t getButtonTimeMs(void) { return getClockTimeInUs() / 1000; }
+
+static void armInterrupt(void) {
+    // Waits for the level to change from the debounced one. Level triggering
+    // also wakes the chip from light sleep, which edges wouldn't.
+    ESP_ERROR_CHECK(gpio_wakeup_enable(
+        RING_BUTTON_PIN,
+        buttonLevel ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL));
+    ESP_ERROR_CHECK(gpio_intr_enable(RING_BUTTON_PIN));
+}
+
+static void handleButtonInterrupt(void* arg) {
+    // The level would keep triggering, so only the debounce timer looks at
+    // the pin until it is settled
+    gpio_intr_disable(RING_BUTTON_PIN);
+    esp_timer_start_once(debounceTimer, BUTTON_DEBOUNCE_TIME_IN_US);
+}
+
+static void handleDebounceTimer(void* arg) {
+    if (!buttonMonitoring) {
+        return;
+    }
+
+    const int level = gpio_get_level(RING_BUTTON_PIN);
+
+    if (level != buttonLevel) {
+        buttonLevel = level;
+        ButtonEvent event = {
+            .type = level ? BUTTON_EVENT_PRESS : BUTTON_EVENT_RELEASE,
+            .timeMs = getButtonTimeMs()};
+
+        if (xQueueSend(buttonEventQueue, &event, 0) != pdTRUE) {
+            LOGW(LOG_TAG, "Button event queue is full.");
+        }
+    }
+
+    armInterrupt();
+}
+
+esp_err_t initButton(void) {
+    buttonEventQueue =
+        xQueueCreate(BUTTON_EVENT_QUEUE_LENGTH, sizeof(ButtonEvent));
+
+    if (!buttonEventQueue) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_timer_create_args_t timerArgs = {
+        .callback = handleDebounceTimer,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "button"};
+    esp_err_t error = esp_timer_create(&timerArgs, &debounceTimer);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    error = gpio_install_isr_service(0);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    ESP_ERROR_CHECK(gpio_intr_disable(RING_BUTTON_PIN));
+    return gpio_isr_handler_add(RING_BUTTON_PIN, handleButtonInterrupt, NULL);
+}
+
+void startButtonMonitoring(void) {
+    if (buttonMonitoring) {
+        return;
+    }
+
+    // Sleeping with ext1 wakeup hands the pin over to the RTC domain
+    ESP_ERROR_CHECK(rtc_gpio_deinit(RING_BUTTON_PIN));
+    ESP_ERROR_CHECK(gpio_set_direction(RING_BUTTON_PIN, GPIO_MODE_INPUT));
+
+    xQueueReset(buttonEventQueue);
+    buttonLevel = gpio_get_level(RING_BUTTON_PIN);
+    buttonMonitoring = true;
+    setGpioWakeupEnabled(true);
+    armInterrupt();
+}
+
+void stopButtonMonitoring(void) {
+    if (!buttonMonitoring) {
+        return;
+    }
+
+    buttonMonitoring = false;
+    ESP_ERROR_CHECK(gpio_intr_disable(RING_BUTTON_PIN));
+    esp_timer_stop(debounceTimer);
+    ESP_ERROR_CHECK(gpio_wakeup_disable(RING_BUTTON_PIN));
+    setGpioWakeupEnabled(false);
+}
+
+bool isButtonMonitoringActive(void) { return buttonMonitoring; }
+
+bool isButtonPressed(void) { return buttonLevel != 0; }
+
+bool waitForButtonEvent(ButtonEvent* event, uint32_t timeoutInMs) {
+    // Rounds up so that the deadline has passed on timeout
+    TickType_t timeout = timeoutInMs == GESTURE_NO_DEADLINE
+                             ? portMAX_DELAY
+                             : pdMS_TO_TICKS(timeoutInMs) + 1;
+    return xQueueReceive(buttonEventQueue, event, timeout) == pdTRUE;
+}
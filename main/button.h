@@ -0,0 +1,19 @@
+#pragma once
+
+#include "gesture.h"
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+esp_err_t initButton(void);
+// Reports debounced edges of the ring button until stopped. The chip is
+// allowed to light sleep between edges.
+void startButtonMonitoring(void);
+void stopButtonMonitoring(void);
+bool isButtonMonitoringActive(void);
+// Debounced level seen by monitoring
+bool isButtonPressed(void);
+// Returns false if no edge was seen within the timeout
+bool waitForButtonEvent(ButtonEvent* event, uint32_t timeoutInMs);
+uint32_t getButtonTimeMs(void);
@@ -0,0 +1,148 @@
+#include "buzzer.h"
+#include "energy.h"
+#include "log.h"
+#include "pin.h"
+#include "trace.h"
+
+#include <driver/dac.h>
+#include <esp_pm.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+
+#define LOG_TAG "buzzer"
+#define BUZZER_IDLE_BIT BIT0
+
+static const int8_t BUZZER_DC_OFFSET = 63;
+
+// Attenuation for each level above 0
+static const dac_cw_scale_t BUZZER_LEVEL_SCALES[TONE_LEVEL_MAX] = {
+    DAC_CW_SCALE_8, DAC_CW_SCALE_4, DAC_CW_SCALE_2, DAC_CW_SCALE_1};
+
+static esp_timer_handle_t buzzerTimer = NULL;
+// The DAC stops while the chip is in light sleep
+static esp_pm_lock_handle_t buzzerPmLock = NULL;
+static EventGroupHandle_t buzzerEventGroup = NULL;
+static ToneSequencer buzzerSequencer;
+static BuzzerCallback buzzerCallback = NULL;
+static void* buzzerCallbackUserData = NULL;
+static bool buzzerOutputEnabled = false;
+
+static void setOutput(const ToneStep* step) {
+    if (step->level == 0) {
+        if (buzzerOutputEnabled) {
+            ESP_ERROR_CHECK(dac_output_disable(BUZZER_DAC_CNANNEL));
+            buzzerOutputEnabled = false;
+        }
+        return;
+    }
+
+    dac_cw_config_t cwConfig = {
+        .en_ch = BUZZER_DAC_CNANNEL,
+        .scale = BUZZER_LEVEL_SCALES[step->level - 1],
+        .phase = DAC_CW_PHASE_0,
+        .freq = step->frequency,
+        .offset = BUZZER_DC_OFFSET};
+
+    ESP_ERROR_CHECK(dac_cw_generator_config(&cwConfig));
+
+    if (!buzzerOutputEnabled) {
+        ESP_ERROR_CHECK(dac_output_enable(BUZZER_DAC_CNANNEL));
+        buzzerOutputEnabled = true;
+    }
+}
+
+static void finishPlayback(void) {
+    const ToneStep silence = {.frequency = 0, .level = 0, .durationInMs = 0};
+    setOutput(&silence);
+    ESP_ERROR_CHECK(esp_pm_lock_release(buzzerPmLock));
+    energyEnd(ENERGY_CONSUMER_BUZZER);
+    traceEnd(TRACE_EVENT_BUZZER);
+
+    BuzzerCallback callback = buzzerCallback;
+    void* userData = buzzerCallbackUserData;
+    buzzerCallback = NULL;
+
+    xEventGroupSetBits(buzzerEventGroup, BUZZER_IDLE_BIT);
+
+    if (callback) {
+        callback(userData);
+    }
+}
+
+// The DAC keeps generating the wave by itself; the CPU is only needed to
+// change steps
+static void playNextStep(void) {
+    ToneStep step;
+
+    if (!ToneSequencer_next(&buzzerSequencer, &step)) {
+        finishPlayback();
+        return;
+    }
+
+    setOutput(&step);
+    ESP_ERROR_CHECK(
+        esp_timer_start_once(buzzerTimer, step.durationInMs * 1000ULL));
+}
+
+static void buzzerTimerCallback(void* arg) { playNextStep(); }
+
+esp_err_t initBuzzer(void) {
+    esp_err_t error = dac_cw_generator_enable();
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    buzzerEventGroup = xEventGroupCreate();
+
+    if (!buzzerEventGroup) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    xEventGroupSetBits(buzzerEventGroup, BUZZER_IDLE_BIT);
+
+    error =
+        esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "buzzer", &buzzerPmLock);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    esp_timer_create_args_t timerArgs = {
+        .callback = buzzerTimerCallback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "buzzer"};
+
+    return esp_timer_create(&timerArgs, &buzzerTimer);
+}
+
+esp_err_t playTones(
+    const Tone* tones,
+    size_t count,
+    BuzzerCallback callback,
+    void* userData) {
+
+    // Claims the buzzer atomically
+    if (!(xEventGroupClearBits(buzzerEventGroup, BUZZER_IDLE_BIT) &
+          BUZZER_IDLE_BIT)) {
+        LOGW(LOG_TAG, "Buzzer is busy.");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    buzzerCallback = callback;
+    buzzerCallbackUserData = userData;
+    ToneSequencer_init(&buzzerSequencer, tones, count);
+
+    traceBegin(TRACE_EVENT_BUZZER);
+    energyBegin(ENERGY_CONSUMER_BUZZER);
+    ESP_ERROR_CHECK(esp_pm_lock_acquire(buzzerPmLock));
+    playNextStep();
+    return ESP_OK;
+}
+
+void waitForBuzzer(void) {
+    xEventGroupWaitBits(
+        buzzerEventGroup, BUZZER_IDLE_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "tone.h"
+
+#include <esp_err.h>
+#include <stddef.h>
+
+// Called from the esp_timer task and must not block
+typedef void (*BuzzerCallback)(void* userData);
+
+esp_err_t initBuzzer(void);
+// Starts playing the tones and returns immediately. The tones must stay
+// valid until playback has finished. Fails if a sequence is still playing.
+esp_err_t playTones(
+    const Tone* tones,
+    size_t count,
+    BuzzerCallback callback,
+    void* userData);
+void waitForBuzzer(void);
@@ -0,0 +1,5 @@
+#include "clock.h"
+
+#include <esp32/clk.h>
+
+uint64_t getClockTimeInUs(void) { return esp_clk_rtc_time(); }
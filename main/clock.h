@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+// Time in µs that keeps counting through light and deep sleep. State that
+// outlives a wake is timed with this clock, which is the one to replace with
+// a virtual clock when running off-target.
+uint64_t getClockTimeInUs(void);
@@ -0,0 +1,58 @@
+#include "devicekey.h"
+#include "log.h"
+
+#include <nvs.h>
+#include <string.h>
+
+#define LOG_TAG "devicekey"
+
+#define DEVICE_KEY_NVS_NAMESPACE "device"
+#define DEVICE_KEY_NVS_KEY "key"
+
+esp_err_t getDeviceKey(uint8_t* key) {
+    nvs_handle_t handle;
+    esp_err_t error = nvs_open(DEVICE_KEY_NVS_NAMESPACE, NVS_READONLY, &handle);
+
+    if (error != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    size_t size = DEVICE_KEY_SIZE;
+    error = nvs_get_blob(handle, DEVICE_KEY_NVS_KEY, key, &size);
+    nvs_close(handle);
+
+    if (error != ESP_OK || size != DEVICE_KEY_SIZE) {
+        memset(key, 0, DEVICE_KEY_SIZE);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t setDeviceKey(const uint8_t* key, size_t keySize) {
+    if (keySize != DEVICE_KEY_SIZE) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t error =
+        nvs_open(DEVICE_KEY_NVS_NAMESPACE, NVS_READWRITE, &handle);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    error = nvs_set_blob(handle, DEVICE_KEY_NVS_KEY, key, keySize);
+
+    if (error == ESP_OK) {
+        error = nvs_commit(handle);
+    }
+
+    nvs_close(handle);
+
+    if (error != ESP_OK) {
+        LOGE(LOG_TAG, "Unable to store device key (%d).", error);
+    }
+
+    return error;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEVICE_KEY_SIZE 32
+
+// Secret shared with the server, provisioned along with the WiFi
+// credentials. Returns ESP_ERR_NOT_FOUND if there is none.
+esp_err_t getDeviceKey(uint8_t* key);
+esp_err_t setDeviceKey(const uint8_t* key, size_t keySize);
@@ -0,0 +1,100 @@
+#include "energy.h"
+#include "clock.h"
+
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+
+// Typical current draw in µA. Time spent in automatic light sleep while
+// waiting is counted as CPU time, so CPU figures are on the high side.
+#if CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ >= 240
+#define ENERGY_CPU_CURRENT 50000
+#elif CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ >= 160
+#define ENERGY_CPU_CURRENT 40000
+#else
+#define ENERGY_CPU_CURRENT 30000
+#endif
+
+static const uint32_t ENERGY_CURRENTS[ENERGY_CONSUMER_MAX_VALUE] = {
+    [ENERGY_CONSUMER_CPU] = ENERGY_CPU_CURRENT,
+    // Average of receiving with power saving off and transmit bursts
+    [ENERGY_CONSUMER_WIFI] = 100000,
+    [ENERGY_CONSUMER_BUZZER] = 15000,
+    [ENERGY_CONSUMER_LIGHT_SLEEP] = 800,
+    // Deep sleep with the ULP and RTC peripherals on
+    [ENERGY_CONSUMER_STANDBY] = 150};
+
+static const uint64_t US_PER_MS = 1000;
+static const uint64_t MS_PER_HOUR = 60 * 60 * 1000;
+
+// Kept in RTC memory so that standby can be closed after waking from it
+typedef struct {
+    // In µA·ms, which doesn't overflow within the life of a battery
+    uint64_t charge[ENERGY_CONSUMER_MAX_VALUE];
+    uint64_t onSince[ENERGY_CONSUMER_MAX_VALUE];
+    uint32_t onMask;
+} EnergyAccount;
+
+static RTC_DATA_ATTR EnergyAccount energyAccount = {0};
+static portMUX_TYPE energyLock = portMUX_INITIALIZER_UNLOCKED;
+
+static void endLocked(EnergyConsumer consumer, uint64_t now) {
+    const uint32_t bit = 1 << consumer;
+
+    if (!(energyAccount.onMask & bit)) {
+        return;
+    }
+
+    const uint64_t elapsed = now - energyAccount.onSince[consumer];
+    energyAccount.charge[consumer] +=
+        elapsed * ENERGY_CURRENTS[consumer] / US_PER_MS;
+    energyAccount.onMask &= ~bit;
+}
+
+void initEnergy(void) {
+    const uint64_t now = getClockTimeInUs();
+
+    portENTER_CRITICAL(&energyLock);
+    for (int consumer = 0; consumer < ENERGY_CONSUMER_MAX_VALUE; ++consumer) {
+        endLocked(consumer, now);
+    }
+    energyAccount.onSince[ENERGY_CONSUMER_CPU] = now;
+    energyAccount.onMask |= 1 << ENERGY_CONSUMER_CPU;
+    portEXIT_CRITICAL(&energyLock);
+}
+
+void energyBegin(EnergyConsumer consumer) {
+    const uint64_t now = getClockTimeInUs();
+
+    portENTER_CRITICAL(&energyLock);
+    if (!(energyAccount.onMask & (1 << consumer))) {
+        energyAccount.onSince[consumer] = now;
+        energyAccount.onMask |= 1 << consumer;
+    }
+    portEXIT_CRITICAL(&energyLock);
+}
+
+void energyEnd(EnergyConsumer consumer) {
+    const uint64_t now = getClockTimeInUs();
+
+    portENTER_CRITICAL(&energyLock);
+    endLocked(consumer, now);
+    portEXIT_CRITICAL(&energyLock);
+}
+
+void getEnergyInfo(EnergyInfo* info) {
+    const uint64_t now = getClockTimeInUs();
+
+    portENTER_CRITICAL(&energyLock);
+    for (int consumer = 0; consumer < ENERGY_CONSUMER_MAX_VALUE; ++consumer) {
+        uint64_t charge = energyAccount.charge[consumer];
+
+        // Includes consumers that are still on
+        if (energyAccount.onMask & (1 << consumer)) {
+            charge += (now - energyAccount.onSince[consumer]) *
+                      ENERGY_CURRENTS[consumer] / US_PER_MS;
+        }
+
+        info->chargeInUAh[consumer] = charge / MS_PER_HOUR;
+    }
+    portEXIT_CRITICAL(&energyLock);
+}
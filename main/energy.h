@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+// Consumers that are on at the same time add up, e.g. WiFi on top of the
+// CPU. The two sleep states replace the CPU.
+typedef enum {
+    ENERGY_CONSUMER_CPU,
+    ENERGY_CONSUMER_WIFI,
+    ENERGY_CONSUMER_BUZZER,
+    ENERGY_CONSUMER_LIGHT_SLEEP,
+    ENERGY_CONSUMER_STANDBY,
+    ENERGY_CONSUMER_MAX_VALUE
+} EnergyConsumer;
+
+typedef struct {
+    // Since the last cold boot
+    uint32_t chargeInUAh[ENERGY_CONSUMER_MAX_VALUE];
+} EnergyInfo;
+
+// Closes the standby that the chip woke from and starts accounting the CPU
+void initEnergy(void);
+void energyBegin(EnergyConsumer consumer);
+void energyEnd(EnergyConsumer consumer);
+void getEnergyInfo(EnergyInfo* info);
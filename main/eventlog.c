@@ -0,0 +1,482 @@
+#include "eventlog.h"
+#include "log.h"
+
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <string.h>
+
+#define LOG_TAG "eventlog"
+
+#define EVENT_LOG_MAGIC 0x474c5645
+#define SLOT_SIZE 32
+#define SLOTS_PER_SECTOR (FLASH_SECTOR_SIZE / SLOT_SIZE)
+#define SCAN_CHUNK_SLOTS 8
+
+// Flash can only clear bits, so the state of a record moves from empty to
+// pending to acknowledged without erasing. A record torn by power loss
+// fails its CRC and is skipped.
+#define RECORD_STATE_PENDING 0xfe
+#define RECORD_STATE_ACKNOWLEDGED 0xfc
+
+// The first slot of every sector
+typedef struct {
+    uint32_t magic;
+    uint32_t logId;
+    // Increases by one whenever a sector is taken into use
+    uint32_t sequence;
+    uint32_t crc;
+    uint8_t padding[16];
+} SectorHeader;
+
+typedef struct {
+    uint8_t state;
+    uint8_t type;
+    uint16_t reserved;
+    // Covers everything but state and itself
+    uint32_t crc;
+    uint32_t sequence;
+    uint32_t clockId;
+    uint64_t time;
+    uint8_t padding[8];
+} EventRecord;
+
+_Static_assert(sizeof(SectorHeader) == SLOT_SIZE, "Header must fill a slot");
+_Static_assert(sizeof(EventRecord) == SLOT_SIZE, "Record must fill a slot");
+
+// State of the log that was changed last, kept through deep sleep so that
+// opening it again doesn't scan the whole partition
+typedef struct {
+    bool valid;
+    EventLog log;
+} EventLogSnapshot;
+
+static RTC_DATA_ATTR EventLogSnapshot eventLogSnapshot = {0};
+
+typedef void (*SlotVisitor)(
+    EventLog* log, uint32_t offset, const EventRecord* record, void* userData);
+
+static uint32_t crc32(uint32_t crc, const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    crc = ~crc;
+    while (size--) {
+        crc ^= *bytes++;
+        for (int i = 0; i < 8; ++i) {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t getHeaderCrc(const SectorHeader* header) {
+    return crc32(0, header, offsetof(SectorHeader, crc));
+}
+
+static uint32_t getRecordCrc(const EventRecord* record) {
+    uint32_t crc = crc32(0, &record->type, 1);
+    crc = crc32(crc, &record->reserved, sizeof(record->reserved));
+    return crc32(
+        crc, &record->sequence,
+        sizeof(EventRecord) - offsetof(EventRecord, sequence));
+}
+
+static bool isErased(const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < size; ++i) {
+        if (bytes[i] != 0xff) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool isValidRecord(const EventRecord* record) {
+    return (record->state == RECORD_STATE_PENDING ||
+            record->state == RECORD_STATE_ACKNOWLEDGED) &&
+           record->crc == getRecordCrc(record);
+}
+
+static bool isPendingRecord(const EventRecord* record) {
+    return record->state == RECORD_STATE_PENDING &&
+           record->crc == getRecordCrc(record);
+}
+
+static bool
+readSectorHeader(EventLog* log, uint32_t sector, SectorHeader* header) {
+    FlashStorage* storage = &log->storage;
+    return storage->read(
+               storage->context, sector * FLASH_SECTOR_SIZE, header,
+               sizeof(*header)) == ESP_OK &&
+           header->magic == EVENT_LOG_MAGIC &&
+           header->crc == getHeaderCrc(header);
+}
+
+static uint32_t getSlotOffset(uint32_t sector, uint32_t slot) {
+    return sector * FLASH_SECTOR_SIZE + slot * SLOT_SIZE;
+}
+
+static uint32_t getWriteOffset(const EventLog* log) {
+    if (log->headSlot < SLOTS_PER_SECTOR) {
+        return getSlotOffset(log->headSector, log->headSlot);
+    }
+    return getSlotOffset((log->headSector + 1) % log->sectorCount, 1);
+}
+
+static uint32_t getNextSlotOffset(const EventLog* log, uint32_t offset) {
+    offset += SLOT_SIZE;
+    if (offset % FLASH_SECTOR_SIZE == 0) {
+        // Skip the header of the next sector
+        offset = offset % (log->sectorCount * FLASH_SECTOR_SIZE) + SLOT_SIZE;
+    }
+    return offset;
+}
+
+static void saveSnapshot(const EventLog* log) {
+    eventLogSnapshot.log = *log;
+    eventLogSnapshot.valid = true;
+}
+
+// Until the change is complete, so that a failure leaves the next open to
+// scan the partition
+static void invalidateSnapshot(void) { eventLogSnapshot.valid = false; }
+
+// Only trusts the snapshot if the head sector is still the one it points
+// to and nothing was written past the head since
+static bool restoreSnapshot(EventLog* log) {
+    const EventLog* saved = &eventLogSnapshot.log;
+    SectorHeader header;
+    EventRecord record;
+
+    if (!eventLogSnapshot.valid || saved->sectorCount != log->sectorCount ||
+        saved->headSector >= log->sectorCount ||
+        !readSectorHeader(log, saved->headSector, &header) ||
+        header.logId != saved->logId ||
+        header.sequence != saved->headSectorSequence) {
+        return false;
+    }
+
+    if (saved->headSlot < SLOTS_PER_SECTOR &&
+        (log->storage.read(
+             log->storage.context,
+             getSlotOffset(saved->headSector, saved->headSlot), &record,
+             sizeof(record)) != ESP_OK ||
+         !isErased(&record, sizeof(record)))) {
+        return false;
+    }
+
+    const FlashStorage storage = log->storage;
+    *log = *saved;
+    log->storage = storage;
+    return true;
+}
+
+static esp_err_t visitSector(
+    EventLog* log, uint32_t sector, SlotVisitor visit, void* userData) {
+    FlashStorage* storage = &log->storage;
+    EventRecord records[SCAN_CHUNK_SLOTS];
+
+    for (uint32_t slot = 0; slot < SLOTS_PER_SECTOR;
+         slot += SCAN_CHUNK_SLOTS) {
+        const uint32_t offset = getSlotOffset(sector, slot);
+        esp_err_t error =
+            storage->read(storage->context, offset, records, sizeof(records));
+
+        if (error != ESP_OK) {
+            return error;
+        }
+
+        for (uint32_t i = 0; i < SCAN_CHUNK_SLOTS; ++i) {
+            if (slot + i > 0) {
+                visit(log, offset + i * SLOT_SIZE, &records[i], userData);
+            }
+        }
+    }
+
+    return ESP_OK;
+}
+
+static void recoverSlot(
+    EventLog* log, uint32_t offset, const EventRecord* record, void* userData) {
+    uint32_t* lastUsedSlot = userData;
+
+    if (isErased(record, sizeof(*record))) {
+        return;
+    }
+
+    *lastUsedSlot = (offset % FLASH_SECTOR_SIZE) / SLOT_SIZE;
+
+    if (!isValidRecord(record)) {
+        return;
+    }
+
+    if (record->sequence >= log->nextSequence) {
+        log->nextSequence = record->sequence + 1;
+    }
+
+    if (record->state == RECORD_STATE_PENDING) {
+        if (log->pendingCount == 0) {
+            log->readOffset = offset;
+        }
+        ++log->pendingCount;
+    }
+}
+
+static void countPendingSlot(
+    EventLog* log, uint32_t offset, const EventRecord* record, void* userData) {
+    if (isPendingRecord(record)) {
+        ++*(uint32_t*)userData;
+    }
+}
+
+esp_err_t EventLog_open(EventLog* log, const FlashStorage* storage) {
+    memset(log, 0, sizeof(*log));
+    log->storage = *storage;
+    log->sectorCount = storage->size / FLASH_SECTOR_SIZE;
+
+    if (log->sectorCount < 2) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (restoreSnapshot(log)) {
+        LOGD(
+            LOG_TAG, "Restored event log %08x with %u pending events.",
+            log->logId, log->pendingCount);
+        return ESP_OK;
+    }
+
+    invalidateSnapshot();
+    bool found = false;
+
+    for (uint32_t sector = 0; sector < log->sectorCount; ++sector) {
+        SectorHeader header;
+        if (readSectorHeader(log, sector, &header) &&
+            (!found || header.sequence > log->headSectorSequence)) {
+            found = true;
+            log->logId = header.logId;
+            log->headSector = sector;
+            log->headSectorSequence = header.sequence;
+        }
+    }
+
+    if (!found) {
+        // The first append takes the first sector into use
+        LOGD(LOG_TAG, "No event log found, creating a new one.");
+        log->logId = esp_random();
+        log->headSector = log->sectorCount - 1;
+        log->headSlot = SLOTS_PER_SECTOR;
+        // Nothing on flash to check a snapshot against yet
+        return ESP_OK;
+    }
+
+    // Sectors are taken into use in order, so starting after the head visits
+    // them from oldest to newest
+    for (uint32_t i = 1; i <= log->sectorCount; ++i) {
+        const uint32_t sector = (log->headSector + i) % log->sectorCount;
+        SectorHeader header;
+
+        if (!readSectorHeader(log, sector, &header) ||
+            header.logId != log->logId) {
+            continue;
+        }
+
+        uint32_t lastUsedSlot = 0;
+        esp_err_t error = visitSector(log, sector, recoverSlot, &lastUsedSlot);
+
+        if (error != ESP_OK) {
+            return error;
+        }
+
+        if (sector == log->headSector) {
+            log->headSlot = lastUsedSlot + 1;
+        }
+    }
+
+    LOGD(
+        LOG_TAG, "Opened event log %08x with %u pending events.", log->logId,
+        log->pendingCount);
+    saveSnapshot(log);
+    return ESP_OK;
+}
+
+static esp_err_t takeNextSector(EventLog* log) {
+    FlashStorage* storage = &log->storage;
+    const uint32_t sector = (log->headSector + 1) % log->sectorCount;
+    SectorHeader header;
+
+    if (readSectorHeader(log, sector, &header) && header.logId == log->logId) {
+        uint32_t lostCount = 0;
+        esp_err_t error =
+            visitSector(log, sector, countPendingSlot, &lostCount);
+
+        if (error != ESP_OK) {
+            return error;
+        }
+
+        if (lostCount > 0) {
+            LOGW(LOG_TAG, "Event log is full, dropping %u events.", lostCount);
+            log->droppedCount += lostCount;
+            log->pendingCount -= lostCount;
+        }
+
+        if (log->readOffset / FLASH_SECTOR_SIZE == sector) {
+            log->readOffset =
+                getSlotOffset((sector + 1) % log->sectorCount, 1);
+        }
+    }
+
+    esp_err_t error = storage->erase(
+        storage->context, sector * FLASH_SECTOR_SIZE, FLASH_SECTOR_SIZE);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    // A sector without a header is ignored, so losing power before this
+    // point leaves the log as it was
+    memset(&header, 0xff, sizeof(header));
+    header.magic = EVENT_LOG_MAGIC;
+    header.logId = log->logId;
+    header.sequence = log->headSectorSequence + 1;
+    header.crc = getHeaderCrc(&header);
+
+    error = storage->write(
+        storage->context, sector * FLASH_SECTOR_SIZE, &header, sizeof(header));
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    log->headSector = sector;
+    log->headSectorSequence = header.sequence;
+    log->headSlot = 1;
+    return ESP_OK;
+}
+
+esp_err_t EventLog_append(
+    EventLog* log,
+    EventType type,
+    uint32_t clockId,
+    uint64_t time,
+    LoggedEvent* appended) {
+    FlashStorage* storage = &log->storage;
+    invalidateSnapshot();
+
+    if (log->headSlot >= SLOTS_PER_SECTOR) {
+        esp_err_t error = takeNextSector(log);
+
+        if (error != ESP_OK) {
+            LOGE(LOG_TAG, "Unable to take a new sector into use.");
+            return error;
+        }
+    }
+
+    EventRecord record;
+    memset(&record, 0xff, sizeof(record));
+    record.state = RECORD_STATE_PENDING;
+    record.type = type;
+    record.sequence = log->nextSequence;
+    record.clockId = clockId;
+    record.time = time;
+    record.crc = getRecordCrc(&record);
+
+    const uint32_t offset = getWriteOffset(log);
+    // The slot can't be reused even if the write failed halfway
+    ++log->headSlot;
+
+    esp_err_t error =
+        storage->write(storage->context, offset, &record, sizeof(record));
+
+    if (error != ESP_OK) {
+        LOGE(LOG_TAG, "Unable to write event.");
+        return error;
+    }
+
+    if (log->pendingCount == 0) {
+        log->readOffset = offset;
+    }
+
+    if (appended) {
+        appended->type = type;
+        appended->sequence = record.sequence;
+        appended->clockId = clockId;
+        appended->time = time;
+        appended->offset = offset;
+    }
+
+    ++log->pendingCount;
+    ++log->nextSequence;
+    saveSnapshot(log);
+    return ESP_OK;
+}
+
+esp_err_t EventLog_peek(
+    EventLog* log, LoggedEvent* events, size_t maxCount, size_t* count) {
+    FlashStorage* storage = &log->storage;
+    *count = 0;
+
+    if (log->pendingCount == 0) {
+        return ESP_OK;
+    }
+
+    const uint32_t end = getWriteOffset(log);
+    uint32_t offset = log->readOffset;
+
+    while (offset != end && *count < maxCount) {
+        EventRecord record;
+        esp_err_t error =
+            storage->read(storage->context, offset, &record, sizeof(record));
+
+        if (error != ESP_OK) {
+            return error;
+        }
+
+        if (isPendingRecord(&record)) {
+            if (*count == 0) {
+                // Saves skipping acknowledged records next time
+                log->readOffset = offset;
+            }
+
+            LoggedEvent* event = &events[(*count)++];
+            event->type = record.type;
+            event->sequence = record.sequence;
+            event->clockId = record.clockId;
+            event->time = record.time;
+            event->offset = offset;
+        }
+
+        offset = getNextSlotOffset(log, offset);
+    }
+
+    if (eventLogSnapshot.valid &&
+        eventLogSnapshot.log.logId == log->logId) {
+        eventLogSnapshot.log.readOffset = log->readOffset;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t EventLog_acknowledge(
+    EventLog* log, const LoggedEvent* events, size_t count) {
+    FlashStorage* storage = &log->storage;
+    const uint8_t state = RECORD_STATE_ACKNOWLEDGED;
+    invalidateSnapshot();
+
+    for (size_t i = 0; i < count; ++i) {
+        esp_err_t error = storage->write(
+            storage->context, events[i].offset, &state, sizeof(state));
+
+        if (error != ESP_OK) {
+            return error;
+        }
+
+        if (log->pendingCount > 0) {
+            --log->pendingCount;
+        }
+    }
+
+    saveSnapshot(log);
+    return ESP_OK;
+}
+
+uint32_t EventLog_getPendingCount(const EventLog* log) {
+    return log->pendingCount;
+}
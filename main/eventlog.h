@@ -0,0 +1,59 @@
+#pragma once
+
+#include "flash.h"
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum { EVENT_TYPE_RING = 1 } EventType;
+
+typedef struct {
+    EventType type;
+    // Increases by one for every appended event during the lifetime of the
+    // log, so that (logId, sequence) identifies an event
+    uint32_t sequence;
+    // Identifies the clock that time was taken from
+    uint32_t clockId;
+    uint64_t time;
+    // Location in flash, used when acknowledging
+    uint32_t offset;
+} LoggedEvent;
+
+// Append-only log of events that have yet to be delivered. Sectors are used
+// round-robin and records are only ever written once per erase, so wear is
+// spread evenly. Not thread-safe.
+typedef struct {
+    FlashStorage storage;
+    uint32_t logId;
+    uint32_t sectorCount;
+    uint32_t headSector;
+    uint32_t headSectorSequence;
+    // Next free slot in the head sector
+    uint32_t headSlot;
+    uint32_t nextSequence;
+    // Offset at or before the oldest pending record
+    uint32_t readOffset;
+    uint32_t pendingCount;
+    // Pending events overwritten because the log was full
+    uint32_t droppedCount;
+} EventLog;
+
+// Scans the storage after a cold boot. After deep sleep, picks up where the
+// log was left if its head sector on flash still matches.
+esp_err_t EventLog_open(EventLog* log, const FlashStorage* storage);
+// The appended event is returned unless appended is NULL
+esp_err_t EventLog_append(
+    EventLog* log,
+    EventType type,
+    uint32_t clockId,
+    uint64_t time,
+    LoggedEvent* appended);
+// Fetches up to maxCount of the oldest events that have not been
+// acknowledged yet
+esp_err_t EventLog_peek(
+    EventLog* log, LoggedEvent* events, size_t maxCount, size_t* count);
+esp_err_t EventLog_acknowledge(
+    EventLog* log, const LoggedEvent* events, size_t count);
+uint32_t EventLog_getPendingCount(const EventLog* log);
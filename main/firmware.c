@@ -1,14 +1,128 @@
 #include "firmware.h"
-#include "api.h"
+#include "flash.h"
+#include "https.h"
+#include "log.h"
+#include "lzss.h"
+#include "patch.h"
 
-#include <esp_https_ota.h>
 #include <esp_ota_ops.h>
+#include <esp_system.h>
+#include <mbedtls/sha256.h>
+#include <nvs.h>
 #include <string.h>
 
+#define LOG_TAG "firmware"
+
+#define FIRMWARE_NVS_NAMESPACE "firmware"
+#define FIRMWARE_PROGRESS_KEY "progress"
+#define FIRMWARE_HASH_SIZE 32
+
+// See scripts/mkcompressed.py
+#define COMPRESSED_IMAGE_MAGIC 0x5a544f44
+#define COMPRESSED_IMAGE_VERSION 1
+#define COMPRESSED_IMAGE_HEADER_SIZE 16
+// Header and block offsets, fetched with the first request
+#define COMPRESSED_IMAGE_MAX_HEADER_SIZE 512
+
 static const int HTTP_TIMEOUT_IN_MS = 5000;
+// Requested with one Range request, a multiple of the sector size so that
+// progress is saved on sector boundaries
+static const uint32_t FIRMWARE_CHUNK_SIZE = 16 * FLASH_SECTOR_SIZE;
+// Larger images take several wakes to download
+static const uint32_t FIRMWARE_MAX_DOWNLOAD_PER_CALL = 512 * 1024;
 
-esp_err_t firmwareHttpEventHandler(esp_http_client_event_t* evt) {
-    return ESP_OK;
+typedef struct {
+    esp_ota_handle_t handle;
+    esp_err_t error;
+    PatchApplier* patch;
+    const esp_partition_t* sourcePartition;
+} PatchDownload;
+
+typedef enum {
+    FIRMWARE_FORMAT_UNKNOWN,
+    FIRMWARE_FORMAT_RAW,
+    FIRMWARE_FORMAT_COMPRESSED
+} FirmwareFormat;
+
+typedef enum {
+    IMAGE_REQUEST_HEADER,
+    IMAGE_REQUEST_RAW,
+    IMAGE_REQUEST_BLOCK
+} ImageRequestType;
+
+// Saved in NVS after every chunk so that a download continues where it
+// stopped, even after a reset
+typedef struct {
+    char version[FIRMWARE_VERSION_MAX_LENGTH];
+    uint32_t partitionAddress;
+    FirmwareFormat format;
+    // 0 until known
+    uint32_t imageSize;
+    uint32_t offset;
+    // SHA-256 of the image up to offset, checked against flash on resume
+    uint8_t hash[FIRMWARE_HASH_SIZE];
+} FirmwareProgress;
+
+// Blocks of the image are compressed independently, so that downloads
+// resume at the start of a block
+typedef struct {
+    uint8_t windowBits;
+    uint8_t lookaheadBits;
+    uint32_t blockSize;
+    uint32_t blockCount;
+    // blockCount + 1 offsets into the file, pointing into the header
+    const uint8_t* offsets;
+} CompressedImage;
+
+typedef struct {
+    const esp_partition_t* partition;
+    FirmwareProgress progress;
+    // Covers everything written so far
+    mbedtls_sha256_context sha;
+    uint32_t writeOffset;
+    ImageRequestType requestType;
+    // Where the body of the ongoing request starts in the downloaded file
+    uint32_t requestOffset;
+    esp_err_t error;
+    // Start of the file, which tells raw and compressed images apart
+    uint8_t header[COMPRESSED_IMAGE_MAX_HEADER_SIZE];
+    size_t headerLength;
+    CompressedImage compressed;
+    LzssDecoder decoder;
+    // Where the block being decompressed ends in the image
+    uint32_t blockEnd;
+} ImageDownload;
+
+// Only one update runs at a time, and both are too large for the stack
+static PatchApplier firmwarePatchApplier;
+static ImageDownload firmwareImageDownload;
+
+static uint32_t readUint32(const uint8_t* data) {
+    return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+static esp_err_t patchHttpEventHandler(HttpsEvent* evt) {
+    PatchDownload* download = (PatchDownload*)evt->userData;
+
+    if (evt->id != HTTPS_EVENT_ON_DATA || evt->statusCode != 200) {
+        return ESP_OK;
+    }
+
+    download->error =
+        PatchApplier_feed(download->patch, evt->data, evt->dataLength);
+    return download->error;
+}
+
+static esp_err_t
+readSourceImage(void* context, uint32_t offset, void* data, size_t size) {
+    const PatchDownload* download = context;
+    return esp_partition_read(download->sourcePartition, offset, data, size);
+}
+
+static esp_err_t
+writeTargetImage(void* context, const void* data, size_t size) {
+    const PatchDownload* download = context;
+    return esp_ota_write(download->handle, data, size);
 }
 
 size_t getFirmwareVersion(char* version, size_t versionSize) {
@@ -21,22 +135,595 @@ size_t getFirmwareVersion(char* version, size_t versionSize) {
     return versionLength;
 }
 
-esp_err_t applyFirmwareUpdate(const char* url, bool restart) {
-    esp_http_client_config_t config;
-    memset(&config, 0, sizeof(esp_http_client_config_t));
+static esp_err_t downloadFirmwarePatch(const char* url) {
+    HttpsUrl parsedUrl;
+    esp_err_t error = parseHttpsUrl(url, &parsedUrl);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    const esp_partition_t* partition = esp_ota_get_next_update_partition(NULL);
+
+    if (!partition) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    PatchDownload download = {
+        .handle = 0,
+        .error = ESP_OK,
+        .patch = &firmwarePatchApplier,
+        .sourcePartition = esp_ota_get_running_partition()};
+    uint8_t sourceHash[PATCH_HASH_SIZE];
+
+    // The hash appended to the running image, not the whole partition
+    error = esp_partition_get_sha256(download.sourcePartition, sourceHash);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    error = esp_ota_begin(partition, OTA_SIZE_UNKNOWN, &download.handle);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    PatchApplier_init(
+        download.patch, readSourceImage, writeTargetImage, &download,
+        download.sourcePartition->size, sourceHash);
+
+    HttpsRequest request = {
+        .method = HTTPS_METHOD_GET,
+        .host = parsedUrl.host,
+        .port = parsedUrl.port,
+        .path = parsedUrl.path,
+        .timeoutMs = HTTP_TIMEOUT_IN_MS,
+        .eventHandler = patchHttpEventHandler,
+        .userData = &download};
+
+    HttpsResponse response;
+    error = httpsRequest(&request, &response);
+
+    if (error == ESP_OK && response.statusCode != 200) {
+        LOGE(
+            LOG_TAG, "Firmware patch download failed (HTTP %d).",
+            response.statusCode);
+        error = ESP_FAIL;
+    }
+
+    if (error == ESP_OK && download.error != ESP_OK) {
+        error = download.error;
+    }
+
+    if (error == ESP_OK) {
+        error = PatchApplier_finish(download.patch);
+    }
+
+    PatchApplier_free(download.patch);
+
+    if (error != ESP_OK) {
+        LOGE(LOG_TAG, "Unable to apply firmware patch (%d).", error);
+        esp_ota_abort(download.handle);
+        return error;
+    }
+
+    if ((error = esp_ota_end(download.handle)) != ESP_OK) {
+        return error;
+    }
+
+    return esp_ota_set_boot_partition(partition);
+}
+
+static bool loadProgress(FirmwareProgress* progress) {
+    nvs_handle_t handle;
+
+    if (nvs_open(FIRMWARE_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+
+    size_t size = sizeof(*progress);
+    esp_err_t error =
+        nvs_get_blob(handle, FIRMWARE_PROGRESS_KEY, progress, &size);
+    nvs_close(handle);
+    return error == ESP_OK && size == sizeof(*progress);
+}
+
+static void saveProgress(const FirmwareProgress* progress) {
+    nvs_handle_t handle;
+
+    if (nvs_open(FIRMWARE_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+
+    if (progress) {
+        nvs_set_blob(
+            handle, FIRMWARE_PROGRESS_KEY, progress, sizeof(*progress));
+    } else {
+        nvs_erase_key(handle, FIRMWARE_PROGRESS_KEY);
+    }
+
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+bool isFirmwareUpdateInProgress(const char* version) {
+    FirmwareProgress progress;
+    return loadProgress(&progress) && progress.offset > 0 &&
+           strncmp(progress.version, version, sizeof(progress.version)) == 0;
+}
+
+static void restartImageDownload(ImageDownload* download) {
+    memset(download->progress.hash, 0, sizeof(download->progress.hash));
+    download->progress.partitionAddress = download->partition->address;
+    download->progress.imageSize = 0;
+    download->progress.offset = 0;
+    download->writeOffset = 0;
+    mbedtls_sha256_starts_ret(&download->sha, 0);
+}
+
+// Hashes what was written before, which also catches a partition that was
+// changed in the meantime, e.g. by a patch
+static bool verifyWrittenImage(ImageDownload* download) {
+    uint8_t buffer[512];
+    uint8_t hash[FIRMWARE_HASH_SIZE];
+    const uint32_t length = download->progress.offset;
+
+    mbedtls_sha256_starts_ret(&download->sha, 0);
+
+    for (uint32_t offset = 0; offset < length; offset += sizeof(buffer)) {
+        const size_t count = length - offset < sizeof(buffer)
+                                 ? length - offset
+                                 : sizeof(buffer);
+
+        if (esp_partition_read(download->partition, offset, buffer, count) !=
+            ESP_OK) {
+            return false;
+        }
+
+        mbedtls_sha256_update_ret(&download->sha, buffer, count);
+    }
+
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_clone(&sha, &download->sha);
+    mbedtls_sha256_finish_ret(&sha, hash);
+    mbedtls_sha256_free(&sha);
+
+    return memcmp(hash, download->progress.hash, sizeof(hash)) == 0;
+}
+
+static void startImageDownload(
+    ImageDownload* download,
+    const esp_partition_t* partition,
+    const char* version) {
+    download->partition = partition;
+    download->error = ESP_OK;
+    mbedtls_sha256_init(&download->sha);
+
+    FirmwareProgress* progress = &download->progress;
+
+    if (loadProgress(progress) &&
+        strncmp(progress->version, version, sizeof(progress->version)) == 0 &&
+        progress->partitionAddress == partition->address &&
+        progress->offset <= partition->size &&
+        progress->offset % FLASH_SECTOR_SIZE == 0) {
+        if (verifyWrittenImage(download)) {
+            LOGD(
+                LOG_TAG, "Resuming firmware download at %u bytes.",
+                progress->offset);
+            download->writeOffset = progress->offset;
+            return;
+        }
+
+        LOGW(LOG_TAG, "Firmware download can't be resumed.");
+    }
+
+    memset(progress, 0, sizeof(*progress));
+    strncpy(progress->version, version, sizeof(progress->version) - 1);
+    restartImageDownload(download);
+}
+
+static void checkpointImageDownload(ImageDownload* download) {
+    // The hash is only known at the end of what was written
+    if (download->writeOffset % FLASH_SECTOR_SIZE != 0) {
+        return;
+    }
+
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_clone(&sha, &download->sha);
+    mbedtls_sha256_finish_ret(&sha, download->progress.hash);
+    mbedtls_sha256_free(&sha);
+
+    download->progress.offset = download->writeOffset;
+    saveProgress(&download->progress);
+}
+
+static esp_err_t
+writeImageData(ImageDownload* download, const uint8_t* data, size_t size) {
+    const esp_partition_t* partition = download->partition;
+
+    if (size > partition->size - download->writeOffset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    while (size > 0) {
+        const uint32_t offset = download->writeOffset;
+        const uint32_t sectorOffset = offset % FLASH_SECTOR_SIZE;
+        size_t count = FLASH_SECTOR_SIZE - sectorOffset;
+        count = count < size ? count : size;
+
+        // Sectors are erased as they are reached, unlike with esp_ota_begin()
+        // which erases everything up front
+        if (sectorOffset == 0) {
+            esp_err_t error =
+                esp_partition_erase_range(partition, offset, FLASH_SECTOR_SIZE);
+
+            if (error != ESP_OK) {
+                return error;
+            }
+        }
+
+        esp_err_t error = esp_partition_write(partition, offset, data, count);
+
+        if (error != ESP_OK) {
+            return error;
+        }
+
+        mbedtls_sha256_update_ret(&download->sha, data, count);
+        download->writeOffset += count;
+        data += count;
+        size -= count;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t
+writeDecompressedData(void* context, const void* data, size_t size) {
+    ImageDownload* download = context;
+
+    if (size > download->blockEnd - download->writeOffset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return writeImageData(download, data, size);
+}
+
+static esp_err_t imageHttpEventHandler(HttpsEvent* evt) {
+    ImageDownload* download = (ImageDownload*)evt->userData;
+
+    if (evt->id != HTTPS_EVENT_ON_DATA ||
+        (evt->statusCode != 200 && evt->statusCode != 206)) {
+        return ESP_OK;
+    }
+
+    if (evt->statusCode == 206 && evt->rangeStart != download->requestOffset) {
+        download->error = ESP_ERR_INVALID_RESPONSE;
+        return download->error;
+    }
+
+    size_t count;
+
+    switch (download->requestType) {
+    case IMAGE_REQUEST_HEADER:
+        // The rest is fetched again later
+        count = sizeof(download->header) - download->headerLength;
+        count = count < evt->dataLength ? count : evt->dataLength;
+        memcpy(&download->header[download->headerLength], evt->data, count);
+        download->headerLength += count;
+        break;
+    case IMAGE_REQUEST_RAW:
+        if (evt->statusCode == 200 && download->requestOffset > 0) {
+            // The server ignored the range and sends the whole image
+            restartImageDownload(download);
+            download->requestOffset = 0;
+        }
+
+        download->error = writeImageData(
+            download, (const uint8_t*)evt->data, evt->dataLength);
+        break;
+    case IMAGE_REQUEST_BLOCK:
+        // Decompression can't skip to the block
+        download->error =
+            evt->statusCode == 206
+                ? LzssDecoder_feed(
+                      &download->decoder, evt->data, evt->dataLength)
+                : ESP_ERR_NOT_SUPPORTED;
+        break;
+    }
+
+    return download->error;
+}
+
+static bool isImageDownloadComplete(const ImageDownload* download) {
+    return download->progress.imageSize > 0 &&
+           download->writeOffset == download->progress.imageSize;
+}
+
+static esp_err_t requestImageRange(
+    ImageDownload* download,
+    HttpsClient* client,
+    const HttpsUrl* url,
+    ImageRequestType type,
+    uint32_t start,
+    uint32_t length,
+    HttpsResponse* response) {
+    download->requestType = type;
+    download->requestOffset = start;
+
+    HttpsRequest request = {
+        .method = HTTPS_METHOD_GET,
+        .host = url->host,
+        .port = url->port,
+        .path = url->path,
+        .rangeStart = start,
+        .rangeLength = length,
+        .timeoutMs = HTTP_TIMEOUT_IN_MS,
+        .eventHandler = imageHttpEventHandler,
+        .userData = download};
+
+    esp_err_t error = HttpsClient_request(client, &request, response);
+
+    if (error == ESP_OK && download->error != ESP_OK) {
+        error = download->error;
+    }
 
-    config.url = url;
-    config.method = HTTP_METHOD_GET;
-    config.timeout_ms = HTTP_TIMEOUT_IN_MS;
-    config.event_handler = firmwareHttpEventHandler;
-    config.user_data = NULL;
-    // TODO: Should be set to false in production code
-    config.skip_cert_common_name_check = true;
-    config.cert_pem = ApiClient_getServerCertificate();
+    if (error == ESP_OK && response->statusCode != 200 &&
+        response->statusCode != 206) {
+        LOGE(
+            LOG_TAG, "Firmware download failed (HTTP %d).",
+            response->statusCode);
+        error = ESP_FAIL;
+    }
+
+    return error;
+}
+
+static esp_err_t parseCompressedImageHeader(ImageDownload* download) {
+    const uint8_t* header = download->header;
+    CompressedImage* compressed = &download->compressed;
+    FirmwareProgress* progress = &download->progress;
+
+    if (download->headerLength < COMPRESSED_IMAGE_HEADER_SIZE ||
+        header[4] != COMPRESSED_IMAGE_VERSION) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    compressed->windowBits = header[5];
+    compressed->lookaheadBits = header[6];
+    compressed->blockSize = readUint32(&header[8]);
+    const uint32_t imageSize = readUint32(&header[12]);
+
+    // Progress is only saved at the end of blocks
+    if (compressed->blockSize == 0 ||
+        compressed->blockSize % FLASH_SECTOR_SIZE != 0 || imageSize == 0 ||
+        imageSize > download->partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    compressed->blockCount =
+        (imageSize + compressed->blockSize - 1) / compressed->blockSize;
+    compressed->offsets = &header[COMPRESSED_IMAGE_HEADER_SIZE];
+
+    if (COMPRESSED_IMAGE_HEADER_SIZE + 4 * (compressed->blockCount + 1) >
+        download->headerLength) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (progress->format != FIRMWARE_FORMAT_COMPRESSED ||
+        progress->imageSize != imageSize ||
+        download->writeOffset % compressed->blockSize != 0) {
+        restartImageDownload(download);
+        progress->format = FIRMWARE_FORMAT_COMPRESSED;
+    }
+
+    progress->imageSize = imageSize;
+    return ESP_OK;
+}
+
+// Tells a compressed image from a raw one by its header, which is kept for
+// compressed images
+static esp_err_t readImageHeader(
+    ImageDownload* download, HttpsClient* client, const HttpsUrl* url) {
+    HttpsResponse response;
+    download->headerLength = 0;
+    esp_err_t error = requestImageRange(
+        download, client, url, IMAGE_REQUEST_HEADER, 0,
+        sizeof(download->header), &response);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    if (download->headerLength >= 4 &&
+        readUint32(download->header) == COMPRESSED_IMAGE_MAGIC) {
+        return parseCompressedImageHeader(download);
+    }
+
+    // Raw images are only resumed without reading the header again
+    restartImageDownload(download);
+    download->progress.format = FIRMWARE_FORMAT_RAW;
+
+    if (response.statusCode == 206 && response.totalLength > 0) {
+        download->progress.imageSize = response.totalLength;
+    }
+
+    // The header is fetched again with the first chunk, so that chunks
+    // start on sector boundaries where progress is saved
+    return ESP_OK;
+}
+
+static esp_err_t downloadImageChunk(
+    ImageDownload* download,
+    HttpsClient* client,
+    const HttpsUrl* url,
+    uint32_t* downloaded) {
+    HttpsResponse response;
+    esp_err_t error = requestImageRange(
+        download, client, url, IMAGE_REQUEST_RAW, download->writeOffset,
+        FIRMWARE_CHUNK_SIZE, &response);
+    *downloaded += download->writeOffset - download->requestOffset;
+
+    if (error != ESP_OK) {
+        return error;
+    }
 
-    esp_err_t error = esp_https_ota(&config);
+    if (response.statusCode == 200) {
+        download->progress.imageSize = download->writeOffset;
+    } else if (response.totalLength > 0) {
+        download->progress.imageSize = response.totalLength;
+    } else {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    if (download->progress.imageSize > download->partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t downloadImageBlock(
+    ImageDownload* download,
+    HttpsClient* client,
+    const HttpsUrl* url,
+    uint32_t* downloaded) {
+    const CompressedImage* compressed = &download->compressed;
+    const uint32_t block = download->writeOffset / compressed->blockSize;
+    const uint32_t start = readUint32(&compressed->offsets[4 * block]);
+    const uint32_t end = readUint32(&compressed->offsets[4 * (block + 1)]);
+
+    if (end <= start) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    download->blockEnd = download->writeOffset + compressed->blockSize;
+
+    if (download->blockEnd > download->progress.imageSize) {
+        download->blockEnd = download->progress.imageSize;
+    }
+
+    esp_err_t error = LzssDecoder_init(
+        &download->decoder, compressed->windowBits, compressed->lookaheadBits,
+        writeDecompressedData, download);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    HttpsResponse response;
+    error = requestImageRange(
+        download, client, url, IMAGE_REQUEST_BLOCK, start, end - start,
+        &response);
+    *downloaded += end - start;
+
+    if (error == ESP_OK) {
+        error = LzssDecoder_flush(&download->decoder);
+    }
+
+    if (error == ESP_OK && download->writeOffset != download->blockEnd) {
+        // Truncated
+        error = ESP_ERR_INVALID_SIZE;
+    }
+
+    return error;
+}
+
+// Returns ESP_ERR_TIMEOUT if the download continues on a later call
+static esp_err_t downloadFirmwareImage(const char* url, const char* version) {
+    HttpsUrl parsedUrl;
+    esp_err_t error = parseHttpsUrl(url, &parsedUrl);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    const esp_partition_t* partition = esp_ota_get_next_update_partition(NULL);
+
+    if (!partition) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    ImageDownload* download = &firmwareImageDownload;
+    startImageDownload(download, partition, version);
+
+    HttpsClient client;
+    memset(&client, 0, sizeof(client));
+    uint32_t downloaded = 0;
+
+    // Compressed images need their block offsets every time
+    if (download->progress.format != FIRMWARE_FORMAT_RAW) {
+        error = readImageHeader(download, &client, &parsedUrl);
+    }
+
+    while (error == ESP_OK && !isImageDownloadComplete(download)) {
+        if (downloaded >= FIRMWARE_MAX_DOWNLOAD_PER_CALL) {
+            error = ESP_ERR_TIMEOUT;
+            break;
+        }
+
+        if (download->progress.format == FIRMWARE_FORMAT_COMPRESSED) {
+            error =
+                downloadImageBlock(download, &client, &parsedUrl, &downloaded);
+        } else {
+            error =
+                downloadImageChunk(download, &client, &parsedUrl, &downloaded);
+        }
+
+        if (error == ESP_OK && !isImageDownloadComplete(download)) {
+            checkpointImageDownload(download);
+        }
+    }
+
+    HttpsClient_close(&client);
+    mbedtls_sha256_free(&download->sha);
+
+    if (error == ESP_ERR_TIMEOUT) {
+        LOGD(
+            LOG_TAG, "Downloaded %u of %u bytes of the firmware.",
+            download->writeOffset, download->progress.imageSize);
+        return error;
+    }
+
+    if (error != ESP_OK) {
+        // Resumes from the last checkpoint next time
+        return error;
+    }
+
+    saveProgress(NULL);
+    // Verifies the image before switching to it
+    return esp_ota_set_boot_partition(partition);
+}
+
+esp_err_t applyFirmwareUpdate(
+    const char* url,
+    const char* patchUrl,
+    const char* version,
+    bool restart) {
+    esp_err_t error = ESP_FAIL;
+
+    // Once the image is being downloaded the patch has already failed
+    if (patchUrl && !isFirmwareUpdateInProgress(version)) {
+        error = downloadFirmwarePatch(patchUrl);
+    }
+
+    // Falls back to the full image, e.g. when the patch is for another image
+    if (error != ESP_OK) {
+        error = downloadFirmwareImage(url, version);
+    } else {
+        saveProgress(NULL);
+    }
+
+    if (error != ESP_OK) {
+        if (error != ESP_ERR_TIMEOUT) {
+            LOGE(LOG_TAG, "Unable to update firmware (%d).", error);
+        }
+        return error;
+    }
 
-    if (error == ESP_OK && restart) {
+    if (restart) {
         esp_restart();
     }
 
@@ -8,4 +8,14 @@
 #define FIRMWARE_VERSION_MAX_LENGTH 32
 
 size_t getFirmwareVersion(char* version, size_t versionSize);
-esp_err_t applyFirmwareUpdate(const char* url, bool restart);
+// Prefers a patch against the running image when patchUrl isn't NULL, see
+// scripts/mkpatch.py. The full image, which may be compressed with
+// scripts/mkcompressed.py, is downloaded in chunks and may take several
+// calls, which return ESP_ERR_TIMEOUT until it's done.
+esp_err_t applyFirmwareUpdate(
+    const char* url,
+    const char* patchUrl,
+    const char* version,
+    bool restart);
+// True if part of the given version has been downloaded
+bool isFirmwareUpdateInProgress(const char* version);
@@ -1,5 +1,6 @@
 #include "flash.h"
 
+#include <esp_partition.h>
 #include <nvs_flash.h>
 
 NvsFlashStatus initFlash(void) {
@@ -14,3 +15,33 @@ NvsFlashStatus initFlash(void) {
     ESP_ERROR_CHECK(error);
     return status;
 }
+
+static esp_err_t
+readPartition(void* context, size_t offset, void* data, size_t size) {
+    return esp_partition_read(context, offset, data, size);
+}
+
+static esp_err_t
+writePartition(void* context, size_t offset, const void* data, size_t size) {
+    return esp_partition_write(context, offset, data, size);
+}
+
+static esp_err_t erasePartition(void* context, size_t offset, size_t size) {
+    return esp_partition_erase_range(context, offset, size);
+}
+
+esp_err_t openFlashPartition(const char* label, FlashStorage* storage) {
+    const esp_partition_t* partition = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+
+    if (!partition) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    storage->read = readPartition;
+    storage->write = writePartition;
+    storage->erase = erasePartition;
+    storage->context = (void*)partition;
+    storage->size = partition->size;
+    return ESP_OK;
+}
@@ -1,5 +1,23 @@
 #pragma once
 
+#include <esp_err.h>
+#include <stddef.h>
+
 typedef enum { NVS_FLASH_STATUS_OK, NVS_FLASH_STATUS_ERASED } NvsFlashStatus;
 
+#define FLASH_SECTOR_SIZE 4096
+
+// NOR flash region where writes can only clear bits and erasing sets whole
+// sectors back to 0xff. Abstracted so that users can run against an
+// emulator on the host.
+typedef struct {
+    esp_err_t (*read)(void* context, size_t offset, void* data, size_t size);
+    esp_err_t (*write)(
+        void* context, size_t offset, const void* data, size_t size);
+    esp_err_t (*erase)(void* context, size_t offset, size_t size);
+    void* context;
+    size_t size;
+} FlashStorage;
+
 NvsFlashStatus initFlash(void);
+esp_err_t openFlashPartition(const char* label, FlashStorage* storage);
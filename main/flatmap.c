@@ -0,0 +1,113 @@
+#include "flatmap.h"
+#include "log.h"
+
+#include <string.h>
+
+#define LOG_TAG "flatmap"
+
+void FlatmapParser_init(
+    FlatmapParser* parser, FlatmapCallback callback, void* userData) {
+    parser->callback = callback;
+    parser->userData = userData;
+    parser->lineLength = 0;
+    parser->skippingLine = false;
+}
+
+static void emitLine(FlatmapParser* parser, const char* line, size_t length) {
+    if (length > 0 && line[length - 1] == '\r') {
+        --length;
+    }
+
+    if (length == 0) {
+        return;
+    }
+
+    const char* separator = memchr(line, '=', length);
+
+    if (!separator) {
+        return;
+    }
+
+    const size_t keyLength = separator - line;
+    parser->callback(
+        line, keyLength, separator + 1, length - keyLength - 1,
+        parser->userData);
+}
+
+void FlatmapParser_feed(
+    FlatmapParser* parser, const char* data, size_t length) {
+    if (!parser->callback) {
+        return;
+    }
+
+    const char* end = data + length;
+
+    while (data < end) {
+        const char* lineEnd = memchr(data, '\n', end - data);
+
+        if (parser->skippingLine) {
+            if (!lineEnd) {
+                return;
+            }
+            parser->skippingLine = false;
+            data = lineEnd + 1;
+            continue;
+        }
+
+        // Complete lines are passed on without copying
+        if (parser->lineLength == 0 && lineEnd) {
+            emitLine(parser, data, lineEnd - data);
+            data = lineEnd + 1;
+            continue;
+        }
+
+        const char* partEnd = lineEnd ? lineEnd : end;
+        const size_t partLength = partEnd - data;
+
+        if (parser->lineLength + partLength > sizeof(parser->line)) {
+            LOGW(
+                LOG_TAG, "Skipping line longer than %u bytes.",
+                sizeof(parser->line));
+            parser->lineLength = 0;
+            parser->skippingLine = !lineEnd;
+            data = partEnd + (lineEnd ? 1 : 0);
+            continue;
+        }
+
+        memcpy(parser->line + parser->lineLength, data, partLength);
+        parser->lineLength += partLength;
+        data = partEnd;
+
+        if (lineEnd) {
+            emitLine(parser, parser->line, parser->lineLength);
+            parser->lineLength = 0;
+            ++data;
+        }
+    }
+}
+
+void FlatmapParser_finish(FlatmapParser* parser) {
+    if (parser->callback && !parser->skippingLine && parser->lineLength > 0) {
+        emitLine(parser, parser->line, parser->lineLength);
+    }
+
+    parser->lineLength = 0;
+    parser->skippingLine = false;
+}
+
+bool flatmapKeyEquals(const char* key, size_t keyLength, const char* expected) {
+    return strlen(expected) == keyLength &&
+           memcmp(key, expected, keyLength) == 0;
+}
+
+void copyFlatmapValue(
+    char* target, size_t targetSize, const char* value, size_t valueLength) {
+    if (targetSize == 0) {
+        return;
+    }
+
+    const size_t length =
+        valueLength < targetSize - 1 ? valueLength : targetSize - 1;
+    memcpy(target, value, length);
+    target[length] = 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Longest "key=value" line that can be split across chunks
+#define FLATMAP_LINE_MAX_LENGTH 320
+
+// Key and value are not null-terminated. They point into the fed data when
+// the whole line was in one chunk, otherwise into the parser's line buffer.
+typedef void (*FlatmapCallback)(
+    const char* key,
+    size_t keyLength,
+    const char* value,
+    size_t valueLength,
+    void* userData);
+
+// Incremental parser for "key=value\n" lines using constant memory
+typedef struct {
+    FlatmapCallback callback;
+    void* userData;
+    char line[FLATMAP_LINE_MAX_LENGTH];
+    size_t lineLength;
+    bool skippingLine;
+} FlatmapParser;
+
+void FlatmapParser_init(
+    FlatmapParser* parser, FlatmapCallback callback, void* userData);
+void FlatmapParser_feed(FlatmapParser* parser, const char* data, size_t length);
+void FlatmapParser_finish(FlatmapParser* parser);
+
+bool flatmapKeyEquals(const char* key, size_t keyLength, const char* expected);
+void copyFlatmapValue(
+    char* target, size_t targetSize, const char* value, size_t valueLength);
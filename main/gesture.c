@@ -0,0 +1,100 @@
+#include "gesture.h"
+
+void GestureRecognizer_init(
+    GestureRecognizer* recognizer, const GestureConfig* config) {
+    recognizer->config = *config;
+    recognizer->state = GESTURE_STATE_IDLE;
+    recognizer->pressed = false;
+    recognizer->longPressReported = false;
+    recognizer->pressTimeMs = 0;
+    recognizer->ringed = false;
+    recognizer->ringTimeMs = 0;
+    recognizer->armedTimeMs = 0;
+    recognizer->seriesPressCount = 0;
+}
+
+Gesture GestureRecognizer_feed(
+    GestureRecognizer* recognizer, const ButtonEvent* event) {
+    const GestureConfig* config = &recognizer->config;
+
+    if (event->type == BUTTON_EVENT_RELEASE) {
+        recognizer->pressed = false;
+        return GESTURE_NONE;
+    }
+
+    if (recognizer->pressed) {
+        // Missed a release
+        return GESTURE_NONE;
+    }
+
+    recognizer->pressed = true;
+    recognizer->longPressReported = false;
+    recognizer->pressTimeMs = event->timeMs;
+
+    if (recognizer->state == GESTURE_STATE_ARMED &&
+        event->timeMs - recognizer->armedTimeMs <= config->seriesWindowMs) {
+        if (++recognizer->seriesPressCount >= config->seriesPressCount) {
+            recognizer->state = GESTURE_STATE_IDLE;
+            // Keeps the last press of the series from starting a long press
+            recognizer->longPressReported = true;
+            return GESTURE_PRESS_SERIES;
+        }
+        return GESTURE_NONE;
+    }
+
+    recognizer->state = GESTURE_STATE_IDLE;
+
+    if (recognizer->ringed &&
+        event->timeMs - recognizer->ringTimeMs < config->ringCoalescingMs) {
+        return GESTURE_NONE;
+    }
+
+    recognizer->ringed = true;
+    recognizer->ringTimeMs = event->timeMs;
+    return GESTURE_RING;
+}
+
+Gesture GestureRecognizer_poll(GestureRecognizer* recognizer, uint32_t nowMs) {
+    const GestureConfig* config = &recognizer->config;
+
+    if (recognizer->state == GESTURE_STATE_ARMED &&
+        nowMs - recognizer->armedTimeMs > config->seriesWindowMs) {
+        recognizer->state = GESTURE_STATE_IDLE;
+    }
+
+    if (recognizer->pressed && !recognizer->longPressReported &&
+        recognizer->state == GESTURE_STATE_IDLE &&
+        nowMs - recognizer->pressTimeMs >= config->longPressMs) {
+        recognizer->longPressReported = true;
+        recognizer->state = GESTURE_STATE_ARMED;
+        recognizer->armedTimeMs = nowMs;
+        recognizer->seriesPressCount = 0;
+        return GESTURE_LONG_PRESS;
+    }
+
+    return GESTURE_NONE;
+}
+
+uint32_t GestureRecognizer_getTimeUntilDeadline(
+    GestureRecognizer* recognizer, uint32_t nowMs) {
+    const GestureConfig* config = &recognizer->config;
+
+    if (recognizer->state == GESTURE_STATE_ARMED) {
+        const uint32_t elapsed = nowMs - recognizer->armedTimeMs;
+        return elapsed <= config->seriesWindowMs
+                   ? config->seriesWindowMs - elapsed + 1
+                   : 0;
+    }
+
+    if (recognizer->pressed && !recognizer->longPressReported) {
+        const uint32_t elapsed = nowMs - recognizer->pressTimeMs;
+        return elapsed < config->longPressMs ? config->longPressMs - elapsed
+                                             : 0;
+    }
+
+    return GESTURE_NO_DEADLINE;
+}
+
+bool GestureRecognizer_isIdle(const GestureRecognizer* recognizer) {
+    return !recognizer->pressed && recognizer->state == GESTURE_STATE_IDLE;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define GESTURE_NO_DEADLINE UINT32_MAX
+
+typedef enum { BUTTON_EVENT_PRESS, BUTTON_EVENT_RELEASE } ButtonEventType;
+
+// A debounced edge. Times are in ms and may wrap around.
+typedef struct {
+    ButtonEventType type;
+    uint32_t timeMs;
+} ButtonEvent;
+
+typedef enum {
+    GESTURE_NONE,
+    // A press that isn't within the coalescing window of the previous ring
+    GESTURE_RING,
+    // The button has been held for long enough, reported while still held
+    GESTURE_LONG_PRESS,
+    // Enough presses within the window following a long press
+    GESTURE_PRESS_SERIES
+} Gesture;
+
+typedef struct {
+    uint32_t ringCoalescingMs;
+    uint32_t longPressMs;
+    uint32_t seriesPressCount;
+    uint32_t seriesWindowMs;
+} GestureConfig;
+
+typedef enum {
+    GESTURE_STATE_IDLE,
+    // Waiting for the series after a long press
+    GESTURE_STATE_ARMED
+} GestureState;
+
+// Turns button events into gestures. Doesn't touch hardware or clocks so
+// that it can be fed synthetic timelines.
+typedef struct {
+    GestureConfig config;
+    GestureState state;
+    bool pressed;
+    bool longPressReported;
+    uint32_t pressTimeMs;
+    bool ringed;
+    uint32_t ringTimeMs;
+    uint32_t armedTimeMs;
+    uint32_t seriesPressCount;
+} GestureRecognizer;
+
+void GestureRecognizer_init(
+    GestureRecognizer* recognizer, const GestureConfig* config);
+Gesture GestureRecognizer_feed(
+    GestureRecognizer* recognizer, const ButtonEvent* event);
+// Reports gestures that are due to time passing
+Gesture GestureRecognizer_poll(GestureRecognizer* recognizer, uint32_t nowMs);
+// Time until poll() needs to be called, or GESTURE_NO_DEADLINE
+uint32_t GestureRecognizer_getTimeUntilDeadline(
+    GestureRecognizer* recognizer, uint32_t nowMs);
+// True when no gesture is in progress
+bool GestureRecognizer_isIdle(const GestureRecognizer* recognizer);
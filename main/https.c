@@ -0,0 +1,564 @@
+#include "https.h"
+#include "log.h"
+#include "trace.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define LOG_TAG "https"
+#define HTTPS_BUFFER_SIZE 1024
+#define HTTPS_MAX_CHUNK_SIZE 0x0FFFFFFF
+
+static const char* HTTPS_SCHEME = "https://";
+static const char* HTTPS_USER_AGENT = "doorbell";
+
+typedef enum {
+    CHUNK_STATE_SIZE,
+    CHUNK_STATE_EXTENSION,
+    CHUNK_STATE_SIZE_LF,
+    CHUNK_STATE_DATA,
+    CHUNK_STATE_DATA_CR,
+    CHUNK_STATE_DATA_LF,
+    CHUNK_STATE_TRAILER,
+    CHUNK_STATE_DONE
+} ChunkState;
+
+typedef enum {
+    BODY_MODE_NONE,
+    BODY_MODE_LENGTH,
+    BODY_MODE_CHUNKED,
+    BODY_MODE_UNTIL_CLOSE
+} BodyMode;
+
+typedef struct {
+    BodyMode mode;
+    ChunkState chunkState;
+    size_t remaining;
+    size_t trailerLineLength;
+    bool closeConnection;
+} BodyReader;
+
+esp_err_t parseHttpsUrl(const char* url, HttpsUrl* parsedUrl) {
+    const size_t schemeLength = strlen(HTTPS_SCHEME);
+
+    if (!url || !parsedUrl || strncmp(url, HTTPS_SCHEME, schemeLength) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const char* host = url + schemeLength;
+    const char* hostEnd = host + strcspn(host, ":/");
+    const size_t hostLength = hostEnd - host;
+
+    if (hostLength == 0 || hostLength >= sizeof(parsedUrl->host)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(parsedUrl->host, host, hostLength);
+    parsedUrl->host[hostLength] = 0;
+    parsedUrl->port = HTTPS_DEFAULT_PORT;
+
+    const char* path = hostEnd;
+
+    if (*path == ':') {
+        char* portEnd = NULL;
+        long port = strtol(path + 1, &portEnd, 10);
+        if (port <= 0 || port > 65535 || (*portEnd && *portEnd != '/')) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        parsedUrl->port = port;
+        path = portEnd;
+    }
+
+    parsedUrl->path = *path ? path : "/";
+    return ESP_OK;
+}
+
+static esp_err_t writeRequest(
+    TlsConnection* connection, const HttpsRequest* request, bool keepAlive) {
+    char header[512];
+    const char* method =
+        request->method == HTTPS_METHOD_POST ? "POST" : "GET";
+
+    int headerLength = snprintf(
+        header, sizeof(header),
+        "%s %s HTTP/1.1\r\n"
+        "Host: %s\r\n"
+        "User-Agent: %s\r\n"
+        "Connection: %s\r\n",
+        method, request->path, request->host, HTTPS_USER_AGENT,
+        keepAlive ? "keep-alive" : "close");
+
+    if (request->contentType && headerLength < sizeof(header)) {
+        headerLength += snprintf(
+            header + headerLength, sizeof(header) - headerLength,
+            "Content-Type: %s\r\n", request->contentType);
+    }
+
+    if (request->rangeLength > 0 && headerLength < sizeof(header)) {
+        headerLength += snprintf(
+            header + headerLength, sizeof(header) - headerLength,
+            "Range: bytes=%u-%u\r\n", request->rangeStart,
+            request->rangeStart + request->rangeLength - 1);
+    }
+
+    if (request->method == HTTPS_METHOD_POST && headerLength < sizeof(header)) {
+        headerLength += snprintf(
+            header + headerLength, sizeof(header) - headerLength,
+            "Content-Length: %u\r\n", request->contentLength);
+    }
+
+    if (headerLength < sizeof(header)) {
+        headerLength += snprintf(
+            header + headerLength, sizeof(header) - headerLength, "\r\n");
+    }
+
+    if (headerLength >= sizeof(header)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (TlsConnection_write(connection, header, headerLength) < 0) {
+        return ESP_FAIL;
+    }
+
+    if (request->content && request->contentLength > 0 &&
+        TlsConnection_write(
+            connection, request->content, request->contentLength) < 0) {
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
+
+static bool headerEquals(const char* line, const char* name) {
+    const size_t nameLength = strlen(name);
+    return strncasecmp(line, name, nameLength) == 0 && line[nameLength] == ':';
+}
+
+static const char* headerValue(const char* line) {
+    const char* value = strchr(line, ':') + 1;
+    while (*value == ' ' || *value == '\t') {
+        ++value;
+    }
+    return value;
+}
+
+static esp_err_t parseResponseHeader(
+    char* header, HttpsResponse* response, BodyReader* reader) {
+    if (sscanf(header, "HTTP/%*u.%*u %d", &response->statusCode) != 1) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    response->contentLength = -1;
+    response->rangeStart = -1;
+    response->totalLength = -1;
+    reader->mode = BODY_MODE_UNTIL_CLOSE;
+
+    char* line = strstr(header, "\r\n");
+
+    while (line && *line) {
+        line += 2;
+        char* lineEnd = strstr(line, "\r\n");
+        if (lineEnd) {
+            *lineEnd = 0;
+        }
+
+        if (headerEquals(line, "Content-Length")) {
+            response->contentLength = strtoll(headerValue(line), NULL, 10);
+        } else if (headerEquals(line, "Content-Range")) {
+            long long start = 0;
+            long long total = 0;
+            if (sscanf(
+                    headerValue(line), "bytes %lld-%*d/%lld", &start,
+                    &total) == 2) {
+                response->rangeStart = start;
+                response->totalLength = total;
+            }
+        } else if (
+            headerEquals(line, "Transfer-Encoding") &&
+            strstr(headerValue(line), "chunked")) {
+            reader->mode = BODY_MODE_CHUNKED;
+        } else if (
+            headerEquals(line, "Connection") &&
+            strcasecmp(headerValue(line), "close") == 0) {
+            reader->closeConnection = true;
+        }
+
+        if (!lineEnd) {
+            break;
+        }
+        *lineEnd = '\r';
+        line = lineEnd;
+    }
+
+    if (response->statusCode == 204 || response->statusCode == 304) {
+        reader->mode = BODY_MODE_NONE;
+    } else if (
+        reader->mode != BODY_MODE_CHUNKED && response->contentLength >= 0) {
+        reader->mode = BODY_MODE_LENGTH;
+        reader->remaining = response->contentLength;
+    }
+
+    if (reader->mode == BODY_MODE_LENGTH && reader->remaining == 0) {
+        reader->mode = BODY_MODE_NONE;
+    }
+
+    if (reader->mode == BODY_MODE_UNTIL_CLOSE) {
+        reader->closeConnection = true;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t emitData(
+    const HttpsRequest* request,
+    HttpsResponse* response,
+    const char* data,
+    size_t length) {
+    if (length == 0) {
+        return ESP_OK;
+    }
+
+    response->bodyLength += length;
+
+    if (!request->eventHandler) {
+        return ESP_OK;
+    }
+
+    HttpsEvent event = {
+        .id = HTTPS_EVENT_ON_DATA,
+        .statusCode = response->statusCode,
+        .rangeStart = response->rangeStart,
+        .data = data,
+        .dataLength = length,
+        .userData = request->userData};
+
+    return request->eventHandler(&event);
+}
+
+static int hexDigitValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+static esp_err_t decodeChunks(
+    BodyReader* reader,
+    const char* data,
+    size_t length,
+    const HttpsRequest* request,
+    HttpsResponse* response) {
+
+    for (size_t i = 0; i < length && reader->chunkState != CHUNK_STATE_DONE;) {
+        const char c = data[i];
+
+        switch (reader->chunkState) {
+        case CHUNK_STATE_SIZE: {
+            int digit = hexDigitValue(c);
+            if (digit >= 0) {
+                if (reader->remaining > HTTPS_MAX_CHUNK_SIZE / 16) {
+                    return ESP_ERR_INVALID_RESPONSE;
+                }
+                reader->remaining = reader->remaining * 16 + digit;
+            } else if (c == ';' || c == ' ' || c == '\t') {
+                reader->chunkState = CHUNK_STATE_EXTENSION;
+            } else if (c == '\r') {
+                reader->chunkState = CHUNK_STATE_SIZE_LF;
+            } else {
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            ++i;
+            break;
+        }
+        case CHUNK_STATE_EXTENSION:
+            if (c == '\r') {
+                reader->chunkState = CHUNK_STATE_SIZE_LF;
+            }
+            ++i;
+            break;
+        case CHUNK_STATE_SIZE_LF:
+            if (c != '\n') {
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            reader->chunkState = reader->remaining > 0 ? CHUNK_STATE_DATA
+                                                       : CHUNK_STATE_TRAILER;
+            reader->trailerLineLength = 0;
+            ++i;
+            break;
+        case CHUNK_STATE_DATA: {
+            size_t available = length - i;
+            size_t count =
+                available < reader->remaining ? available : reader->remaining;
+            esp_err_t error = emitData(request, response, &data[i], count);
+            if (error != ESP_OK) {
+                return error;
+            }
+            reader->remaining -= count;
+            if (reader->remaining == 0) {
+                reader->chunkState = CHUNK_STATE_DATA_CR;
+            }
+            i += count;
+            break;
+        }
+        case CHUNK_STATE_DATA_CR:
+            if (c != '\r') {
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            reader->chunkState = CHUNK_STATE_DATA_LF;
+            ++i;
+            break;
+        case CHUNK_STATE_DATA_LF:
+            if (c != '\n') {
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+            reader->chunkState = CHUNK_STATE_SIZE;
+            ++i;
+            break;
+        case CHUNK_STATE_TRAILER:
+            if (c == '\n') {
+                if (reader->trailerLineLength == 0) {
+                    reader->chunkState = CHUNK_STATE_DONE;
+                }
+                reader->trailerLineLength = 0;
+            } else if (c != '\r') {
+                ++reader->trailerLineLength;
+            }
+            ++i;
+            break;
+        case CHUNK_STATE_DONE:
+            break;
+        }
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t readBody(
+    BodyReader* reader,
+    const char* data,
+    size_t length,
+    const HttpsRequest* request,
+    HttpsResponse* response) {
+
+    switch (reader->mode) {
+    case BODY_MODE_LENGTH: {
+        size_t count = length < reader->remaining ? length : reader->remaining;
+        reader->remaining -= count;
+        return emitData(request, response, data, count);
+    }
+    case BODY_MODE_CHUNKED:
+        return decodeChunks(reader, data, length, request, response);
+    case BODY_MODE_UNTIL_CLOSE:
+        return emitData(request, response, data, length);
+    default:
+        return ESP_OK;
+    }
+}
+
+static bool bodyComplete(const BodyReader* reader) {
+    switch (reader->mode) {
+    case BODY_MODE_NONE:
+        return true;
+    case BODY_MODE_LENGTH:
+        return reader->remaining == 0;
+    case BODY_MODE_CHUNKED:
+        return reader->chunkState == CHUNK_STATE_DONE;
+    default:
+        return false;
+    }
+}
+
+// Sets closeConnection when the connection can't be used for another request
+static esp_err_t readResponse(
+    TlsConnection* connection,
+    const HttpsRequest* request,
+    HttpsResponse* response,
+    bool* closeConnection) {
+
+    char buffer[HTTPS_BUFFER_SIZE];
+    size_t bufferLength = 0;
+    char* headerEnd = NULL;
+
+    while (!headerEnd) {
+        if (bufferLength >= sizeof(buffer) - 1) {
+            LOGE(LOG_TAG, "HTTP response header is too large.");
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        int bytesRead = TlsConnection_read(
+            connection, buffer + bufferLength,
+            sizeof(buffer) - 1 - bufferLength);
+
+        if (bytesRead <= 0) {
+            // No response at all usually means an idle connection was closed
+            return bufferLength == 0 && bytesRead == 0 ? ESP_ERR_INVALID_STATE
+                                                       : ESP_FAIL;
+        }
+
+        bufferLength += bytesRead;
+        buffer[bufferLength] = 0;
+        headerEnd = strstr(buffer, "\r\n\r\n");
+    }
+
+    BodyReader reader;
+    memset(&reader, 0, sizeof(reader));
+    *headerEnd = 0;
+
+    esp_err_t error = parseResponseHeader(buffer, response, &reader);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    *closeConnection = reader.closeConnection;
+
+    const char* body = headerEnd + 4;
+    error = readBody(
+        &reader, body, bufferLength - (body - buffer), request, response);
+
+    while (error == ESP_OK && !bodyComplete(&reader)) {
+        int bytesRead = TlsConnection_read(connection, buffer, sizeof(buffer));
+
+        if (bytesRead == 0 && reader.mode == BODY_MODE_UNTIL_CLOSE) {
+            break;
+        }
+
+        if (bytesRead <= 0) {
+            LOGE(LOG_TAG, "HTTP response body is incomplete.");
+            return ESP_FAIL;
+        }
+
+        error = readBody(&reader, buffer, bytesRead, request, response);
+    }
+
+    if (error == ESP_OK && request->eventHandler) {
+        HttpsEvent event = {
+            .id = HTTPS_EVENT_ON_FINISH,
+            .statusCode = response->statusCode,
+            .rangeStart = response->rangeStart,
+            .data = NULL,
+            .dataLength = 0,
+            .userData = request->userData};
+        error = request->eventHandler(&event);
+    }
+
+    return error;
+}
+
+static esp_err_t exchange(
+    TlsConnection* connection,
+    const HttpsRequest* request,
+    HttpsResponse* response,
+    bool keepAlive,
+    bool* closeConnection) {
+
+    memset(response, 0, sizeof(HttpsResponse));
+    *closeConnection = true;
+
+    traceBegin(TRACE_EVENT_HTTP_REQUEST);
+    esp_err_t error = writeRequest(connection, request, keepAlive);
+    traceEnd(TRACE_EVENT_HTTP_REQUEST);
+
+    if (error == ESP_OK) {
+        traceBegin(TRACE_EVENT_HTTP_RESPONSE);
+        error = readResponse(connection, request, response, closeConnection);
+        traceEnd(TRACE_EVENT_HTTP_RESPONSE);
+    }
+
+    if (error != ESP_OK) {
+        *closeConnection = true;
+    }
+
+    return error;
+}
+
+esp_err_t httpsRequest(const HttpsRequest* request, HttpsResponse* response) {
+    TlsConnection connection;
+    esp_err_t error = TlsConnection_open(
+        &connection, request->host, request->port, request->timeoutMs);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    bool closeConnection = true;
+    error = exchange(&connection, request, response, false, &closeConnection);
+
+    TlsConnection_close(&connection);
+    return error;
+}
+
+esp_err_t HttpsClient_request(
+    HttpsClient* client,
+    const HttpsRequest* request,
+    HttpsResponse* response) {
+
+    if (strlen(request->host) >= sizeof(client->host)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (client->open && (strcmp(client->host, request->host) != 0 ||
+                         client->port != request->port)) {
+        HttpsClient_close(client);
+    }
+
+    for (int attempt = 0;; ++attempt) {
+        bool reused = client->open;
+
+        if (reused) {
+            client->connection.timeoutMs = request->timeoutMs;
+        } else {
+            esp_err_t error = TlsConnection_open(
+                &client->connection, request->host, request->port,
+                request->timeoutMs);
+
+            if (error != ESP_OK) {
+                return error;
+            }
+
+            strcpy(client->host, request->host);
+            client->port = request->port;
+            client->open = true;
+            ++client->stats.reconnects;
+        }
+
+        bool closeConnection = true;
+        esp_err_t error = exchange(
+            &client->connection, request, response, true, &closeConnection);
+
+        if (closeConnection) {
+            HttpsClient_close(client);
+        }
+
+        if (error == ESP_OK && reused) {
+            ++client->stats.reuses;
+        }
+
+        // The server may have closed the idle connection since the last
+        // request, in which case it's safe to try once more on a new one.
+        if (error == ESP_ERR_INVALID_STATE && reused && attempt == 0) {
+            LOGD(LOG_TAG, "Kept-alive connection was closed; reconnecting.");
+            continue;
+        }
+
+        return error;
+    }
+}
+
+void HttpsClient_close(HttpsClient* client) {
+    if (!client->open) {
+        return;
+    }
+
+    TlsConnection_close(&client->connection);
+    client->open = false;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "tls.h"
+
+#include <esp_err.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define HTTPS_HOST_MAX_LENGTH 64
+#define HTTPS_DEFAULT_PORT 443
+
+typedef enum { HTTPS_METHOD_GET, HTTPS_METHOD_POST } HttpsMethod;
+
+typedef enum { HTTPS_EVENT_ON_DATA, HTTPS_EVENT_ON_FINISH } HttpsEventId;
+
+typedef struct {
+    HttpsEventId id;
+    int statusCode;
+    // See HttpsResponse
+    int64_t rangeStart;
+    const char* data;
+    size_t dataLength;
+    void* userData;
+} HttpsEvent;
+
+typedef esp_err_t (*HttpsEventHandler)(HttpsEvent* event);
+
+typedef struct {
+    char host[HTTPS_HOST_MAX_LENGTH];
+    uint16_t port;
+    const char* path;
+} HttpsUrl;
+
+typedef struct {
+    HttpsMethod method;
+    const char* host;
+    uint16_t port;
+    const char* path;
+    const char* contentType;
+    const char* content;
+    size_t contentLength;
+    // Requests rangeLength bytes from rangeStart unless rangeLength is 0
+    uint32_t rangeStart;
+    uint32_t rangeLength;
+    uint32_t timeoutMs;
+    HttpsEventHandler eventHandler;
+    void* userData;
+} HttpsRequest;
+
+typedef struct {
+    int statusCode;
+    int64_t contentLength;
+    size_t bodyLength;
+    // From Content-Range, -1 if not given
+    int64_t rangeStart;
+    int64_t totalLength;
+} HttpsResponse;
+
+typedef struct {
+    uint32_t reuses;
+    uint32_t reconnects;
+} HttpsClientStats;
+
+// Keeps a connection open between requests to the same server
+typedef struct {
+    TlsConnection connection;
+    char host[HTTPS_HOST_MAX_LENGTH];
+    uint16_t port;
+    bool open;
+    HttpsClientStats stats;
+} HttpsClient;
+
+esp_err_t parseHttpsUrl(const char* url, HttpsUrl* parsedUrl);
+esp_err_t httpsRequest(const HttpsRequest* request, HttpsResponse* response);
+esp_err_t HttpsClient_request(
+    HttpsClient* client,
+    const HttpsRequest* request,
+    HttpsResponse* response);
+void HttpsClient_close(HttpsClient* client);
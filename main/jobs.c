@@ -0,0 +1,147 @@
+#include "jobs.h"
+#include "log.h"
+
+#include <esp_attr.h>
+#include <esp_task.h>
+#include <esp_timer.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <stdio.h>
+
+#define LOG_TAG "jobs"
+
+// So that a long job, such as a firmware download, doesn't hold up others
+#define JOB_WORKER_COUNT 2
+// Enough for a TLS connection with a firmware download on top
+#define JOB_WORKER_STACK_SIZE 8192
+#define JOB_QUEUE_LENGTH 4
+// Away from WiFi, see CONFIG_ESP32_WIFI_TASK_PINNED_TO_CORE_0
+#define JOB_WORKER_CORE (portNUM_PROCESSORS - 1)
+// Workers take jobs ahead of the main task and then switch to the priority
+// of the job
+#define JOB_WORKER_IDLE_PRIORITY (ESP_TASK_MAIN_PRIO + 1)
+
+typedef struct {
+    uint32_t count;
+    uint64_t totalLatencyInUs;
+    uint32_t maxLatencyInUs;
+    uint32_t maxQueueDepth;
+} JobCounters;
+
+typedef struct {
+    StaticTask_t task;
+    StackType_t stack[JOB_WORKER_STACK_SIZE];
+} JobWorker;
+
+static RTC_DATA_ATTR JobCounters jobCounters;
+
+static JobWorker jobWorkers[JOB_WORKER_COUNT];
+static StaticQueue_t jobQueueBuffer;
+static uint8_t jobQueueStorage[JOB_QUEUE_LENGTH * sizeof(Job*)];
+static QueueHandle_t jobQueue = NULL;
+static portMUX_TYPE jobStatsLock = portMUX_INITIALIZER_UNLOCKED;
+
+static void countJobStart(int64_t latencyInUs) {
+    const uint32_t latency = latencyInUs > 0 ? (uint32_t)latencyInUs : 0;
+
+    portENTER_CRITICAL(&jobStatsLock);
+    ++jobCounters.count;
+    jobCounters.totalLatencyInUs += latency;
+    if (latency > jobCounters.maxLatencyInUs) {
+        jobCounters.maxLatencyInUs = latency;
+    }
+    portEXIT_CRITICAL(&jobStatsLock);
+}
+
+static void countQueueDepth(uint32_t depth) {
+    portENTER_CRITICAL(&jobStatsLock);
+    if (depth > jobCounters.maxQueueDepth) {
+        jobCounters.maxQueueDepth = depth;
+    }
+    portEXIT_CRITICAL(&jobStatsLock);
+}
+
+static void runWorker(void* parameter) {
+    while (true) {
+        Job* job = NULL;
+
+        if (xQueueReceive(jobQueue, &job, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        countJobStart(esp_timer_get_time() - job->submitTime);
+
+        vTaskPrioritySet(NULL, job->priority);
+        job->function(job->argument);
+        vTaskPrioritySet(NULL, JOB_WORKER_IDLE_PRIORITY);
+        LOGD(
+            LOG_TAG, "%s stack left: %u bytes", pcTaskGetTaskName(NULL),
+            uxTaskGetStackHighWaterMark(NULL));
+
+        // The job may be gone as soon as this returns
+        xSemaphoreGive(job->done);
+    }
+}
+
+esp_err_t initJobs(void) {
+    if (jobQueue) {
+        return ESP_OK;
+    }
+
+    jobQueue = xQueueCreateStatic(
+        JOB_QUEUE_LENGTH, sizeof(Job*), jobQueueStorage, &jobQueueBuffer);
+
+    if (!jobQueue) {
+        return ESP_FAIL;
+    }
+
+    for (size_t i = 0; i < JOB_WORKER_COUNT; ++i) {
+        char name[configMAX_TASK_NAME_LEN];
+        snprintf(name, sizeof(name), "Worker %u", i);
+
+        TaskHandle_t task = xTaskCreateStaticPinnedToCore(
+            runWorker, name, JOB_WORKER_STACK_SIZE, NULL,
+            JOB_WORKER_IDLE_PRIORITY, jobWorkers[i].stack,
+            &jobWorkers[i].task, JOB_WORKER_CORE);
+
+        if (!task) {
+            LOGE(LOG_TAG, "Unable to start worker %u.", i);
+            return ESP_FAIL;
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t Job_submit(
+    Job* job, JobFunction function, void* argument, UBaseType_t priority) {
+    job->function = function;
+    job->argument = argument;
+    // vTaskPrioritySet asserts instead of clamping like task creation does
+    job->priority =
+        priority < configMAX_PRIORITIES ? priority : configMAX_PRIORITIES - 1;
+    job->done = xSemaphoreCreateBinaryStatic(&job->doneBuffer);
+    job->submitTime = esp_timer_get_time();
+
+    if (xQueueSend(jobQueue, &job, 0) != pdTRUE) {
+        LOGE(LOG_TAG, "Job queue is full.");
+        return ESP_ERR_NO_MEM;
+    }
+
+    countQueueDepth(uxQueueMessagesWaiting(jobQueue));
+    return ESP_OK;
+}
+
+void Job_wait(Job* job) { xSemaphoreTake(job->done, portMAX_DELAY); }
+
+void getJobStats(JobStats* stats) {
+    portENTER_CRITICAL(&jobStatsLock);
+    stats->count = jobCounters.count;
+    stats->meanLatencyInUs =
+        jobCounters.count > 0
+            ? (uint32_t)(jobCounters.totalLatencyInUs / jobCounters.count)
+            : 0;
+    stats->maxLatencyInUs = jobCounters.maxLatencyInUs;
+    stats->maxQueueDepth = jobCounters.maxQueueDepth;
+    portEXIT_CRITICAL(&jobStatsLock);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <esp_err.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stdint.h>
+
+typedef void (*JobFunction)(void* argument);
+
+// Since the last cold boot. Latency is the time from submitting a job until
+// a worker starts running it.
+typedef struct {
+    uint32_t count;
+    uint32_t meanLatencyInUs;
+    uint32_t maxLatencyInUs;
+    // Most jobs waiting for a worker at once
+    uint32_t maxQueueDepth;
+} JobStats;
+
+// Owned by whoever submits it, and must stay valid until Job_wait returns
+typedef struct {
+    JobFunction function;
+    void* argument;
+    UBaseType_t priority;
+    int64_t submitTime;
+    SemaphoreHandle_t done;
+    StaticSemaphore_t doneBuffer;
+} Job;
+
+// Starts a fixed set of workers that run jobs in the order they were
+// submitted. Workers, their stacks and the queue are allocated statically
+// and live until restart, so running a job doesn't touch the heap.
+esp_err_t initJobs(void);
+// Queues the function to run on a worker at the given priority. Fails
+// rather than blocking if the queue is full, in which case callers run the
+// function themselves. The main task stack is sized for that.
+esp_err_t Job_submit(
+    Job* job, JobFunction function, void* argument, UBaseType_t priority);
+void Job_wait(Job* job);
+void getJobStats(JobStats* stats);
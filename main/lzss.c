@@ -0,0 +1,134 @@
+#include "lzss.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+esp_err_t LzssDecoder_init(
+    LzssDecoder* decoder,
+    uint8_t windowBits,
+    uint8_t lookaheadBits,
+    LzssWriter write,
+    void* context) {
+    // Same limits as heatshrink
+    if (windowBits < 4 || windowBits > LZSS_MAX_WINDOW_BITS ||
+        lookaheadBits < 3 || lookaheadBits >= windowBits) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    // References before the start of the stream read zeros
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->write = write;
+    decoder->context = context;
+    decoder->windowBits = windowBits;
+    decoder->lookaheadBits = lookaheadBits;
+    decoder->state = LZSS_STATE_TAG;
+    return ESP_OK;
+}
+
+esp_err_t LzssDecoder_flush(LzssDecoder* decoder) {
+    if (decoder->outputLength == 0) {
+        return ESP_OK;
+    }
+
+    esp_err_t error = decoder->write(
+        decoder->context, decoder->output, decoder->outputLength);
+    decoder->outputLength = 0;
+    return error;
+}
+
+static esp_err_t emitByte(LzssDecoder* decoder, uint8_t byte) {
+    const uint16_t windowMask = (1 << decoder->windowBits) - 1;
+    decoder->window[decoder->windowHead] = byte;
+    decoder->windowHead = (decoder->windowHead + 1) & windowMask;
+    decoder->output[decoder->outputLength++] = byte;
+
+    if (decoder->outputLength == sizeof(decoder->output)) {
+        return LzssDecoder_flush(decoder);
+    }
+
+    return ESP_OK;
+}
+
+// Returns false until count bits are available
+static bool takeBits(LzssDecoder* decoder, uint8_t count, uint16_t* value) {
+    if (decoder->bitCount < count) {
+        return false;
+    }
+
+    decoder->bitCount -= count;
+    *value = (decoder->bits >> decoder->bitCount) & ((1 << count) - 1);
+    return true;
+}
+
+static esp_err_t copyReference(LzssDecoder* decoder, uint16_t count) {
+    const uint16_t windowMask = (1 << decoder->windowBits) - 1;
+    uint16_t position = (decoder->windowHead - decoder->index) & windowMask;
+
+    // The source may overlap with what is being written
+    while (count--) {
+        esp_err_t error = emitByte(decoder, decoder->window[position]);
+
+        if (error != ESP_OK) {
+            return error;
+        }
+
+        position = (position + 1) & windowMask;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t
+LzssDecoder_feed(LzssDecoder* decoder, const void* data, size_t size) {
+    const uint8_t* bytes = data;
+
+    for (size_t i = 0; i < size; ++i) {
+        decoder->bits = decoder->bits << 8 | bytes[i];
+        decoder->bitCount += 8;
+
+        // Every field is at most 16 bits, so this can't overflow
+        bool progress = true;
+
+        while (progress) {
+            uint16_t value;
+            esp_err_t error = ESP_OK;
+
+            switch (decoder->state) {
+            case LZSS_STATE_TAG:
+                progress = takeBits(decoder, 1, &value);
+                if (progress) {
+                    decoder->state =
+                        value ? LZSS_STATE_LITERAL : LZSS_STATE_INDEX;
+                }
+                break;
+            case LZSS_STATE_LITERAL:
+                progress = takeBits(decoder, 8, &value);
+                if (progress) {
+                    error = emitByte(decoder, value);
+                    decoder->state = LZSS_STATE_TAG;
+                }
+                break;
+            case LZSS_STATE_INDEX:
+                progress = takeBits(decoder, decoder->windowBits, &value);
+                if (progress) {
+                    decoder->index = value + 1;
+                    decoder->state = LZSS_STATE_COUNT;
+                }
+                break;
+            case LZSS_STATE_COUNT:
+                progress = takeBits(decoder, decoder->lookaheadBits, &value);
+                if (progress) {
+                    error = copyReference(decoder, value + 1);
+                    decoder->state = LZSS_STATE_TAG;
+                }
+                break;
+            }
+
+            if (error != ESP_OK) {
+                return error;
+            }
+        }
+    }
+
+    return ESP_OK;
+}
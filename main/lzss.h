@@ -0,0 +1,48 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Largest window the decoder has memory for
+#define LZSS_MAX_WINDOW_BITS 10
+#define LZSS_OUTPUT_BUFFER_SIZE 256
+
+typedef esp_err_t (*LzssWriter)(void* context, const void* data, size_t size);
+
+typedef enum {
+    LZSS_STATE_TAG,
+    LZSS_STATE_LITERAL,
+    LZSS_STATE_INDEX,
+    LZSS_STATE_COUNT
+} LzssState;
+
+// Decodes the LZSS stream of heatshrink (see scripts/mkcompressed.py) that is
+// fed in chunks of any size. Memory use is fixed by LZSS_MAX_WINDOW_BITS.
+typedef struct {
+    LzssWriter write;
+    void* context;
+    uint8_t windowBits;
+    uint8_t lookaheadBits;
+    LzssState state;
+    // Bits not consumed yet, most significant first
+    uint32_t bits;
+    uint8_t bitCount;
+    uint16_t index;
+    // The last decoded bytes, which back-references point into
+    uint8_t window[1 << LZSS_MAX_WINDOW_BITS];
+    uint16_t windowHead;
+    uint8_t output[LZSS_OUTPUT_BUFFER_SIZE];
+    size_t outputLength;
+} LzssDecoder;
+
+esp_err_t LzssDecoder_init(
+    LzssDecoder* decoder,
+    uint8_t windowBits,
+    uint8_t lookaheadBits,
+    LzssWriter write,
+    void* context);
+esp_err_t LzssDecoder_feed(LzssDecoder* decoder, const void* data, size_t size);
+// Writes out what is still buffered. Bits that are left over pad the last
+// byte of the stream and are ignored.
+esp_err_t LzssDecoder_flush(LzssDecoder* decoder);
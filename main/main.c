@@ -1,58 +1,128 @@
 #include "adc.h"
 #include "api.h"
 #include "battery.h"
+#include "button.h"
+#include "buzzer.h"
+#include "energy.h"
+#include "eventlog.h"
 #include "flash.h"
+#include "jobs.h"
 #include "log.h"
 #include "pin.h"
 #include "provisioning.h"
+#include "schedule.h"
 #include "sleep.h"
 #include "tasks.h"
+#include "tls.h"
+#include "trace.h"
 #include "wifi.h"
 
-#include <driver/dac.h>
 #include <esp_err.h>
 #include <esp_event.h>
+#include <esp_sleep.h>
+#include <freertos/task.h>
 
 static ApiClientContext apiClientContext = {
-    .serverUrl = DEFAULT_API_SERVER_URL};
+    .serverUrl = DEFAULT_API_SERVER_URL,
+    .mode = DEFAULT_API_MODE,
+    .encoding = DEFAULT_API_ENCODING,
+    .ringDatagramPort = DEFAULT_API_RING_DATAGRAM_PORT};
+static EventLog ringEventLog;
 
 #define LOG_TAG  "main"
 
+// Longer than the retries of a failing connection take
+static const uint32_t WIFI_CONNECT_TIMEOUT_IN_MS = 20 * 1000;
+
 esp_err_t networkConnectionHandler(void) {
-    if (waitForWifiConnection() == WIFI_WAIT_RESULT_OK) {
+    switch (waitForWifiConnection(WIFI_CONNECT_TIMEOUT_IN_MS)) {
+    case WIFI_WAIT_RESULT_OK:
         return ESP_OK;
+    case WIFI_WAIT_RESULT_TIMEOUT:
+        LOGE(LOG_TAG, "Timed out establishing a WiFi connection.");
+        return ESP_ERR_TIMEOUT;
+    default:
+        LOGE(LOG_TAG, "Unable to establish a WiFi connection.");
+        return ESP_FAIL;
+    }
+}
+
+void networkDisconnectionHandler(void) {
+    ApiClient_disconnect(&apiClientContext);
+}
+
+void openRingEventLog(void) {
+    FlashStorage storage;
+
+    if (openFlashPartition("storage", &storage) != ESP_OK ||
+        EventLog_open(&ringEventLog, &storage) != ESP_OK) {
+        LOGE(LOG_TAG, "Unable to open the ring event log.");
+        return;
     }
-    LOGE(LOG_TAG, "Unable to establish a WiFi connection.");
-    return ESP_FAIL;
+
+    setRingEventLog(&ringEventLog);
 }
 
 void setup(void) {
+    initEnergy();
     NvsFlashStatus flashStatus = initFlash();
     LOGD(LOG_TAG, "NVS flash status: %d", flashStatus);
 
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
     initSleep(1 << RING_BUTTON_PIN);
-    ESP_ERROR_CHECK(dac_cw_generator_enable());
+    endStandby();
+    ESP_ERROR_CHECK(initBuzzer());
+    ESP_ERROR_CHECK(initButton());
     initAdc();
+    openRingEventLog();
     initWifi();
+    ESP_ERROR_CHECK(initTls());
+    ESP_ERROR_CHECK(initJobs());
     runFirstTimeProvisioning();
+    ESP_ERROR_CHECK(ApiClient_init(&apiClientContext));
     ApiClient_setNetworkConnectHandler(networkConnectionHandler);
+    setWifiStopHandler(networkDisconnectionHandler);
 }
 
 void loop(void) {
+    traceWake(esp_sleep_get_wakeup_cause());
     bool wokenByRingButton = wakeTriggeredByPin(RING_BUTTON_PIN);
-    startWifi();
+    // Presses shortly after a ring only count towards gestures
+    bool ring = wokenByRingButton && handleRingButtonWake();
+
+    if (ring || !wokenByRingButton) {
+        uint32_t batteryReading;
+
+        if (takeStandbyBatteryReading(&batteryReading)) {
+            measureBatteryFromAdcReading(batteryReading);
+        } else {
+            // Takes 8 ms before the radio starts drawing current
+            measureBattery();
+        }
+
+        startWifi();
 
-    if (wokenByRingButton) {
-        runRingTasks(&apiClientContext);
-    } else {
-        runHeartbeatTask(&apiClientContext, false);
+        if (ring) {
+            runRingTasks(&apiClientContext);
+        } else {
+            runHeartbeatTask(&apiClientContext, false);
+        }
+
+        stopWifi();
     }
 
-    stopWifi();
-    handleOnDemandHeartbeatSequence(&apiClientContext);
-    lightSleepNow();
+    handleButtonGestures(&apiClientContext);
+    setTimerWakeup(getTimeUntilNextHeartbeatInUs());
+    // Jobs run here when the queue is full, see Job_submit()
+    LOGD(
+        LOG_TAG, "Main task stack left: %u bytes",
+        uxTaskGetStackHighWaterMark(NULL));
+
+    // Light sleep keeps the state of setup() but draws more current
+    if (standbyNow() != ESP_OK) {
+        lightSleepNow();
+    }
 }
 
 void app_main(void) {
@@ -0,0 +1,219 @@
+#include "patch.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define PATCH_MAGIC 0x41544f44
+#define PATCH_FORMAT_VERSION 1
+
+typedef enum {
+    PATCH_COMMAND_END = 0,
+    PATCH_COMMAND_COPY = 1,
+    PATCH_COMMAND_INSERT = 2
+} PatchCommand;
+
+static uint32_t readUint32(const uint8_t* data) {
+    return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24;
+}
+
+void PatchApplier_init(
+    PatchApplier* applier,
+    PatchSourceReader readSource,
+    PatchTargetWriter writeTarget,
+    void* context,
+    uint32_t sourceSize,
+    const uint8_t* sourceHash) {
+    memset(applier, 0, sizeof(*applier));
+    applier->readSource = readSource;
+    applier->writeTarget = writeTarget;
+    applier->context = context;
+    applier->sourceSize = sourceSize;
+    applier->sourceHash = sourceHash;
+    applier->state = PATCH_STATE_HEADER;
+    mbedtls_sha256_init(&applier->targetSha);
+    mbedtls_sha256_starts_ret(&applier->targetSha, 0);
+}
+
+void PatchApplier_free(PatchApplier* applier) {
+    mbedtls_sha256_free(&applier->targetSha);
+}
+
+// Returns true once the buffer holds size bytes
+static bool fillBuffer(
+    PatchApplier* applier, const uint8_t** data, size_t* size, size_t needed) {
+    size_t count = needed - applier->bufferLength;
+    count = count < *size ? count : *size;
+    memcpy(&applier->buffer[applier->bufferLength], *data, count);
+    applier->bufferLength += count;
+    *data += count;
+    *size -= count;
+    return applier->bufferLength == needed;
+}
+
+static esp_err_t
+writeTarget(PatchApplier* applier, const uint8_t* data, size_t size) {
+    if (size > applier->targetSize - applier->targetLength) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    mbedtls_sha256_update_ret(&applier->targetSha, data, size);
+    applier->targetLength += size;
+    return applier->writeTarget(applier->context, data, size);
+}
+
+static esp_err_t parseHeader(PatchApplier* applier) {
+    const uint8_t* header = applier->buffer;
+
+    if (readUint32(&header[0]) != PATCH_MAGIC ||
+        header[4] != PATCH_FORMAT_VERSION) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    const uint32_t sourceSize = readUint32(&header[8]);
+    const uint8_t* sourceHash = &header[16];
+
+    if (sourceSize > applier->sourceSize ||
+        (applier->sourceHash &&
+         memcmp(sourceHash, applier->sourceHash, PATCH_HASH_SIZE) != 0)) {
+        // Made for a different image
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    applier->sourceSize = sourceSize;
+    applier->targetSize = readUint32(&header[12]);
+    memcpy(
+        applier->targetHash, &header[16 + PATCH_HASH_SIZE], PATCH_HASH_SIZE);
+    return ESP_OK;
+}
+
+static esp_err_t
+copyFromSource(PatchApplier* applier, uint32_t offset, uint32_t length) {
+    if (length > applier->sourceSize ||
+        offset > applier->sourceSize - length) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    while (length > 0) {
+        const size_t count = length < sizeof(applier->copyBuffer)
+                                 ? length
+                                 : sizeof(applier->copyBuffer);
+        esp_err_t error = applier->readSource(
+            applier->context, offset, applier->copyBuffer, count);
+
+        if (error != ESP_OK) {
+            return error;
+        }
+
+        if ((error = writeTarget(applier, applier->copyBuffer, count)) !=
+            ESP_OK) {
+            return error;
+        }
+
+        offset += count;
+        length -= count;
+    }
+
+    return ESP_OK;
+}
+
+static size_t getCommandSize(uint8_t command) {
+    switch (command) {
+    case PATCH_COMMAND_END:
+        return 1;
+    case PATCH_COMMAND_COPY:
+        return 9;
+    case PATCH_COMMAND_INSERT:
+        return 5;
+    default:
+        return 0;
+    }
+}
+
+static esp_err_t runCommand(PatchApplier* applier) {
+    const uint8_t* command = applier->buffer;
+
+    switch (command[0]) {
+    case PATCH_COMMAND_END:
+        applier->state = PATCH_STATE_DONE;
+        return ESP_OK;
+    case PATCH_COMMAND_COPY:
+        return copyFromSource(
+            applier, readUint32(&command[1]), readUint32(&command[5]));
+    default:
+        applier->insertRemaining = readUint32(&command[1]);
+        if (applier->insertRemaining > 0) {
+            applier->state = PATCH_STATE_INSERT;
+        }
+        return ESP_OK;
+    }
+}
+
+esp_err_t
+PatchApplier_feed(PatchApplier* applier, const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    esp_err_t error = ESP_OK;
+
+    while (size > 0 && error == ESP_OK) {
+        switch (applier->state) {
+        case PATCH_STATE_HEADER:
+            if (fillBuffer(applier, &bytes, &size, PATCH_HEADER_SIZE)) {
+                applier->bufferLength = 0;
+                applier->state = PATCH_STATE_COMMAND;
+                error = parseHeader(applier);
+            }
+            break;
+        case PATCH_STATE_COMMAND: {
+            if (applier->bufferLength == 0) {
+                fillBuffer(applier, &bytes, &size, 1);
+            }
+
+            const size_t commandSize = getCommandSize(applier->buffer[0]);
+
+            if (commandSize == 0) {
+                return ESP_ERR_INVALID_RESPONSE;
+            }
+
+            if (fillBuffer(applier, &bytes, &size, commandSize)) {
+                applier->bufferLength = 0;
+                error = runCommand(applier);
+            }
+            break;
+        }
+        case PATCH_STATE_INSERT: {
+            const size_t count = size < applier->insertRemaining
+                                     ? size
+                                     : applier->insertRemaining;
+            error = writeTarget(applier, bytes, count);
+            bytes += count;
+            size -= count;
+            applier->insertRemaining -= count;
+
+            if (applier->insertRemaining == 0) {
+                applier->state = PATCH_STATE_COMMAND;
+            }
+            break;
+        }
+        case PATCH_STATE_DONE:
+            // Trailing data
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+
+    return error;
+}
+
+esp_err_t PatchApplier_finish(PatchApplier* applier) {
+    if (applier->state != PATCH_STATE_DONE ||
+        applier->targetLength != applier->targetSize) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint8_t hash[PATCH_HASH_SIZE];
+    mbedtls_sha256_finish_ret(&applier->targetSha, hash);
+
+    if (memcmp(hash, applier->targetHash, PATCH_HASH_SIZE) != 0) {
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    return ESP_OK;
+}
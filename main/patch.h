@@ -0,0 +1,56 @@
+#pragma once
+
+#include <esp_err.h>
+#include <mbedtls/sha256.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PATCH_HASH_SIZE 32
+// Header, see scripts/mkpatch.py for the format
+#define PATCH_HEADER_SIZE 80
+#define PATCH_COPY_BUFFER_SIZE 512
+
+typedef esp_err_t (*PatchSourceReader)(
+    void* context, uint32_t offset, void* data, size_t size);
+typedef esp_err_t (*PatchTargetWriter)(
+    void* context, const void* data, size_t size);
+
+typedef enum {
+    PATCH_STATE_HEADER,
+    PATCH_STATE_COMMAND,
+    PATCH_STATE_INSERT,
+    PATCH_STATE_DONE
+} PatchState;
+
+// Rebuilds an image from a source image and a patch that is fed in chunks
+// of any size. Memory use doesn't depend on the size of the images.
+typedef struct {
+    PatchSourceReader readSource;
+    PatchTargetWriter writeTarget;
+    void* context;
+    uint32_t sourceSize;
+    // Checked against the header unless NULL
+    const uint8_t* sourceHash;
+    PatchState state;
+    uint8_t buffer[PATCH_HEADER_SIZE];
+    size_t bufferLength;
+    uint32_t targetSize;
+    uint32_t targetLength;
+    uint32_t insertRemaining;
+    uint8_t targetHash[PATCH_HASH_SIZE];
+    mbedtls_sha256_context targetSha;
+    uint8_t copyBuffer[PATCH_COPY_BUFFER_SIZE];
+} PatchApplier;
+
+void PatchApplier_init(
+    PatchApplier* applier,
+    PatchSourceReader readSource,
+    PatchTargetWriter writeTarget,
+    void* context,
+    uint32_t sourceSize,
+    const uint8_t* sourceHash);
+esp_err_t
+PatchApplier_feed(PatchApplier* applier, const void* data, size_t size);
+// Checks that the patch is complete and the target has the expected hash
+esp_err_t PatchApplier_finish(PatchApplier* applier);
+void PatchApplier_free(PatchApplier* applier);
@@ -1,4 +1,5 @@
 #include "provisioning.h"
+#include "devicekey.h"
 #include "log.h"
 #include "sleep.h"
 #include "wifi.h"
@@ -6,6 +7,7 @@
 #include <esp_err.h>
 #include <esp_system.h>
 #include <esp_wifi.h>
+#include <stdlib.h>
 #include <string.h>
 #include <wifi_provisioning/manager.h>
 #include <wifi_provisioning/scheme_ble.h>
@@ -28,6 +30,9 @@ const char* PROVISIONING_ERROR_REASON_UNKNOWN = "Unknown reason";
 const uint8_t SERVICE_UUID[] = {0xea, 0x06, 0x88, 0x7b, 0xd1, 0x3a, 0xf7, 0x4f,
                                 0x82, 0xa7, 0x79, 0xb7, 0x47, 0x4d, 0x39, 0x38};
 
+// Custom endpoint through which the app sends the device key
+static const char* DEVICE_KEY_ENDPOINT = "device-key";
+
 // From ESP32 provisioning manager example code
 static void getDeviceServiceName(char* serviceName, size_t max) {
     uint8_t eth_mac[6];
@@ -92,6 +97,28 @@ void provisioningEventHandler(
     }
 }
 
+static esp_err_t deviceKeyEndpointHandler(
+    uint32_t sessionId,
+    const uint8_t* input,
+    ssize_t inputLength,
+    uint8_t** output,
+    ssize_t* outputLength,
+    void* userData) {
+    esp_err_t error = setDeviceKey(input, inputLength > 0 ? inputLength : 0);
+    LOGD(TAG, "Received device key (%d)", error);
+
+    const char* response = error == ESP_OK ? "ok" : "error";
+    // Freed by the provisioning manager
+    *output = (uint8_t*)strdup(response);
+
+    if (!*output) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    *outputLength = strlen(response) + 1;
+    return ESP_OK;
+}
+
 void initProvisioning(void) {
     wifi_prov_mgr_config_t config = {
         .scheme = wifi_prov_scheme_ble,
@@ -139,12 +166,24 @@ ProvisioningResult startProvisioning(void) {
         generateCode(proofOfPossession, sizeof(proofOfPossession));
         LOGI(TAG, "Proof of possession: %s", proofOfPossession);
 
+        if ((error = wifi_prov_mgr_endpoint_create(DEVICE_KEY_ENDPOINT)) !=
+            ESP_OK) {
+            break;
+        }
+
         LOGD(TAG, "Starting provisioning");
         if ((error = wifi_prov_mgr_start_provisioning(
                  WIFI_PROV_SECURITY_1, proofOfPossession, serviceName, NULL)) !=
             ESP_OK) {
             break;
         }
+
+        // Only possible once provisioning has started
+        if ((error = wifi_prov_mgr_endpoint_register(
+                 DEVICE_KEY_ENDPOINT, deviceKeyEndpointHandler, NULL)) !=
+            ESP_OK) {
+            break;
+        }
         LOGD(TAG, "Waiting for provisioning to complete");
         wifi_prov_mgr_wait();
 
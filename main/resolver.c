@@ -0,0 +1,158 @@
+#include "resolver.h"
+#include "clock.h"
+#include "log.h"
+#include "wifi.h"
+
+#include <esp_attr.h>
+#include <freertos/FreeRTOS.h>
+#include <lwip/netdb.h>
+#include <stdbool.h>
+#include <string.h>
+
+#define LOG_TAG "resolver"
+#define RESOLVER_CACHE_SIZE 2
+#define RESOLVER_HOST_MAX_LENGTH 64
+
+// getaddrinfo() doesn't tell the TTL of the record, so this takes its place
+static const uint64_t RESOLVER_TTL_IN_US = 60 * 60 * 1000000ULL;
+
+typedef struct {
+    char host[RESOLVER_HOST_MAX_LENGTH];
+    // Network byte order
+    uint32_t address;
+    uint64_t expiryTime;
+    // Network the address was resolved in
+    uint8_t bssid[6];
+    uint32_t subnet;
+} ResolverEntry;
+
+static RTC_DATA_ATTR ResolverEntry resolverCache[RESOLVER_CACHE_SIZE];
+static RTC_DATA_ATTR ResolverStats resolverStats;
+static portMUX_TYPE resolverLock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool
+isInNetwork(const ResolverEntry* entry, const WifiNetwork* network) {
+    return memcmp(entry->bssid, network->bssid, sizeof(entry->bssid)) == 0 &&
+           entry->subnet == (network->address & network->netmask);
+}
+
+static ResolverEntry* findEntryLocked(const char* host) {
+    for (size_t i = 0; i < RESOLVER_CACHE_SIZE; ++i) {
+        if (resolverCache[i].host[0] &&
+            strcmp(resolverCache[i].host, host) == 0) {
+            return &resolverCache[i];
+        }
+    }
+    return NULL;
+}
+
+static bool lookUpCache(
+    const char* host, const WifiNetwork* network, uint32_t* address) {
+    const uint64_t now = getClockTimeInUs();
+    bool hit = false;
+
+    portENTER_CRITICAL(&resolverLock);
+    ResolverEntry* entry = findEntryLocked(host);
+
+    if (entry && network && now < entry->expiryTime &&
+        isInNetwork(entry, network)) {
+        *address = entry->address;
+        hit = true;
+        ++resolverStats.hits;
+    } else {
+        if (entry) {
+            entry->host[0] = 0;
+        }
+        ++resolverStats.misses;
+    }
+
+    portEXIT_CRITICAL(&resolverLock);
+    return hit;
+}
+
+static void
+storeInCache(const char* host, const WifiNetwork* network, uint32_t address) {
+    if (strlen(host) >= RESOLVER_HOST_MAX_LENGTH) {
+        return;
+    }
+
+    const uint64_t now = getClockTimeInUs();
+    portENTER_CRITICAL(&resolverLock);
+
+    ResolverEntry* entry = findEntryLocked(host);
+
+    // Otherwise replaces an empty entry or the one that expires first
+    if (!entry) {
+        entry = &resolverCache[0];
+        for (size_t i = 1; i < RESOLVER_CACHE_SIZE && entry->host[0]; ++i) {
+            ResolverEntry* candidate = &resolverCache[i];
+            if (!candidate->host[0] ||
+                candidate->expiryTime < entry->expiryTime) {
+                entry = candidate;
+            }
+        }
+    }
+
+    strcpy(entry->host, host);
+    entry->address = address;
+    entry->expiryTime = now + RESOLVER_TTL_IN_US;
+    memcpy(entry->bssid, network->bssid, sizeof(entry->bssid));
+    entry->subnet = network->address & network->netmask;
+
+    portEXIT_CRITICAL(&resolverLock);
+}
+
+esp_err_t
+resolveHost(const char* host, uint16_t port, struct sockaddr_in* address) {
+    memset(address, 0, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_port = htons(port);
+
+    WifiNetwork network;
+    const bool connected = getWifiNetwork(&network) == ESP_OK;
+
+    if (lookUpCache(
+            host, connected ? &network : NULL, &address->sin_addr.s_addr)) {
+        return ESP_OK;
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+
+    struct addrinfo* addresses = NULL;
+    int ret = getaddrinfo(host, NULL, &hints, &addresses);
+
+    if (ret != 0 || !addresses) {
+        LOGE(LOG_TAG, "Unable to resolve %s (%d).", host, ret);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    address->sin_addr =
+        ((const struct sockaddr_in*)addresses->ai_addr)->sin_addr;
+    freeaddrinfo(addresses);
+
+    if (connected) {
+        storeInCache(host, &network, address->sin_addr.s_addr);
+    }
+
+    LOGD(
+        LOG_TAG, "Resolved %s (cache hits: %u, misses: %u)", host,
+        resolverStats.hits, resolverStats.misses);
+    return ESP_OK;
+}
+
+void invalidateResolvedHost(const char* host) {
+    portENTER_CRITICAL(&resolverLock);
+    ResolverEntry* entry = findEntryLocked(host);
+    if (entry) {
+        entry->host[0] = 0;
+    }
+    portEXIT_CRITICAL(&resolverLock);
+}
+
+void getResolverStats(ResolverStats* stats) {
+    portENTER_CRITICAL(&resolverLock);
+    *stats = resolverStats;
+    portEXIT_CRITICAL(&resolverLock);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <esp_err.h>
+#include <lwip/sockets.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+} ResolverStats;
+
+// Resolves the IPv4 address of a host. Answers are kept in RTC memory for
+// the next wakes as long as the station stays in the same network, which
+// saves an mDNS query for .local hosts.
+esp_err_t
+resolveHost(const char* host, uint16_t port, struct sockaddr_in* address);
+// Forgets the address of a host, e.g. when it can't be reached
+void invalidateResolvedHost(const char* host);
+void getResolverStats(ResolverStats* stats);
@@ -0,0 +1,175 @@
+#include "ringdatagram.h"
+#include "devicekey.h"
+#include "log.h"
+#include "resolver.h"
+
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <lwip/sockets.h>
+#include <mbedtls/md.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#define LOG_TAG "ringdatagram"
+
+#define RING_DATAGRAM_MAGIC 0x474e5244
+#define RING_DATAGRAM_VERSION 1
+#define RING_DATAGRAM_MAC_SIZE 16
+
+typedef enum {
+    RING_DATAGRAM_TYPE_RING = 1,
+    RING_DATAGRAM_TYPE_ACK = 2
+} RingDatagramType;
+
+// Little-endian. Rings and acknowledgements have the same layout, and the
+// MAC is a truncated HMAC-SHA256 of everything before it.
+typedef struct {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t type;
+    uint16_t reserved;
+    // WiFi station MAC address, zero-padded
+    uint8_t deviceId[8];
+    uint32_t logId;
+    uint32_t sequence;
+    uint8_t mac[RING_DATAGRAM_MAC_SIZE];
+} RingDatagram;
+
+_Static_assert(sizeof(RingDatagram) == 40, "Datagram must not be padded");
+
+// Doubles after every retransmission
+static const uint32_t RING_DATAGRAM_FIRST_RETRY_IN_MS = 50;
+
+static void
+computeMac(const RingDatagram* datagram, const uint8_t* key, uint8_t* mac) {
+    uint8_t hmac[32];
+    mbedtls_md_hmac(
+        mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), key, DEVICE_KEY_SIZE,
+        (const unsigned char*)datagram, offsetof(RingDatagram, mac), hmac);
+    memcpy(mac, hmac, RING_DATAGRAM_MAC_SIZE);
+}
+
+static bool isAcknowledgement(
+    const RingDatagram* ack, const RingDatagram* ring, const uint8_t* key) {
+    if (ack->magic != RING_DATAGRAM_MAGIC ||
+        ack->version != RING_DATAGRAM_VERSION ||
+        ack->type != RING_DATAGRAM_TYPE_ACK ||
+        memcmp(ack->deviceId, ring->deviceId, sizeof(ack->deviceId)) != 0 ||
+        ack->logId != ring->logId || ack->sequence != ring->sequence) {
+        return false;
+    }
+
+    uint8_t mac[RING_DATAGRAM_MAC_SIZE];
+    computeMac(ack, key, mac);
+
+    // Constant time
+    uint8_t difference = 0;
+    for (size_t i = 0; i < sizeof(mac); ++i) {
+        difference |= mac[i] ^ ack->mac[i];
+    }
+    return difference == 0;
+}
+
+static int openSocket(const char* host, uint16_t port) {
+    struct sockaddr_in address;
+
+    if (resolveHost(host, port, &address) != ESP_OK) {
+        return -1;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+    // Only datagrams from the server are received after connecting
+    if (fd >= 0 &&
+        connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+
+    return fd;
+}
+
+// Returns true if an acknowledgement arrived before the deadline
+static bool waitForAcknowledgement(
+    int fd, const RingDatagram* ring, const uint8_t* key, int64_t deadline) {
+    int64_t now;
+
+    while ((now = esp_timer_get_time()) < deadline) {
+        const int64_t remaining = deadline - now;
+        struct timeval timeout = {
+            .tv_sec = remaining / 1000000, .tv_usec = remaining % 1000000};
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(fd, &readSet);
+
+        if (select(fd + 1, &readSet, NULL, NULL, &timeout) <= 0) {
+            return false;
+        }
+
+        RingDatagram ack;
+
+        if (recv(fd, &ack, sizeof(ack), 0) == sizeof(ack) &&
+            isAcknowledgement(&ack, ring, key)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+esp_err_t sendRingDatagram(
+    const char* host,
+    uint16_t port,
+    uint32_t logId,
+    uint32_t sequence,
+    uint32_t timeoutInMs) {
+
+    uint8_t key[DEVICE_KEY_SIZE];
+
+    if (getDeviceKey(key) != ESP_OK) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    RingDatagram ring;
+    memset(&ring, 0, sizeof(ring));
+    ring.magic = RING_DATAGRAM_MAGIC;
+    ring.version = RING_DATAGRAM_VERSION;
+    ring.type = RING_DATAGRAM_TYPE_RING;
+    esp_read_mac(ring.deviceId, ESP_MAC_WIFI_STA);
+    ring.logId = logId;
+    ring.sequence = sequence;
+    computeMac(&ring, key, ring.mac);
+
+    const int64_t startTime = esp_timer_get_time();
+    const int64_t deadline = startTime + (int64_t)timeoutInMs * 1000;
+    int fd = openSocket(host, port);
+    esp_err_t error = fd >= 0 ? ESP_ERR_TIMEOUT : ESP_FAIL;
+    uint32_t retryInMs = RING_DATAGRAM_FIRST_RETRY_IN_MS;
+
+    while (fd >= 0 && esp_timer_get_time() < deadline) {
+        if (send(fd, &ring, sizeof(ring), 0) != sizeof(ring)) {
+            LOGW(LOG_TAG, "Unable to send ring datagram (%d).", errno);
+        }
+
+        int64_t retryTime = esp_timer_get_time() + (int64_t)retryInMs * 1000;
+        retryInMs *= 2;
+
+        if (waitForAcknowledgement(
+                fd, &ring, key,
+                retryTime < deadline ? retryTime : deadline)) {
+            LOGD(
+                LOG_TAG, "Ring acknowledged after %lld ms.",
+                (esp_timer_get_time() - startTime) / 1000);
+            error = ESP_OK;
+            break;
+        }
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    memset(key, 0, sizeof(key));
+    return error;
+}
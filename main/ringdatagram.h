@@ -0,0 +1,16 @@
+#pragma once
+
+#include <esp_err.h>
+#include <stdint.h>
+
+// Sends a ring identified by (logId, sequence) as one UDP datagram signed
+// with the device key, and sends it again until the server acknowledges it
+// or timeoutInMs passes. See scripts/ringreceiver.py for the format.
+// Returns ESP_ERR_TIMEOUT without acknowledgement and ESP_ERR_NOT_FOUND
+// without a device key.
+esp_err_t sendRingDatagram(
+    const char* host,
+    uint16_t port,
+    uint32_t logId,
+    uint32_t sequence,
+    uint32_t timeoutInMs);
@@ -0,0 +1,118 @@
+#include "schedule.h"
+#include "clock.h"
+#include "log.h"
+
+#include <esp_attr.h>
+
+#define LOG_TAG "schedule"
+
+static const uint32_t DEFAULT_HEARTBEAT_INTERVAL_IN_S = 60 * 60;
+static const uint32_t MIN_HEARTBEAT_INTERVAL_IN_S = 15 * 60;
+static const uint32_t MAX_HEARTBEAT_INTERVAL_IN_S = 24 * 60 * 60;
+// Ring wakes report device health too, so busy doorbells need fewer
+// heartbeats
+static const uint32_t BUSY_RINGS_PER_DAY = 10;
+static const uint64_t MIN_SLEEP_IN_US = 1000 * 1000;
+static const uint64_t DAY_IN_US = 24ULL * 60 * 60 * 1000 * 1000;
+
+// Doubling per battery level saves most where it matters
+static const uint32_t BATTERY_LEVEL_INTERVAL_FACTORS[] = {1, 2, 4, 8};
+
+typedef struct {
+    uint64_t nextHeartbeatTimeInUs;
+    uint32_t intervalInS;
+    uint64_t ringWindowStartInUs;
+    uint32_t ringWindowCount;
+    uint32_t previousRingWindowCount;
+} HeartbeatSchedule;
+
+static RTC_DATA_ATTR HeartbeatSchedule heartbeatSchedule = {0};
+
+uint32_t getHeartbeatIntervalInS(const HeartbeatScheduleInput* input) {
+    uint32_t interval = input->serverIntervalInS;
+
+    // The server sees the battery level too, so its interval is used as is
+    if (interval == 0) {
+        const unsigned int factorCount =
+            sizeof(BATTERY_LEVEL_INTERVAL_FACTORS) /
+            sizeof(BATTERY_LEVEL_INTERVAL_FACTORS[0]);
+        const uint32_t factor =
+            input->batteryLevel < factorCount
+                ? BATTERY_LEVEL_INTERVAL_FACTORS[input->batteryLevel]
+                : BATTERY_LEVEL_INTERVAL_FACTORS[factorCount - 1];
+
+        interval = DEFAULT_HEARTBEAT_INTERVAL_IN_S * factor;
+
+        if (input->ringsPerDay >= BUSY_RINGS_PER_DAY) {
+            interval *= 2;
+        }
+    }
+
+    if (interval < MIN_HEARTBEAT_INTERVAL_IN_S) {
+        return MIN_HEARTBEAT_INTERVAL_IN_S;
+    }
+
+    if (interval > MAX_HEARTBEAT_INTERVAL_IN_S) {
+        return MAX_HEARTBEAT_INTERVAL_IN_S;
+    }
+
+    return interval;
+}
+
+static void updateRingWindow(uint64_t now) {
+    HeartbeatSchedule* schedule = &heartbeatSchedule;
+    const uint64_t elapsed = now - schedule->ringWindowStartInUs;
+
+    if (now < schedule->ringWindowStartInUs || elapsed >= DAY_IN_US) {
+        // A window that ended long ago says nothing about the last day
+        schedule->previousRingWindowCount =
+            elapsed < 2 * DAY_IN_US ? schedule->ringWindowCount : 0;
+        schedule->ringWindowStartInUs = now;
+        schedule->ringWindowCount = 0;
+    }
+}
+
+void recordRingActivity(void) {
+    updateRingWindow(getClockTimeInUs());
+    ++heartbeatSchedule.ringWindowCount;
+}
+
+void scheduleNextHeartbeat(uint32_t serverIntervalInS) {
+    HeartbeatSchedule* schedule = &heartbeatSchedule;
+    const uint64_t now = getClockTimeInUs();
+    updateRingWindow(now);
+
+    BatteryInfo batteryInfo;
+    getBatteryInfo(&batteryInfo);
+
+    const uint32_t ringsPerDay =
+        schedule->ringWindowCount > schedule->previousRingWindowCount
+            ? schedule->ringWindowCount
+            : schedule->previousRingWindowCount;
+
+    HeartbeatScheduleInput input = {
+        .batteryLevel = batteryInfo.level,
+        .ringsPerDay = ringsPerDay,
+        .serverIntervalInS = serverIntervalInS};
+
+    schedule->intervalInS = getHeartbeatIntervalInS(&input);
+    schedule->nextHeartbeatTimeInUs =
+        now + schedule->intervalInS * 1000000ULL;
+
+    LOGD(LOG_TAG, "Next heartbeat in %u s.", schedule->intervalInS);
+}
+
+uint64_t getTimeUntilNextHeartbeatInUs(void) {
+    const HeartbeatSchedule* schedule = &heartbeatSchedule;
+    const uint64_t now = getClockTimeInUs();
+
+    if (schedule->nextHeartbeatTimeInUs == 0) {
+        return DEFAULT_HEARTBEAT_INTERVAL_IN_S * 1000000ULL;
+    }
+
+    if (schedule->nextHeartbeatTimeInUs < now + MIN_SLEEP_IN_US) {
+        return MIN_SLEEP_IN_US;
+    }
+
+    return schedule->nextHeartbeatTimeInUs - now;
+}
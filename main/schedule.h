@@ -0,0 +1,20 @@
+#pragma once
+
+#include "battery.h"
+
+#include <stdint.h>
+
+typedef struct {
+    BatteryLevel batteryLevel;
+    uint32_t ringsPerDay;
+    // Requested by the server, 0 if none
+    uint32_t serverIntervalInS;
+} HeartbeatScheduleInput;
+
+// Pure scheduling policy, clamped to safe bounds
+uint32_t getHeartbeatIntervalInS(const HeartbeatScheduleInput* input);
+
+void recordRingActivity(void);
+// Called after device health has been reported
+void scheduleNextHeartbeat(uint32_t serverIntervalInS);
+uint64_t getTimeUntilNextHeartbeatInUs(void);
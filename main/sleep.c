@@ -1,15 +1,45 @@
 #include "sleep.h"
+#include "energy.h"
 #include "log.h"
+#include "pin.h"
+#include "standbymodel.h"
+#include "trace.h"
+#include "ulp_main.h"
 
+#include <driver/adc.h>
 #include <driver/rtc_io.h>
 #include <driver/uart.h>
+#include <esp32/pm.h>
+#include <esp32/ulp.h>
+#include <esp_attr.h>
+#include <esp_pm.h>
 #include <esp_sleep.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <soc/rtc_cntl_reg.h>
+#include <soc/soc.h>
 
 #define LOG_TAG "sleep"
 #define MAX_WAKEUP_INTERVAL_IN_US 1 * 60 * 60 * 1000000LL
 
+extern const uint8_t ulpStandbyStart[] asm("_binary_ulp_main_bin_start");
+extern const uint8_t ulpStandbyEnd[] asm("_binary_ulp_main_bin_end");
+
+static const uint32_t STANDBY_ULP_PERIOD_IN_US = 20 * 1000;
+static const StandbyConfig STANDBY_CONFIG = {
+    // 20-40 ms
+    .debounceSamples = 2,
+    // Once a minute
+    .batteryInterval = 3000};
+
+// Set from entering standby until the next boot, which may also follow a
+// reset rather than a wakeup
+static RTC_DATA_ATTR bool standbyEntered = false;
+// Set while the ULP variables belong to a standby that was woken from
+static bool standbyWokenFrom = false;
+
+static uint64_t sleepWakeupPinMask = 0;
+
 void delayMs(uint32_t time) { vTaskDelay(time / portTICK_PERIOD_MS); }
 void yield() { vTaskDelay(1); }
 
@@ -23,9 +53,62 @@ void initSleep(uint64_t wakeupPinMask) {
     ESP_ERROR_CHECK(esp_sleep_enable_timer_wakeup(MAX_WAKEUP_INTERVAL_IN_US));
     ESP_ERROR_CHECK(
         esp_sleep_enable_ext1_wakeup(wakeupPinMask, ESP_EXT1_WAKEUP_ANY_HIGH));
+    sleepWakeupPinMask = wakeupPinMask;
+
+    // Lets the idle task light sleep while waiting, e.g. between button
+    // presses. Drivers that can't sleep hold a lock, like WiFi does while
+    // connected.
+    esp_pm_config_esp32_t pmConfig = {
+        .max_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ,
+        .light_sleep_enable = true};
+    ESP_ERROR_CHECK(esp_pm_configure(&pmConfig));
+}
+
+void endStandby(void) {
+    standbyWokenFrom = standbyEntered;
+    standbyEntered = false;
+
+    // The ULP only stops itself when it wakes the chip, and otherwise would
+    // keep using the ADC
+    if (esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_ULP) {
+        CLEAR_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN);
+    }
+}
+
+void setGpioWakeupEnabled(bool enabled) {
+    // ext1 wakes on a level, so it would keep waking the chip while a wakeup
+    // pin is held. GPIO wakeup follows the levels set with
+    // gpio_wakeup_enable() instead.
+    if (enabled) {
+        ESP_ERROR_CHECK(esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_EXT1));
+        ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+    } else {
+        ESP_ERROR_CHECK(esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_GPIO));
+        ESP_ERROR_CHECK(esp_sleep_enable_ext1_wakeup(
+            sleepWakeupPinMask, ESP_EXT1_WAKEUP_ANY_HIGH));
+    }
+}
+
+void setTimerWakeup(uint64_t timeInUs) {
+    ESP_ERROR_CHECK(esp_sleep_enable_timer_wakeup(timeInUs));
+}
+
+static StandbyWakeReason getStandbyWakeReason(void) {
+    if (!standbyWokenFrom ||
+        esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_ULP) {
+        return STANDBY_WAKE_NONE;
+    }
+    // Only the lower half of ULP memory words is written by the ULP
+    return ulp_wake_reason & UINT16_MAX;
 }
 
 bool wakeTriggeredByPin(uint8_t pin) {
+    if (pin == RING_BUTTON_PIN &&
+        getStandbyWakeReason() == STANDBY_WAKE_RING) {
+        return true;
+    }
+
     // FIXME: Sometimes esp_sleep_get_ext1_wakeup_status() returns 0 even when
     // the wakeup cause was ESP_SLEEP_WAKEUP_EXT1 which causes this function to
     // incorrectly return false.
@@ -38,11 +121,92 @@ bool wakeTriggeredByPin(uint8_t pin) {
 
 void lightSleepNow(void) {
     LOGD(LOG_TAG, "Entering light sleep");
+    standbyWokenFrom = false;
+    traceInstant(TRACE_EVENT_SLEEP);
     // Flush UART TX FIFO before entering light sleep
     uart_wait_tx_idle_polling(CONFIG_ESP_CONSOLE_UART_NUM);
+    energyEnd(ENERGY_CONSUMER_CPU);
+    energyBegin(ENERGY_CONSUMER_LIGHT_SLEEP);
     ESP_ERROR_CHECK(esp_light_sleep_start());
+    energyEnd(ENERGY_CONSUMER_LIGHT_SLEEP);
+    energyBegin(ENERGY_CONSUMER_CPU);
+}
+bool takeStandbyBatteryReading(uint32_t* reading) {
+    if (!standbyWokenFrom) {
+        return false;
+    }
+
+    const StandbyState state = {
+        .batteryReading = ulp_battery_reading & UINT16_MAX,
+        .batterySampleCount = ulp_battery_sample_count & UINT16_MAX};
+    return StandbyModel_getBatteryReading(&state, reading);
+}
+
+static esp_err_t startStandbyProgram(void) {
+    esp_err_t error = ulp_load_binary(
+        0, ulpStandbyStart,
+        (ulpStandbyEnd - ulpStandbyStart) / sizeof(uint32_t));
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    StandbyState state;
+    StandbyModel_init(&state);
+    ulp_debounce_samples = STANDBY_CONFIG.debounceSamples;
+    ulp_battery_interval = STANDBY_CONFIG.batteryInterval;
+    ulp_button_armed = state.buttonArmed;
+    ulp_button_count = state.buttonCount;
+    ulp_battery_ticks = state.batteryTicks;
+    ulp_battery_reading = state.batteryReading;
+    ulp_battery_sample_count = state.batterySampleCount;
+    ulp_wake_reason = state.wakeReason;
+
+    // The ULP reads the pin and ADC through the RTC domain
+    ESP_ERROR_CHECK(rtc_gpio_init(RING_BUTTON_PIN));
+    ESP_ERROR_CHECK(
+        rtc_gpio_set_direction(RING_BUTTON_PIN, RTC_GPIO_MODE_INPUT_ONLY));
+    adc1_ulp_enable();
+
+    error = ulp_set_wakeup_period(0, STANDBY_ULP_PERIOD_IN_US);
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    return ulp_run(&ulp_entry - RTC_SLOW_MEM);
+}
+
+esp_err_t standbyNow(void) {
+    esp_err_t error = startStandbyProgram();
+
+    if (error != ESP_OK) {
+        LOGE(LOG_TAG, "Unable to start the standby program.");
+        return error;
+    }
+
+    LOGD(LOG_TAG, "Entering standby");
+    traceInstant(TRACE_EVENT_SLEEP);
+
+    // The button is debounced by the ULP instead, and the timer set for the
+    // next heartbeat stays
+    ESP_ERROR_CHECK(esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_EXT1));
+    ESP_ERROR_CHECK(esp_sleep_enable_ulp_wakeup());
+    // The RTC peripherals must stay powered for the ULP to read them
+    ESP_ERROR_CHECK(
+        esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON));
+
+    standbyEntered = true;
+    uart_wait_tx_idle_polling(CONFIG_ESP_CONSOLE_UART_NUM);
+    // Closed by initEnergy() after waking up
+    energyEnd(ENERGY_CONSUMER_CPU);
+    energyBegin(ENERGY_CONSUMER_STANDBY);
+    esp_deep_sleep_start();
+    return ESP_OK;
 }
+
 void deepSleepNow(void) {
     LOGD(LOG_TAG, "Entering deep sleep");
+    traceInstant(TRACE_EVENT_SLEEP);
     esp_deep_sleep_start();
 }
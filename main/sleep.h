@@ -1,11 +1,24 @@
 #pragma once
 
+#include <esp_err.h>
 #include <stdbool.h>
 #include <stdint.h>
 
 void delayMs(uint32_t time);
 void yield();
 void initSleep(uint64_t wakeupPinMask);
+// Takes over from the ULP after waking up, and must be called before the
+// ADC is used
+void endStandby(void);
+// Overrides the default wakeup interval for the following sleeps
+void setTimerWakeup(uint64_t timeInUs);
+// Replaces wakeup by the pins given to initSleep() with GPIO wakeup
+void setGpioWakeupEnabled(bool enabled);
 bool wakeTriggeredByPin(uint8_t pin);
+// Takes the battery reading made by the ULP during the last standby
+bool takeStandbyBatteryReading(uint32_t* reading);
 void lightSleepNow(void);
+// Deep sleeps while the ULP watches the ring button. Wakes up like a reset,
+// so only RTC memory survives. Returns if standby can't be entered.
+esp_err_t standbyNow(void);
 void deepSleepNow(void);
@@ -0,0 +1,66 @@
+#include "standbymodel.h"
+
+void StandbyModel_init(StandbyState* state) {
+    state->buttonArmed = 0;
+    state->buttonCount = 0;
+    state->batteryTicks = 0;
+    state->batteryReading = 0;
+    state->batterySampleCount = 0;
+    state->wakeReason = STANDBY_WAKE_NONE;
+}
+
+static void sampleBattery(StandbyState* state, uint16_t sample) {
+    const uint16_t scaled = sample << STANDBY_BATTERY_READING_SHIFT;
+
+    if (state->batterySampleCount == 0) {
+        state->batteryReading = scaled;
+    } else {
+        // Moving average with a weight of 1/8 for the new sample
+        state->batteryReading = state->batteryReading -
+                                (state->batteryReading >> 3) + (scaled >> 3);
+    }
+
+    ++state->batterySampleCount;
+}
+
+bool StandbyModel_step(
+    StandbyState* state,
+    const StandbyConfig* config,
+    bool buttonPressed,
+    uint16_t batterySample) {
+    if (config->batteryInterval > 0 &&
+        ++state->batteryTicks == config->batteryInterval) {
+        state->batteryTicks = 0;
+        sampleBattery(state, batterySample);
+    }
+
+    if (!buttonPressed) {
+        state->buttonArmed = 1;
+        state->buttonCount = 0;
+        return false;
+    }
+
+    if (!state->buttonArmed) {
+        return false;
+    }
+
+    if (++state->buttonCount < config->debounceSamples) {
+        return false;
+    }
+
+    state->buttonArmed = 0;
+    state->buttonCount = 0;
+    state->wakeReason = STANDBY_WAKE_RING;
+    return true;
+}
+
+bool StandbyModel_getBatteryReading(
+    const StandbyState* state, uint32_t* reading) {
+    if (state->batterySampleCount == 0) {
+        return false;
+    }
+
+    const uint32_t half = 1 << (STANDBY_BATTERY_READING_SHIFT - 1);
+    *reading = (state->batteryReading + half) >> STANDBY_BATTERY_READING_SHIFT;
+    return true;
+}
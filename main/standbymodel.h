@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Battery readings are kept in 1/8 ADC steps
+#define STANDBY_BATTERY_READING_SHIFT 3
+
+typedef enum { STANDBY_WAKE_NONE, STANDBY_WAKE_RING } StandbyWakeReason;
+
+typedef struct {
+    // Consecutive pressed samples that make a ring
+    uint16_t debounceSamples;
+    // Runs between battery samples, 0 to not sample
+    uint16_t batteryInterval;
+} StandbyConfig;
+
+// The ULP only has 16-bit registers
+typedef struct {
+    // Set once the button has been seen released, so that a press that
+    // started before standby doesn't ring
+    uint16_t buttonArmed;
+    uint16_t buttonCount;
+    uint16_t batteryTicks;
+    uint16_t batteryReading;
+    uint16_t batterySampleCount;
+    uint16_t wakeReason;
+} StandbyState;
+
+// Mirrors one run of the ULP program in ulp/standby.S, which only exists in
+// assembly on the device. Keep the two in sync.
+void StandbyModel_init(StandbyState* state);
+// Returns true if the main CPU should be woken. The battery sample is only
+// used when one is due.
+bool StandbyModel_step(
+    StandbyState* state,
+    const StandbyConfig* config,
+    bool buttonPressed,
+    uint16_t batterySample);
+// Returns false if no battery sample has been taken
+bool StandbyModel_getBatteryReading(
+    const StandbyState* state, uint32_t* reading);
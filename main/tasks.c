@@ -1,16 +1,26 @@
 #include "tasks.h"
 #include "battery.h"
+#include "button.h"
+#include "buzzer.h"
+#include "clock.h"
+#include "energy.h"
+#include "eventlog.h"
 #include "firmware.h"
+#include "gesture.h"
+#include "jobs.h"
 #include "log.h"
-#include "pin.h"
-#include "sleep.h"
+#include "resolver.h"
+#include "schedule.h"
+#include "tlsheap.h"
+#include "trace.h"
 #include "wifi.h"
 
-#include <driver/dac.h>
+#include <esp_attr.h>
 #include <esp_event.h>
+#include <esp_system.h>
 #include <esp_task.h>
 #include <esp_timer.h>
-#include <freertos/event_groups.h>
+#include <stdio.h>
 
 #define LOG_TAG "tasks"
 
@@ -18,205 +28,462 @@
 #define TASK_PRIORITY_MEDIUM 20
 #define TASK_PRIORITY_LOW 10
 
-#define RING_SOUND_COMPLETED_BIT BIT0
-#define RING_API_CALL_COMPLETED_BIT BIT1
-#define HEARTBEAT_COMPLETED_BIT BIT0
+#define RING_UPLOAD_BATCH_SIZE API_MAX_RING_COUNT
+
+static const Tone RING_CHIME[] = {
+    {.frequency = 2500,
+     .durationInMs = 500,
+     .attackInMs = 15,
+     .releaseInMs = 30},
+    {.frequency = 2000,
+     .durationInMs = 1000,
+     .attackInMs = 15,
+     .releaseInMs = 300}};
+
+static const Tone CONFIRMATION_BEEP[] = {
+    {.frequency = 2500, .durationInMs = 50}};
+
+static const Tone DOUBLE_CONFIRMATION_BEEP[] = {
+    {.frequency = 2500, .durationInMs = 50},
+    {.frequency = 0, .durationInMs = 100},
+    {.frequency = 2500, .durationInMs = 50},
+    {.frequency = 0, .durationInMs = 100}};
+
+static const GestureConfig BUTTON_GESTURE_CONFIG = {
+    .ringCoalescingMs = 3000,
+    // Followed by presses to run a heartbeat on demand
+    .longPressMs = 5000,
+    .seriesPressCount = 5,
+    .seriesWindowMs = 5000};
 
 typedef struct {
-    EventGroupHandle_t group;
-    int bit;
-    ApiClientContext* apiClientContext;
-} RingTaskParam;
-
-typedef struct {
-    EventGroupHandle_t group;
-    int bit;
     ApiClientContext* apiClientContext;
     bool applyFirmwareUpdate;
     bool restartAfterFirmwareUpdate;
-} HeartbeatTaskParam;
-
-void buzz(
-    adc_channel_t channel,
-    uint32_t frequency,
-    int8_t offset,
-    uint32_t durationInMs) {
-
-    dac_cw_config_t cwConfig = {
-        .en_ch = channel,
-        .scale = DAC_CW_SCALE_1,
-        .phase = DAC_CW_PHASE_0,
-        .freq = frequency,
-        .offset = offset};
-
-    ESP_ERROR_CHECK(dac_cw_generator_config(&cwConfig));
-    ESP_ERROR_CHECK(dac_output_enable(channel));
-    delayMs(durationInMs);
-    ESP_ERROR_CHECK(dac_output_disable(channel));
-}
+    // Of an update to apply once the report is through, empty if none
+    char updateVersion[FIRMWARE_VERSION_MAX_LENGTH];
+    char updateUrl[384];
+    char updatePatchUrl[384];
+} HeartbeatJobParam;
+
+typedef struct {
+    DeviceHealth health;
+    char firmwareVersion[FIRMWARE_VERSION_MAX_LENGTH];
+    char trace[512];
+    uint32_t traceCursor;
+} HealthReport;
+
+typedef struct {
+    uint32_t count;
+    esp_err_t lastError;
+} RingUploadFailures;
 
-void ringSoundTask(RingTaskParam* parameter) {
-    buzz(BUZZER_DAC_CNANNEL, 2500, 63, 500);
-    buzz(BUZZER_DAC_CNANNEL, 2000, 63, 1000);
+static EventLog* ringEventLog = NULL;
 
-    // TODO: report error
+// Reported with device health, as there is no other way to tell the server
+static RTC_DATA_ATTR RingUploadFailures ringUploadFailures = {0};
 
-    xEventGroupSetBits(parameter->group, parameter->bit);
-    vTaskDelete(NULL);
+// Identifies the RTC clock that ring times are taken from. RTC data is
+// reinitialized on every boot except when waking from deep sleep, which is
+// also when the clock keeps counting.
+static RTC_DATA_ATTR uint32_t ringClockId = 0;
+
+static uint32_t getRingClockId(void) {
+    if (ringClockId == 0) {
+        ringClockId = esp_random() | 1;
+    }
+    return ringClockId;
 }
 
-void ringApiCallTask(RingTaskParam* parameter) {
-    ApiClient_ring(parameter->apiClientContext);
-    // TODO: report error
-    xEventGroupSetBits(parameter->group, parameter->bit);
-    vTaskDelete(NULL);
+void setRingEventLog(EventLog* eventLog) { ringEventLog = eventLog; }
+
+static void collectHealthReport(HealthReport* report) {
+    BatteryInfo batteryInfo;
+    getBatteryInfo(&batteryInfo);
+
+    getFirmwareVersion(
+        report->firmwareVersion, sizeof(report->firmwareVersion));
+
+    uint32_t traceDropped = 0;
+    report->traceCursor =
+        encodeTrace(report->trace, sizeof(report->trace), &traceDropped);
+
+    WifiFastConnectStats wifiStats;
+    getWifiFastConnectStats(&wifiStats);
+
+    ResolverStats resolverStats;
+    getResolverStats(&resolverStats);
+
+    TlsHeapStats tlsHeapStats;
+    getTlsHeapStats(&tlsHeapStats);
+
+    JobStats jobStats;
+    getJobStats(&jobStats);
+
+    EnergyInfo energyInfo;
+    getEnergyInfo(&energyInfo);
+    const uint32_t* charge = energyInfo.chargeInUAh;
+
+    DeviceHealth health = {
+        .battery =
+            {.level = getBatteryLevelString(batteryInfo.level),
+             .voltage = batteryInfo.voltage,
+             .charge = batteryInfo.charge,
+             .dischargeRate = batteryInfo.dischargeRate,
+             .remainingHours = batteryInfo.remainingHours},
+        .firmware = {.version = report->firmwareVersion},
+        .wifi =
+            {.fastConnectAttempts = wifiStats.attempts,
+             .fastConnectSuccesses = wifiStats.successes},
+        .dns =
+            {.cacheHits = resolverStats.hits,
+             .cacheMisses = resolverStats.misses},
+        .tls =
+            {.connectionHeapPeak = tlsHeapStats.connectionPeak,
+             .heapPeak = tlsHeapStats.totalPeak,
+             .untrackedConnections = tlsHeapStats.untrackedConnections},
+        .jobs =
+            {.count = jobStats.count,
+             .meanLatencyInUs = jobStats.meanLatencyInUs,
+             .maxLatencyInUs = jobStats.maxLatencyInUs,
+             .maxQueueDepth = jobStats.maxQueueDepth},
+        .rings =
+            {.uploadFailures = ringUploadFailures.count,
+             .lastUploadError = ringUploadFailures.lastError},
+        .trace = {.data = report->trace, .dropped = traceDropped},
+        .energy = {
+            .cpu = charge[ENERGY_CONSUMER_CPU],
+            .wifi = charge[ENERGY_CONSUMER_WIFI],
+            .buzzer = charge[ENERGY_CONSUMER_BUZZER],
+            .lightSleep = charge[ENERGY_CONSUMER_LIGHT_SLEEP],
+            .standby = charge[ENERGY_CONSUMER_STANDBY]}};
+
+    report->health = health;
 }
 
-void firmwareUpdateAvailableCallback(
-    const char* updateVersion, const char* updatePath, void* userData) {
+// Sends the ring of this wake, queued rings and device health in as few
+// requests as possible. Rings are only removed from the queue once sent.
+static esp_err_t sendWakeReport(
+    ApiClientContext* apiClientContext,
+    bool ringWake,
+    const HealthReport* healthReport,
+    FirmwareUpdateAvailableCallback firmwareUpdateAvailableCallback,
+    void* userData) {
+
+    LoggedEvent events[RING_UPLOAD_BATCH_SIZE];
+    RingEvent rings[RING_UPLOAD_BATCH_SIZE];
+    const uint64_t now = getClockTimeInUs();
+    const DeviceHealth* health = healthReport ? &healthReport->health : NULL;
+    size_t unloggedRingCount = 0;
+    size_t loggedRingCount = 0;
+    // Logged rings asked for in the current batch. Once fewer are read, the
+    // log has been drained.
+    size_t maxCount = 0;
+
+    if (ringWake) {
+        recordRingActivity();
+    }
 
-    const HeartbeatTaskParam* taskParam = (HeartbeatTaskParam*)userData;
-    char updateUrl[384] = {0};
+    LoggedEvent ringEvent;
+
+    // Queue the ring first so that it isn't lost if the upload fails
+    if (ringWake &&
+        (!ringEventLog ||
+         EventLog_append(
+             ringEventLog, EVENT_TYPE_RING, getRingClockId(), now,
+             &ringEvent) != ESP_OK)) {
+        // Sent only once and not deduplicated by the server
+        rings[0] = (RingEvent){.logId = 0, .sequence = 0, .ageInMs = 0};
+        unloggedRingCount = 1;
+    } else if (ringWake) {
+        RingEvent ring = {
+            .logId = ringEventLog->logId,
+            .sequence = ringEvent.sequence,
+            .ageInMs = 0};
+
+        // Once acknowledged, HTTPS only carries everything else
+        if (ApiClient_sendRingDatagram(apiClientContext, &ring) == ESP_OK) {
+            EventLog_acknowledge(ringEventLog, &ringEvent, 1);
+        }
+    }
 
-    esp_err_t error = ApiClient_url(
-        taskParam->apiClientContext, updatePath, updateUrl, sizeof(updateUrl));
+    do {
+        maxCount = RING_UPLOAD_BATCH_SIZE - unloggedRingCount;
+        loggedRingCount = 0;
 
-    if (error != ESP_OK) {
-        return;
+        if (ringEventLog) {
+            esp_err_t error = EventLog_peek(
+                ringEventLog, events, maxCount, &loggedRingCount);
+
+            if (error != ESP_OK) {
+                return error;
+            }
+        }
+
+        if (unloggedRingCount + loggedRingCount == 0 && !health) {
+            break;
+        }
+
+        for (size_t i = 0; i < loggedRingCount; ++i) {
+            RingEvent* ring = &rings[unloggedRingCount + i];
+            ring->logId = ringEventLog->logId;
+            ring->sequence = events[i].sequence;
+            ring->ageInMs =
+                events[i].clockId == getRingClockId() && events[i].time <= now
+                    ? (now - events[i].time) / 1000
+                    : -1;
+        }
+
+        WakeReport report = {
+            .rings = rings,
+            .ringCount = unloggedRingCount + loggedRingCount,
+            .health = health};
+
+        esp_err_t error = ApiClient_report(
+            apiClientContext, &report, firmwareUpdateAvailableCallback,
+            userData);
+
+        if (error != ESP_OK) {
+            return error;
+        }
+
+        confirmWifiFastConnect();
+
+        if (loggedRingCount > 0 &&
+            (error = EventLog_acknowledge(
+                 ringEventLog, events, loggedRingCount)) != ESP_OK) {
+            return error;
+        }
+
+        if (health) {
+            commitTraceUpload(healthReport->traceCursor);
+            scheduleNextHeartbeat(apiClientContext->heartbeatIntervalHint);
+        }
+
+        // Only the first request carries these
+        health = NULL;
+        firmwareUpdateAvailableCallback = NULL;
+        unloggedRingCount = 0;
+    } while (loggedRingCount == maxCount);
+
+    return ESP_OK;
+}
+
+static void ringApiCallJob(void* argument) {
+    ApiClientContext* apiClientContext = argument;
+    // Servers without /report only get device health with heartbeats, as
+    // they always did
+    HealthReport healthReport;
+    const bool withHealth = apiClientContext->mode == API_MODE_REPORT;
+
+    if (withHealth) {
+        collectHealthReport(&healthReport);
     }
 
-    updateUrl[sizeof(updateUrl) - 1] = 0;
+    esp_err_t error = sendWakeReport(
+        apiClientContext, true, withHealth ? &healthReport : NULL, NULL, NULL);
 
-    if (taskParam->applyFirmwareUpdate) {
-        applyFirmwareUpdate(updateUrl, taskParam->restartAfterFirmwareUpdate);
+    if (error != ESP_OK) {
+        LOGE(LOG_TAG, "Unable to upload rings (%d).", error);
+        invalidateWifiFastConnect();
+        ++ringUploadFailures.count;
+        ringUploadFailures.lastError = error;
     }
 }
 
-void heartbeatTask(HeartbeatTaskParam* parameter) {
-    BatteryInfo batteryInfo;
-    getBatteryInfo(&batteryInfo);
+void firmwareUpdateAvailableCallback(
+    const char* updateVersion,
+    const char* updatePath,
+    const char* updatePatchPath,
+    void* userData) {
 
-    char firmwareVersion[FIRMWARE_VERSION_MAX_LENGTH];
-    getFirmwareVersion(firmwareVersion, sizeof(firmwareVersion));
+    HeartbeatJobParam* jobParam = (HeartbeatJobParam*)userData;
 
-    DeviceHealth deviceHealth = {
-        .battery =
-            {.level = getBatteryLevelString(batteryInfo.level),
-             .voltage = batteryInfo.voltage},
-        .firmware = {.version = firmwareVersion}};
+    // Started on demand, but then continued by every heartbeat
+    if (!jobParam->applyFirmwareUpdate &&
+        !isFirmwareUpdateInProgress(updateVersion)) {
+        return;
+    }
+
+    if (ApiClient_url(
+            jobParam->apiClientContext, updatePath, jobParam->updateUrl,
+            sizeof(jobParam->updateUrl)) != ESP_OK) {
+        jobParam->updateUrl[0] = 0;
+        return;
+    }
 
-    ApiClient_heartbeat(
-        parameter->apiClientContext, &deviceHealth,
-        firmwareUpdateAvailableCallback, parameter);
+    jobParam->updateUrl[sizeof(jobParam->updateUrl) - 1] = 0;
 
-    xEventGroupSetBits(parameter->group, parameter->bit);
-    vTaskDelete(NULL);
-}
+    if (updatePatchPath &&
+        ApiClient_url(
+            jobParam->apiClientContext, updatePatchPath,
+            jobParam->updatePatchUrl,
+            sizeof(jobParam->updatePatchUrl)) == ESP_OK) {
+        jobParam->updatePatchUrl[sizeof(jobParam->updatePatchUrl) - 1] = 0;
+    } else {
+        jobParam->updatePatchUrl[0] = 0;
+    }
 
-void runRingTasks(ApiClientContext* apiClientContext) {
-    EventGroupHandle_t ringTasksEventGroup = xEventGroupCreate();
+    snprintf(
+        jobParam->updateVersion, sizeof(jobParam->updateVersion), "%s",
+        updateVersion);
+}
 
-    RingTaskParam ringSoundTaskParam = {
-        .group = ringTasksEventGroup,
-        .bit = RING_SOUND_COMPLETED_BIT,
-        .apiClientContext = NULL};
+// Once the API connection is closed, so that the download doesn't need
+// the memory of two TLS connections
+static void applyPendingFirmwareUpdate(HeartbeatJobParam* parameter) {
+    if (!parameter->updateUrl[0]) {
+        return;
+    }
 
-    RingTaskParam ringCallTaskParam = {
-        .group = ringTasksEventGroup,
-        .bit = RING_API_CALL_COMPLETED_BIT,
-        .apiClientContext = apiClientContext};
+    ApiClient_disconnect(parameter->apiClientContext);
+    applyFirmwareUpdate(
+        parameter->updateUrl,
+        parameter->updatePatchUrl[0] ? parameter->updatePatchUrl : NULL,
+        parameter->updateVersion, parameter->restartAfterFirmwareUpdate);
+}
 
-    xTaskCreate(
-        (TaskFunction_t)ringSoundTask, "Ring Sound", 1024, &ringSoundTaskParam,
-        TASK_PRIORITY_HIGH, NULL);
+static void heartbeatJob(void* argument) {
+    HeartbeatJobParam* parameter = argument;
+    HealthReport healthReport;
+    collectHealthReport(&healthReport);
+
+    if (sendWakeReport(
+            parameter->apiClientContext, false, &healthReport,
+            firmwareUpdateAvailableCallback, parameter) != ESP_OK) {
+        invalidateWifiFastConnect();
+        // Try again after a regular interval rather than right away
+        scheduleNextHeartbeat(0);
+    }
 
-    xTaskCreate(
-        (TaskFunction_t)ringApiCallTask, "Ring API Call", 4096,
-        &ringCallTaskParam, TASK_PRIORITY_HIGH - 1, NULL);
+    applyPendingFirmwareUpdate(parameter);
+}
 
-    xEventGroupWaitBits(
-        ringTasksEventGroup,
-        RING_SOUND_COMPLETED_BIT | RING_API_CALL_COMPLETED_BIT, pdFALSE, pdTRUE,
-        portMAX_DELAY);
+void runRingTasks(ApiClientContext* apiClientContext) {
+    // Plays in the background while the API is called
+    playTones(
+        RING_CHIME, sizeof(RING_CHIME) / sizeof(RING_CHIME[0]), NULL, NULL);
+
+    Job ringApiCall;
+
+    if (Job_submit(
+            &ringApiCall, ringApiCallJob, apiClientContext,
+            TASK_PRIORITY_HIGH - 1) == ESP_OK) {
+        Job_wait(&ringApiCall);
+    } else {
+        // Late rather than not at all
+        ringApiCallJob(apiClientContext);
+    }
 
-    vEventGroupDelete(ringTasksEventGroup);
+    waitForBuzzer();
 }
 
 void runHeartbeatTask(
     ApiClientContext* apiClientContext, bool applyFirmwareUpdate) {
-    EventGroupHandle_t heartbeatTaskEventGroup = xEventGroupCreate();
-
-    HeartbeatTaskParam heartbeatTaskParam = {
-        .group = heartbeatTaskEventGroup,
-        .bit = HEARTBEAT_COMPLETED_BIT,
+    HeartbeatJobParam heartbeatJobParam = {
         .apiClientContext = apiClientContext,
         .applyFirmwareUpdate = applyFirmwareUpdate,
         .restartAfterFirmwareUpdate = true};
 
-    xTaskCreate(
-        (TaskFunction_t)heartbeatTask, "Heartbeat", 8192, &heartbeatTaskParam,
-        TASK_PRIORITY_MEDIUM, NULL);
-
-    xEventGroupWaitBits(
-        heartbeatTaskEventGroup, HEARTBEAT_COMPLETED_BIT, pdFALSE, pdTRUE,
-        portMAX_DELAY);
+    Job heartbeat;
 
-    vEventGroupDelete(heartbeatTaskEventGroup);
+    if (Job_submit(
+            &heartbeat, heartbeatJob, &heartbeatJobParam,
+            TASK_PRIORITY_MEDIUM) == ESP_OK) {
+        Job_wait(&heartbeat);
+    } else {
+        heartbeatJob(&heartbeatJobParam);
+    }
 }
 
-void handleOnDemandHeartbeatSequence(ApiClientContext* apiClientContext) {
-    // Handle secret ring button sequence to initiate hearbeat.
-    // Useful for triggering firmware updates.
+static GestureRecognizer* getButtonGestures(void) {
+    // Kept across sleep so that presses shortly after a ring are coalesced
+    static RTC_DATA_ATTR GestureRecognizer gestures;
+    static RTC_DATA_ATTR bool initialized = false;
 
-    if (!wakeTriggeredByPin(RING_BUTTON_PIN) ||
-        gpio_get_level(RING_BUTTON_PIN) == 0) {
-        return;
+    if (!initialized) {
+        GestureRecognizer_init(&gestures, &BUTTON_GESTURE_CONFIG);
+        initialized = true;
     }
 
-    ESP_ERROR_CHECK(gpio_set_direction(BUZZER_PIN, GPIO_MODE_OUTPUT));
-    bool cancel = false;
-    int64_t startTime = esp_timer_get_time();
+    return &gestures;
+}
+
+bool handleRingButtonWake(void) {
+    GestureRecognizer* gestures = getButtonGestures();
+    // The press that woke the chip happened before it could be monitored
+    const ButtonEvent press = {
+        .type = BUTTON_EVENT_PRESS, .timeMs = getButtonTimeMs()};
+    const Gesture gesture = GestureRecognizer_feed(gestures, &press);
 
-    // Button must be pressed for 5 seconds
-    while (esp_timer_get_time() - startTime < 5000 * 1000) {
-        if (gpio_get_level(RING_BUTTON_PIN) == 0) {
-            cancel = true;
-        } else {
-            delayMs(10);
-        }
+    startButtonMonitoring();
+
+    if (!isButtonPressed()) {
+        const ButtonEvent release = {
+            .type = BUTTON_EVENT_RELEASE, .timeMs = getButtonTimeMs()};
+        GestureRecognizer_feed(gestures, &release);
     }
 
-    if (cancel) {
-        return;
+    if (gesture != GESTURE_RING) {
+        LOGD(LOG_TAG, "Ring coalesced with the previous one.");
+        return false;
     }
 
-    buzz(BUZZER_DAC_CNANNEL, 2500, 63, 50);
+    return true;
+}
 
-    // Button must be pressed for 5 times within the next 5 seconds
-    int buttonState = gpio_get_level(RING_BUTTON_PIN);
-    startTime = esp_timer_get_time();
-    int buttonPressCount = 0;
+static void handleGesture(ApiClientContext* apiClientContext, Gesture gesture) {
+    switch (gesture) {
+    case GESTURE_RING:
+        startWifi();
+        runRingTasks(apiClientContext);
+        stopWifi();
+        break;
+    case GESTURE_LONG_PRESS:
+        LOGD(LOG_TAG, "Waiting for the on-demand heartbeat sequence.");
+        playTones(CONFIRMATION_BEEP, 1, NULL, NULL);
+        break;
+    case GESTURE_PRESS_SERIES:
+        // Useful for triggering firmware updates
+        LOGD(LOG_TAG, "Running on-demand heartbeat.");
+        playTones(
+            DOUBLE_CONFIRMATION_BEEP,
+            sizeof(DOUBLE_CONFIRMATION_BEEP) /
+                sizeof(DOUBLE_CONFIRMATION_BEEP[0]),
+            NULL, NULL);
+        waitForBuzzer();
+        startWifi();
+        runHeartbeatTask(apiClientContext, true);
+        stopWifi();
+        break;
+    default:
+        break;
+    }
+}
 
-    while (esp_timer_get_time() - startTime < 5000 * 1000 &&
-           buttonPressCount < 5) {
-        if (buttonState == 0 && gpio_get_level(RING_BUTTON_PIN) == 1) {
-            buttonState = 1;
-            ++buttonPressCount;
-        } else if (buttonState == 1 && gpio_get_level(RING_BUTTON_PIN) == 0) {
-            buttonState = 0;
-        }
+void handleButtonGestures(ApiClientContext* apiClientContext) {
+    GestureRecognizer* gestures = getButtonGestures();
 
-        delayMs(10);
-    }
+    // Blocking on the queue lets the chip light sleep between edges
+    while (isButtonMonitoringActive() && !GestureRecognizer_isIdle(gestures)) {
+        const uint32_t timeout = GestureRecognizer_getTimeUntilDeadline(
+            gestures, getButtonTimeMs());
+        ButtonEvent event;
 
-    if (buttonPressCount >= 5) {
-        for (int i = 0; i < 2; ++i) {
-            buzz(BUZZER_DAC_CNANNEL, 2500, 63, 50);
-            delayMs(100);
+        if (!waitForButtonEvent(&event, timeout)) {
+            handleGesture(
+                apiClientContext,
+                GestureRecognizer_poll(gestures, getButtonTimeMs()));
+            continue;
         }
 
-        startWifi();
-        runHeartbeatTask(apiClientContext, true);
-        stopWifi();
+        // Edges may have queued up while busy, so deadlines are checked as of
+        // the time of the edge
+        handleGesture(
+            apiClientContext, GestureRecognizer_poll(gestures, event.timeMs));
+        handleGesture(
+            apiClientContext, GestureRecognizer_feed(gestures, &event));
     }
+
+    stopButtonMonitoring();
 }
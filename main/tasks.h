@@ -1,10 +1,21 @@
 #pragma once
 
 #include "api.h"
+#include "eventlog.h"
 
 #include <stdbool.h>
 
+// Rings are queued in the log until uploaded. Without a log they are only
+// sent once.
+void setRingEventLog(EventLog* eventLog);
 void runRingTasks(ApiClientContext* apiClientContext);
 void runHeartbeatTask(
     ApiClientContext* apiClientContext, bool applyFirmwareUpdate);
-void handleOnDemandHeartbeatSequence(ApiClientContext* apiClientContext);
+// Feeds the press that woke the chip to the gesture recognizer and starts
+// monitoring the button. Returns false if the press is coalesced with a
+// recent ring.
+bool handleRingButtonWake(void);
+// Handles gestures until the button has been idle, e.g. holding the button
+// and then pressing it a few times runs a heartbeat that applies updates.
+// Runs with WiFi stopped so that the chip can sleep between presses.
+void handleButtonGestures(ApiClientContext* apiClientContext);
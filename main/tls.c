@@ -0,0 +1,526 @@
+#include "tls.h"
+#include "devicekey.h"
+#include "log.h"
+#include "resolver.h"
+#include "trace.h"
+
+#include <errno.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <lwip/sockets.h>
+#include <mbedtls/md.h>
+#include <mbedtls/ssl_ciphersuites.h>
+#include <mbedtls/x509_crt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_TAG "tls"
+#define TLS_SESSION_HOST_MAX_LENGTH 64
+#define TLS_SESSION_TICKET_MAX_LENGTH 512
+#define TLS_MASTER_SECRET_LENGTH 48
+#define TLS_PSK_SIZE 32
+#define TLS_PSK_LABEL "doorbell-tls-psk"
+#define TLS_PSK_IDENTITY_LENGTH 12
+// Lets dynamic buffers stay at a quarter of the 16 KiB a record may take
+#define TLS_MAX_FRAGMENT_LENGTH MBEDTLS_SSL_MAX_FRAG_LEN_4096
+
+#if CONFIG_DOORBELL_TLS_VERIFY_HOSTNAME
+static const bool TLS_VERIFY_HOSTNAME = true;
+#else
+static const bool TLS_VERIFY_HOSTNAME = false;
+#endif
+
+extern const uint8_t serverCertPemStart[] asm("_binary_server_cert_pem_start");
+// Converted from PEM at build time, see scripts/pem2der.py
+extern const uint8_t serverCertDerStart[] asm("_binary_server_cert_der_start");
+extern const uint8_t serverCertDerEnd[] asm("_binary_server_cert_der_end");
+
+// The session is kept in RTC memory so that it survives both light and deep
+// sleep. Pointers inside mbedtls_ssl_session do not survive deep sleep, so the
+// ticket is stored next to it and the peer certificate is dropped.
+typedef struct {
+    bool valid;
+    char host[TLS_SESSION_HOST_MAX_LENGTH];
+    mbedtls_ssl_session session;
+    uint8_t ticket[TLS_SESSION_TICKET_MAX_LENGTH];
+} TlsSessionCache;
+
+static RTC_DATA_ATTR TlsSessionCache sessionCache;
+static RTC_DATA_ATTR TlsSessionStats sessionStats;
+
+static bool tlsInitialized = false;
+static mbedtls_x509_crt caCertificate;
+static mbedtls_ssl_config tlsConfig;
+static SemaphoreHandle_t sessionMutex = NULL;
+#if CONFIG_DOORBELL_TLS_PSK
+static int* pskCiphersuites = NULL;
+#endif
+
+static int tlsRandom(void* context, unsigned char* output, size_t length) {
+    esp_fill_random(output, length);
+    return 0;
+}
+
+static int tlsSend(void* context, const unsigned char* data, size_t length) {
+    TlsConnection* connection = (TlsConnection*)context;
+    return mbedtls_net_send(&connection->socket, data, length);
+}
+
+static int tlsReceive(void* context, unsigned char* data, size_t size) {
+    TlsConnection* connection = (TlsConnection*)context;
+    return mbedtls_net_recv_timeout(
+        &connection->socket, data, size, connection->timeoutMs);
+}
+
+#if CONFIG_DOORBELL_TLS_PSK
+// The PSK is derived from the device key rather than being the key itself,
+// as the device key also authenticates ring datagrams
+static int setTlsPsk(const uint8_t* deviceKey) {
+    uint8_t psk[TLS_PSK_SIZE];
+    int ret = mbedtls_md_hmac(
+        mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), deviceKey,
+        DEVICE_KEY_SIZE, (const unsigned char*)TLS_PSK_LABEL,
+        strlen(TLS_PSK_LABEL), psk);
+
+    uint8_t mac[6];
+    char identity[TLS_PSK_IDENTITY_LENGTH + 1];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+
+    for (size_t i = 0; i < sizeof(mac); ++i) {
+        sprintf(&identity[i * 2], "%02x", mac[i]);
+    }
+
+    if (ret == 0) {
+        ret = mbedtls_ssl_conf_psk(
+            &tlsConfig, psk, sizeof(psk), (const unsigned char*)identity,
+            strlen(identity));
+    }
+
+    memset(psk, 0, sizeof(psk));
+    return ret;
+}
+
+static bool isPskCiphersuite(int id) {
+    const mbedtls_ssl_ciphersuite_t* info =
+        mbedtls_ssl_ciphersuite_from_id(id);
+    return info && info->key_exchange == MBEDTLS_KEY_EXCHANGE_ECDHE_PSK;
+}
+
+// PSK cipher suites are offered ahead of the default ones, so the server
+// decides whether the certificate is needed
+static void configureTlsPsk(void) {
+    uint8_t deviceKey[DEVICE_KEY_SIZE];
+
+    if (getDeviceKey(deviceKey) != ESP_OK) {
+        LOGD(LOG_TAG, "No device key, not offering PSK cipher suites.");
+        return;
+    }
+
+    int ret = setTlsPsk(deviceKey);
+    memset(deviceKey, 0, sizeof(deviceKey));
+
+    if (ret != 0) {
+        LOGE(LOG_TAG, "Unable to set TLS PSK (-0x%x).", -ret);
+        return;
+    }
+
+    const int* defaults = mbedtls_ssl_list_ciphersuites();
+    size_t count = 0;
+
+    while (defaults[count] != 0) {
+        ++count;
+    }
+
+    pskCiphersuites = calloc(count + 1, sizeof(int));
+
+    if (!pskCiphersuites) {
+        return;
+    }
+
+    size_t length = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        if (isPskCiphersuite(defaults[i])) {
+            pskCiphersuites[length++] = defaults[i];
+        }
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (!isPskCiphersuite(defaults[i])) {
+            pskCiphersuites[length++] = defaults[i];
+        }
+    }
+
+    mbedtls_ssl_conf_ciphersuites(&tlsConfig, pskCiphersuites);
+}
+#endif
+
+esp_err_t initTls(void) {
+    if (tlsInitialized) {
+        return ESP_OK;
+    }
+
+    // The CA certificate is parsed once and shared by all connections
+    mbedtls_x509_crt_init(&caCertificate);
+    int ret = mbedtls_x509_crt_parse_der(
+        &caCertificate, serverCertDerStart,
+        serverCertDerEnd - serverCertDerStart);
+
+    if (ret != 0) {
+        LOGE(LOG_TAG, "Unable to parse server certificate (-0x%x).", -ret);
+        mbedtls_x509_crt_free(&caCertificate);
+        return ESP_FAIL;
+    }
+
+    mbedtls_ssl_config_init(&tlsConfig);
+    ret = mbedtls_ssl_config_defaults(
+        &tlsConfig, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+        MBEDTLS_SSL_PRESET_DEFAULT);
+
+    if (ret != 0) {
+        LOGE(LOG_TAG, "Unable to configure TLS (-0x%x).", -ret);
+        mbedtls_ssl_config_free(&tlsConfig);
+        mbedtls_x509_crt_free(&caCertificate);
+        return ESP_FAIL;
+    }
+
+    mbedtls_ssl_conf_authmode(&tlsConfig, MBEDTLS_SSL_VERIFY_REQUIRED);
+    mbedtls_ssl_conf_ca_chain(&tlsConfig, &caCertificate, NULL);
+    mbedtls_ssl_conf_rng(&tlsConfig, tlsRandom, NULL);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(
+        &tlsConfig, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+    // The extension is optional, servers without it keep sending records of
+    // up to CONFIG_MBEDTLS_SSL_IN_CONTENT_LEN bytes
+    mbedtls_ssl_conf_max_frag_len(&tlsConfig, TLS_MAX_FRAGMENT_LENGTH);
+#endif
+#if CONFIG_DOORBELL_TLS_PSK
+    configureTlsPsk();
+#endif
+
+    sessionMutex = xSemaphoreCreateMutex();
+    assert(sessionMutex);
+
+    tlsInitialized = true;
+    return ESP_OK;
+}
+
+const char* getTlsServerCertificate(void) {
+    return (const char*)serverCertPemStart;
+}
+
+void getTlsSessionStats(TlsSessionStats* stats) {
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    *stats = sessionStats;
+    xSemaphoreGive(sessionMutex);
+}
+
+void clearTlsSession(void) {
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    memset(&sessionCache, 0, sizeof(sessionCache));
+    xSemaphoreGive(sessionMutex);
+}
+
+// Offers the cached session to the server, if there is one for this host.
+// The master secret is returned so that resumption can be detected after the
+// handshake: a resumed session keeps its master secret.
+static bool loadTlsSession(
+    mbedtls_ssl_context* ssl, const char* host, unsigned char* masterSecret) {
+    bool loaded = false;
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+
+    if (sessionCache.valid && strcmp(sessionCache.host, host) == 0) {
+        mbedtls_ssl_session session = sessionCache.session;
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+        if (session.ticket_len > 0) {
+            session.ticket = sessionCache.ticket;
+        }
+#endif
+        // The session is copied, including the ticket
+        if (mbedtls_ssl_set_session(ssl, &session) == 0) {
+            memcpy(masterSecret, session.master, TLS_MASTER_SECRET_LENGTH);
+            loaded = true;
+        }
+        memset(&session, 0, sizeof(session));
+    }
+
+    xSemaphoreGive(sessionMutex);
+    return loaded;
+}
+
+static void storeTlsSession(const mbedtls_ssl_context* ssl, const char* host) {
+    const mbedtls_ssl_session* session = ssl->session;
+    size_t ticketLength = 0;
+
+    if (!session || strlen(host) >= TLS_SESSION_HOST_MAX_LENGTH) {
+        return;
+    }
+
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    ticketLength = session->ticket ? session->ticket_len : 0;
+    if (ticketLength > TLS_SESSION_TICKET_MAX_LENGTH) {
+        LOGD(LOG_TAG, "Session ticket too large (%u bytes).", ticketLength);
+        ticketLength = 0;
+    }
+#endif
+
+    // Without a session ID or ticket the server is unable to resume
+    if (session->id_len == 0 && ticketLength == 0) {
+        return;
+    }
+
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+
+    memcpy(&sessionCache.session, session, sizeof(sessionCache.session));
+    sessionCache.session.peer_cert = NULL;
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    sessionCache.session.ticket = NULL;
+    sessionCache.session.ticket_len = ticketLength;
+    memcpy(sessionCache.ticket, session->ticket, ticketLength);
+#endif
+    strcpy(sessionCache.host, host);
+    sessionCache.valid = true;
+
+    xSemaphoreGive(sessionMutex);
+}
+
+static void countTlsSession(bool hit) {
+    xSemaphoreTake(sessionMutex, portMAX_DELAY);
+    if (hit) {
+        ++sessionStats.hits;
+    } else {
+        ++sessionStats.misses;
+    }
+    LOGD(
+        LOG_TAG, "TLS session %s (hits: %u, misses: %u)",
+        hit ? "resumed" : "not resumed", sessionStats.hits,
+        sessionStats.misses);
+    xSemaphoreGive(sessionMutex);
+}
+
+// Gives up after timeoutMs, if not 0, rather than when TCP stops retrying
+static bool
+connectWithin(int fd, const struct sockaddr_in* address, uint32_t timeoutMs) {
+    const int flags = fcntl(fd, F_GETFL, 0);
+
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return false;
+    }
+
+    if (connect(fd, (const struct sockaddr*)address, sizeof(*address)) != 0) {
+        if (errno != EINPROGRESS) {
+            return false;
+        }
+
+        struct timeval timeout = {
+            .tv_sec = timeoutMs / 1000, .tv_usec = (timeoutMs % 1000) * 1000};
+        fd_set writeSet;
+        FD_ZERO(&writeSet);
+        FD_SET(fd, &writeSet);
+        int error = 0;
+        socklen_t errorSize = sizeof(error);
+
+        if (select(
+                fd + 1, NULL, &writeSet, NULL,
+                timeoutMs > 0 ? &timeout : NULL) <= 0 ||
+            getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorSize) != 0 ||
+            error != 0) {
+            return false;
+        }
+    }
+
+    // Sends by mbedTLS expect a blocking socket
+    return fcntl(fd, F_SETFL, flags) == 0;
+}
+
+static int connectSocket(const char* host, uint16_t port, uint32_t timeoutMs) {
+    struct sockaddr_in address;
+
+    traceBegin(TRACE_EVENT_DNS);
+    esp_err_t error = resolveHost(host, port, &address);
+    traceEnd(TRACE_EVENT_DNS);
+
+    if (error != ESP_OK) {
+        return -1;
+    }
+
+    traceBegin(TRACE_EVENT_TCP_CONNECT);
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    if (fd >= 0 && !connectWithin(fd, &address, timeoutMs)) {
+        close(fd);
+        fd = -1;
+    }
+
+    traceEnd(TRACE_EVENT_TCP_CONNECT);
+
+    if (fd < 0) {
+        LOGE(LOG_TAG, "Unable to connect to %s:%u.", host, port);
+        // The host may have moved to another address
+        invalidateResolvedHost(host);
+    }
+
+    return fd;
+}
+
+static esp_err_t
+openConnection(TlsConnection* connection, const char* host, uint16_t port) {
+    connection->socket.fd =
+        connectSocket(host, port, connection->timeoutMs);
+
+    if (connection->socket.fd < 0) {
+        TlsConnection_close(connection);
+        return ESP_FAIL;
+    }
+
+    int ret = 0;
+
+    if ((ret = mbedtls_ssl_setup(&connection->ssl, &tlsConfig)) != 0) {
+        LOGE(LOG_TAG, "Unable to set up TLS context (-0x%x).", -ret);
+        TlsConnection_close(connection);
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (TLS_VERIFY_HOSTNAME &&
+        (ret = mbedtls_ssl_set_hostname(&connection->ssl, host)) != 0) {
+        LOGE(LOG_TAG, "Unable to set TLS hostname (-0x%x).", -ret);
+        TlsConnection_close(connection);
+        return ESP_ERR_NO_MEM;
+    }
+
+    mbedtls_ssl_set_bio(
+        &connection->ssl, connection, tlsSend, tlsReceive, NULL);
+
+    unsigned char offeredMasterSecret[TLS_MASTER_SECRET_LENGTH];
+    bool sessionOffered =
+        loadTlsSession(&connection->ssl, host, offeredMasterSecret);
+
+    traceBegin(TRACE_EVENT_TLS_HANDSHAKE);
+    while ((ret = mbedtls_ssl_handshake(&connection->ssl)) != 0) {
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ &&
+            ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            break;
+        }
+    }
+    traceEnd(TRACE_EVENT_TLS_HANDSHAKE);
+
+    if (ret != 0) {
+        LOGE(LOG_TAG, "TLS handshake with %s failed (-0x%x).", host, -ret);
+        if (sessionOffered) {
+            // Don't keep offering a session that may be the cause
+            clearTlsSession();
+        }
+        memset(offeredMasterSecret, 0, sizeof(offeredMasterSecret));
+        TlsConnection_close(connection);
+        return ESP_FAIL;
+    }
+
+    bool resumed =
+        sessionOffered &&
+        memcmp(
+            connection->ssl.session->master, offeredMasterSecret,
+            TLS_MASTER_SECRET_LENGTH) == 0;
+    memset(offeredMasterSecret, 0, sizeof(offeredMasterSecret));
+
+    countTlsSession(resumed);
+    storeTlsSession(&connection->ssl, host);
+
+    connection->connected = true;
+    return ESP_OK;
+}
+
+esp_err_t TlsConnection_open(
+    TlsConnection* connection,
+    const char* host,
+    uint16_t port,
+    uint32_t timeoutMs) {
+
+    if (!tlsInitialized) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    memset(connection, 0, sizeof(TlsConnection));
+    connection->timeoutMs = timeoutMs;
+    mbedtls_net_init(&connection->socket);
+    mbedtls_ssl_init(&connection->ssl);
+
+    beginTlsHeapTracking(&connection->heapUsage);
+    enterTlsHeapScope(&connection->heapUsage);
+    esp_err_t error = openConnection(connection, host, port);
+    exitTlsHeapScope(&connection->heapUsage);
+    return error;
+}
+
+static int
+writeAll(TlsConnection* connection, const void* data, size_t length) {
+    const unsigned char* bytes = (const unsigned char*)data;
+    size_t written = 0;
+
+    while (written < length) {
+        int ret = mbedtls_ssl_write(
+            &connection->ssl, bytes + written, length - written);
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+            ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            continue;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        written += ret;
+    }
+
+    return written;
+}
+
+static int readSome(TlsConnection* connection, void* data, size_t size) {
+    while (true) {
+        int ret = mbedtls_ssl_read(&connection->ssl, data, size);
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+            ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            continue;
+        }
+        if (ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+            return 0;
+        }
+        return ret;
+    }
+}
+
+// Dynamic buffers are allocated per record, so reads and writes are
+// attributed to the connection as well
+int TlsConnection_write(
+    TlsConnection* connection, const void* data, size_t length) {
+    enterTlsHeapScope(&connection->heapUsage);
+    int ret = writeAll(connection, data, length);
+    exitTlsHeapScope(&connection->heapUsage);
+    return ret;
+}
+
+int TlsConnection_read(TlsConnection* connection, void* data, size_t size) {
+    enterTlsHeapScope(&connection->heapUsage);
+    int ret = readSome(connection, data, size);
+    exitTlsHeapScope(&connection->heapUsage);
+    return ret;
+}
+
+void TlsConnection_close(TlsConnection* connection) {
+    if (connection->connected) {
+        enterTlsHeapScope(&connection->heapUsage);
+        mbedtls_ssl_close_notify(&connection->ssl);
+        exitTlsHeapScope(&connection->heapUsage);
+        connection->connected = false;
+    }
+
+    mbedtls_ssl_free(&connection->ssl);
+    mbedtls_net_free(&connection->socket);
+
+    endTlsHeapTracking(&connection->heapUsage);
+    LOGD(
+        LOG_TAG, "TLS connection used at most %u bytes of heap.",
+        connection->heapUsage.peak);
+}
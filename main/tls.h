@@ -0,0 +1,38 @@
+#pragma once
+
+#include "tlsheap.h"
+
+#include <esp_err.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+} TlsSessionStats;
+
+typedef struct {
+    mbedtls_net_context socket;
+    mbedtls_ssl_context ssl;
+    uint32_t timeoutMs;
+    bool connected;
+    TlsHeapUsage heapUsage;
+} TlsConnection;
+
+esp_err_t initTls(void);
+const char* getTlsServerCertificate(void);
+void getTlsSessionStats(TlsSessionStats* stats);
+void clearTlsSession(void);
+
+esp_err_t TlsConnection_open(
+    TlsConnection* connection,
+    const char* host,
+    uint16_t port,
+    uint32_t timeoutMs);
+int TlsConnection_write(
+    TlsConnection* connection, const void* data, size_t length);
+int TlsConnection_read(TlsConnection* connection, void* data, size_t size);
+void TlsConnection_close(TlsConnection* connection);
@@ -0,0 +1,151 @@
+#include "tlsheap.h"
+#include "log.h"
+
+#include <esp_attr.h>
+#include <esp_heap_caps.h>
+#include <string.h>
+
+#define TLS_HEAP_MAX_TRACKED 4
+#define TLS_HEAP_UNTRACKED 0xff
+
+#define LOG_TAG "tlsheap"
+
+// Prepended to every allocation so that frees can be accounted for. Keeps
+// the alignment of the underlying allocator.
+typedef struct {
+    uint32_t size;
+    uint8_t owner;
+    uint8_t reserved[3];
+} AllocationHeader;
+
+_Static_assert(sizeof(AllocationHeader) == 8, "Header must keep alignment");
+
+static RTC_DATA_ATTR TlsHeapStats heapStats;
+
+static TlsHeapUsage* trackedUsages[TLS_HEAP_MAX_TRACKED];
+static size_t heapInUse = 0;
+static portMUX_TYPE heapLock = portMUX_INITIALIZER_UNLOCKED;
+
+void beginTlsHeapTracking(TlsHeapUsage* usage) {
+    bool tracked = false;
+    memset(usage, 0, sizeof(*usage));
+
+    portENTER_CRITICAL(&heapLock);
+    for (size_t i = 0; i < TLS_HEAP_MAX_TRACKED && !tracked; ++i) {
+        if (!trackedUsages[i]) {
+            trackedUsages[i] = usage;
+            tracked = true;
+        }
+    }
+    if (!tracked) {
+        ++heapStats.untrackedConnections;
+    }
+    portEXIT_CRITICAL(&heapLock);
+
+    if (!tracked) {
+        LOGW(
+            LOG_TAG, "Not tracking the heap of more than %d connections.",
+            TLS_HEAP_MAX_TRACKED);
+    }
+}
+
+void endTlsHeapTracking(TlsHeapUsage* usage) {
+    portENTER_CRITICAL(&heapLock);
+    for (size_t i = 0; i < TLS_HEAP_MAX_TRACKED; ++i) {
+        if (trackedUsages[i] == usage) {
+            trackedUsages[i] = NULL;
+        }
+    }
+    if (usage->peak > heapStats.connectionPeak) {
+        heapStats.connectionPeak = usage->peak;
+    }
+    portEXIT_CRITICAL(&heapLock);
+}
+
+void enterTlsHeapScope(TlsHeapUsage* usage) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+
+    portENTER_CRITICAL(&heapLock);
+    usage->task = task;
+    usage->active = true;
+    portEXIT_CRITICAL(&heapLock);
+}
+
+void exitTlsHeapScope(TlsHeapUsage* usage) {
+    portENTER_CRITICAL(&heapLock);
+    usage->active = false;
+    portEXIT_CRITICAL(&heapLock);
+}
+
+void getTlsHeapStats(TlsHeapStats* stats) {
+    portENTER_CRITICAL(&heapLock);
+    *stats = heapStats;
+    portEXIT_CRITICAL(&heapLock);
+}
+
+static uint8_t findOwnerLocked(TaskHandle_t task) {
+    for (size_t i = 0; i < TLS_HEAP_MAX_TRACKED; ++i) {
+        TlsHeapUsage* usage = trackedUsages[i];
+        if (usage && usage->active && usage->task == task) {
+            return i;
+        }
+    }
+    return TLS_HEAP_UNTRACKED;
+}
+
+// Replaces the allocator of CONFIG_MBEDTLS_INTERNAL_MEM_ALLOC, see
+// CONFIG_MBEDTLS_CUSTOM_MEM_ALLOC
+void* esp_mbedtls_mem_calloc(size_t count, size_t size) {
+    if (count > 0 && size > (UINT32_MAX - sizeof(AllocationHeader)) / count) {
+        return NULL;
+    }
+
+    const size_t total = count * size + sizeof(AllocationHeader);
+    AllocationHeader* header = heap_caps_calloc(
+        1, total, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+
+    if (!header) {
+        return NULL;
+    }
+
+    header->size = total;
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+
+    portENTER_CRITICAL(&heapLock);
+    header->owner = findOwnerLocked(task);
+
+    if (header->owner != TLS_HEAP_UNTRACKED) {
+        TlsHeapUsage* usage = trackedUsages[header->owner];
+        usage->inUse += total;
+        if (usage->inUse > usage->peak) {
+            usage->peak = usage->inUse;
+        }
+    }
+
+    heapInUse += total;
+    if (heapInUse > heapStats.totalPeak) {
+        heapStats.totalPeak = heapInUse;
+    }
+    portEXIT_CRITICAL(&heapLock);
+
+    return header + 1;
+}
+
+void esp_mbedtls_mem_free(void* pointer) {
+    if (!pointer) {
+        return;
+    }
+
+    AllocationHeader* header = (AllocationHeader*)pointer - 1;
+
+    portENTER_CRITICAL(&heapLock);
+    if (header->owner != TLS_HEAP_UNTRACKED && trackedUsages[header->owner]) {
+        TlsHeapUsage* usage = trackedUsages[header->owner];
+        usage->inUse -= header->size <= usage->inUse ? header->size
+                                                     : usage->inUse;
+    }
+    heapInUse -= header->size <= heapInUse ? header->size : heapInUse;
+    portEXIT_CRITICAL(&heapLock);
+
+    heap_caps_free(header);
+}
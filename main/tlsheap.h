@@ -0,0 +1,37 @@
+#pragma once
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Peaks of heap allocated by mbedTLS since the last cold boot
+typedef struct {
+    // Largest amount used by a single connection
+    uint32_t connectionPeak;
+    // Largest amount used at once, including the shared configuration
+    uint32_t totalPeak;
+    // Connections begun while all slots were taken. Their heap only counts
+    // towards totalPeak.
+    uint32_t untrackedConnections;
+} TlsHeapStats;
+
+// Heap allocated by mbedTLS on behalf of one connection
+typedef struct {
+    // Task in the scope of the connection, if any
+    TaskHandle_t task;
+    bool active;
+    size_t inUse;
+    size_t peak;
+} TlsHeapUsage;
+
+// Memory is accounted to usage from the beginning of tracking until it
+// ends, which must be after everything allocated for the connection has been
+// freed. Allocations are attributed to it while the allocating task is in
+// its scope, so a connection may move between tasks.
+void beginTlsHeapTracking(TlsHeapUsage* usage);
+void endTlsHeapTracking(TlsHeapUsage* usage);
+void enterTlsHeapScope(TlsHeapUsage* usage);
+void exitTlsHeapScope(TlsHeapUsage* usage);
+void getTlsHeapStats(TlsHeapStats* stats);
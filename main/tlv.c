@@ -0,0 +1,200 @@
+#include "tlv.h"
+#include "log.h"
+
+#include <string.h>
+
+#define LOG_TAG "tlv"
+
+void TlvWriter_init(TlvWriter* writer, void* data, size_t size) {
+    writer->data = data;
+    writer->size = size;
+    writer->length = 0;
+    writer->overflow = false;
+}
+
+static void putVarint(TlvWriter* writer, uint64_t value) {
+    do {
+        if (writer->length >= writer->size) {
+            writer->overflow = true;
+            return;
+        }
+
+        const uint8_t byte = value & 0x7f;
+        value >>= 7;
+        writer->data[writer->length++] = byte | (value ? 0x80 : 0);
+    } while (value);
+}
+
+static void putKey(TlvWriter* writer, uint32_t id, TlvWireType type) {
+    putVarint(writer, (uint64_t)id << 1 | type);
+}
+
+void TlvWriter_putUint(TlvWriter* writer, uint32_t id, uint64_t value) {
+    putKey(writer, id, TLV_WIRE_VARINT);
+    putVarint(writer, value);
+}
+
+void TlvWriter_putInt(TlvWriter* writer, uint32_t id, int64_t value) {
+    TlvWriter_putUint(
+        writer, id, (uint64_t)value << 1 ^ (uint64_t)(value >> 63));
+}
+
+void TlvWriter_putBytes(
+    TlvWriter* writer, uint32_t id, const void* data, size_t length) {
+    putKey(writer, id, TLV_WIRE_BYTES);
+    putVarint(writer, length);
+
+    if (writer->overflow || length > writer->size - writer->length) {
+        writer->overflow = true;
+        return;
+    }
+
+    memcpy(writer->data + writer->length, data, length);
+    writer->length += length;
+}
+
+void TlvWriter_putString(
+    TlvWriter* writer, uint32_t id, const char* value, size_t maxLength) {
+    if (!value) {
+        return;
+    }
+
+    const size_t length = strnlen(value, maxLength);
+    TlvWriter_putBytes(writer, id, value, length);
+}
+
+bool TlvWriter_hasOverflowed(const TlvWriter* writer) {
+    return writer->overflow;
+}
+
+void TlvParser_init(TlvParser* parser, TlvCallback callback, void* userData) {
+    parser->callback = callback;
+    parser->userData = userData;
+    parser->state = TLV_STATE_KEY;
+    parser->varint = 0;
+    parser->varintShift = 0;
+    parser->remaining = 0;
+}
+
+// Returns true once the varint is complete
+static bool takeVarint(TlvParser* parser, uint8_t byte) {
+    if (parser->varintShift < 64) {
+        parser->varint |= (uint64_t)(byte & 0x7f) << parser->varintShift;
+    }
+
+    parser->varintShift += 7;
+    return !(byte & 0x80);
+}
+
+static void emitField(TlvParser* parser) {
+    if (parser->callback) {
+        parser->callback(&parser->field, parser->userData);
+    }
+
+    parser->state = TLV_STATE_KEY;
+}
+
+void TlvParser_feed(TlvParser* parser, const void* data, size_t length) {
+    const uint8_t* bytes = data;
+    const uint8_t* end = bytes + length;
+
+    while (bytes < end) {
+        if (parser->state == TLV_STATE_BYTES ||
+            parser->state == TLV_STATE_SKIP) {
+            size_t count = end - bytes;
+            count = count < parser->remaining ? count : parser->remaining;
+
+            if (parser->state == TLV_STATE_BYTES) {
+                memcpy(
+                    parser->value + parser->field.length - parser->remaining,
+                    bytes, count);
+            }
+
+            bytes += count;
+            parser->remaining -= count;
+
+            if (parser->remaining > 0) {
+                continue;
+            }
+
+            if (parser->state == TLV_STATE_BYTES) {
+                parser->field.data = parser->value;
+                emitField(parser);
+            } else {
+                parser->state = TLV_STATE_KEY;
+            }
+            continue;
+        }
+
+        if (!takeVarint(parser, *bytes++)) {
+            continue;
+        }
+
+        const uint64_t varint = parser->varint;
+        parser->varint = 0;
+        parser->varintShift = 0;
+
+        switch (parser->state) {
+        case TLV_STATE_KEY:
+            parser->field.id = varint >> 1;
+            parser->field.type = varint & 1;
+            parser->field.value = 0;
+            parser->field.data = NULL;
+            parser->field.length = 0;
+            parser->state = parser->field.type == TLV_WIRE_VARINT
+                                ? TLV_STATE_VARINT
+                                : TLV_STATE_LENGTH;
+            break;
+        case TLV_STATE_VARINT:
+            parser->field.value = varint;
+            emitField(parser);
+            break;
+        case TLV_STATE_LENGTH:
+            parser->field.length = varint;
+            parser->remaining = varint;
+
+            if (varint > sizeof(parser->value)) {
+                LOGW(
+                    LOG_TAG, "Skipping field %u longer than %u bytes.",
+                    parser->field.id, sizeof(parser->value));
+                parser->state = TLV_STATE_SKIP;
+            } else if (varint == 0) {
+                parser->field.data = parser->value;
+                emitField(parser);
+            } else {
+                parser->state = TLV_STATE_BYTES;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void TlvParser_finish(TlvParser* parser) {
+    if (parser->state != TLV_STATE_KEY || parser->varintShift > 0) {
+        LOGW(LOG_TAG, "Ignoring truncated field.");
+    }
+
+    TlvParser_init(parser, parser->callback, parser->userData);
+}
+
+int64_t getTlvInt(const TlvField* field) {
+    return (int64_t)(field->value >> 1) ^ -(int64_t)(field->value & 1);
+}
+
+void copyTlvString(char* target, size_t targetSize, const TlvField* field) {
+    if (targetSize == 0) {
+        return;
+    }
+
+    size_t length = 0;
+
+    if (field->type == TLV_WIRE_BYTES) {
+        length = field->length < targetSize - 1 ? field->length
+                                                : targetSize - 1;
+        memcpy(target, field->data, length);
+    }
+
+    target[length] = 0;
+}
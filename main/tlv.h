@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest bytes value that can be split across chunks
+#define TLV_VALUE_MAX_LENGTH 256
+#define TLV_VARINT_MAX_SIZE 10
+// Enough for IDs below 8192
+#define TLV_KEY_MAX_SIZE 2
+// Encoded size limits of a field, see apischema.def
+#define TLV_MAX_SIZE_UINT(maxLength) (TLV_KEY_MAX_SIZE + TLV_VARINT_MAX_SIZE)
+#define TLV_MAX_SIZE_INT(maxLength) (TLV_KEY_MAX_SIZE + TLV_VARINT_MAX_SIZE)
+#define TLV_MAX_SIZE_STRING(maxLength) (TLV_KEY_MAX_SIZE + 2 + (maxLength))
+#define TLV_MAX_SIZE_BASE64 TLV_MAX_SIZE_STRING
+
+// Every field is a LEB128 varint key of (id << 1 | wire type) followed by
+// either a varint or a varint length and that many bytes. Signed values are
+// zigzag encoded. Unknown fields are skipped, so IDs can be added freely.
+typedef enum { TLV_WIRE_VARINT = 0, TLV_WIRE_BYTES = 1 } TlvWireType;
+
+typedef struct {
+    uint32_t id;
+    TlvWireType type;
+    // Set for varints
+    uint64_t value;
+    // Set for bytes, not null-terminated
+    const uint8_t* data;
+    size_t length;
+} TlvField;
+
+typedef void (*TlvCallback)(const TlvField* field, void* userData);
+
+// Writes into a fixed buffer. Running out of space is only reported by
+// TlvWriter_hasOverflowed() so that fields can be written without checks.
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t length;
+    bool overflow;
+} TlvWriter;
+
+typedef enum {
+    TLV_STATE_KEY,
+    TLV_STATE_VARINT,
+    TLV_STATE_LENGTH,
+    TLV_STATE_BYTES,
+    TLV_STATE_SKIP
+} TlvState;
+
+// Incremental parser using constant memory
+typedef struct {
+    TlvCallback callback;
+    void* userData;
+    TlvState state;
+    uint64_t varint;
+    uint8_t varintShift;
+    TlvField field;
+    // Bytes left of the value being buffered or skipped
+    size_t remaining;
+    uint8_t value[TLV_VALUE_MAX_LENGTH];
+} TlvParser;
+
+void TlvWriter_init(TlvWriter* writer, void* data, size_t size);
+void TlvWriter_putUint(TlvWriter* writer, uint32_t id, uint64_t value);
+void TlvWriter_putInt(TlvWriter* writer, uint32_t id, int64_t value);
+void TlvWriter_putBytes(
+    TlvWriter* writer, uint32_t id, const void* data, size_t length);
+// Nothing is written for NULL, longer strings are cut at maxLength
+void TlvWriter_putString(
+    TlvWriter* writer, uint32_t id, const char* value, size_t maxLength);
+bool TlvWriter_hasOverflowed(const TlvWriter* writer);
+
+void TlvParser_init(TlvParser* parser, TlvCallback callback, void* userData);
+void TlvParser_feed(TlvParser* parser, const void* data, size_t length);
+void TlvParser_finish(TlvParser* parser);
+
+int64_t getTlvInt(const TlvField* field);
+void copyTlvString(char* target, size_t targetSize, const TlvField* field);
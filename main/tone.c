@@ -0,0 +1,74 @@
+#include "tone.h"
+
+#define RAMP_STEP_COUNT (TONE_LEVEL_MAX - 1)
+
+void ToneSequencer_init(
+    ToneSequencer* sequencer, const Tone* tones, size_t toneCount) {
+    sequencer->tones = tones;
+    sequencer->toneCount = toneCount;
+    sequencer->toneIndex = 0;
+    sequencer->phase = TONE_PHASE_ATTACK;
+    sequencer->phaseStep = 0;
+}
+
+// Splits the duration so that the parts add up exactly
+static uint32_t getRampStepDuration(uint32_t duration, uint8_t index) {
+    return duration * (index + 1) / RAMP_STEP_COUNT -
+           duration * index / RAMP_STEP_COUNT;
+}
+
+bool ToneSequencer_next(ToneSequencer* sequencer, ToneStep* step) {
+    while (sequencer->toneIndex < sequencer->toneCount) {
+        const Tone* tone = &sequencer->tones[sequencer->toneIndex];
+        const uint32_t duration = tone->durationInMs;
+        uint32_t attack = 0;
+        uint32_t release = 0;
+
+        if (tone->frequency > 0) {
+            attack = tone->attackInMs < duration ? tone->attackInMs : duration;
+            release = tone->releaseInMs < duration - attack
+                          ? tone->releaseInMs
+                          : duration - attack;
+        }
+
+        step->frequency = tone->frequency;
+
+        switch (sequencer->phase) {
+        case TONE_PHASE_ATTACK:
+            if (sequencer->phaseStep < RAMP_STEP_COUNT) {
+                const uint8_t index = sequencer->phaseStep++;
+                step->level = index + 1;
+                step->durationInMs = getRampStepDuration(attack, index);
+                break;
+            }
+            sequencer->phase = TONE_PHASE_SUSTAIN;
+            continue;
+
+        case TONE_PHASE_SUSTAIN:
+            sequencer->phase = TONE_PHASE_RELEASE;
+            sequencer->phaseStep = 0;
+            step->level = tone->frequency > 0 ? TONE_LEVEL_MAX : 0;
+            step->durationInMs = duration - attack - release;
+            break;
+
+        case TONE_PHASE_RELEASE:
+            if (sequencer->phaseStep < RAMP_STEP_COUNT) {
+                const uint8_t index = sequencer->phaseStep++;
+                step->level = TONE_LEVEL_MAX - 1 - index;
+                step->durationInMs = getRampStepDuration(release, index);
+                break;
+            }
+            ++sequencer->toneIndex;
+            sequencer->phase = TONE_PHASE_ATTACK;
+            sequencer->phaseStep = 0;
+            continue;
+        }
+
+        // Steps too short to be heard are skipped
+        if (step->durationInMs > 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
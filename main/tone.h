@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define TONE_LEVEL_MAX 4
+
+typedef struct {
+    // 0 for silence
+    uint32_t frequency;
+    uint32_t durationInMs;
+    // Fade in and out, part of the duration
+    uint16_t attackInMs;
+    uint16_t releaseInMs;
+} Tone;
+
+// A stretch of constant frequency and level
+typedef struct {
+    uint32_t frequency;
+    // 0 (off) to TONE_LEVEL_MAX
+    uint8_t level;
+    uint32_t durationInMs;
+} ToneStep;
+
+typedef enum {
+    TONE_PHASE_ATTACK,
+    TONE_PHASE_SUSTAIN,
+    TONE_PHASE_RELEASE
+} TonePhase;
+
+// Splits a sequence of tones into steps. Attack and release ramp through
+// the levels in equally long steps.
+typedef struct {
+    const Tone* tones;
+    size_t toneCount;
+    size_t toneIndex;
+    TonePhase phase;
+    uint8_t phaseStep;
+} ToneSequencer;
+
+void ToneSequencer_init(
+    ToneSequencer* sequencer, const Tone* tones, size_t toneCount);
+// Returns false when the sequence has ended
+bool ToneSequencer_next(ToneSequencer* sequencer, ToneStep* step);
@@ -0,0 +1,173 @@
+#include "trace.h"
+
+#include <esp_attr.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <mbedtls/base64.h>
+
+#define TRACE_RECORD_COUNT 128
+#define TRACE_FORMAT_VERSION 1
+// Resolution of uploaded timestamps
+#define TRACE_TIME_UNIT_IN_US 100
+#define TRACE_ENCODE_BUFFER_SIZE 384
+#define TRACE_MAX_ENCODED_RECORD_SIZE 6
+
+// Wake records store the wakeup cause instead of a timestamp
+typedef struct {
+    uint32_t time;
+    uint8_t event;
+    uint8_t phase;
+} TraceRecord;
+
+// Kept in RTC memory so that the trace of a wake cycle can be uploaded
+// during a later one. Counters are never reset; they index the ring modulo
+// its size.
+static RTC_DATA_ATTR TraceRecord traceRecords[TRACE_RECORD_COUNT];
+static RTC_DATA_ATTR uint32_t traceRecordCount = 0;
+static RTC_DATA_ATTR uint32_t traceCurrentWakeIndex = 0;
+static RTC_DATA_ATTR uint32_t traceUploadedCount = 0;
+
+static int64_t traceWakeTime = 0;
+static portMUX_TYPE traceLock = portMUX_INITIALIZER_UNLOCKED;
+
+static void addRecordLocked(TraceEvent event, TracePhase phase, uint32_t time) {
+    TraceRecord* record = &traceRecords[traceRecordCount % TRACE_RECORD_COUNT];
+    record->time = time;
+    record->event = event;
+    record->phase = phase;
+    ++traceRecordCount;
+}
+
+static void addRecord(TraceEvent event, TracePhase phase) {
+    portENTER_CRITICAL(&traceLock);
+    addRecordLocked(
+        event, phase, (uint32_t)(esp_timer_get_time() - traceWakeTime));
+    portEXIT_CRITICAL(&traceLock);
+}
+
+void traceWake(uint32_t wakeupCause) {
+    portENTER_CRITICAL(&traceLock);
+    traceWakeTime = esp_timer_get_time();
+    traceCurrentWakeIndex = traceRecordCount;
+    addRecordLocked(TRACE_EVENT_WAKE, TRACE_PHASE_INSTANT, wakeupCause);
+    portEXIT_CRITICAL(&traceLock);
+}
+
+void traceBegin(TraceEvent event) { addRecord(event, TRACE_PHASE_BEGIN); }
+
+void traceEnd(TraceEvent event) { addRecord(event, TRACE_PHASE_END); }
+
+void traceInstant(TraceEvent event) { addRecord(event, TRACE_PHASE_INSTANT); }
+
+static size_t encodeVarint(uint32_t value, uint8_t* output) {
+    size_t length = 0;
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        output[length++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return length;
+}
+
+// Binary format: a version byte followed by one entry per record. An entry
+// is a byte holding (event << 2 | phase) and a LEB128 varint. For wake
+// records the varint is the wakeup cause, otherwise it's the time since the
+// previous record of the same wake in units of TRACE_TIME_UNIT_IN_US.
+uint32_t encodeTrace(char* output, size_t outputSize, uint32_t* dropped) {
+    uint8_t binary[TRACE_ENCODE_BUFFER_SIZE];
+    size_t capacity = (outputSize > 0 ? outputSize - 1 : 0) / 4 * 3;
+    capacity = capacity < sizeof(binary) ? capacity : sizeof(binary);
+
+    if (outputSize > 0) {
+        output[0] = 0;
+    }
+    *dropped = 0;
+
+    portENTER_CRITICAL(&traceLock);
+
+    uint32_t first = traceUploadedCount;
+    // Records of the ongoing wake cycle are left for the next upload
+    const uint32_t end = traceCurrentWakeIndex;
+    const uint32_t oldest = traceRecordCount > TRACE_RECORD_COUNT
+                                ? traceRecordCount - TRACE_RECORD_COUNT
+                                : 0;
+
+    if (first < oldest) {
+        *dropped = oldest - first;
+        first = oldest;
+    }
+
+    size_t length = 0;
+    binary[length++] = TRACE_FORMAT_VERSION;
+
+    uint32_t cursor = first;
+    uint32_t wakeCursor = first;
+    size_t wakeLength = length;
+    uint32_t previousTime = 0;
+
+    if (capacity < length + TRACE_MAX_ENCODED_RECORD_SIZE) {
+        portEXIT_CRITICAL(&traceLock);
+        return cursor;
+    }
+
+    for (uint32_t i = first; i < end; ++i) {
+        const TraceRecord* record = &traceRecords[i % TRACE_RECORD_COUNT];
+        uint32_t value = 0;
+
+        if (record->event == TRACE_EVENT_WAKE) {
+            // Everything before this wake record is complete
+            cursor = i;
+            wakeCursor = i;
+            wakeLength = length;
+            previousTime = 0;
+            value = record->time;
+        } else {
+            uint32_t time = record->time / TRACE_TIME_UNIT_IN_US;
+            value = time >= previousTime ? time - previousTime : 0;
+            previousTime = time;
+        }
+
+        if (length + TRACE_MAX_ENCODED_RECORD_SIZE > capacity) {
+            if (wakeLength > 1) {
+                // Upload the whole wake cycle next time
+                length = wakeLength;
+                cursor = wakeCursor;
+            } else {
+                // A single wake cycle that doesn't fit is cut short
+                cursor = i;
+                while (cursor < end &&
+                       traceRecords[cursor % TRACE_RECORD_COUNT].event !=
+                           TRACE_EVENT_WAKE) {
+                    ++cursor;
+                    ++*dropped;
+                }
+            }
+            break;
+        }
+
+        binary[length++] = (record->event << 2) | record->phase;
+        length += encodeVarint(value, &binary[length]);
+        cursor = i + 1;
+    }
+
+    portEXIT_CRITICAL(&traceLock);
+
+    if (length > 1) {
+        size_t outputLength = 0;
+        if (mbedtls_base64_encode(
+                (unsigned char*)output, outputSize, &outputLength, binary,
+                length) != 0) {
+            output[0] = 0;
+        }
+    }
+
+    return cursor;
+}
+
+void commitTraceUpload(uint32_t cursor) {
+    portENTER_CRITICAL(&traceLock);
+    if (cursor > traceUploadedCount) {
+        traceUploadedCount = cursor;
+    }
+    portEXIT_CRITICAL(&traceLock);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Keep in sync with scripts/trace2chrome.py
+typedef enum {
+    TRACE_EVENT_WAKE,
+    TRACE_EVENT_WIFI_START,
+    TRACE_EVENT_WIFI_ASSOCIATION,
+    TRACE_EVENT_WIFI_GOT_IP,
+    TRACE_EVENT_DNS,
+    TRACE_EVENT_TCP_CONNECT,
+    TRACE_EVENT_TLS_HANDSHAKE,
+    TRACE_EVENT_HTTP_REQUEST,
+    TRACE_EVENT_HTTP_RESPONSE,
+    TRACE_EVENT_BUZZER,
+    TRACE_EVENT_SLEEP,
+    TRACE_EVENT_MAX_VALUE
+} TraceEvent;
+
+typedef enum {
+    TRACE_PHASE_BEGIN,
+    TRACE_PHASE_END,
+    TRACE_PHASE_INSTANT
+} TracePhase;
+
+void traceWake(uint32_t wakeupCause);
+void traceBegin(TraceEvent event);
+void traceEnd(TraceEvent event);
+void traceInstant(TraceEvent event);
+
+// Encodes the records of completed wake cycles that have not been uploaded
+// yet as base64. Returns a cursor to pass to commitTraceUpload() once the
+// upload has succeeded.
+uint32_t encodeTrace(char* output, size_t outputSize, uint32_t* dropped);
+void commitTraceUpload(uint32_t cursor);
@@ -1,25 +1,167 @@
 #include "wifi.h"
+#include "clock.h"
+#include "energy.h"
 #include "log.h"
-#include "sleep.h"
+#include "trace.h"
 
 #include <driver/adc.h>
+#include <esp_attr.h>
 #include <esp_event.h>
+#include <esp_netif_net_stack.h>
 #include <esp_timer.h>
 #include <esp_wifi.h>
 #include <freertos/event_groups.h>
-#include <stdatomic.h>
+#include <lwip/dhcp.h>
+#include <string.h>
 
 #define LOG_TAG "wifi"
 #define WIFI_MAX_TRIES 6
+// Both bits stay set until the next start so that any number of tasks can
+// wait for the outcome, including ones that arrive late
 #define WIFI_CONNECTED_BIT BIT0
 #define WIFI_FAIL_BIT BIT1
 
+// Last successful connection, kept in RTC memory so that it survives deep
+// sleep. Reused to skip the scan and DHCP until it's invalidated.
+typedef struct {
+    bool valid;
+    uint8_t ssid[32];
+    uint8_t bssid[6];
+    uint8_t channel;
+    esp_netif_ip_info_t ipInfo;
+    esp_netif_dns_info_t dnsInfo;
+    // On the RTC clock, when DHCP would renew the lease (T1). The server may
+    // give the address to another client once the lease ends, so it's
+    // only reused until then.
+    uint64_t renewalTime;
+} WifiFastConnectCache;
+
+static RTC_DATA_ATTR WifiFastConnectCache wifiFastConnectCache = {0};
+static RTC_DATA_ATTR WifiFastConnectStats wifiFastConnectStats = {0};
+
 static EventGroupHandle_t wifiEventGroup = NULL;
+static esp_netif_t* wifiStaNetif = NULL;
+static bool wifiFastConnecting = false;
+// Whether a request got through since fast connecting
+static bool wifiFastConnectConfirmed = false;
+// Avoids rewriting the WiFi config, which is persisted in flash, every wake
+static bool wifiBssidConfigured = false;
 static esp_event_handler_instance_t anyWifiEventInstance = NULL;
 static esp_event_handler_instance_t gotIpEventInstance = NULL;
 static uint8_t wifiConnectAttempts = 0;
-static atomic_int wifiConnectRefCount = 0;
-static atomic_int wifiLastConnectResult = WIFI_WAIT_RESULT_FAIL;
+static void (*wifiStopHandler)(void) = NULL;
+
+static void configureBssid(bool enable) {
+    if (enable == wifiBssidConfigured) {
+        return;
+    }
+
+    wifi_config_t wifiConfig;
+    ESP_ERROR_CHECK(esp_wifi_get_config(ESP_IF_WIFI_STA, &wifiConfig));
+
+    wifiConfig.sta.bssid_set = enable;
+    if (enable) {
+        memcpy(
+            wifiConfig.sta.bssid, wifiFastConnectCache.bssid,
+            sizeof(wifiConfig.sta.bssid));
+        wifiConfig.sta.channel = wifiFastConnectCache.channel;
+    } else {
+        wifiConfig.sta.channel = 0;
+    }
+
+    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifiConfig));
+    wifiBssidConfigured = enable;
+}
+
+static bool isFastConnectCacheUsable(void) {
+    if (!wifiFastConnectCache.valid) {
+        return false;
+    }
+
+    if (getClockTimeInUs() >= wifiFastConnectCache.renewalTime) {
+        LOGD(LOG_TAG, "Cached WiFi connection has expired.");
+        return false;
+    }
+
+    // Provisioning may have changed the network
+    wifi_config_t wifiConfig;
+    ESP_ERROR_CHECK(esp_wifi_get_config(ESP_IF_WIFI_STA, &wifiConfig));
+    return memcmp(
+               wifiConfig.sta.ssid, wifiFastConnectCache.ssid,
+               sizeof(wifiFastConnectCache.ssid)) == 0;
+}
+
+static void enableStaticIp(void) {
+    esp_err_t error = esp_netif_dhcpc_stop(wifiStaNetif);
+
+    if (error != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED) {
+        ESP_ERROR_CHECK(error);
+    }
+
+    // An IP_EVENT_STA_GOT_IP is posted with the static IP once connected
+    ESP_ERROR_CHECK(
+        esp_netif_set_ip_info(wifiStaNetif, &wifiFastConnectCache.ipInfo));
+    ESP_ERROR_CHECK(esp_netif_set_dns_info(
+        wifiStaNetif, ESP_NETIF_DNS_MAIN, &wifiFastConnectCache.dnsInfo));
+}
+
+static void enableDhcp(void) {
+    esp_err_t error = esp_netif_dhcpc_start(wifiStaNetif);
+
+    if (error != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED) {
+        ESP_ERROR_CHECK(error);
+    }
+}
+
+static void fallBackFromFastConnect(void) {
+    LOGD(LOG_TAG, "Fast WiFi connect failed, scanning instead.");
+    wifiFastConnecting = false;
+    invalidateWifiFastConnect();
+    configureBssid(false);
+    enableDhcp();
+}
+
+// Seconds until DHCP renews the lease it just got. esp_netif_dhcpc_option()
+// doesn't support reading it in ESP-IDF 4.2, so it's taken from lwIP.
+static bool getDhcpRenewalTime(uint32_t* timeInS) {
+    struct netif* netif = esp_netif_get_netif_impl(wifiStaNetif);
+    const struct dhcp* dhcp = netif ? netif_dhcp_data(netif) : NULL;
+
+    if (!dhcp || dhcp->offered_t1_renew == 0) {
+        return false;
+    }
+
+    *timeInS = dhcp->offered_t1_renew;
+    return true;
+}
+
+static void storeFastConnectCache(const esp_netif_ip_info_t* ipInfo) {
+    wifi_ap_record_t apInfo;
+    wifi_config_t wifiConfig;
+    uint32_t renewalTimeInS;
+
+    if (!getDhcpRenewalTime(&renewalTimeInS) ||
+        esp_wifi_sta_get_ap_info(&apInfo) != ESP_OK ||
+        esp_wifi_get_config(ESP_IF_WIFI_STA, &wifiConfig) != ESP_OK ||
+        esp_netif_get_dns_info(
+            wifiStaNetif, ESP_NETIF_DNS_MAIN,
+            &wifiFastConnectCache.dnsInfo) != ESP_OK) {
+        wifiFastConnectCache.valid = false;
+        return;
+    }
+
+    memcpy(
+        wifiFastConnectCache.ssid, wifiConfig.sta.ssid,
+        sizeof(wifiFastConnectCache.ssid));
+    memcpy(
+        wifiFastConnectCache.bssid, apInfo.bssid,
+        sizeof(wifiFastConnectCache.bssid));
+    wifiFastConnectCache.channel = apInfo.primary;
+    wifiFastConnectCache.ipInfo = *ipInfo;
+    wifiFastConnectCache.renewalTime =
+        getClockTimeInUs() + renewalTimeInS * 1000000ULL;
+    wifiFastConnectCache.valid = true;
+}
 
 void wifiEventHandler(
     void* event_handler_arg,
@@ -30,13 +172,28 @@ void wifiEventHandler(
     if (event_base == WIFI_EVENT) {
         if (event_id == WIFI_EVENT_STA_START) {
             wifiConnectAttempts = 1;
+            if (wifiFastConnecting) {
+                ++wifiFastConnectStats.attempts;
+                enableStaticIp();
+            } else {
+                enableDhcp();
+            }
             LOGD(LOG_TAG, "Attempting to connect to WiFi (%d/%d).", wifiConnectAttempts, WIFI_MAX_TRIES);
+            traceBegin(TRACE_EVENT_WIFI_ASSOCIATION);
             ESP_ERROR_CHECK(esp_wifi_connect());
         } else if (event_id == WIFI_EVENT_STA_STOP) {
             // Do nothing
+        } else if (event_id == WIFI_EVENT_STA_CONNECTED) {
+            traceEnd(TRACE_EVENT_WIFI_ASSOCIATION);
+            traceBegin(TRACE_EVENT_WIFI_GOT_IP);
         } else if (event_id == WIFI_EVENT_STA_DISCONNECTED) {
+            xEventGroupClearBits(wifiEventGroup, WIFI_CONNECTED_BIT);
             // TODO: Throttle
-            if (wifiConnectAttempts < WIFI_MAX_TRIES) {
+            if (wifiFastConnecting) {
+                // Doesn't count as an attempt
+                fallBackFromFastConnect();
+                ESP_ERROR_CHECK(esp_wifi_connect());
+            } else if (wifiConnectAttempts < WIFI_MAX_TRIES) {
                 ++wifiConnectAttempts;
                 LOGD(LOG_TAG, "Attempting to reconnect to WiFi (%d/%d).", wifiConnectAttempts, WIFI_MAX_TRIES);
                 ESP_ERROR_CHECK(esp_wifi_connect());
@@ -47,6 +204,13 @@ void wifiEventHandler(
         }
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         wifiConnectAttempts = 0;
+        traceEnd(TRACE_EVENT_WIFI_GOT_IP);
+        // Fast connections count as successful once a request got through,
+        // see confirmWifiFastConnect()
+        if (!wifiFastConnecting) {
+            const ip_event_got_ip_t* event = (ip_event_got_ip_t*)event_data;
+            storeFastConnectCache(&event->ip_info);
+        }
         LOGD(LOG_TAG, "Connected to WiFi.");
         xEventGroupSetBits(wifiEventGroup, WIFI_CONNECTED_BIT);
     }
@@ -62,8 +226,11 @@ void setWifiConfig(void) {
     wifiConfig.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
     wifiConfig.sta.pmf_cfg.capable = true;
     wifiConfig.sta.pmf_cfg.required = true;
+    wifiConfig.sta.bssid_set = false;
+    wifiConfig.sta.channel = 0;
 
     ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifiConfig));
+    wifiBssidConfigured = false;
 }
 
 void initWifi(void) {
@@ -72,7 +239,7 @@ void initWifi(void) {
     }
 
     ESP_ERROR_CHECK(esp_netif_init());
-    esp_netif_create_default_wifi_sta();
+    wifiStaNetif = esp_netif_create_default_wifi_sta();
 
     wifi_init_config_t wifiInitConfig = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&wifiInitConfig));
@@ -100,12 +267,39 @@ void startWifi(void) {
             &gotIpEventInstance));
     }
 
+    traceBegin(TRACE_EVENT_WIFI_START);
+    xEventGroupClearBits(wifiEventGroup, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT);
+    wifiFastConnecting = isFastConnectCacheUsable();
+    wifiFastConnectConfirmed = false;
+    configureBssid(wifiFastConnecting);
     adc_power_acquire();
+    energyBegin(ENERGY_CONSUMER_WIFI);
     ESP_ERROR_CHECK(esp_wifi_start());
     ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE));
+    traceEnd(TRACE_EVENT_WIFI_START);
+}
+
+void invalidateWifiFastConnect(void) { wifiFastConnectCache.valid = false; }
+
+void confirmWifiFastConnect(void) {
+    if (wifiFastConnecting && !wifiFastConnectConfirmed) {
+        wifiFastConnectConfirmed = true;
+        ++wifiFastConnectStats.successes;
+    }
 }
 
+void getWifiFastConnectStats(WifiFastConnectStats* stats) {
+    *stats = wifiFastConnectStats;
+}
+
+void setWifiStopHandler(void (*handler)(void)) { wifiStopHandler = handler; }
+
 void stopWifi(void) {
+    // Lets connections be closed while the network is still up
+    if (wifiStopHandler) {
+        wifiStopHandler();
+    }
+
     if (gotIpEventInstance) {
         ESP_ERROR_CHECK(esp_event_handler_instance_unregister(
             IP_EVENT, IP_EVENT_STA_GOT_IP, gotIpEventInstance));
@@ -125,30 +319,58 @@ void stopWifi(void) {
     }
 
     ESP_ERROR_CHECK(esp_wifi_stop());
+    energyEnd(ENERGY_CONSUMER_WIFI);
+
+    // Releases tasks still waiting for a connection
+    xEventGroupClearBits(wifiEventGroup, WIFI_CONNECTED_BIT);
+    xEventGroupSetBits(wifiEventGroup, WIFI_FAIL_BIT);
 
     adc_power_release();
 }
 
-WifiWaitResult waitForWifiConnection(void) {
-    ++wifiConnectRefCount;
-    if (wifiConnectRefCount > 1) {
-        LOGD(LOG_TAG, "Waiting for others to finish waiting for a WiFi connection.");
-        while (wifiConnectRefCount > 1) {
-            delayMs(1);
-        }
-        return wifiLastConnectResult;
-    }
-    int64_t t1 = esp_timer_get_time();
-    EventBits_t bits = xEventGroupWaitBits(
-        wifiEventGroup, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT, pdTRUE, pdFALSE,
-        portMAX_DELAY);
-    bool result = (bits & WIFI_CONNECTED_BIT) ? WIFI_WAIT_RESULT_OK
-                                              : WIFI_WAIT_RESULT_FAIL;
-    if (result == WIFI_WAIT_RESULT_OK) {
-        int64_t t2 = (esp_timer_get_time() - t1) / 1000;
-        LOGD(LOG_TAG, "WiFi connected after %lld ms", t2);
-    }
-    wifiLastConnectResult = result;
-    --wifiConnectRefCount;
-    return result;
+esp_err_t getWifiNetwork(WifiNetwork* network) {
+    wifi_ap_record_t apInfo;
+    esp_netif_ip_info_t ipInfo;
+
+    if (!(xEventGroupGetBits(wifiEventGroup) & WIFI_CONNECTED_BIT)) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t error = esp_wifi_sta_get_ap_info(&apInfo);
+
+    if (error == ESP_OK) {
+        error = esp_netif_get_ip_info(wifiStaNetif, &ipInfo);
+    }
+
+    if (error != ESP_OK) {
+        return error;
+    }
+
+    memcpy(network->bssid, apInfo.bssid, sizeof(network->bssid));
+    network->address = ipInfo.ip.addr;
+    network->netmask = ipInfo.netmask.addr;
+    return ESP_OK;
+}
+
+WifiWaitResult waitForWifiConnection(uint32_t timeoutInMs) {
+    const int64_t startTime = esp_timer_get_time();
+    // Bits are left set for the other waiters
+    const EventBits_t bits = xEventGroupWaitBits(
+        wifiEventGroup, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT, pdFALSE, pdFALSE,
+        timeoutInMs == WIFI_WAIT_FOREVER ? portMAX_DELAY
+                                         : pdMS_TO_TICKS(timeoutInMs));
+
+    if (bits & WIFI_CONNECTED_BIT) {
+        LOGD(
+            LOG_TAG, "WiFi connected after waiting for %lld ms",
+            (esp_timer_get_time() - startTime) / 1000);
+        return WIFI_WAIT_RESULT_OK;
+    }
+
+    if (bits & WIFI_FAIL_BIT) {
+        return WIFI_WAIT_RESULT_FAIL;
+    }
+
+    LOGW(LOG_TAG, "Timed out waiting for a WiFi connection.");
+    return WIFI_WAIT_RESULT_TIMEOUT;
 }
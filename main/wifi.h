@@ -1,9 +1,43 @@
 #pragma once
 
-typedef enum { WIFI_WAIT_RESULT_OK, WIFI_WAIT_RESULT_FAIL } WifiWaitResult;
+#include <esp_err.h>
+#include <stdint.h>
+
+typedef struct {
+    uint32_t attempts;
+    uint32_t successes;
+} WifiFastConnectStats;
+
+// Identifies the network the station is connected to
+typedef struct {
+    uint8_t bssid[6];
+    // IPv4 addresses in network byte order
+    uint32_t address;
+    uint32_t netmask;
+} WifiNetwork;
+
+#define WIFI_WAIT_FOREVER UINT32_MAX
+
+typedef enum {
+    WIFI_WAIT_RESULT_OK,
+    WIFI_WAIT_RESULT_FAIL,
+    WIFI_WAIT_RESULT_TIMEOUT
+} WifiWaitResult;
 
 void initWifi(void);
 void deinitWifi(void);
 void startWifi(void);
 void stopWifi(void);
-WifiWaitResult waitForWifiConnection(void);
+void setWifiStopHandler(void (*handler)(void));
+// Forces the next connection to scan and use DHCP, e.g. when the network
+// seems unreachable with the cached IP configuration
+void invalidateWifiFastConnect(void);
+// Counts the fast connection as a success, once a request got through with
+// the cached IP configuration
+void confirmWifiFastConnect(void);
+void getWifiFastConnectStats(WifiFastConnectStats* stats);
+// Blocks until the connection attempt started by startWifi() succeeds or
+// fails. Safe to call from several tasks at once, each with its own timeout.
+WifiWaitResult waitForWifiConnection(uint32_t timeoutInMs);
+// Fails unless connected
+esp_err_t getWifiNetwork(WifiNetwork* network);
@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""Compresses a firmware image for full updates decompressed on the fly by
+main/lzss.c.
+
+The image is split into blocks that are compressed independently, so that
+an interrupted download resumes at the start of a block. Blocks use the
+LZSS stream format of heatshrink: a 1 bit tag, then either an 8 bit literal
+or a back-reference of (distance - 1) in window bits and (length - 1) in
+lookahead bits, most significant bit first, with the last byte padded with
+zeros. Blocks made with "heatshrink -e -w <window> -l <lookahead>" work too.
+
+Format, little-endian:
+
+  header  "DOTZ", version (u8), window bits (u8), lookahead bits (u8),
+          1 reserved byte, block size (u32), image size (u32)
+  offsets block count + 1 offsets (u32) from the start of the file, the
+          last one being the end of the last block
+  blocks
+
+Usage: mkcompressed.py image.bin compressed.bin
+       mkcompressed.py --check image.bin compressed.bin
+"""
+
+import struct
+import sys
+
+MAGIC = b"DOTZ"
+FORMAT_VERSION = 1
+HEADER_SIZE = 16
+# The device fetches the header and offsets with one small request
+MAX_HEADER_SIZE = 512
+
+# Limited by the memory of the decoder, see LZSS_MAX_WINDOW_BITS
+WINDOW_BITS = 10
+LOOKAHEAD_BITS = 5
+# A multiple of the flash sector size
+BLOCK_SIZE = 64 * 1024
+# Shorter matches take more bits as a back-reference than as literals
+MIN_MATCH_LENGTH = 3
+MAX_CHAIN_LENGTH = 64
+
+
+class BitWriter:
+    def __init__(self):
+        self.output = bytearray()
+        self.bits = 0
+        self.count = 0
+
+    def write(self, value, count):
+        self.bits = self.bits << count | value
+        self.count += count
+        while self.count >= 8:
+            self.count -= 8
+            self.output.append(self.bits >> self.count & 0xFF)
+        self.bits &= (1 << self.count) - 1
+
+    def finish(self):
+        if self.count:
+            self.output.append(self.bits << (8 - self.count) & 0xFF)
+        return bytes(self.output)
+
+
+def compress(data, window_bits=WINDOW_BITS, lookahead_bits=LOOKAHEAD_BITS):
+    window_size = 1 << window_bits
+    max_length = 1 << lookahead_bits
+    writer = BitWriter()
+    # Most recent positions of every 3 byte prefix
+    chains = {}
+    position = 0
+
+    def index(start, end):
+        for i in range(start, min(end, len(data) - MIN_MATCH_LENGTH + 1)):
+            chains.setdefault(data[i:i + MIN_MATCH_LENGTH], []).append(i)
+
+    while position < len(data):
+        best_length = 0
+        best_distance = 0
+        candidates = chains.get(data[position:position + MIN_MATCH_LENGTH], [])
+        limit = min(max_length, len(data) - position)
+
+        for candidate in reversed(candidates[-MAX_CHAIN_LENGTH:]):
+            distance = position - candidate
+            if distance > window_size:
+                break
+            length = 0
+            while (length < limit and
+                   data[candidate + length] == data[position + length]):
+                length += 1
+            if length > best_length:
+                best_length = length
+                best_distance = distance
+                if length == limit:
+                    break
+
+        if best_length >= MIN_MATCH_LENGTH:
+            writer.write(0, 1)
+            writer.write(best_distance - 1, window_bits)
+            writer.write(best_length - 1, lookahead_bits)
+        else:
+            best_length = 1
+            writer.write(1, 1)
+            writer.write(data[position], 8)
+
+        index(position, position + best_length)
+        position += best_length
+
+    return writer.finish()
+
+
+def decompress(data, size, window_bits, lookahead_bits):
+    """Reference implementation of main/lzss.c, stops after size bytes."""
+    output = bytearray()
+    bits = 0
+    count = 0
+    position = 0
+
+    def take(width):
+        nonlocal bits, count, position
+        while count < width:
+            if position == len(data):
+                return None
+            bits = bits << 8 | data[position]
+            count += 8
+            position += 1
+        count -= width
+        return bits >> count & ((1 << width) - 1)
+
+    while len(output) < size:
+        tag = take(1)
+        if tag is None:
+            break
+        if tag:
+            literal = take(8)
+            if literal is None:
+                break
+            output.append(literal)
+            continue
+        distance = take(window_bits)
+        length = take(lookahead_bits)
+        if length is None:
+            break
+        for _ in range(length + 1):
+            # References before the start of the block read zeros
+            source = len(output) - distance - 1
+            output.append(output[source] if source >= 0 else 0)
+
+    return bytes(output[:size])
+
+
+def encode(image):
+    blocks = [compress(image[offset:offset + BLOCK_SIZE])
+              for offset in range(0, len(image), BLOCK_SIZE)]
+    header_size = HEADER_SIZE + 4 * (len(blocks) + 1)
+    if header_size > MAX_HEADER_SIZE:
+        raise ValueError("Image has too many blocks")
+
+    output = bytearray(MAGIC + struct.pack(
+        "<BBBxII", FORMAT_VERSION, WINDOW_BITS, LOOKAHEAD_BITS, BLOCK_SIZE,
+        len(image)))
+    offset = header_size
+    for block in [b""] + blocks:
+        offset += len(block)
+        output += struct.pack("<I", offset)
+    for block in blocks:
+        output += block
+    return bytes(output)
+
+
+def decode(compressed):
+    if compressed[:4] != MAGIC or compressed[4] != FORMAT_VERSION:
+        raise ValueError("Unsupported format")
+    window_bits, lookahead_bits, block_size, image_size = struct.unpack_from(
+        "<BBxII", compressed, 5)
+    block_count = (image_size + block_size - 1) // block_size
+    offsets = struct.unpack_from("<%dI" % (block_count + 1), compressed,
+                                 HEADER_SIZE)
+    image = bytearray()
+    for i in range(block_count):
+        size = min(block_size, image_size - len(image))
+        block = decompress(compressed[offsets[i]:offsets[i + 1]], size,
+                           window_bits, lookahead_bits)
+        if len(block) != size:
+            raise ValueError("Block %d is truncated" % i)
+        image += block
+    return bytes(image)
+
+
+def main():
+    args = sys.argv[1:]
+    check = args[:1] == ["--check"]
+    if check:
+        args = args[1:]
+    if len(args) != 2:
+        sys.exit(__doc__)
+
+    image = open(args[0], "rb").read()
+
+    if check:
+        if decode(open(args[1], "rb").read()) != image:
+            sys.exit("Compressed file doesn't reproduce the image")
+        return
+
+    compressed = encode(image)
+    if decode(compressed) != image:
+        sys.exit("Internal error: compressed file doesn't reproduce the image")
+    open(args[1], "wb").write(compressed)
+    print("%d bytes, %.1f%% of the image" %
+          (len(compressed), 100.0 * len(compressed) / len(image)),
+          file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
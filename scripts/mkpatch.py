@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""Creates a patch that turns one firmware image into another, for delta
+updates applied by main/patch.c.
+
+Format, little-endian:
+
+  header   "DOTA", version (u8), 3 reserved bytes, source size (u32),
+           target size (u32), source hash (32), target hash (32)
+  commands 0x01 offset (u32) length (u32): copy bytes of the source
+           0x02 length (u32) data: insert bytes
+           0x00: end
+
+The source hash is the SHA-256 that ESP-IDF appends to app images, which
+is what the device reads with esp_partition_get_sha256(). The target hash
+covers the whole target image.
+
+Usage: mkpatch.py source.bin target.bin patch.bin
+       mkpatch.py --check source.bin target.bin patch.bin
+"""
+
+import hashlib
+import struct
+import sys
+
+MAGIC = b"DOTA"
+FORMAT_VERSION = 1
+COMMAND_END = 0
+COMMAND_COPY = 1
+COMMAND_INSERT = 2
+
+BLOCK_SIZE = 16
+# Source blocks are indexed at this stride; every target offset is looked up
+INDEX_STRIDE = 4
+# Shorter matches cost more as a copy command than as inserted data
+MIN_COPY_LENGTH = 24
+
+
+def header(source, target):
+    return (MAGIC + struct.pack("<B3xII", FORMAT_VERSION, len(source),
+                                len(target)) +
+            source[-32:] + hashlib.sha256(target).digest())
+
+
+def diff(source, target):
+    """Yields ("copy", offset, length) and ("insert", data) commands."""
+    index = {}
+    for offset in range(0, len(source) - BLOCK_SIZE + 1, INDEX_STRIDE):
+        index.setdefault(source[offset:offset + BLOCK_SIZE], offset)
+
+    literal_start = 0
+    position = 0
+
+    while position + BLOCK_SIZE <= len(target):
+        offset = index.get(target[position:position + BLOCK_SIZE])
+        if offset is None:
+            position += 1
+            continue
+
+        # Extend backwards into pending literals and forwards
+        start = position
+        while (start > literal_start and offset > 0 and
+               source[offset - 1] == target[start - 1]):
+            start -= 1
+            offset -= 1
+        end = position + BLOCK_SIZE
+        source_end = offset + (end - start)
+        while (end < len(target) and source_end < len(source) and
+               source[source_end] == target[end]):
+            end += 1
+            source_end += 1
+
+        if end - start < MIN_COPY_LENGTH:
+            position += 1
+            continue
+
+        if start > literal_start:
+            yield ("insert", target[literal_start:start])
+        yield ("copy", offset, end - start)
+        literal_start = end
+        position = end
+
+    if literal_start < len(target):
+        yield ("insert", target[literal_start:])
+
+
+def encode(source, target):
+    output = bytearray(header(source, target))
+    for command in diff(source, target):
+        if command[0] == "copy":
+            output += struct.pack("<BII", COMMAND_COPY, command[1], command[2])
+        else:
+            output += struct.pack("<BI", COMMAND_INSERT, len(command[1]))
+            output += command[1]
+    output.append(COMMAND_END)
+    return bytes(output)
+
+
+def apply(source, patch):
+    """Reference implementation of main/patch.c."""
+    if patch[:4] != MAGIC or patch[4] != FORMAT_VERSION:
+        raise ValueError("Unsupported patch format")
+    source_size, target_size = struct.unpack_from("<II", patch, 8)
+    if source[-32:] != patch[16:48] or len(source) != source_size:
+        raise ValueError("Patch is for a different source image")
+    target_hash = patch[48:80]
+    target = bytearray()
+    position = 80
+
+    while True:
+        command = patch[position]
+        position += 1
+        if command == COMMAND_END:
+            break
+        if command == COMMAND_COPY:
+            offset, length = struct.unpack_from("<II", patch, position)
+            position += 8
+            target += source[offset:offset + length]
+        elif command == COMMAND_INSERT:
+            (length,) = struct.unpack_from("<I", patch, position)
+            position += 4
+            target += patch[position:position + length]
+            position += length
+        else:
+            raise ValueError("Unknown command %d" % command)
+
+    if (len(target) != target_size or
+            hashlib.sha256(target).digest() != target_hash):
+        raise ValueError("Patched image doesn't match the target")
+    return bytes(target)
+
+
+def main():
+    args = sys.argv[1:]
+    check = args[:1] == ["--check"]
+    if check:
+        args = args[1:]
+    if len(args) != 3:
+        sys.exit(__doc__)
+
+    source = open(args[0], "rb").read()
+    target = open(args[1], "rb").read()
+
+    if check:
+        patch = open(args[2], "rb").read()
+        if apply(source, patch) != target:
+            sys.exit("Patch doesn't reproduce the target")
+        return
+
+    patch = encode(source, target)
+    if apply(source, patch) != target:
+        sys.exit("Internal error: patch doesn't reproduce the target")
+    open(args[2], "wb").write(patch)
+    print("%d bytes, %.1f%% of the target" %
+          (len(patch), 100.0 * len(patch) / len(target)), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+"""Converts the server certificate from PEM to DER at build time, so that
+the device parses it without decoding base64.
+
+Exactly one certificate is expected, as mbedtls_x509_crt_parse_der only
+reads the first certificate of its input.
+
+Usage: pem2der.py server.cert.pem server.cert.der
+"""
+
+import base64
+import sys
+
+BEGIN = "-----BEGIN CERTIFICATE-----"
+END = "-----END CERTIFICATE-----"
+
+
+def convert(pem):
+    certificates = []
+    lines = None
+
+    for line in pem.splitlines():
+        line = line.strip()
+        if line == BEGIN:
+            lines = []
+        elif line == END and lines is not None:
+            certificates.append(base64.b64decode("".join(lines)))
+            lines = None
+        elif lines is not None:
+            lines.append(line)
+
+    if len(certificates) != 1:
+        raise ValueError(
+            "Expected one certificate, found %d" % len(certificates))
+
+    return certificates[0]
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+
+    with open(sys.argv[1]) as source:
+        der = convert(source.read())
+
+    with open(sys.argv[2], "wb") as output:
+        output.write(der)
+
+
+if __name__ == "__main__":
+    main()
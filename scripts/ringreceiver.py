@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+"""Reference receiver for ring datagrams sent by main/ringdatagram.c, and a
+client that compares their latency with HTTPS requests.
+
+Datagrams are 40 bytes, little-endian:
+
+  "DRNG", version (u8), type (u8, 1 = ring, 2 = acknowledgement),
+  2 reserved bytes, device ID (8, WiFi MAC address zero-padded),
+  log ID (u32), sequence (u32), MAC (16)
+
+The MAC is HMAC-SHA256 with the 32 byte device key over the preceding 24
+bytes, truncated to 16 bytes. An acknowledgement repeats the ring with the
+type changed and its own MAC. Retransmitted rings are acknowledged again
+but reported once; (log ID, sequence) identify a ring as in HTTPS uploads.
+
+Keys are read from a file with one "<device ID hex> <key hex>" per line.
+With --drop, the first N copies of every ring are ignored as if lost, which
+shows the cost of retransmissions.
+
+Usage: ringreceiver.py serve [--port 4040] [--drop N] keys.txt
+       ringreceiver.py measure [--count 20] [--https-url URL]
+                       host port deviceid keyhex
+"""
+
+import argparse
+import hashlib
+import hmac
+import os
+import socket
+import ssl
+import struct
+import sys
+import time
+import urllib.request
+
+MAGIC = b"DRNG"
+FORMAT_VERSION = 1
+TYPE_RING = 1
+TYPE_ACK = 2
+DATAGRAM_FORMAT = "<4sBBH8sII"
+DATAGRAM_SIZE = 40
+MAC_SIZE = 16
+
+
+def sign(key, message_type, device_id, log_id, sequence):
+    body = struct.pack(DATAGRAM_FORMAT, MAGIC, FORMAT_VERSION, message_type,
+                       0, device_id, log_id, sequence)
+    return body + hmac.new(key, body, hashlib.sha256).digest()[:MAC_SIZE]
+
+
+def parse(datagram, keys):
+    """Returns (type, device ID, log ID, sequence) of an authentic datagram,
+    otherwise None."""
+    if len(datagram) != DATAGRAM_SIZE:
+        return None
+    magic, version, message_type, _, device_id, log_id, sequence = (
+        struct.unpack_from(DATAGRAM_FORMAT, datagram))
+    key = keys.get(device_id)
+    if magic != MAGIC or version != FORMAT_VERSION or key is None:
+        return None
+    expected = sign(key, message_type, device_id, log_id, sequence)
+    if not hmac.compare_digest(expected, datagram):
+        return None
+    return message_type, device_id, log_id, sequence
+
+
+def read_keys(path):
+    keys = {}
+    for line in open(path):
+        fields = line.split()
+        if len(fields) == 2 and not line.startswith("#"):
+            device_id = bytes.fromhex(fields[0].replace(":", ""))
+            keys[device_id.ljust(8, b"\0")] = bytes.fromhex(fields[1])
+    return keys
+
+
+def serve(args):
+    keys = read_keys(args.keys)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("", args.port))
+    seen = set()
+    copies = {}
+    print("Listening on UDP port %d" % args.port, file=sys.stderr,
+          flush=True)
+
+    while True:
+        datagram, address = sock.recvfrom(64)
+        parsed = parse(datagram, keys)
+        if not parsed or parsed[0] != TYPE_RING:
+            continue
+        _, device_id, log_id, sequence = parsed
+        ring = (device_id, log_id, sequence)
+        copies[ring] = copies.get(ring, 0) + 1
+        if copies[ring] <= args.drop:
+            continue
+        # Recorded before the acknowledgement, after which the device
+        # forgets the ring
+        if ring not in seen:
+            seen.add(ring)
+            print("%s ring %08x-%u from %s" %
+                  (device_id[:6].hex(":"), log_id, sequence, address[0]),
+                  flush=True)
+        sock.sendto(sign(keys[device_id], TYPE_ACK, device_id, log_id,
+                         sequence), address)
+
+
+def measure_datagram(host, port, key, device_id, sequence):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(1)
+    start = time.monotonic()
+    # Includes name resolution, like on the device
+    sock.connect((host, port))
+    sock.send(sign(key, TYPE_RING, device_id, 0, sequence))
+    while True:
+        parsed = parse(sock.recv(64), {device_id: key})
+        if parsed and parsed[0] == TYPE_ACK and parsed[3] == sequence:
+            return time.monotonic() - start
+
+
+def measure_https(url):
+    # Without certificate checks, as the server usually has a private CA
+    context = ssl.create_default_context()
+    context.check_hostname = False
+    context.verify_mode = ssl.CERT_NONE
+    request = urllib.request.Request(
+        url, data=b"ring.count=0\n", method="POST",
+        headers={"Content-Type": "application/flatmap"})
+    start = time.monotonic()
+    urllib.request.urlopen(request, context=context, timeout=10).read()
+    return time.monotonic() - start
+
+
+def summarize(name, times):
+    times = sorted(times)
+    print("%-8s median %6.1f ms  p90 %6.1f ms  max %6.1f ms" %
+          (name, 1000 * times[len(times) // 2],
+           1000 * times[len(times) * 9 // 10], 1000 * times[-1]))
+
+
+def measure(args):
+    device_id = bytes.fromhex(args.deviceid.replace(":", "")).ljust(8, b"\0")
+    key = bytes.fromhex(args.keyhex)
+    first = struct.unpack("<I", os.urandom(4))[0] >> 1
+    summarize("udp", [
+        measure_datagram(args.host, args.port, key, device_id, first + i)
+        for i in range(args.count)])
+    if args.https_url:
+        summarize("https",
+                  [measure_https(args.https_url) for _ in range(args.count)])
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawTextHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+    serve_parser = commands.add_parser("serve")
+    serve_parser.add_argument("--port", type=int, default=4040)
+    serve_parser.add_argument("--drop", type=int, default=0)
+    serve_parser.add_argument("keys")
+    measure_parser = commands.add_parser("measure")
+    measure_parser.add_argument("--count", type=int, default=20)
+    measure_parser.add_argument("--https-url")
+    measure_parser.add_argument("host")
+    measure_parser.add_argument("port", type=int)
+    measure_parser.add_argument("deviceid")
+    measure_parser.add_argument("keyhex")
+    args = parser.parse_args()
+
+    if args.command == "serve":
+        serve(args)
+    else:
+        measure(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+"""Converts wake cycle traces uploaded with heartbeats into the Chrome trace
+event format, viewable in chrome://tracing or Perfetto.
+
+Each input line is either "<device> <base64>" or just "<base64>". Every device
+becomes a process and every wake cycle a thread.
+
+Usage: trace2chrome.py [input] > trace.json
+"""
+
+import base64
+import json
+import sys
+
+# Keep in sync with TraceEvent in main/trace.h
+EVENT_NAMES = [
+    "wake",
+    "wifi.start",
+    "wifi.association",
+    "wifi.got_ip",
+    "dns",
+    "tcp.connect",
+    "tls.handshake",
+    "http.request",
+    "http.response",
+    "buzzer",
+    "sleep",
+]
+EVENT_WAKE = 0
+
+PHASE_BEGIN = 0
+PHASE_END = 1
+PHASE_INSTANT = 2
+PHASES = {PHASE_BEGIN: "B", PHASE_END: "E", PHASE_INSTANT: "i"}
+
+FORMAT_VERSION = 1
+TIME_UNIT_IN_US = 100
+
+# See esp_sleep_source_t
+WAKEUP_CAUSES = {
+    0: "undefined",
+    2: "ext0",
+    3: "ext1",
+    4: "timer",
+    5: "touchpad",
+    6: "ulp",
+    7: "gpio",
+    8: "uart",
+}
+
+
+def read_varint(data, offset):
+    value = 0
+    shift = 0
+    while True:
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, offset
+
+
+def decode(data):
+    """Yields (event, phase, value) tuples."""
+    if not data or data[0] != FORMAT_VERSION:
+        raise ValueError("Unsupported trace format")
+    offset = 1
+    while offset < len(data):
+        header = data[offset]
+        value, offset = read_varint(data, offset + 1)
+        yield header >> 2, header & 3, value
+
+
+def convert(device, data, pid, first_tid, events):
+    """Appends the events of one upload and returns the next free thread ID.
+    Records preceding the first wake record belong to a wake cycle whose
+    beginning was dropped on the device."""
+    tid = first_tid
+    time = 0
+    open_spans = []
+
+    def close_spans():
+        while open_spans:
+            events.append({
+                "name": open_spans.pop(),
+                "ph": "E",
+                "ts": time,
+                "pid": pid,
+                "tid": tid,
+            })
+
+    def name_thread(name):
+        events.append({
+            "name": "thread_name",
+            "ph": "M",
+            "pid": pid,
+            "tid": tid,
+            "args": {"name": name},
+        })
+
+    started = False
+
+    for event, phase, value in decode(data):
+        name = EVENT_NAMES[event] if event < len(EVENT_NAMES) else str(event)
+
+        if event == EVENT_WAKE:
+            if started:
+                close_spans()
+                tid += 1
+            started = True
+            time = 0
+            cause = WAKEUP_CAUSES.get(value, str(value))
+            name_thread("wake %d (%s)" % (tid - first_tid, cause))
+            events.append({
+                "name": name,
+                "ph": "i",
+                "s": "t",
+                "ts": 0,
+                "pid": pid,
+                "tid": tid,
+                "args": {"cause": cause},
+            })
+            continue
+
+        if not started:
+            started = True
+            name_thread("partial wake")
+
+        time += value * TIME_UNIT_IN_US
+        entry = {"name": name, "ph": PHASES[phase], "ts": time, "pid": pid,
+                 "tid": tid}
+
+        if phase == PHASE_BEGIN:
+            open_spans.append(name)
+        elif phase == PHASE_END:
+            if name in open_spans:
+                open_spans.remove(name)
+            else:
+                # The matching begin was dropped
+                continue
+        else:
+            entry["s"] = "t"
+
+        events.append(entry)
+
+    close_spans()
+    return tid + 1
+
+
+def main():
+    source = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+    events = []
+    pids = {}
+    next_tids = {}
+
+    for line in source:
+        fields = line.split()
+        if not fields:
+            continue
+        device = fields[0] if len(fields) > 1 else "device"
+        encoded = fields[-1]
+
+        if device not in pids:
+            pids[device] = len(pids) + 1
+            next_tids[device] = 1
+            events.append({
+                "name": "process_name",
+                "ph": "M",
+                "pid": pids[device],
+                "args": {"name": device},
+            })
+
+        next_tids[device] = convert(
+            device, base64.b64decode(encoded), pids[device],
+            next_tids[device], events)
+
+    json.dump({"traceEvents": events, "displayTimeUnit": "ms"}, sys.stdout,
+              indent=1)
+
+
+if __name__ == "__main__":
+    main()